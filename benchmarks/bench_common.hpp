@@ -0,0 +1,374 @@
+#pragma once
+
+// Общая часть бенчмарков: замер времени, отчёт в JSON и сравнение с базовым
+// отчётом. Отчёт - объект {"benchmark": ..., "results": [{"name", "status",
+// "metrics": {...}}]}; сравниваются метрики записей с одинаковым именем
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace bnf_bench {
+
+using Clock = std::chrono::steady_clock;
+
+inline double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+inline double median(std::vector<double> values) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+inline double minimum(const std::vector<double>& values) {
+    return values.empty() ? 0.0 : *std::min_element(values.begin(), values.end());
+}
+
+// Результат одного замера: метрики в порядке добавления
+struct BenchResult {
+    std::string name;
+    std::string status = "ok";
+    std::string message;  // Причина ошибки для status == "error"
+    std::vector<std::pair<std::string, double>> metrics;
+
+    void add(const std::string& metric, double value) { metrics.emplace_back(metric, value); }
+};
+
+inline std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out;
+}
+
+inline std::string formatNumber(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", value);
+    return buf;
+}
+
+inline std::string toJson(const std::string& benchmark, const std::vector<BenchResult>& results) {
+    std::ostringstream ss;
+    ss << "{\n  \"benchmark\": \"" << jsonEscape(benchmark) << "\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        ss << (i ? ",\n" : "\n") << "    {\"name\": \"" << jsonEscape(r.name)
+           << "\", \"status\": \"" << r.status << "\"";
+        if (!r.message.empty()) ss << ", \"message\": \"" << jsonEscape(r.message) << "\"";
+        ss << ", \"metrics\": {";
+        for (size_t m = 0; m < r.metrics.size(); ++m) {
+            ss << (m ? ", " : "") << "\"" << r.metrics[m].first << "\": "
+               << formatNumber(r.metrics[m].second);
+        }
+        ss << "}}";
+    }
+    ss << "\n  ]\n}\n";
+    return ss.str();
+}
+
+inline void printTable(const std::vector<BenchResult>& results, std::ostream& out) {
+    for (const auto& r : results) {
+        out << r.name;
+        if (r.status != "ok") {
+            out << "  [" << r.status << "] " << r.message << "\n";
+            continue;
+        }
+        for (const auto& [metric, value] : r.metrics) {
+            out << "  " << metric << "=" << formatNumber(value);
+        }
+        out << "\n";
+    }
+}
+
+/**
+ * Минимальный разбор JSON, достаточный для отчётов бенчмарков: из объектов
+ * results берутся name, status и числовые поля metrics
+ */
+class ReportReader {
+private:
+    const std::string& text_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+
+    void skipSpace() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    std::string readString() {
+        std::string out;
+        if (!consume('"')) {
+            ok_ = false;
+            return out;
+        }
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+                char e = text_[++pos_];
+                out += e == 'n' ? '\n' : e == 't' ? '\t' : e == 'r' ? '\r' : e;
+                if (e == 'u') pos_ += 4;  // Управляющие символы в именах не встречаются
+            } else {
+                out += text_[pos_];
+            }
+            ++pos_;
+        }
+        if (pos_ >= text_.size()) ok_ = false;
+        ++pos_;
+        return out;
+    }
+
+    // Значение любого вида; число возвращается в number, строка - в str
+    void readValue(double* number, std::string* str) {
+        skipSpace();
+        if (pos_ >= text_.size()) {
+            ok_ = false;
+            return;
+        }
+        char c = text_[pos_];
+        if (c == '"') {
+            std::string s = readString();
+            if (str) *str = s;
+        } else if (c == '{') {
+            ++pos_;
+            if (consume('}')) return;
+            do {
+                readString();
+                if (!consume(':')) { ok_ = false; return; }
+                readValue(nullptr, nullptr);
+            } while (ok_ && consume(','));
+            if (!consume('}')) ok_ = false;
+        } else if (c == '[') {
+            ++pos_;
+            if (consume(']')) return;
+            do {
+                readValue(nullptr, nullptr);
+            } while (ok_ && consume(','));
+            if (!consume(']')) ok_ = false;
+        } else {
+            size_t start = pos_;
+            while (pos_ < text_.size() && !std::strchr(",}] \t\r\n", text_[pos_])) ++pos_;
+            std::string token = text_.substr(start, pos_ - start);
+            if (token == "true" || token == "false" || token == "null") return;
+            char* end = nullptr;
+            double value = std::strtod(token.c_str(), &end);
+            if (token.empty() || *end != '\0') ok_ = false;
+            if (number) *number = value;
+        }
+    }
+
+    BenchResult readResult() {
+        BenchResult r;
+        if (!consume('{')) { ok_ = false; return r; }
+        if (consume('}')) return r;
+        do {
+            std::string key = readString();
+            if (!consume(':')) { ok_ = false; return r; }
+            if (key == "name") {
+                readValue(nullptr, &r.name);
+            } else if (key == "status") {
+                readValue(nullptr, &r.status);
+            } else if (key == "message") {
+                readValue(nullptr, &r.message);
+            } else if (key == "metrics") {
+                if (!consume('{')) { ok_ = false; return r; }
+                if (consume('}')) continue;
+                do {
+                    std::string metric = readString();
+                    if (!consume(':')) { ok_ = false; return r; }
+                    double value = 0.0;
+                    readValue(&value, nullptr);
+                    r.add(metric, value);
+                } while (ok_ && consume(','));
+                if (!consume('}')) ok_ = false;
+            } else {
+                readValue(nullptr, nullptr);
+            }
+        } while (ok_ && consume(','));
+        if (!consume('}')) ok_ = false;
+        return r;
+    }
+
+public:
+    explicit ReportReader(const std::string& text) : text_(text) {}
+
+    // false, если текст не является отчётом
+    bool read(std::vector<BenchResult>& results) {
+        if (!consume('{')) return false;
+        if (consume('}')) return true;
+        do {
+            std::string key = readString();
+            if (!consume(':')) return false;
+            if (key != "results") {
+                readValue(nullptr, nullptr);
+                continue;
+            }
+            if (!consume('[')) return false;
+            if (consume(']')) continue;
+            do {
+                results.push_back(readResult());
+            } while (ok_ && consume(','));
+            if (!consume(']')) return false;
+        } while (ok_ && consume(','));
+        return ok_ && consume('}');
+    }
+};
+
+// Направление метрики: +1 - чем больше, тем лучше; -1 - чем меньше;
+// 0 - метрика не сравнивается (размеры входа и т.п.)
+inline int metricDirection(const std::string& metric) {
+    if (metric.find("per_s") != std::string::npos) return 1;
+    if (metric.find("_ms") != std::string::npos || metric == "allocations" ||
+        metric == "allocated_bytes" || metric == "peak_rss_kb") {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Сравнить отчёт с базовым. Регрессия - ухудшение метрики больше чем на
+ * threshold_percent процентов или ошибка там, где базовый замер прошёл.
+ * Печатает таблицу изменений в out и возвращает число регрессий
+ */
+inline size_t compareWithBaseline(const std::vector<BenchResult>& results,
+                                  const std::vector<BenchResult>& baseline,
+                                  double threshold_percent, std::ostream& out) {
+    std::map<std::string, const BenchResult*> base;
+    for (const auto& r : baseline) base[r.name] = &r;
+
+    size_t regressions = 0;
+    out << "\nComparison with baseline (threshold " << formatNumber(threshold_percent) << "%):\n";
+    for (const auto& r : results) {
+        auto it = base.find(r.name);
+        if (it == base.end()) {
+            out << "  " << r.name << ": new\n";
+            continue;
+        }
+        const BenchResult& b = *it->second;
+        if (r.status != "ok" || b.status != "ok") {
+            bool regressed = r.status != "ok" && b.status == "ok";
+            if (regressed) ++regressions;
+            out << "  " << r.name << ": " << b.status << " -> " << r.status
+                      << (regressed ? "  REGRESSION" : "") << "\n";
+            continue;
+        }
+        for (const auto& [metric, value] : r.metrics) {
+            int direction = metricDirection(metric);
+            if (direction == 0) continue;
+            auto bm = std::find_if(b.metrics.begin(), b.metrics.end(),
+                                   [&](const auto& m) { return m.first == metric; });
+            if (bm == b.metrics.end()) continue;
+            if (bm->second == 0.0) {
+                // Было ноль (например, выделений в арене): любое ухудшение - регрессия
+                bool regressed = direction < 0 && value > 0.0;
+                if (regressed) ++regressions;
+                out << "  " << r.name << " " << metric << ": 0 -> " << formatNumber(value)
+                          << (regressed ? "  REGRESSION" : "") << "\n";
+                continue;
+            }
+            double change = (value - bm->second) / bm->second * 100.0;
+            bool regressed = direction * change < -threshold_percent;
+            if (regressed) ++regressions;
+            out << "  " << r.name << " " << metric << ": " << formatNumber(bm->second)
+                      << " -> " << formatNumber(value) << " (" << (change >= 0 ? "+" : "")
+                      << formatNumber(std::round(change * 10.0) / 10.0) << "%)"
+                      << (regressed ? "  REGRESSION" : "") << "\n";
+        }
+    }
+    out << (regressions ? std::to_string(regressions) + " regression(s)" : "No regressions") << "\n";
+    return regressions;
+}
+
+inline bool readFile(const std::string& path, std::string& content) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+// Общие параметры командной строки: --json FILE, --baseline FILE, --threshold PCT
+struct ReportOptions {
+    std::string json_path;
+    std::string baseline_path;
+    double threshold_percent = 10.0;
+
+    // true, если аргумент разобран (i сдвигается на значение)
+    bool parse(int argc, char* argv[], int& i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        if (arg == "--json") json_path = argv[++i];
+        else if (arg == "--baseline") baseline_path = argv[++i];
+        else if (arg == "--threshold") threshold_percent = std::atof(argv[++i]);
+        else return false;
+        return true;
+    }
+};
+
+/**
+ * Вывести результаты: JSON в файл или в stdout для "-", таблицу и сравнение
+ * с базовым отчётом - в stdout (в stderr, если туда идёт JSON).
+ * Возвращает код завершения: 1 при регрессии
+ */
+inline int finishReport(const std::string& benchmark, const std::vector<BenchResult>& results,
+                        const ReportOptions& options) {
+    std::ostream& out = options.json_path == "-" ? std::cerr : std::cout;
+    printTable(results, out);
+    std::string json = toJson(benchmark, results);
+    if (options.json_path == "-") {
+        std::cout << json;
+    } else if (!options.json_path.empty()) {
+        std::ofstream out(options.json_path, std::ios::binary);
+        if (!out) {
+            std::cerr << "Error: cannot write " << options.json_path << "\n";
+            return 2;
+        }
+        out << json;
+    }
+    if (options.baseline_path.empty()) return 0;
+
+    std::string text;
+    std::vector<BenchResult> baseline;
+    if (!readFile(options.baseline_path, text) || !ReportReader(text).read(baseline)) {
+        std::cerr << "Error: cannot read baseline report " << options.baseline_path << "\n";
+        return 2;
+    }
+    return compareWithBaseline(results, baseline, options.threshold_percent, out) ? 1 : 0;
+}
+
+} // namespace bnf_bench
@@ -0,0 +1,291 @@
+// Бенчмарк генератора: загрузка грамматики (BNFGrammarFactory::fromFile и
+// двоичной формы - fromBinary), валидация (BNFParser::validateGrammar), компиляция в байт-код
+// интерпретатора (BytecodeProgram) и генерация C++ (CppCodeGenerator) для каждого файла grammars/*.bnf;
+// лексер и парсер BNF на синтетической грамматике из --synthetic-rules правил;
+// функции utf8_utils на многоязычном тексте из --utf8-size МБ
+
+#include "bench_common.hpp"
+#include "bnf_parser.hpp"
+#include "bytecode_vm.hpp"
+#include "code_generator.hpp"
+#include "utf8_utils.hpp"
+#include <filesystem>
+
+using namespace bnf_parser_generator;
+using namespace bnf_bench;
+
+namespace {
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [OPTIONS]\n\n"
+              << "Times grammar loading (text and binary), validation, bytecode compilation and C++ generation\n"
+              << "for every *.bnf file.\n\n"
+              << "OPTIONS:\n"
+              << "  --grammars DIR      Grammar directory (default: grammars)\n"
+              << "  --repeat N          Iterations per phase (default: 20)\n"
+              << "  --synthetic-rules N Rules in the synthetic front-end grammar (default: 100000, 0 to skip)\n"
+              << "  --utf8-size MB      Size of the multilingual UTF-8 text (default: 8, 0 to skip)\n"
+              << "  --json FILE         Write the JSON report to FILE ('-' for stdout)\n"
+              << "  --baseline FILE     Compare with a previous JSON report\n"
+              << "  --threshold PCT     Allowed slowdown before a regression (default: 10)\n";
+}
+
+BenchResult errorResult(const std::string& name, const std::string& message) {
+    BenchResult r;
+    r.name = name;
+    r.status = "error";
+    r.message = message;
+    return r;
+}
+
+BenchResult timedResult(const std::string& name, const std::vector<double>& times) {
+    BenchResult r;
+    r.name = name;
+    r.add("min_ms", minimum(times));
+    r.add("median_ms", median(times));
+    return r;
+}
+
+void benchGrammar(const std::filesystem::path& path, size_t repeat, std::vector<BenchResult>& results) {
+    const std::string base = path.filename().string();
+
+    // Загрузка: фабрика бросает исключение, если грамматика не разбирается
+    std::vector<double> load_times;
+    std::unique_ptr<Grammar> grammar;
+    try {
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = Clock::now();
+            grammar = BNFGrammarFactory::fromFile(path.string());
+            load_times.push_back(elapsedMs(start));
+        }
+    } catch (const std::exception& e) {
+        results.push_back(errorResult(base + "/load", e.what()));
+        return;
+    }
+    if (!grammar) {
+        results.push_back(errorResult(base + "/load", "grammar was not loaded"));
+        return;
+    }
+    results.push_back(timedResult(base + "/load", load_times));
+    results.back().add("rules", static_cast<double>(grammar->rules.size()));
+
+    // Двоичная форма той же грамматики: без лексера, парсера и валидации
+    const std::string binary = BNFGrammarFactory::toBinary(*grammar);
+    std::vector<double> binary_times;
+    for (size_t i = 0; i < repeat; ++i) {
+        auto start = Clock::now();
+        auto loaded = BNFGrammarFactory::fromBinary(binary);
+        binary_times.push_back(elapsedMs(start));
+    }
+    results.push_back(timedResult(base + "/load-binary", binary_times));
+    results.back().add("binary_bytes", static_cast<double>(binary.size()));
+
+    std::vector<double> validate_times;
+    BNFParser::ValidationResult validation;
+    for (size_t i = 0; i < repeat; ++i) {
+        auto start = Clock::now();
+        validation = BNFParser::validateGrammar(*grammar);
+        validate_times.push_back(elapsedMs(start));
+    }
+    results.push_back(timedResult(base + "/validate", validate_times));
+    results.back().add("errors", static_cast<double>(validation.errors.size()));
+
+    // Время от грамматики до готового к разбору интерпретатора
+    std::vector<double> bytecode_times;
+    try {
+        BytecodeProgram program;
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = Clock::now();
+            program = BytecodeProgram::compile(*grammar);
+            bytecode_times.push_back(elapsedMs(start));
+        }
+        results.push_back(timedResult(base + "/compile-bytecode", bytecode_times));
+        results.back().add("instructions", static_cast<double>(program.code.size()));
+    } catch (const std::exception& e) {
+        results.push_back(errorResult(base + "/compile-bytecode", e.what()));
+    }
+
+    auto generator = CodeGeneratorFactory::create("cpp");
+    GeneratorOptions options;
+    options.parser_name = "BenchParser";
+    options.generate_executable = true;
+
+    std::vector<double> generate_times;
+    GeneratedCode code;
+    try {
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = Clock::now();
+            code = generator->generate(*grammar, options);
+            generate_times.push_back(elapsedMs(start));
+        }
+    } catch (const std::exception& e) {
+        results.push_back(errorResult(base + "/generate", e.what()));
+        return;
+    }
+    if (!code.success) {
+        results.push_back(errorResult(base + "/generate", code.error_message));
+        return;
+    }
+    results.push_back(timedResult(base + "/generate", generate_times));
+    results.back().add("code_bytes", static_cast<double>(code.parser_code.size() + code.main_code.size()));
+}
+
+// Грамматика из rules правил с комментариями, экранированными литералами,
+// диапазонами, группами и ссылками вперёд и назад
+std::string syntheticGrammar(size_t rules) {
+    std::string text;
+    for (size_t i = 0; i < rules; ++i) {
+        const std::string name = "rule_" + std::to_string(i);
+        if (i % 100 == 0) text += "# section " + std::to_string(i / 100) + "\n";
+        text += name + " ::= 'kw_" + std::to_string(i) + "' ";
+        if (i + 1 < rules) text += "rule_" + std::to_string(i + 1) + "? ";
+        text += "| (\"\\t\" | 'a'..'z' | <digit>)+ ";
+        if (i > 0) text += "{ ',' rule_" + std::to_string(i / 2) + " } ";
+        text += "| '\\u00e9' [ Item_" + std::to_string(i % 10) + " ];\n";
+    }
+    text += "digit ::= '0'..'9';\n";
+    for (size_t i = 0; i < 10; ++i) {
+        text += "Item_" + std::to_string(i) + " ::= '<' digit* '>';\n";
+    }
+    return text;
+}
+
+void benchFrontEnd(size_t rules, size_t repeat, std::vector<BenchResult>& results) {
+    const std::string base = "synthetic-" + std::to_string(rules);
+    const std::string text = syntheticGrammar(rules);
+
+    std::vector<double> lex_times;
+    size_t tokens = 0;
+    for (size_t i = 0; i < repeat; ++i) {
+        auto start = Clock::now();
+        BNFLexer lexer(text);
+        tokens = 0;
+        while (lexer.next().type != TokenType::EOF_TOKEN) ++tokens;
+        lex_times.push_back(elapsedMs(start));
+    }
+    results.push_back(timedResult(base + "/lex", lex_times));
+    results.back().add("tokens", static_cast<double>(tokens));
+    results.back().add("bytes", static_cast<double>(text.size()));
+
+    std::vector<double> parse_times;
+    for (size_t i = 0; i < repeat; ++i) {
+        auto start = Clock::now();
+        BNFParser parser(text);
+        auto grammar = parser.parseGrammar();
+        parse_times.push_back(elapsedMs(start));
+        if (!grammar) {
+            results.push_back(errorResult(base + "/parse", parser.getError()));
+            return;
+        }
+    }
+    results.push_back(timedResult(base + "/parse", parse_times));
+    results.back().add("mb_per_s", static_cast<double>(text.size()) / 1000.0 / minimum(parse_times));
+
+    // Вместе с валидацией - то, что делает fromString
+    std::vector<double> load_times;
+    try {
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = Clock::now();
+            auto grammar = BNFGrammarFactory::fromString(text);
+            load_times.push_back(elapsedMs(start));
+        }
+    } catch (const std::exception& e) {
+        results.push_back(errorResult(base + "/load", e.what()));
+        return;
+    }
+    results.push_back(timedResult(base + "/load", load_times));
+}
+
+// Декодирование по символу (строкой и кодовой точкой), подсчёт и проверка
+void benchUtf8(size_t megabytes, size_t repeat, std::vector<BenchResult>& results) {
+    const std::string base = "utf8-" + std::to_string(megabytes) + "mb";
+    const std::string sample = "The quick brown fox, \"Съешь же ещё этих мягких булок\", "
+                               "敏捷的棕色狐狸 \xF0\x9F\xA6\x8A, Übermäßig große Füße.\n";
+    std::string text;
+    while (text.size() < megabytes * 1000000) text += sample;
+    const double mb = static_cast<double>(text.size()) / 1000.0;
+
+    auto phase = [&](const std::string& name, auto&& body) {
+        std::vector<double> times;
+        size_t result = 0;
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = Clock::now();
+            result = body();
+            times.push_back(elapsedMs(start));
+        }
+        results.push_back(timedResult(base + "/" + name, times));
+        results.back().add("mb_per_s", mb / minimum(times));
+        results.back().add("result", static_cast<double>(result));
+    };
+    phase("iterate-strings", [&] {
+        size_t sum = 0;
+        for (utf8::Utf8Iterator it(text); !it.atEnd(); it.next()) sum += it.current().size();
+        return sum;
+    });
+    phase("decode", [&] {
+        size_t sum = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            const utf8::DecodedChar ch = utf8::decode(text, pos);
+            sum += ch.codepoint & 1;
+            pos += ch.length;
+        }
+        return sum;
+    });
+    phase("length", [&] { return utf8::length(text); });
+    phase("validate", [&] { return static_cast<size_t>(utf8::isValid(text)); });
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string grammars_dir = "grammars";
+    size_t repeat = 20;
+    size_t synthetic_rules = 100000;
+    size_t utf8_size = 8;
+    ReportOptions report;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "--grammars" && i + 1 < argc) {
+            grammars_dir = argv[++i];
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--synthetic-rules" && i + 1 < argc) {
+            synthetic_rules = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--utf8-size" && i + 1 < argc) {
+            utf8_size = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (!report.parse(argc, argv, i)) {
+            std::cerr << "Error: unknown argument " << arg << "\n";
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(grammars_dir, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".bnf") {
+            files.push_back(entry.path());
+        }
+    }
+    if (ec || files.empty()) {
+        std::cerr << "Error: no *.bnf files in " << grammars_dir << "\n";
+        return 2;
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<BenchResult> results;
+    for (const auto& path : files) {
+        benchGrammar(path, repeat, results);
+    }
+    if (synthetic_rules > 0) {
+        benchFrontEnd(synthetic_rules, repeat, results);
+    }
+    if (utf8_size > 0) {
+        benchUtf8(utf8_size, repeat, results);
+    }
+    return finishReport("generator", results, report);
+}
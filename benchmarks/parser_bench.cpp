@@ -0,0 +1,476 @@
+// Бенчмарк сгенерированных парсеров: для каждой пары грамматика/пример из
+// examples/ генерирует парсер, собирает его с драйвером замера системным
+// компилятором и разбирает увеличенный вход (или случайный корпус грамматики,
+// --corpus). Драйвер считает выделения памяти (замена operator new), время
+// разбора и пиковый RSS (getrusage)
+
+#include "bench_common.hpp"
+#include "bnf_parser.hpp"
+#include "code_generator.hpp"
+#include "corpus_generator.hpp"
+#include "grammar_optimizer.hpp"
+#include <filesystem>
+
+using namespace bnf_parser_generator;
+using namespace bnf_bench;
+
+namespace {
+
+// Вход увеличивается повторением примера: prefix, копии через separator, suffix.
+// Так JSON остаётся одним значением (массивом), а файлы из последовательностей
+// элементов (клаузы, формы, строки) - последовательностями
+struct Workload {
+    const char* name;
+    const char* grammar;
+    const char* input;
+    const char* prefix;
+    const char* separator;
+    const char* suffix;
+};
+
+const Workload kWorkloads[] = {
+    {"json", "json.bnf", "test.json", "[\n", ",\n", "\n]\n"},
+    {"prolog", "prolog.bnf", "test.pl", "", "\n", ""},
+    {"clojure", "clojure.bnf", "test.clj", "", "\n", ""},
+    {"yaml_anchors", "yaml_anchors.bnf", "test_yaml_anchors.yaml", "", "\n", ""},
+    {"indentation", "indentation.bnf", "test_indentation.py", "", "\n", ""},
+};
+
+// Вариант генерации: имя в отчёте и флаги генератора через запятую
+struct Variant {
+    std::string name;
+    std::vector<std::string> flags;
+};
+
+struct BenchConfig {
+    std::string grammars_dir = "grammars";
+    std::string examples_dir = "examples";
+    std::string work_dir = "bench_work";
+    std::string cxx;
+    std::string cxxflags = "-std=c++20 -O2";
+    std::vector<double> sizes_mb;  // Пусто - 4 МБ
+    size_t repeat = 5;
+    // Корпус CorpusGenerator вместо повторения примера; каждый размер
+    // замеряется с каждой глубиной вложенности
+    bool corpus = false;
+    std::vector<size_t> depths;  // Пусто - CorpusOptions::max_depth
+    uint64_t seed = 1;
+    std::vector<std::string> only;
+    std::vector<Variant> variants;
+};
+
+// Драйвер замера; PARSER_TYPE и путь к парсеру подставляются при записи
+const char* kDriverTemplate = R"DRIVER(#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <sys/resource.h>
+#include "@PARSER_FILE@"
+
+static bool g_counting = false;
+static size_t g_allocations = 0;
+static size_t g_allocated_bytes = 0;
+
+void* operator new(std::size_t size) {
+    if (g_counting) {
+        ++g_allocations;
+        g_allocated_bytes += size;
+    }
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) return 2;
+    std::ifstream file(argv[1], std::ios::binary);
+    std::ostringstream content;
+    content << file.rdbuf();
+    const std::string input = content.str();
+    const int repeat = std::atoi(argv[2]);
+
+    // Warm-up parse: grows the parser's buffers to their steady-state size
+    @PARSER_TYPE@ parser{std::string_view(input)};
+    {
+        auto result = parser.parse();
+        if (!result) {
+            std::fprintf(stderr, "%s\n", parser.getError().c_str());
+            return 1;
+        }
+    }
+
+    // Timed parses reuse the parser; the tree is released inside the timing
+    double best_ms = 1e300;
+    for (int i = 0; i < repeat; ++i) {
+        parser.reset(std::string_view(input));
+        g_counting = i == 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            auto result = parser.parse();
+            if (!result) return 1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        g_counting = false;
+        if (ms < best_ms) best_ms = ms;
+    }
+
+    // Incremental parsers: a one-byte edit in the middle of the input, replacing
+    // a byte with itself so that every reparse sees the same text
+    double best_reparse_us = 0.0;
+#if @REPARSE@
+    const size_t middle = input.size() / 2;
+    const std::string byte = input.substr(middle, 1);
+    if (!parser.reparse(middle, 1, byte)) return 1;  // Copies the input and grows the edit gap
+    best_reparse_us = 1e300;
+    for (int i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        for (int edit = 0; edit < 100; ++edit) {
+            if (!parser.reparse(middle, 1, byte)) return 1;
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / 100;
+        if (us < best_reparse_us) best_reparse_us = us;
+    }
+#endif
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::printf("%zu %.6f %zu %zu %ld %.6f\n", input.size(), best_ms, g_allocations, g_allocated_bytes,
+                static_cast<long>(usage.ru_maxrss), best_reparse_us);
+    return 0;
+}
+)DRIVER";
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [OPTIONS]\n\n"
+              << "Builds a parser for each example grammar and measures it on a scaled-up input.\n\n"
+              << "OPTIONS:\n"
+              << "  --grammars DIR      Grammar directory (default: grammars)\n"
+              << "  --examples DIR      Example input directory (default: examples)\n"
+              << "  --work-dir DIR      Directory for generated parsers and inputs (default: bench_work)\n"
+              << "  --size MB[,MB...]   Input sizes; each one is measured (default: 4)\n"
+              << "  --repeat N          Timed parses per parser, best is reported (default: 5)\n"
+              << "  --only NAME         Run only this workload (json, prolog, clojure, yaml_anchors,\n"
+              << "                      indentation); may be repeated\n"
+              << "  --variant NAME=F,G  Generator variant with flags F,G (memoize, arena, lazy-positions,\n"
+              << "                      dfa-lexer, no-dispatch, no-class-scan, no-literal-trie,\n"
+              << "                      recognizer, events, incremental, optimize, templates);\n"
+              << "                      may be repeated (default: one variant 'default' without flags)\n"
+              << "  --corpus            Parse a random corpus of the grammar instead of the example\n"
+              << "  --depth N[,N...]    Corpus nesting depths; each one is measured (default: 24)\n"
+              << "  --seed N            Corpus random seed (default: 1)\n"
+              << "  --cxx CMD           Compiler for the parsers (default: $CXX or c++)\n"
+              << "  --cxxflags FLAGS    Compiler flags (default: -std=c++20 -O2)\n"
+              << "  --json FILE         Write the JSON report to FILE ('-' for stdout)\n"
+              << "  --baseline FILE     Compare with a previous JSON report\n"
+              << "  --threshold PCT     Allowed slowdown before a regression (default: 10)\n";
+}
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Флаг варианта в настройках генератора; false - неизвестный флаг
+bool applyFlag(const std::string& flag, GeneratorOptions& options) {
+    if (flag == "memoize") options.memoize = true;
+    else if (flag == "arena") options.arena_allocation = true;
+    else if (flag == "lazy-positions") options.lazy_positions = true;
+    else if (flag == "dfa-lexer") options.dfa_lexer = true;
+    else if (flag == "no-dispatch") options.first_set_dispatch = false;
+    else if (flag == "no-class-scan") options.char_class_scanners = false;
+    else if (flag == "no-literal-trie") options.literal_tries = false;
+    else if (flag == "recognizer") options.recognizer = true;
+    else if (flag == "events") options.event_callbacks = true;
+    else if (flag == "incremental") options.incremental = true;
+    else return false;
+    return true;
+}
+
+std::string shellQuote(const std::string& text) {
+    std::string out = "'";
+    for (char c : text) {
+        if (c == '\'') out += "'\\''";
+        else out += c;
+    }
+    return out + "'";
+}
+
+bool writeFile(const std::filesystem::path& path, const std::string& content) {
+    std::ofstream out(path, std::ios::binary);
+    out << content;
+    return static_cast<bool>(out);
+}
+
+// Последние строки файла с выводом команды - для сообщения об ошибке
+std::string outputTail(const std::filesystem::path& path) {
+    std::string text;
+    readFile(path.string(), text);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+    size_t start = text.size();
+    for (int lines = 0; lines < 3 && start > 0; ) {
+        if (text[--start] == '\n') ++lines;
+    }
+    if (start > 0) ++start;
+    std::string tail = text.substr(start);
+    std::replace(tail.begin(), tail.end(), '\n', ' ');
+    return tail.empty() ? "no output" : tail;
+}
+
+std::string scaledInput(const std::string& example, const Workload& workload, size_t target_bytes) {
+    std::string input = workload.prefix;
+    input += example;
+    while (input.size() < target_bytes) {
+        input += workload.separator;
+        input += example;
+    }
+    input += workload.suffix;
+    return input;
+}
+
+// Корпус грамматики пишется в файл потоком, не собираясь в памяти
+bool writeCorpus(const std::filesystem::path& path, const Grammar& grammar, const GeneratorOptions& generator,
+                 size_t target_bytes, size_t depth, const BenchConfig& config, CorpusStats& stats,
+                 std::string& error) {
+    CorpusOptions options;
+    options.seed = config.seed;
+    options.target_bytes = target_bytes;
+    options.max_depth = depth;
+    options.whitespace_rule = generator.whitespace_rule;
+    options.token_rules = generator.token_rules;
+    try {
+        std::ofstream out(path, std::ios::binary);
+        stats = CorpusGenerator(grammar, options).generate(out);
+        if (!out) error = "cannot write to " + config.work_dir;
+    } catch (const std::exception& e) {
+        error = std::string("corpus: ") + e.what();
+    }
+    return error.empty();
+}
+
+// Один парсер на вариант, разбирающий входы каждого размера (и глубины для
+// корпуса); размер и глубина входят в имя результата, только если их несколько
+std::vector<BenchResult> runWorkload(const Workload& workload, const Variant& variant, const BenchConfig& config) {
+    namespace fs = std::filesystem;
+    const std::string name = std::string(workload.name) + "/" + variant.name;
+    auto fail = [&name](const std::string& message) {
+        BenchResult r;
+        r.name = name;
+        r.status = "error";
+        r.message = message;
+        return std::vector<BenchResult>{r};
+    };
+
+    GeneratorOptions options;
+    options.parser_name = "BenchParser";
+    bool optimize = false;   // Грамматика по умолчанию генерируется как написана
+    bool templates = false;  // Генератор cpp-templates вместо cpp
+    for (const auto& flag : variant.flags) {
+        if (flag == "optimize") optimize = true;
+        else if (flag == "templates") templates = true;
+        else if (!applyFlag(flag, options)) return fail("unknown generator flag " + flag);
+    }
+
+    std::unique_ptr<Grammar> grammar;
+    try {
+        grammar = BNFGrammarFactory::fromFile((fs::path(config.grammars_dir) / workload.grammar).string());
+    } catch (const std::exception& e) {
+        return fail(std::string("grammar: ") + e.what());
+    }
+    if (!grammar) return fail("grammar was not loaded");
+    if (optimize) GrammarOptimizer::optimize(*grammar, OptimizerOptions::forGenerator(options));
+
+    auto generator = CodeGeneratorFactory::create(templates ? "cpp-templates" : "cpp");
+    GeneratedCode code;
+    try {
+        code = generator->generate(*grammar, options);
+    } catch (const std::exception& e) {
+        return fail(std::string("generate: ") + e.what());
+    }
+    if (!code.success) return fail("generate: " + code.error_message);
+
+    std::string example;
+    if (!config.corpus && !readFile((fs::path(config.examples_dir) / workload.input).string(), example)) {
+        return fail(std::string("cannot read example ") + workload.input);
+    }
+
+    const std::string stem = std::string(workload.name) + "_" + variant.name;
+    const fs::path dir(config.work_dir);
+    const fs::path parser_path = dir / (stem + "_parser.cpp");
+    const fs::path driver_path = dir / (stem + "_driver.cpp");
+    const fs::path binary_path = dir / (stem + "_bench");
+    const fs::path log_path = dir / (stem + ".log");
+
+    std::string driver = kDriverTemplate;
+    auto substitute = [&driver](const std::string& key, const std::string& value) {
+        driver.replace(driver.find(key), key.size(), value);
+    };
+    substitute("@PARSER_FILE@", fs::absolute(parser_path).string());
+    substitute("@PARSER_TYPE@", options.event_callbacks ? "BenchParser<>" : "BenchParser");
+    substitute("@REPARSE@", options.incremental ? "1" : "0");
+
+    if (!writeFile(parser_path, code.parser_code) || !writeFile(driver_path, driver)) {
+        return fail("cannot write to " + config.work_dir);
+    }
+
+    auto compile_start = Clock::now();
+    std::string compile = config.cxx + " " + config.cxxflags + " -o " + shellQuote(binary_path.string()) + " " +
+                          shellQuote(driver_path.string()) + " > " + shellQuote(log_path.string()) + " 2>&1";
+    if (std::system(compile.c_str()) != 0) return fail("compile: " + outputTail(log_path));
+    double compile_ms = elapsedMs(compile_start);
+
+    const std::vector<double> sizes = config.sizes_mb.empty() ? std::vector<double>{4.0} : config.sizes_mb;
+    std::vector<size_t> depths{CorpusOptions{}.max_depth};
+    if (config.corpus && !config.depths.empty()) depths = config.depths;
+
+    std::vector<BenchResult> results;
+    for (double size_mb : sizes) {
+        for (size_t depth : depths) {
+            std::ostringstream suffix;
+            if (sizes.size() > 1) suffix << "@" << size_mb << "MB";
+            if (depths.size() > 1) suffix << "@depth" << depth;
+            results.emplace_back();
+            BenchResult& result = results.back();
+            result.name = name + suffix.str();
+            auto failed = [&result](const std::string& message) {
+                result.status = "error";
+                result.message = message;
+            };
+
+            const size_t target_bytes = static_cast<size_t>(size_mb * 1e6);
+            const fs::path input_path =
+                dir / (std::string(workload.name) + (config.corpus ? "_corpus" : "_input") + suffix.str() +
+                       fs::path(workload.input).extension().string());
+            CorpusStats stats;
+            std::string error;
+            if (config.corpus) {
+                if (!writeCorpus(input_path, *grammar, options, target_bytes, depth, config, stats, error)) {
+                    failed(error);
+                    continue;
+                }
+            } else if (!writeFile(input_path, scaledInput(example, workload, target_bytes))) {
+                failed("cannot write to " + config.work_dir);
+                continue;
+            }
+
+            std::string run = shellQuote(binary_path.string()) + " " + shellQuote(input_path.string()) + " " +
+                              std::to_string(config.repeat) + " > " + shellQuote(log_path.string()) + " 2>&1";
+            if (std::system(run.c_str()) != 0) {
+                failed("parse: " + outputTail(log_path));
+                continue;
+            }
+
+            std::string output;
+            readFile(log_path.string(), output);
+            std::istringstream in(output);
+            size_t input_bytes = 0, allocations = 0, allocated_bytes = 0;
+            double best_ms = 0.0, reparse_us = 0.0;
+            long peak_rss_kb = 0;
+            if (!(in >> input_bytes >> best_ms >> allocations >> allocated_bytes >> peak_rss_kb >> reparse_us)) {
+                failed("unexpected driver output: " + outputTail(log_path));
+                continue;
+            }
+
+            result.add("input_mb", static_cast<double>(input_bytes) / 1e6);
+            result.add("parse_ms", best_ms);
+            result.add("mb_per_s",
+                       best_ms > 0.0 ? static_cast<double>(input_bytes) / 1e6 / (best_ms / 1000.0) : 0.0);
+            result.add("allocations", static_cast<double>(allocations));
+            result.add("allocated_bytes", static_cast<double>(allocated_bytes));
+            result.add("peak_rss_kb", static_cast<double>(peak_rss_kb));
+            if (options.incremental) result.add("reparse_us", reparse_us);
+            if (config.corpus) result.add("nesting_depth", static_cast<double>(stats.max_depth));
+            result.add("compile_s", compile_ms / 1000.0);
+        }
+    }
+    return results;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    ReportOptions report;
+    if (const char* cxx = std::getenv("CXX")) config.cxx = cxx;
+    if (config.cxx.empty()) config.cxx = "c++";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "--grammars" && has_value) {
+            config.grammars_dir = argv[++i];
+        } else if (arg == "--examples" && has_value) {
+            config.examples_dir = argv[++i];
+        } else if (arg == "--work-dir" && has_value) {
+            config.work_dir = argv[++i];
+        } else if (arg == "--size" && has_value) {
+            for (const auto& size : splitList(argv[++i])) {
+                config.sizes_mb.push_back(std::max(0.001, std::atof(size.c_str())));
+            }
+        } else if (arg == "--corpus") {
+            config.corpus = true;
+        } else if (arg == "--depth" && has_value) {
+            for (const auto& depth : splitList(argv[++i])) {
+                config.depths.push_back(static_cast<size_t>(std::max(1, std::atoi(depth.c_str()))));
+            }
+        } else if (arg == "--seed" && has_value) {
+            config.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--repeat" && has_value) {
+            config.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--only" && has_value) {
+            config.only.push_back(argv[++i]);
+        } else if (arg == "--variant" && has_value) {
+            std::string spec = argv[++i];
+            size_t eq = spec.find('=');
+            Variant variant;
+            variant.name = spec.substr(0, eq);
+            if (eq != std::string::npos) variant.flags = splitList(spec.substr(eq + 1));
+            if (variant.name.empty()) {
+                std::cerr << "Error: variant needs a name: " << spec << "\n";
+                return 2;
+            }
+            config.variants.push_back(variant);
+        } else if (arg == "--cxx" && has_value) {
+            config.cxx = argv[++i];
+        } else if (arg == "--cxxflags" && has_value) {
+            config.cxxflags = argv[++i];
+        } else if (!report.parse(argc, argv, i)) {
+            std::cerr << "Error: unknown argument " << arg << "\n";
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (config.variants.empty()) config.variants.push_back({"default", {}});
+
+    std::error_code ec;
+    std::filesystem::create_directories(config.work_dir, ec);
+    if (ec) {
+        std::cerr << "Error: cannot create " << config.work_dir << ": " << ec.message() << "\n";
+        return 2;
+    }
+
+    std::vector<BenchResult> results;
+    for (const auto& workload : kWorkloads) {
+        if (!config.only.empty() &&
+            std::find(config.only.begin(), config.only.end(), workload.name) == config.only.end()) {
+            continue;
+        }
+        for (const auto& variant : config.variants) {
+            for (auto& result : runWorkload(workload, variant, config)) {
+                std::cerr << "  " << result.name << ": " << result.status << "\n";
+                results.push_back(std::move(result));
+            }
+        }
+    }
+    return finishReport("parser", results, report);
+}
@@ -51,6 +51,7 @@ show_help() {
     echo "  lib                 Library only"
     echo "  tests               Tests only"
     echo "  examples            Examples only"
+    echo "  benchmarks          Generator and parser benchmarks"
     echo "  clean               Clean everything"
     echo ""
     echo "EXAMPLES:"
@@ -111,7 +112,7 @@ while [[ $# -gt 0 ]]; do
             LIBRARY_TYPE="static"
             shift
             ;;
-        all|lib|tests|examples|clean)
+        all|lib|tests|examples|benchmarks|clean)
             TARGET="$1"
             shift
             ;;
@@ -192,6 +193,9 @@ build_target() {
         examples)
             GN_TARGET="examples"
             ;;
+        benchmarks)
+            GN_TARGET="benchmarks"
+            ;;
         *)
             print_error "Unknown target: $build_target"
             exit 1
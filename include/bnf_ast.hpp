@@ -5,8 +5,10 @@
 #include <memory>
 #include <unordered_map>
 #include <variant>
+#include <cstddef>
 #include <cstdint>
 #include <cctype>
+#include <algorithm>
 
 namespace bnf_parser_generator {
 
@@ -61,32 +63,68 @@ private:
     }
 };
 
+// Вид узла AST: тег в базовом классе вместо dynamic_cast
+enum class NodeKind : uint8_t {
+    TERMINAL,
+    NON_TERMINAL,
+    CHAR_RANGE,
+    ALTERNATIVE,
+    SEQUENCE,
+    GROUP,
+    OPTIONAL,
+    ZERO_OR_MORE,
+    ONE_OR_MORE,
+    CONTEXT_ACTION,
+    CUT
+};
+
 // Базовый класс для всех узлов AST
 class ASTNode {
 public:
     virtual ~ASTNode() = default;
     virtual std::string toString(int indent = 0) const = 0;
 
-    // RTTI-хелперы для безопасного приведения типов
+    NodeKind kind() const { return kind_; }
+
+    // Приведение по тегу вида: у каждого класса узла есть static Kind
     template<typename T>
     bool is() const {
-        return dynamic_cast<const T*>(this) != nullptr;
+        return kind_ == T::Kind;
     }
 
     template<typename T>
     const T* as() const {
-        return dynamic_cast<const T*>(this);
+        return is<T>() ? static_cast<const T*>(this) : nullptr;
     }
 
     template<typename T>
     T* as() {
-        return dynamic_cast<T*>(this);
+        return is<T>() ? static_cast<T*>(this) : nullptr;
     }
+
+protected:
+    explicit ASTNode(NodeKind kind) : kind_(kind) {}
+
+private:
+    NodeKind kind_;
 };
 
+// Как dynamic_cast, но по тегу вида; nullptr для nullptr и чужого вида
+template<typename T>
+const T* node_cast(const ASTNode* node) {
+    return node ? node->as<T>() : nullptr;
+}
+
+template<typename T>
+T* node_cast(ASTNode* node) {
+    return node ? node->as<T>() : nullptr;
+}
+
 // Контекстное действие: {store(name, value)} или {lookup(name)}
 class ContextAction : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::CONTEXT_ACTION;
+
     enum class ActionType {
         STORE,   // {store(name, value)}
         LOOKUP,  // {lookup(name)}
@@ -97,7 +135,7 @@ public:
     std::vector<std::string> arguments;
     
     ContextAction(ActionType type, const std::vector<std::string>& args)
-        : actionType(type), arguments(args) {}
+        : ASTNode(Kind), actionType(type), arguments(args) {}
     
     std::string toString(int indent = 0) const override {
         (void)indent;
@@ -118,12 +156,28 @@ public:
     }
 };
 
+// Отсечение ^: после него неудача остатка альтернативы, [ ] или { }
+// не возвращает к другим вариантам, а проваливает всю конструкцию
+class Cut : public ASTNode {
+public:
+    static constexpr NodeKind Kind = NodeKind::CUT;
+
+    Cut() : ASTNode(Kind) {}
+
+    std::string toString(int indent = 0) const override {
+        (void)indent;
+        return "^";
+    }
+};
+
 // Терминальный символ (в кавычках)
 class Terminal : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::TERMINAL;
+
     std::string value;
     
-    explicit Terminal(const std::string& val) : value(val) {}
+    explicit Terminal(const std::string& val) : ASTNode(Kind), value(val) {}
     std::string toString(int indent = 0) const override {
         (void)indent;
         return "\"" + value + "\"";
@@ -133,13 +187,15 @@ public:
 // Нетерминальный символ с поддержкой параметров
 class NonTerminal : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::NON_TERMINAL;
+
     std::string name;
     std::vector<std::string> parameterValues;  // Значения параметров при вызове
     
-    explicit NonTerminal(const std::string& n) : name(n) {}
+    explicit NonTerminal(const std::string& n) : ASTNode(Kind), name(n) {}
     
     NonTerminal(const std::string& n, const std::vector<std::string>& params)
-        : name(n), parameterValues(params) {}
+        : ASTNode(Kind), name(n), parameterValues(params) {}
     
     std::string toString(int indent = 0) const override { 
         (void)indent;
@@ -162,18 +218,24 @@ public:
 // Диапазон символов (EBNF): 'a'..'z' или '\u0000'..'\U0010FFFF'
 class CharRange : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::CHAR_RANGE;
+
     uint32_t start;  // Unicode codepoint
     uint32_t end;    // Unicode codepoint
     
-    CharRange(uint32_t s, uint32_t e) : start(s), end(e) {}
+    CharRange(uint32_t s, uint32_t e) : ASTNode(Kind), start(s), end(e) {}
     std::string toString(int indent = 0) const override;
 };
 
 // Альтернативы: A | B | C
 class Alternative : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::ALTERNATIVE;
+
     std::vector<std::unique_ptr<ASTNode>> choices;
     
+    Alternative() : ASTNode(Kind) {}
+    
     void addChoice(std::unique_ptr<ASTNode> choice) {
         choices.push_back(std::move(choice));
     }
@@ -192,8 +254,12 @@ public:
 // Последовательность: A B C
 class Sequence : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::SEQUENCE;
+
     std::vector<std::unique_ptr<ASTNode>> elements;
     
+    Sequence() : ASTNode(Kind) {}
+    
     void addElement(std::unique_ptr<ASTNode> element) {
         elements.push_back(std::move(element));
     }
@@ -212,9 +278,11 @@ public:
 // Группировка: (A | B)
 class Group : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::GROUP;
+
     std::unique_ptr<ASTNode> content;
     
-    explicit Group(std::unique_ptr<ASTNode> c) : content(std::move(c)) {}
+    explicit Group(std::unique_ptr<ASTNode> c) : ASTNode(Kind), content(std::move(c)) {}
     std::string toString(int indent = 0) const override { 
         (void)indent;
         return "(" + content->toString(indent) + ")"; 
@@ -224,9 +292,11 @@ public:
 // EBNF: Опциональность [A] или A?
 class Optional : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::OPTIONAL;
+
     std::unique_ptr<ASTNode> content;
     
-    explicit Optional(std::unique_ptr<ASTNode> c) : content(std::move(c)) {}
+    explicit Optional(std::unique_ptr<ASTNode> c) : ASTNode(Kind), content(std::move(c)) {}
     std::string toString(int indent = 0) const override { 
         (void)indent;
         return "[" + content->toString(indent) + "]"; 
@@ -236,9 +306,11 @@ public:
 // EBNF: Повторение 0 или более раз {A} или A*
 class ZeroOrMore : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::ZERO_OR_MORE;
+
     std::unique_ptr<ASTNode> content;
     
-    explicit ZeroOrMore(std::unique_ptr<ASTNode> c) : content(std::move(c)) {}
+    explicit ZeroOrMore(std::unique_ptr<ASTNode> c) : ASTNode(Kind), content(std::move(c)) {}
     std::string toString(int indent = 0) const override { 
         (void)indent;
         return "{" + content->toString(indent) + "}"; 
@@ -248,15 +320,44 @@ public:
 // EBNF: Повторение 1 или более раз A+
 class OneOrMore : public ASTNode {
 public:
+    static constexpr NodeKind Kind = NodeKind::ONE_OR_MORE;
+
     std::unique_ptr<ASTNode> content;
     
-    explicit OneOrMore(std::unique_ptr<ASTNode> c) : content(std::move(c)) {}
+    explicit OneOrMore(std::unique_ptr<ASTNode> c) : ASTNode(Kind), content(std::move(c)) {}
     std::string toString(int indent = 0) const override { 
         (void)indent;
         return content->toString(indent) + "+"; 
     }
 };
 
+// Вызывает f для каждого непосредственного потомка узла по порядку
+template<typename F>
+void forEachChild(const ASTNode* node, F&& f) {
+    switch (node->kind()) {
+        case NodeKind::ALTERNATIVE:
+            for (const auto& choice : static_cast<const Alternative*>(node)->choices) f(choice.get());
+            break;
+        case NodeKind::SEQUENCE:
+            for (const auto& element : static_cast<const Sequence*>(node)->elements) f(element.get());
+            break;
+        case NodeKind::GROUP:
+            f(static_cast<const Group*>(node)->content.get());
+            break;
+        case NodeKind::OPTIONAL:
+            f(static_cast<const Optional*>(node)->content.get());
+            break;
+        case NodeKind::ZERO_OR_MORE:
+            f(static_cast<const ZeroOrMore*>(node)->content.get());
+            break;
+        case NodeKind::ONE_OR_MORE:
+            f(static_cast<const OneOrMore*>(node)->content.get());
+            break;
+        default:
+            break;
+    }
+}
+
 // Правило продукции с поддержкой параметров: A[N] ::= B[N] C[N]
 class ProductionRule {
 public:
@@ -306,7 +407,17 @@ public:
     void addRule(std::unique_ptr<ProductionRule> rule) {
         rules.push_back(std::move(rule));
     }
-    
+
+    // Удалить правила, для которых pred(rule) истинен; индекс findRule() строится заново
+    template<typename Pred>
+    void removeRulesIf(Pred pred) {
+        rules.erase(std::remove_if(rules.begin(), rules.end(),
+                                   [&](const std::unique_ptr<ProductionRule>& rule) { return pred(*rule); }),
+                    rules.end());
+        rule_index_.clear();
+        indexed_rules_ = 0;
+    }
+
     // Определяет стартовый символ грамматики после добавления всех правил
     void determineStartSymbol() {
         if (!startSymbol.empty() || rules.empty()) {
@@ -338,47 +449,30 @@ public:
         }
     }
     
-private:
-    // Проверяет, содержит ли узл ссылки на non-terminals
+    // Проверяет, содержит ли узел ссылки на non-terminals
     bool hasNonTerminalReferences(const ASTNode* node) const {
-        if (dynamic_cast<const NonTerminal*>(node)) {
+        if (node->kind() == NodeKind::NON_TERMINAL) {
             return true;
         }
-        if (auto* seq = dynamic_cast<const Sequence*>(node)) {
-            for (const auto& elem : seq->elements) {
-                if (hasNonTerminalReferences(elem.get())) return true;
-            }
-        }
-        if (auto* alt = dynamic_cast<const Alternative*>(node)) {
-            for (const auto& choice : alt->choices) {
-                if (hasNonTerminalReferences(choice.get())) return true;
-            }
-        }
-        if (auto* grp = dynamic_cast<const Group*>(node)) {
-            return hasNonTerminalReferences(grp->content.get());
-        }
-        if (auto* opt = dynamic_cast<const Optional*>(node)) {
-            return hasNonTerminalReferences(opt->content.get());
-        }
-        if (auto* zom = dynamic_cast<const ZeroOrMore*>(node)) {
-            return hasNonTerminalReferences(zom->content.get());
-        }
-        if (auto* oom = dynamic_cast<const OneOrMore*>(node)) {
-            return hasNonTerminalReferences(oom->content.get());
-        }
-        return false;
+        bool found = false;
+        forEachChild(node, [&](const ASTNode* child) {
+            found = found || hasNonTerminalReferences(child);
+        });
+        return found;
     }
     
-public:
-    
-    // Найти правило по имени нетерминала
+    // Найти правило по имени нетерминала (первое определение). Индекс по
+    // именам достраивается, когда в rules добавлены правила
     const ProductionRule* findRule(const std::string& nonTerminal) const {
-        for (const auto& rule : rules) {
-            if (rule->leftSide == nonTerminal) {
-                return rule.get();
-            }
+        if (indexed_rules_ > rules.size()) {
+            rule_index_.clear();
+            indexed_rules_ = 0;
         }
-        return nullptr;
+        for (; indexed_rules_ < rules.size(); ++indexed_rules_) {
+            rule_index_.emplace(rules[indexed_rules_]->leftSide, indexed_rules_);
+        }
+        auto it = rule_index_.find(nonTerminal);
+        return it != rule_index_.end() ? rules[it->second].get() : nullptr;
     }
     
     // Найти все правила с параметрами
@@ -414,34 +508,20 @@ public:
 private:
     // Проверяет, содержит ли узел контекстные действия
     bool hasContextActions(const ASTNode* node) const {
-        if (dynamic_cast<const ContextAction*>(node)) {
+        if (node->kind() == NodeKind::CONTEXT_ACTION) {
             return true;
         }
-        if (auto* seq = dynamic_cast<const Sequence*>(node)) {
-            for (const auto& elem : seq->elements) {
-                if (hasContextActions(elem.get())) return true;
-            }
-        }
-        if (auto* alt = dynamic_cast<const Alternative*>(node)) {
-            for (const auto& choice : alt->choices) {
-                if (hasContextActions(choice.get())) return true;
-            }
-        }
-        if (auto* grp = dynamic_cast<const Group*>(node)) {
-            return hasContextActions(grp->content.get());
-        }
-        if (auto* opt = dynamic_cast<const Optional*>(node)) {
-            return hasContextActions(opt->content.get());
-        }
-        if (auto* zom = dynamic_cast<const ZeroOrMore*>(node)) {
-            return hasContextActions(zom->content.get());
-        }
-        if (auto* oom = dynamic_cast<const OneOrMore*>(node)) {
-            return hasContextActions(oom->content.get());
-        }
-        return false;
+        bool found = false;
+        forEachChild(node, [&](const ASTNode* child) {
+            found = found || hasContextActions(child);
+        });
+        return found;
     }
     
+    // Индекс findRule(): имя -> позиция первого определения в rules
+    mutable std::unordered_map<std::string, size_t> rule_index_;
+    mutable size_t indexed_rules_ = 0;
+    
 public:
     
     // Получить все нетерминалы
@@ -472,25 +552,12 @@ public:
 
 private:
     void collectTerminals(const ASTNode* node, std::vector<std::string>& terminals) const {
-        if (const auto* terminal = dynamic_cast<const Terminal*>(node)) {
+        if (const auto* terminal = node->as<Terminal>()) {
             terminals.push_back(terminal->value);
-        } else if (const auto* alt = dynamic_cast<const Alternative*>(node)) {
-            for (const auto& choice : alt->choices) {
-                collectTerminals(choice.get(), terminals);
-            }
-        } else if (const auto* seq = dynamic_cast<const Sequence*>(node)) {
-            for (const auto& element : seq->elements) {
-                collectTerminals(element.get(), terminals);
-            }
-        } else if (const auto* group = dynamic_cast<const Group*>(node)) {
-            collectTerminals(group->content.get(), terminals);
-        } else if (const auto* opt = dynamic_cast<const Optional*>(node)) {
-            collectTerminals(opt->content.get(), terminals);
-        } else if (const auto* zeroMore = dynamic_cast<const ZeroOrMore*>(node)) {
-            collectTerminals(zeroMore->content.get(), terminals);
-        } else if (const auto* oneMore = dynamic_cast<const OneOrMore*>(node)) {
-            collectTerminals(oneMore->content.get(), terminals);
         }
+        forEachChild(node, [&](const ASTNode* child) {
+            collectTerminals(child, terminals);
+        });
     }
 };
 
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "bnf_ast.hpp"
+#include "grammar_analysis.hpp"
 #include <string>
 #include <memory>
+#include <optional>
+#include <string_view>
 #include <vector>
 #include <unordered_set>
 
@@ -26,9 +29,11 @@ enum class TokenType {
     PLUS,           // +
     STAR,           // *
     QUESTION,       // ?
+    CUT,            // ^ (отсечение)
     DOT_DOT,        // ..
     COMMA,          // , (для параметров)
     COLON,          // : (для типов параметров)
+    NUMBER,         // 42 (целое значение параметра)
     ACTION_OPEN,    // { (начало контекстного действия)
     ACTION_CLOSE,   // } (конец контекстного действия)
     SEMICOLON,      // ;
@@ -38,36 +43,53 @@ enum class TokenType {
     UNKNOWN
 };
 
+// Токен - срез исходного текста, который должен жить, пока используются токены
 struct BNFToken {
-    TokenType type;
-    std::string value;
-    size_t line;
-    size_t column;
-    
-    BNFToken(TokenType t, const std::string& v, size_t l, size_t c)
+    TokenType type = TokenType::EOF_TOKEN;
+    // У TERMINAL - текст между кавычками как есть: escape-последовательности
+    // раскрывает BNFLexer::unescape, если has_escapes
+    std::string_view value;
+    size_t line = 0;
+    size_t column = 0;
+    bool has_escapes = false;
+    
+    BNFToken() = default;
+    BNFToken(TokenType t, std::string_view v, size_t l, size_t c)
         : type(t), value(v), line(l), column(c) {}
 };
 
+/**
+ * Лексер для BNF/EBNF грамматик. Не копирует текст и не выделяет память
+ * на токен: next() выдаёт токены по одному, по требованию парсера
+ */
 class BNFLexer {
 private:
-    std::string input_;
+    std::string_view input_;
     size_t pos_;
     size_t line_;
     size_t column_;
     
 public:
-    explicit BNFLexer(const std::string& input);
+    // Текст должен жить дольше лексера и его токенов
+    explicit BNFLexer(std::string_view input);
+    
+    // Следующий токен; в конце текста - EOF_TOKEN
+    BNFToken next();
     
+    // Все токены вместе с завершающим EOF_TOKEN
     std::vector<BNFToken> tokenize();
     
+    // Значение литерала TERMINAL с раскрытыми \n, \t, \uXXXX и т. п.
+    static std::string unescape(std::string_view raw);
+    
 private:
     char peek(size_t offset = 0) const;
     char advance();
     void skipWhitespace();
+    BNFToken symbol(TokenType type, size_t length);
     BNFToken readString();
     BNFToken readIdentifier();
     BNFToken readComment();
-    BNFToken readCharRange();
     bool isAlpha(char c) const;
     bool isAlnum(char c) const;
     bool isDigit(char c) const;
@@ -75,16 +97,28 @@ private:
 
 /**
  * Парсер BNF/EBNF грамматик
- * Реализует рекурсивный спуск согласно классическим правилам
+ * Реализует рекурсивный спуск согласно классическим правилам.
+ * Токены читаются из лексера по мере разбора; просмотр вперёд - не дальше
+ * двух токенов, в окне фиксированного размера
  */
 class BNFParser {
 private:
+    // Источник токенов: лексер или готовый список (tokens_)
+    std::optional<BNFLexer> lexer_;
     std::vector<BNFToken> tokens_;
-    size_t current_;
+    size_t next_token_ = 0;
+    
+    static constexpr size_t kLookahead = 3;
+    BNFToken window_[kLookahead];
+    size_t head_ = 0;      // Текущий токен в window_
+    size_t buffered_ = 0;  // Прочитано токенов начиная с текущего
+    BNFToken previous_;    // Последний токен, снятый advance()
     std::string error_;
     
 public:
-    explicit BNFParser(const std::vector<BNFToken>& tokens);
+    // Разбор текста; текст должен жить, пока идёт parseGrammar()
+    explicit BNFParser(std::string_view source);
+    explicit BNFParser(std::vector<BNFToken> tokens);
     
     // Основной метод парсинга
     std::unique_ptr<Grammar> parseGrammar();
@@ -100,14 +134,14 @@ public:
     };
     
     static ValidationResult validateGrammar(const Grammar& grammar);
+    static ValidationResult validateGrammar(const GrammarIR& ir);
+    
+    // Анализ nullable/FIRST/FOLLOW и проверка, какие правила являются LL(1)
+    static GrammarAnalysis analyzeGrammar(const Grammar& grammar);
 
 private:
     // Вспомогательные методы для валидации
-    static void collectSymbols(const ASTNode* node, 
-                              std::unordered_set<std::string>& nonTerminals,
-                              std::unordered_set<std::string>& terminals);
-    static bool isProductive(const ASTNode* node, 
-                            const std::unordered_set<std::string>& productive);
+    static bool isProductive(const GrammarIR& ir, NodeId node, const std::vector<bool>& productive);
     // Методы парсинга по правилам грамматики BNF
     std::unique_ptr<ProductionRule> parseRule();
     std::unique_ptr<ASTNode> parseExpression();
@@ -119,11 +153,17 @@ private:
     
     // Утилиты
     bool match(TokenType type);
-    bool check(TokenType type) const;
-    BNFToken advance();
-    BNFToken peek() const;
-    bool isAtEnd() const;
+    bool check(TokenType type);
+    const BNFToken& advance();
+    const BNFToken& peek(size_t ahead = 0) {
+        if (buffered_ <= ahead) fill(ahead);
+        return window_[(head_ + ahead) % kLookahead];
+    }
+    void fill(size_t ahead);
+    BNFToken fetch();
+    bool isAtEnd();
     void error(const std::string& message);
+    static std::string tokenText(const BNFToken& token);
     
     // EBNF конструкции
     std::unique_ptr<ASTNode> parseOptional(std::unique_ptr<ASTNode> content);
@@ -140,6 +180,7 @@ private:
     ParameterType parseParameterType();                 // enum{val1,val2} | int | string | bool
     std::vector<std::string> parseEnumValues();        // {val1, val2, val3}
     std::vector<std::string> parseParameterValues();   // [val1, val2] для вызовов
+    bool parseParameterValue(std::vector<std::string>& values); // name | 42 | n-1 | n+1
     std::unique_ptr<ContextAction> parseContextAction(); // {store(name, value)}
     std::unique_ptr<NonTerminal> parseParameterizedNonTerminal(); // <rule>[param1, param2]
 };
@@ -152,9 +193,16 @@ public:
     // Парсинг из строки
     static std::unique_ptr<Grammar> fromString(const std::string& bnfText);
     
-    // Парсинг из файла
+    // Парсинг из файла: текст BNF или двоичная форма (см. toBinary)
     static std::unique_ptr<Grammar> fromFile(const std::string& filename);
     
+    // Двоичная форма разобранной грамматики: таблица строк и узлы правил в
+    // прямом порядке обхода. Загружается без лексера, парсера и повторной
+    // валидации; некорректные данные - std::runtime_error
+    static std::string toBinary(const Grammar& grammar);
+    static std::unique_ptr<Grammar> fromBinary(const std::string& data);
+    static bool isBinary(const std::string& data);
+    
     // Предустановленные грамматики (переписанные для нового парсера)
     static std::unique_ptr<Grammar> createJSONGrammar();
     static std::unique_ptr<Grammar> createPrologGrammar();
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "bnf_ast.hpp"
+#include "code_generator.hpp"
+#include "grammar_analysis.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bnf_parser_generator {
+
+/**
+ * Инструкции байт-кода разбора (в духе LPeg). Переходы - индексы в
+ * BytecodeProgram::code, остальные операнды - индексы таблиц программы.
+ * Неудача откатывает к последней точке выбора: позиция и узлы дерева
+ * восстанавливаются, выполнение продолжается с её метки.
+ */
+enum class OpCode : uint8_t {
+    CHAR,          // Байт a
+    STRING,        // Литерал literals[a]
+    SET,           // Один байт из sets[a]
+    RANGE,         // Символ UTF-8 с кодовой точкой из ranges[a]
+    SPAN,          // Байты из sets[a], пока они есть; не меньше b штук
+    SKIP,          // Пробелы между токенами: байты skip_set подряд
+    CHOICE,        // Точка выбора с меткой a
+    PLUS_CHOICE,   // Точка выбора первого повторения X+: его неудача - неудача X+
+    LOOP,          // Повторение: пустое - выход, иначе точка выбора сдвигается, переход на a
+    COMMIT,        // Снять точку выбора, переход на a
+    JUMP,          // Переход на a
+    TEST,          // Следующий байт не в sets[b] - переход на a (следующая альтернатива)
+    TEST_WS,       // TEST по байту после пробелов skip_set
+    DISPATCH,      // Переход по следующему байту из dispatch[a]
+    DISPATCH_WS,   // DISPATCH по байту после пробелов skip_set
+    FAIL,          // Неудача
+    CALL,          // Правило a; b: CALL_NODE - узел в дереве, CALL_SKIP - пропуск пробелов правилом
+    RETURN,        // Возврат из правила
+    END            // Конец стартового правила
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+};
+
+/**
+ * Грамматика, скомпилированная в байт-код. Не зависит от Grammar, из
+ * которой построена: сохраняется serialize() и загружается deserialize()
+ * без повторной компиляции.
+ *
+ * Язык разбора тот же, что у CppCodeGenerator: PEG с упорядоченным выбором,
+ * пробелы пропускаются перед токенами синтаксических правил (см.
+ * findLexicalRules), без правила пробелов - std::isspace перед каждым
+ * терминалом. Ссылки внутри токенов узлов не создают (как после
+ * раскрытия правил GrammarOptimizer): токен - лист дерева.
+ */
+struct BytecodeProgram {
+    // Метка, по которой DISPATCH завершается неудачей
+    static constexpr uint32_t FAIL_LABEL = UINT32_MAX;
+    // Флаги CALL. Вызов пропуска пробелов не считается в глубине и не
+    // сдвигает farthest-ошибку: его неудачи - не синтаксические ошибки
+    static constexpr uint32_t CALL_NODE = 1;
+    static constexpr uint32_t CALL_SKIP = 2;
+
+    std::vector<Instruction> code;
+    std::vector<std::string> rule_names;   // По номеру правила
+    std::vector<uint32_t> rule_entries;    // Начало тела правила в code
+    std::vector<std::string> literals;
+    std::vector<LookaheadSet> sets;        // По байту; бит END_OF_INPUT - конец входа
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    std::vector<std::vector<uint32_t>> dispatch;  // 257 меток: байт или конец входа
+    LookaheadSet skip_set;                 // Байты, которые пропускает SKIP
+    uint32_t start_rule = 0;
+    uint32_t entry = 0;                    // CALL стартового правила, затем END
+    uint32_t max_depth = 1000;
+    bool builds_tree = true;
+
+    // Используются whitespace_rule, token_rules, max_recursion_depth,
+    // first_set_dispatch, char_class_scanners и recognizer. Правила с
+    // параметрами и контекстными действиями - std::runtime_error
+    static BytecodeProgram compile(const Grammar& grammar, const GeneratorOptions& options = GeneratorOptions{});
+
+    // Двоичная форма; deserialize проверяет операнды и бросает std::runtime_error
+    std::string serialize() const;
+    static BytecodeProgram deserialize(const std::string& data);
+
+    // Листинг: по инструкции на строку, с именами правил
+    std::string disassemble() const;
+};
+
+/**
+ * Интерпретатор BytecodeProgram. Дерево разбора - плоский массив узлов
+ * в прямом порядке обхода: первый ребёнок nodes()[i] - nodes()[i + 1],
+ * next - индекс сразу за поддеревом узла. Буферы переиспользуются
+ * между вызовами parse().
+ */
+class BytecodeParser {
+public:
+    struct Node {
+        uint32_t rule;  // Номер правила: BytecodeProgram::rule_names
+        size_t begin;   // Разобранный текст - смещения в байтах
+        size_t end;
+        size_t next;
+    };
+
+    // Программа должна жить дольше парсера
+    explicit BytecodeParser(const BytecodeProgram& program) : program_(program) {}
+
+    // Разобрать весь вход стартовым правилом; вход должен жить, пока
+    // используются text() и toString()
+    bool parse(std::string_view input);
+
+    // Корень дерева последнего успешного разбора; nullptr в распознавателе
+    const Node* root() const { return nodes_.empty() ? nullptr : &nodes_[0]; }
+
+    const std::string& getError() const { return error_; }
+    size_t errorOffset() const { return error_offset_; }
+
+    const std::vector<Node>& nodes() const { return nodes_; }
+    std::string_view text(const Node& node) const { return input_.substr(node.begin, node.end - node.begin); }
+    const std::string& ruleName(const Node& node) const { return program_.rule_names[node.rule]; }
+
+    // Дерево с отступами, у листьев - их текст
+    std::string toString(const Node& node, size_t indent = 0) const;
+
+private:
+    // Точка выбора (label - её метка) или кадр вызова правила (CALL_FRAME, SKIP_FRAME)
+    struct Entry {
+        uint32_t label;
+        uint32_t rule_node;  // Кадр: индекс узла правила или NO_NODE
+        size_t pos;          // Точка выбора: позиция; кадр: адрес возврата
+        size_t saved;        // Точка выбора: число узлов; кадр пропуска: farthest до вызова
+    };
+    static constexpr uint32_t CALL_FRAME = UINT32_MAX;
+    static constexpr uint32_t SKIP_FRAME = UINT32_MAX - 1;
+    static constexpr uint32_t PROPAGATE = UINT32_MAX - 2;  // Точка выбора PLUS_CHOICE до первого LOOP
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    const BytecodeProgram& program_;
+    std::string_view input_;
+    std::vector<Entry> stack_;
+    std::vector<Node> nodes_;
+    size_t farthest_ = 0;
+    bool depth_exceeded_ = false;
+    std::string error_;
+    size_t error_offset_ = 0;
+
+    // Выполнить программу с начала входа; конец разбора или npos при неудаче
+    size_t run();
+    size_t lookahead(size_t pos, bool past_whitespace) const;
+};
+
+} // namespace bnf_parser_generator
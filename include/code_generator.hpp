@@ -46,6 +46,110 @@ struct GeneratorOptions {
     
     // Имя входного файла для парсинга (используется в main)
     std::string default_input_file = "";
+
+    // Packrat-мемоизация: каждое правило вычисляется не более одного раза
+    // для каждой позиции входа. Листовые правила (без ссылок на нетерминалы)
+    // по умолчанию не мемоизируются - поиск в таблице дороже их повторного разбора
+    bool memoize = false;
+
+    // Правила, мемоизируемые всегда (даже без memoize и для листовых правил)
+    std::vector<std::string> memoize_rules;
+
+    // Правила, исключённые из мемоизации
+    std::vector<std::string> no_memoize_rules;
+
+    // Размещать узлы AST в арене парсера: откат при backtracking - сброс метки,
+    // всё дерево освобождается одной операцией при следующем parse()/reset()
+    bool arena_allocation = false;
+
+    // Выбирать альтернативы по таблице FIRST-множеств на следующий байт вместо
+    // перебора; при пересечении FIRST-множеств остаётся упорядоченный перебор
+    bool first_set_dispatch = true;
+
+    // Отслеживать в горячем пути только байтовое смещение: узлы хранят offset,
+    // строка и столбец вычисляются по запросу из индекса начал строк
+    bool lazy_positions = false;
+
+    // Повторения классов символов ('0'..'9'+, (' '..'!' | '#'..'[')*) сканировать
+    // блоками (SSE2/AVX2/NEON) вместо посимвольного цикла. Внутри правил-токенов
+    // ссылки на правила-классы раскрываются: узлы для отдельных символов не создаются
+    bool char_class_scanners = true;
+
+    // Альтернативы из одних литералов ('true' | 'false' | 'null', таблицы операторов)
+    // сопоставлять сгенерированным деревом switch по байтам (бор) за один проход
+    // вместо проверки литералов по очереди; результат - первый совпавший по порядку
+    bool literal_tries = true;
+
+    // Правило пробелов между токенами (по умолчанию WHITESPACE или TRIVIA, если есть).
+    // Пробелы пропускаются только в синтаксических правилах перед токенами; внутри
+    // правил-токенов (имя в верхнем регистре и правила, достижимые только из них)
+    // не пропускаются. Без такого правила - std::isspace перед каждым терминалом
+    std::string whitespace_rule;
+
+    // Дополнительные правила-токены для грамматик без соглашения о верхнем регистре
+    std::vector<std::string> token_rules;
+
+    // Двухэтапный разбор: правила-токены компилируются в минимизированный ДКА,
+    // лексер разбивает вход на токены, синтаксические правила разбирают поток
+    // токенов. Нужны правило пробелов и регулярные, различимые по первому байту
+    // токены; иначе генерируется посимвольный парсер с предупреждением
+    bool dfa_lexer = false;
+
+    // Потоковый разбор: вход поступает частями через feed()/finish(), каждый
+    // разобранный элемент stream_item (по умолчанию стартовое правило) передаётся
+    // в callback. В памяти остаётся только неразобранный хвост входа
+    bool streaming = false;
+    std::string stream_item;
+
+    // Инкрементальный разбор: reparse(offset, removed, inserted) правит вход и
+    // разбирает его заново, переиспользуя мемоизированные поддеревья, которые
+    // правка не затронула. Включает мемоизацию и ленивые позиции; узлы хранят
+    // смещения детей относительно начала родителя
+    bool incremental = false;
+
+    // Параллельный разбор одного большого входа, если стартовое правило имеет
+    // вид item* или item+: вход делится на куски по началам строк, куски
+    // разбираются на потоках и сшиваются; неверно угаданные начала доразбираются
+    bool parallel = false;
+
+    // Распознаватель: AST не строится, правила лишь сообщают об успехе, parse()
+    // возвращает успех разбора, errorOffset() - смещение ошибки
+    bool recognizer = false;
+
+    // Событийный разбор без AST: парсер - шаблон класса по обработчику, которому
+    // передаются onEnter(rule), onExit(rule, span) и onToken(span) итогового
+    // разбора. Отсутствующие в обработчике методы не генерируют кода
+    bool event_callbacks = false;
+
+    // Профилирование: каждое parse_<rule> считает вызовы, успехи, неудачи,
+    // байты, разобранные неудавшимися попытками, и попадания в memo. Отчёт -
+    // profile()/printProfile(); без флага код парсера не меняется
+    bool profile = false;
+
+    // Профилирование с временем: включающее и исключающее время правил в тактах
+    // (rdtsc на x86, steady_clock на остальных платформах). Включает profile
+    bool profile_timing = false;
+
+    // Разбор без рекурсии на системном стеке: правила - корутины C++20, кадры
+    // которых лежат в стеке парсера в куче, а вызовы правил выполняет цикл
+    // диспетчера. Глубина вложенности ограничена только памятью (или
+    // setMaxDepth() парсера); max_recursion_depth в этом режиме не действует
+    bool explicit_stack = false;
+
+    // Разбиение на единицы трансляции: parser_code - заголовок с классами узлов
+    // и объявлением парсера, функции правил - в split_units файлах .cpp из
+    // additional_files. Правила одной компоненты сильной связности графа ссылок
+    // попадают в один файл; файл компоненты выбирается по имени её первого
+    // правила и не меняется при правке других правил. 0 - один файл
+    size_t split_units = 0;
+
+    // Диагностика дальней ошибки: парсер запоминает самое дальнее смещение
+    // неудачи и набор ожидавшихся там терминалов, диапазонов и токенов.
+    // Неудачное сопоставление сравнивает позицию с farthest_ и лишь не
+    // отставая от неё обновляет набор; сообщение собирается после неудачи
+    bool diagnostics = false;
+
+    // Новое поле настроек нужно добавить и в ключ GenerationCache (generation_cache.cpp)
 };
 
 /**
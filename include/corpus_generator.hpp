@@ -0,0 +1,206 @@
+#pragma once
+
+#include "bnf_ast.hpp"
+#include "bytecode_vm.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace bnf_parser_generator {
+
+struct CorpusOptions {
+    uint64_t seed = 1;
+    size_t target_bytes = 1 << 20;
+    // Вложенность синтаксических правил (внутри токенов - вложенность токенов);
+    // глубже выбираются кратчайшие завершения: альтернативы наименьшей высоты
+    // вывода, без [ ] и повторений
+    size_t max_depth = 24;
+    // Наибольшее число повторений { } и X+ (основное повторение не ограничено)
+    size_t max_repeat = 4;
+    double optional_probability = 0.5;
+    // Доля символов вне ASCII, когда диапазон допускает и те, и другие
+    double unicode_ratio = 0.0;
+    // Веса альтернатив верхнего уровня правила по его имени; вес 0 - никогда
+    std::map<std::string, std::vector<double>> weights;
+    // Как в GeneratorOptions: правило пробелов и дополнительные токены
+    std::string whitespace_rule;
+    std::vector<std::string> token_rules;
+    // Проверять элементы интерпретатором байт-кода и порождать отвергнутые
+    // заново (не больше max_attempts раз); для грамматик, которые он принимает
+    bool validate = false;
+    size_t max_attempts = 8;
+};
+
+struct CorpusStats {
+    size_t bytes = 0;
+    size_t items = 0;        // Элементы основного повторения или предложения
+    size_t rejected = 0;     // Отвергнуто проверкой
+    size_t max_depth = 0;    // Наибольшая достигнутая вложенность синтаксических правил
+    bool validated = false;  // Хотя бы один элемент проверен
+};
+
+/**
+ * Генератор случайных предложений грамматики заданного объёма - входы для
+ * нагрузочных замеров сгенерированных парсеров.
+ *
+ * Объём набирается основным повторением: первым { } или X+ синтаксического
+ * правила на кратчайшем пути от стартового (program ::= form*, элементы
+ * массива JSON). Оно повторяется, пока вывод не достигнет target_bytes, а
+ * вывод сбрасывается в поток между элементами, поэтому память не зависит от
+ * объёма. Без такого повторения вывод - предложения стартового правила по
+ * одному на строку.
+ *
+ * Между токенами синтаксических правил вставляется пробел, табуляция или
+ * перевод строки, с которого начинается правило пробелов (между элементами -
+ * перевод строки, если правило его допускает). Правило из одних комментариев
+ * поглотило бы следующий токен: тогда токены идут вплотную, без слова за словом.
+ * Без правила пробелов токены - правила-слова (identifier, number), и слово
+ * сразу за словом не порождается: парсер пропускает пробелы и внутри слов.
+ * Правила с параметрами специализируются (GrammarOptimizer::specialize),
+ * параметры INTEGER связываются при порождении. {store} запоминает ключ,
+ * {lookup} при промахе подставляет ранее сохранённый ключ вместо только что
+ * порождённого текста, {check} по параметру проверяет его значение, ^ не
+ * влияет на порождение.
+ *
+ * Порождение следует грамматике, а не разбору PEG: упорядоченный выбор может
+ * отвергнуть порождённый текст (альтернатива, затенённая более ранней).
+ * validate отбрасывает такие элементы; грамматику, которую интерпретатор
+ * байт-кода не принимает, с validate не породить. Один seed на одной сборке
+ * даёт один и тот же вывод.
+ */
+class CorpusGenerator {
+public:
+    // Грамматика копируется; неизвестное правило в weights или число весов,
+    // не совпадающее с числом альтернатив, validate для грамматики, которую не
+    // принимает интерпретатор байт-кода, - std::runtime_error
+    explicit CorpusGenerator(const Grammar& grammar, CorpusOptions options = CorpusOptions{});
+
+    // Вывод объёма не меньше target_bytes; std::runtime_error, если
+    // стартовое правило не порождает ни одного предложения
+    CorpusStats generate(std::ostream& out);
+
+    // Одно предложение стартового правила без основного повторения
+    std::string sentence();
+
+    const CorpusStats& stats() const { return stats_; }
+
+private:
+    struct Span {
+        std::string name;
+        size_t begin;
+        size_t end;
+    };
+    // Кадр вызова правила: значения параметров INTEGER и тексты последних
+    // вызовов правил, которые нужны его контекстным действиям
+    struct Frame {
+        std::vector<std::pair<std::string, long long>> bindings;
+        std::vector<Span> spans;
+    };
+    // Точка возврата: позиция вывода, длина журнала сохранённых ключей и
+    // состояние разделителей и основного повторения
+    struct Mark {
+        size_t position;
+        size_t stored;
+        size_t items;
+        bool item_break;
+        bool last_keyword;
+        bool token_pending;
+        bool filling;
+    };
+    struct RuleInfo {
+        const ProductionRule* rule = nullptr;
+        bool lexical = false;
+        bool whitespace = false;
+        bool frame = false;  // Параметры или контекстные действия
+        std::unordered_set<std::string> context_names;  // Правила, тексты которых читают действия
+    };
+    struct Validator {
+        std::unique_ptr<BytecodeProgram> program;
+        std::unique_ptr<BytecodeParser> parser;
+    };
+
+    std::unique_ptr<Grammar> grammar_;
+    CorpusOptions options_;
+    std::mt19937_64 rng_;
+    CorpusStats stats_;
+
+    std::string whitespace_rule_;
+    std::unordered_set<std::string> lexical_rules_;
+    std::string token_separator_;
+    std::string item_separator_;
+    std::unordered_map<const ASTNode*, size_t> height_;    // Наименьшая высота вывода
+    std::unordered_map<const ASTNode*, size_t> distance_;  // Вызовов до основного повторения
+    std::unordered_map<std::string, size_t> rule_height_;
+    std::unordered_map<std::string, size_t> rule_distance_;
+    std::unordered_map<const ASTNode*, std::vector<double>> weights_;
+    std::unordered_map<const ProductionRule*, RuleInfo> rule_info_;
+    std::unordered_map<const NonTerminal*, const RuleInfo*> calls_;  // nullptr - правило не определено
+
+    // Вывод: сброшенные в поток байты и буфер текущего элемента
+    std::ostream* out_ = nullptr;
+    std::string buffer_;
+    size_t written_ = 0;
+    char last_byte_ = '\n';
+    bool item_break_ = false;    // Следующий токен начинает новый элемент
+    bool last_keyword_ = false;  // Последний токен - ключевое слово (без правила пробелов)
+    bool token_pending_ = false; // Начат токен, его первый символ ещё не порождён
+
+    std::vector<Frame> frames_;
+    const RuleInfo* current_ = nullptr;  // Правило, тело которого порождается
+    size_t depth_ = 0;          // Вложенность синтаксических правил
+    size_t lexical_depth_ = 0;  // Вложенность токенов
+    bool filling_ = false;   // Путь к основному повторению ещё не пройден
+    bool in_item_ = false;   // Порождается элемент основного повторения
+    size_t item_depth_ = 0;  // Глубина правила с основным повторением
+
+    // Ключи {store} по слотам и журнал для отката
+    std::unordered_map<std::string, std::vector<std::string>> slot_keys_;
+    std::unordered_map<std::string, std::unordered_map<std::string, size_t>> slot_counts_;
+    std::vector<std::pair<std::string, std::string>> stored_;
+
+    std::unique_ptr<Grammar> validation_grammar_;
+    std::unordered_map<std::string, Validator> validators_;
+
+    void computeHeights();
+    void computeDistances();
+    size_t nodeHeight(const ASTNode* node) const;
+    size_t nodeDistance(const ASTNode* node) const;
+    void collectContextNames(const ASTNode* node, std::unordered_set<std::string>& names) const;
+
+    bool generateNode(const ASTNode* node);
+    bool generateSequence(const Sequence* node);
+    bool generateAlternative(const Alternative* node);
+    bool generateRepetition(const ASTNode* content, size_t min_count, bool spine);
+    bool generateCall(const NonTerminal* node);
+    bool generateRule(const RuleInfo& info, const NonTerminal* call);
+    const std::vector<std::pair<std::string, long long>>& bindings() const;
+    bool generateAction(const ContextAction* node);
+    bool generateTerminal(std::string_view text);
+    bool generateCodepoint(const CharRange* node);
+
+    bool closing() const { return (syntactic() ? depth_ : lexical_depth_) >= options_.max_depth; }
+    bool syntactic() const { return lexical_depth_ == 0; }
+    bool beginToken(unsigned char first, bool keyword, bool terminal);
+    size_t pick(const std::vector<double>& weights);
+
+    size_t position() const { return written_ + buffer_.size(); }
+    Mark mark() const {
+        return {position(), stored_.size(), stats_.items, item_break_, last_keyword_, token_pending_, filling_};
+    }
+    void restore(const Mark& mark);
+    std::string_view text(size_t begin, size_t end) const;
+    void emit(std::string_view bytes);
+    void flush();
+
+    BytecodeParser& validator(const std::string& rule);
+    bool accepted(const std::string& rule, size_t begin);
+};
+
+} // namespace bnf_parser_generator
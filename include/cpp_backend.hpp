@@ -1,7 +1,10 @@
 #pragma once
 
 #include "code_generator.hpp"
+#include "grammar_analysis.hpp"
+#include "lexer_automaton.hpp"
 #include <sstream>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace bnf_parser_generator {
@@ -20,6 +23,87 @@ private:
     
     // Отслеживание сгенерированных функций для избежания дубликатов
     std::unordered_set<std::string> generated_functions_;
+
+    // Правила, для которых генерируется таблица мемоизации
+    std::unordered_set<std::string> memoized_rules_;
+    std::vector<size_t> memo_index_;  // По RuleId: см. memoIndex()
+
+    // Компактное представление грамматики: номера правил и общий вход анализов
+    std::shared_ptr<const GrammarIR> ir_;
+
+    // FIRST-множества грамматики: без учёта пропуска пробелов и с ним
+    GrammarAnalysis analysis_;
+    GrammarAnalysis ws_analysis_;
+
+    // Пропуск пробелов между токенами. Пустое trivia_rule_ - прежний режим:
+    // std::isspace перед каждым терминалом
+    std::string trivia_rule_;
+    std::unordered_set<std::string> lexical_rules_;  // Внутри них пробелы не пропускаются
+    LookaheadSet skip_class_;    // Байты, с которых может начинаться пропуск
+    bool skip_is_class_ = true;  // Пропуск сводится к классу байтов (цикл без вызова правила)
+    bool in_lexical_rule_ = false;
+
+    // Классы символов под повторением, сканируемые блоками: по функции на класс
+    struct CharClass {
+        LookaheadSet ascii;  // ASCII-байты класса (терминалы и диапазоны)
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;  // Диапазоны кодовых точек для не-ASCII байтов
+    };
+    std::vector<CharClass> scan_classes_;
+    bool has_char_ranges_ = false;  // Нужен общий декодер UTF-8 decodeUtf8()
+    std::unique_ptr<Grammar> specialized_;  // Грамматика после специализации параметров
+
+    // Контекстные действия: слоты хранилища по именам из {store}/{lookup} в
+    // порядке появления и имена правил, текст которых запоминает текущее
+    // правило (локальные ctx_<имя>)
+    std::vector<std::string> context_slots_;
+    std::unordered_map<std::string, size_t> context_slot_;
+    std::unordered_set<std::string> context_spans_;
+
+    // Альтернативы из одних литералов: по функции-бору на набор литералов
+    std::vector<std::vector<std::string>> literal_tries_;
+    const Grammar* grammar_ = nullptr;
+
+    // Диагностика дальней ошибки: ожидаемые элементы (терминалы, диапазоны,
+    // токены) по номерам и группы элементов, которые отмечает место неудачи
+    std::vector<std::string> expected_items_;
+    std::unordered_map<std::string, size_t> expected_item_;
+    std::vector<std::vector<size_t>> expected_groups_;
+
+    // Отсечение: действие при неудаче после ^ для каждой объемлющей
+    // альтернативы, [ ] и { } текущего правила; used - ^ в области встретился
+    struct CutScope {
+        std::string committed;
+        bool used = false;
+    };
+    std::vector<CutScope> cut_scopes_;
+
+    // Двухэтапный разбор (dfa_lexer): ДКА лексера и виды токенов. Ключ вида -
+    // имя правила-токена, "literal:" + текст терминала или rangeKey() диапазона
+    bool lexer_mode_ = false;
+    LexerAutomaton lexer_;
+    struct TokenKindInfo {
+        std::string enumerator;   // TOKEN_STRING, TOKEN_LITERAL_0
+        std::string description;  // Правило или литерал для комментария
+    };
+    std::vector<TokenKindInfo> token_kinds_;
+    std::unordered_map<std::string, size_t> token_kind_;
+    
+    // Потоковый разбор: правило элемента потока
+    std::string stream_item_;
+
+    // Параллельный разбор стартового правила вида item*: правило элемента,
+    // пропуск пробелов перед ним и байты, с которых элемент может начинаться
+    std::string parallel_item_;
+    bool parallel_one_or_more_ = false;
+    bool parallel_skip_ = false;
+    LookaheadSet parallel_first_;
+    
+    // Разбиение на единицы трансляции: файл правил по id имени правила,
+    // тексты функций правил по RuleId и их объявления для класса парсера
+    size_t split_units_ = 0;
+    std::vector<size_t> rule_unit_;
+    std::vector<std::string> rule_functions_;
+    mutable std::string rule_declarations_;
     
     // Текущий уровень отступа
     size_t current_indent_level_ = 0;
@@ -61,6 +145,7 @@ protected:
     
     // Extended BNF visitor методы
     std::string visitContextAction(const ContextAction* node, const std::string& on_failure_action);
+    std::string visitCut(const Cut* node);
     
     // Генерация функций для правил
     std::string generateRuleFunction(const ProductionRule& rule) override;
@@ -102,9 +187,10 @@ private:
     std::string generateParserClass(const Grammar& grammar);
     std::string generateParserState();
     std::string generateHelperMethods();
-    std::string generateMainParseMethod(const Grammar& grammar);
+    std::string generateMainParseMethod(const Grammar& grammar, const std::string& name = "parse");
     std::string generateFooter();
     std::string generateMainCpp(const Grammar& grammar);
+    std::string generateBatchDriver() const;  // Пакетный разбор многих файлов в пуле потоков
     
     // Вспомогательные методы
     std::string getIndent(size_t level) const;
@@ -117,6 +203,119 @@ private:
     std::string generateASTNodeType(const std::string& rule_name) const;
     std::string generateASTConstruction(const std::string& rule_name) const;
     
+    // Packrat-мемоизация
+    void collectMemoizedRules(const Grammar& grammar);
+    bool isMemoized(const std::string& rule_name) const;
+    std::string generateMemoTables(const Grammar& grammar);
+    std::string generateMemoizedWrapper(const ProductionRule& rule);
+    std::string generateDepthWatch() const;
+    std::string generateMemoRelease(const Grammar& grammar) const;
+
+    // Точки возврата: сохранение и восстановление состояния при backtracking.
+    // В режиме lazy_positions сохраняется только pos_
+    std::string generateCheckpoint(const std::string& prefix, const std::string& indent) const;
+    std::string generateRestore(const std::string& prefix) const;
+    std::string generatePositionSave(const std::string& prefix, const std::string& indent) const;
+    std::string generatePositionRestore(const std::string& prefix) const;
+    std::string generatePositionLookup() const;
+    
+    // Владение узлами: unique_ptr, shared_ptr (узлы переиспользуются из memo) или арена
+    std::string generateNodeAllocation(const std::string& rule_name) const;
+    bool arenaRewindEnabled() const;
+    std::string generateArenaClasses();
+
+    // Пропуск пробелов: правило грамматики, правила-токены, цикл пропуска
+    void collectTrivia(const Grammar& grammar);
+    bool collectByteClass(const ASTNode* node, const Grammar& grammar, LookaheadSet& bytes, size_t depth) const;
+    bool skipsBeforeToken() const;
+    bool skipUsesSimd() const;
+    std::string generateSkipWhitespace();
+
+    // Повторения классов символов: сканирование блоками по 16-32 байта
+    bool collectCharClass(const ASTNode* node, CharClass& cls, size_t depth) const;
+    const ProductionRule* inlinableClassRule(const ASTNode* node) const;
+    std::string generateClassRepetition(const ASTNode* content, bool one_or_more,
+                                        const std::string& on_failure_action);
+    std::string generateClassScanner(size_t index) const;
+
+    // Альтернативы из одних литералов: бор из switch по байтам, первый литерал по порядку
+    bool collectLiterals(const Alternative* node, std::vector<std::string>& literals) const;
+    std::string generateLiteralAlternative(const std::vector<std::string>& literals,
+                                           const std::string& on_failure_action);
+    std::string generateLiteralMatcher(size_t index) const;
+
+    // Лексер на ДКА: токены синтаксических правил, типы токенов, tokenize()
+    void planLexer(const Grammar& grammar, GeneratedCode& result);
+    std::string rangeKey(const CharRange* node) const;
+    std::string tokenKind(const std::string& key) const;
+    bool tracksLineColumn() const;
+    std::string generateTokenTypes() const;
+    std::string generateTokenizer() const;
+    std::string generateTokenHelpers() const;
+    std::string generateTokenRuleFunction(const ProductionRule& rule);
+    std::string generateTokenPosition(const std::string& token) const;
+
+    // Инкрементальный разбор: колонки мемоизации по смещениям, reparse()
+    size_t memoIndex(const std::string& rule_name) const;
+    bool resumesInTree() const;  // reparse() разбирает заново только поддерево вокруг правки
+    std::string generateChildOffsetsClass() const;
+    std::string generateEditGap() const;  // Gap buffer текста и колонок, индекс охвата записей
+    std::string generateResumeMethods(const Grammar& grammar) const;
+    std::string generateIncrementalMethods(const Grammar& grammar);
+    
+    // Параллельный разбор: куски входа на потоках, сшивка и доразбор кусков
+    void planParallel(const Grammar& grammar, GeneratedCode& result);
+    std::string generateParallelMethods() const;
+    std::string generateParallelChunks() const;
+    
+    // Разбор без AST: распознаватель и события для обработчика-параметра шаблона
+    bool buildsTree() const;
+    std::string depthLimit() const;  // Предел recursion_depth_ в сгенерированном коде
+    std::string generateEventTypes(const Grammar& grammar) const;
+    std::string generateEventMethods() const;
+    std::string generateRuleEnter(const std::string& rule_name, const std::string& mark) const;
+    
+    // Профилирование: счётчики правил, обёртка parse_X() над разбором правила
+    size_t profileIndex(const std::string& rule_name) const;
+    std::string ruleEntryName(const std::string& rule_name) const;
+    std::string generateProfileTypes() const;
+    std::string generateProfileMembers() const;
+    std::string generateProfileMethods() const;
+    std::string generateProfiledWrapper(const ProductionRule& rule) const;
+
+    // Явный стек: правила - корутины, вызов правила - co_await, вне правил - run()
+    bool ruleIsCoroutine(const std::string& rule_name) const;
+    std::string ruleReturnType(const std::string& rule_name) const;
+    std::string ruleReturn(const std::string& rule_name) const;
+    std::string ruleCall(const std::string& rule_name, const std::string& function, bool from_rule,
+                         const std::vector<std::string>& arguments = {}) const;
+    std::string generateExplicitStackTypes() const;
+
+    // Разбиение на единицы трансляции: заголовок парсера и файлы правил
+    void planSplit();
+    std::string ruleSignature(const std::string& return_type, const std::string& declarator) const;
+    std::string generateRuleUnit(size_t unit) const;
+    std::string headerFilename() const;
+    
+    // Потоковый разбор: feed()/finish() и разбор окна по элементам
+    std::string generateStreamingMethods();
+    std::string generateStreamItems();
+    
+    // Выбор альтернативы по следующему байту (таблица по FIRST-множествам)
+    std::string generateAlternativeDispatch(const Alternative* node, const std::string& label_base,
+                                            std::vector<uint64_t>& choice_bits);
+    bool dispatchPastWhitespace(const Alternative* node) const;
+
+    // Диагностика дальней ошибки: группа элементов, с которых начинается узел,
+    // отметка неудачи перед действием неудачи, поля и сообщение парсера
+    void collectExpected(const ASTNode* node, std::vector<size_t>& items,
+                         std::unordered_set<std::string>& visiting);
+    size_t expectedItem(const std::string& label);
+    size_t expectedGroup(std::vector<size_t> items);
+    std::string noteFailure(const ASTNode* node, const std::string& at = "pos_");
+    std::string noteFailure(size_t group, const std::string& at = "pos_") const;
+    std::string generateDiagnostics() const;
+
     // Обработка особых случаев
     bool needsHelper(const ASTNode* node) const;
     std::string generateHelperFunction(const ASTNode* node, const std::string& name);
@@ -128,14 +327,17 @@ private:
     // Обобщённый метод визитации узлов
     std::string visitNode(const ASTNode* node, const std::string& on_failure_action);
     
-    // Extended BNF методы
-    std::string generateParameterizedFunction(const ProductionRule& rule);
-    std::string generateParameterTypes(const std::vector<RuleParameter>& params);
-    std::string generateParameterDeclarations(const std::vector<RuleParameter>& params);
-    std::string generateParameterPassing(const std::vector<std::string>& paramValues);
-    std::string generateEnumDeclaration(const RuleParameter& param);
+    // Extended BNF методы. После GrammarOptimizer::specialize у правил
+    // остаются только целые параметры времени выполнения
+    std::string generateParameterDeclarations(const std::vector<RuleParameter>& params) const;
+    std::string generateParameterPassing(const std::vector<std::string>& paramValues) const;
+    std::vector<std::string> entryArguments(const std::string& rule_name) const;
     std::string generateContextStorage();  // Для YAML anchors и т.д.
     std::string generateContextActions(const ContextAction* action);
+    std::string generateContextStoreClass() const;
+    void collectContextSlots(const Grammar& grammar);
+    std::string generateContextSpans(const ProductionRule& rule);
+    std::string contextText(const std::string& name) const;
     
     // Проверка поддерживаемых возможностей
     bool isExtendedBNF(const Grammar& grammar) const;
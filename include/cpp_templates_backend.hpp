@@ -0,0 +1,88 @@
+#pragma once
+
+#include "code_generator.hpp"
+#include <cstdint>
+#include <unordered_set>
+
+namespace bnf_parser_generator {
+
+/**
+ * Генератор C++ на шаблонах комбинаторов (язык "cpp-templates").
+ *
+ * Грамматика становится заголовком из типов: правило - структура с
+ * псевдонимом Body, составленным из Seq, Choice, Star, Plus, Opt, Lit, Range
+ * и Set (класс ASCII-символов как constexpr битовая маска). Разбор целиком
+ * виден компилятору: вызовы правил раскрываются, сравнения специализируются
+ * по терминалам, лишние сохранения позиции убираются оптимизатором. Вместо
+ * виртуальных узлов AST - плоский массив узлов в прямом порядке обхода.
+ *
+ * Язык разбора тот же, что у CppCodeGenerator: PEG с упорядоченным выбором,
+ * пробелы пропускаются перед токенами синтаксических правил (см.
+ * findLexicalRules), ссылки внутри токенов узлов не создают. Правила с
+ * параметрами и контекстными действиями не поддерживаются.
+ */
+class CppTemplatesCodeGenerator : public CodeGenerator {
+public:
+    CppTemplatesCodeGenerator() = default;
+
+    GeneratedCode generate(const Grammar& grammar, const GeneratorOptions& options) override;
+
+    std::string getTargetLanguage() const override { return "cpp-templates"; }
+    std::string getFileExtension() const override { return ".hpp"; }
+
+    std::vector<std::string> getSupportedFeatures() const override {
+        return {
+            "recursive_descent",
+            "natural_backtracking",
+            "parse_tree_construction",
+            "compile_time_combinators",
+            "error_reporting",
+            "utf8_support",
+            "header_only"
+        };
+    }
+
+protected:
+    // Каждый visit-метод возвращает тип комбинатора для узла грамматики
+    std::string visitTerminal(const Terminal* node) override;
+    std::string visitNonTerminal(const NonTerminal* node) override;
+    std::string visitCharRange(const CharRange* node) override;
+    std::string visitAlternative(const Alternative* node) override;
+    std::string visitSequence(const Sequence* node) override;
+    std::string visitGroup(const Group* node) override;
+    std::string visitOptional(const Optional* node) override;
+    std::string visitZeroOrMore(const ZeroOrMore* node) override;
+    std::string visitOneOrMore(const OneOrMore* node) override;
+
+    // Определение структуры правила: номер и тело
+    std::string generateRuleFunction(const ProductionRule& rule) override;
+
+private:
+    GeneratorOptions options_;
+    const Grammar* grammar_ = nullptr;
+
+    // Пропуск пробелов - как в CppCodeGenerator. Пустое trivia_rule_ -
+    // std::isspace перед каждым терминалом
+    std::string trivia_rule_;
+    std::unordered_set<std::string> lexical_rules_;
+    bool in_lexical_rule_ = false;
+
+    std::string visitNode(const ASTNode* node);
+
+    // Пропуск пробелов перед токеном: Tok<Ws, P> или P
+    std::string beforeToken(const std::string& type, bool terminal) const;
+
+    // Альтернативы из ASCII-символов и диапазонов - одна битовая маска
+    bool collectByteSet(const ASTNode* node, uint64_t bits[2], bool& has_terminal) const;
+
+    std::string ruleType(const std::string& rule_name) const;
+    std::string ruleEnumerator(const std::string& rule_name) const;
+    bool buildsTree() const { return !options_.recognizer; }
+
+    std::string generateRules(const Grammar& grammar);
+    std::string generateParserClass(const Grammar& grammar) const;
+    std::string generateMain() const;
+    std::vector<std::string> ignoredOptions() const;
+};
+
+} // namespace bnf_parser_generator
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "code_generator.hpp"
+#include <optional>
+#include <string>
+
+namespace bnf_parser_generator {
+
+/**
+ * Кэш результатов генерации на диске, адресуемый содержимым.
+ *
+ * Ключ - текст грамматики, все поля GeneratorOptions, дополнительные
+ * настройки вызывающего (например, проходы оптимизатора) и версия
+ * генератора со временем сборки: пересобранный генератор не использует
+ * записи старого. Запись - файл <хэш ключа>.gen в каталоге кэша; ключ
+ * хранится в записи целиком и сравнивается при чтении, поэтому совпадение
+ * хэшей не выдаёт чужой код. Запись создаётся во временном файле и
+ * переименовывается, так что параллельные запуски видят её целиком или никак.
+ */
+class GenerationCache {
+public:
+    explicit GenerationCache(std::string directory);
+
+    static std::string makeKey(const std::string& grammar_text, const GeneratorOptions& options,
+                               const std::string& extra = "");
+
+    // Результат генерации для ключа; nullopt, если записи нет или она повреждена
+    std::optional<GeneratedCode> load(const std::string& key) const;
+
+    // Сохранить успешный результат; false, если запись не удалась
+    bool store(const std::string& key, const GeneratedCode& code) const;
+
+    std::string entryPath(const std::string& key) const;
+    const std::string& directory() const { return directory_; }
+
+private:
+    std::string directory_;
+};
+
+} // namespace bnf_parser_generator
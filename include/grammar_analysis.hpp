@@ -0,0 +1,101 @@
+#pragma once
+
+#include "bnf_ast.hpp"
+#include "grammar_ir.hpp"
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace bnf_parser_generator {
+
+/**
+ * Множество предпросмотра на один байт: 256 значений байта и конец входа.
+ * Генерируемые парсеры работают с UTF-8 побайтно, поэтому для диапазонов
+ * символов в множество попадают ведущие байты их кодировок.
+ */
+using LookaheadSet = std::bitset<257>;
+constexpr size_t END_OF_INPUT = 256;
+
+/**
+ * Результат анализа одного правила
+ */
+struct RuleAnalysis {
+    std::string name;
+    bool nullable = false;       // Правило может успешно разобрать пустую строку
+    LookaheadSet first;          // FIRST: байты, с которых может начинаться разбор
+    LookaheadSet follow;         // FOLLOW: байты (или конец входа) после правила
+    bool isLL1 = true;           // Все выборы правила различимы по одному байту
+    std::vector<std::string> conflicts;  // Описание конфликтов, если не LL(1)
+};
+
+/**
+ * Анализ грамматики: nullable, FIRST и FOLLOW.
+ * Вычисляется по GrammarIR до неподвижной точки: правило пересчитывается,
+ * только когда изменились множества правил, на которые оно ссылается.
+ */
+class GrammarAnalysis {
+public:
+    struct Options {
+        // Байты, которые парсер может пропустить перед терминалом или диапазоном
+        // символов (пробелы между токенами); добавляются в их FIRST-множества
+        LookaheadSet skippedBeforeTokens;
+    };
+
+    static GrammarAnalysis analyze(const Grammar& grammar);
+    static GrammarAnalysis analyze(const Grammar& grammar, const Options& options);
+    // Анализ уже построенного представления (например, общего для нескольких анализов)
+    static GrammarAnalysis analyze(std::shared_ptr<const GrammarIR> ir, const Options& options);
+
+    // Результаты по правилам в порядке определения
+    const std::vector<RuleAnalysis>& rules() const { return rules_; }
+    const RuleAnalysis* findRule(const std::string& name) const;
+
+    // Свойства выражения правой части. Для узла не из этой грамматики
+    // ответ консервативен: выражение может быть пустым и начинаться с чего угодно
+    bool isNullable(const ASTNode* node) const;
+    LookaheadSet first(const ASTNode* node) const;
+    bool isNullable(NodeId node) const { return node_info_[node].nullable; }
+    LookaheadSet first(NodeId node) const { return node_info_[node].first; }
+    const GrammarIR& ir() const { return *ir_; }
+
+    // Имена правил, которые являются (или не являются) LL(1)
+    std::vector<std::string> ll1Rules() const;
+    std::vector<std::string> nonLL1Rules() const;
+
+    // Человекочитаемая запись множества: 'a'-'z', ' ', EOF, 0xC3
+    static std::string describe(const LookaheadSet& set);
+
+private:
+    struct NodeInfo {
+        bool nullable = false;
+        LookaheadSet first;
+    };
+
+    Options options_;
+    std::shared_ptr<const GrammarIR> ir_;
+    std::vector<RuleAnalysis> rules_;  // По id имени правила в ir_
+    std::vector<NodeInfo> node_info_;  // По NodeId
+
+    // Пересчитывает узлы правила снизу вверх; true, если изменилось само правило
+    bool computeRule(RuleId rule);
+    NodeInfo computeNode(NodeId node) const;
+    void computeFollow(NodeId node, const LookaheadSet& follow, std::vector<size_t>& grown);
+    void checkLL1(NodeId node, const LookaheadSet& follow, RuleAnalysis& rule) const;
+};
+
+/**
+ * Правила-токены. Правило пробелов - requested или, если оно не задано,
+ * WHITESPACE или TRIVIA; пустая строка, если такого правила нет.
+ * Токены - правило пробелов, имена в верхнем регистре (NUMBER), token_rules
+ * и все правила, недостижимые из стартового без прохода через токен. Внутри
+ * токенов пробелы не пропускаются, а их узлы - деталь лексики. Без правила
+ * пробелов все правила синтаксические
+ */
+std::string findWhitespaceRule(const Grammar& grammar, const std::string& requested);
+std::unordered_set<std::string> findLexicalRules(const Grammar& grammar, const std::string& whitespace_rule,
+                                                 const std::vector<std::string>& token_rules);
+
+} // namespace bnf_parser_generator
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "bnf_ast.hpp"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace bnf_parser_generator {
+
+/**
+ * Компактное представление грамматики для валидации, анализа и генерации.
+ * Узлы правых частей лежат в одном массиве и различаются тегом вида, дети
+ * узла - непрерывный отрезок массива индексов, правила и имена - целые числа.
+ * Строится из дерева ASTNode один раз (GrammarIR::lower); ссылка на правило
+ * разрешается при построении, поэтому обходы не сравнивают строки.
+ */
+
+using SymbolId = uint32_t;
+using RuleId = uint32_t;
+using NodeId = uint32_t;
+constexpr uint32_t NO_ID = UINT32_MAX;
+
+// Интернированные строки: каждая хранится один раз, id - порядок появления
+class SymbolTable {
+public:
+    SymbolTable() = default;
+    // Копия ссылалась бы из index_ на строки оригинала
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+    SymbolTable(SymbolTable&&) = default;
+    SymbolTable& operator=(SymbolTable&&) = default;
+
+    SymbolId intern(std::string_view name);
+    SymbolId find(std::string_view name) const;  // NO_ID, если строки нет
+    const std::string& name(SymbolId id) const { return names_[id]; }
+    size_t size() const { return names_.size(); }
+
+private:
+    std::deque<std::string> names_;  // Адреса строк не меняются: на них ссылается index_
+    std::unordered_map<std::string_view, SymbolId> index_;
+};
+
+struct IRNode {
+    NodeKind kind;
+    uint32_t child_begin = 0;  // Дети: GrammarIR::children(id)
+    uint32_t child_count = 0;
+    SymbolId symbol = NO_ID;   // NON_TERMINAL - имя в symbols(), TERMINAL - текст в literals()
+    RuleId rule = NO_ID;       // NON_TERMINAL: первое определение правила, NO_ID - не определено
+    uint32_t range_start = 0;  // CHAR_RANGE: кодовые точки
+    uint32_t range_end = 0;
+};
+
+struct IRRule {
+    SymbolId name;
+    NodeId body;
+    const ProductionRule* source;
+};
+
+class GrammarIR {
+public:
+    static GrammarIR lower(const Grammar& grammar);
+
+    // Правила в порядке grammar.rules; повторное определение - отдельное правило.
+    // Имена правил получают id 0..k-1 в порядке первого определения, поэтому
+    // id имени служит и номером различного правила
+    const std::vector<IRRule>& rules() const { return rules_; }
+    const IRRule& rule(RuleId id) const { return rules_[id]; }
+    size_t ruleNameCount() const { return rule_names_; }
+    RuleId findRule(std::string_view name) const;  // Первое определение или NO_ID
+    RuleId definition(SymbolId name) const { return definitions_[name]; }
+    RuleId startRule() const { return start_rule_; }
+
+    const SymbolTable& symbols() const { return symbols_; }
+    const SymbolTable& literals() const { return literals_; }
+    const std::string& ruleName(RuleId id) const { return symbols_.name(rules_[id].name); }
+
+    // Узлы лежат в прямом порядке обхода: узлы правила - отрезок
+    // [body, bodyEnd), дети узла имеют большие id, чем сам узел
+    size_t nodeCount() const { return nodes_.size(); }
+    NodeId bodyEnd(RuleId id) const {
+        return id + 1 < rules_.size() ? rules_[id + 1].body : static_cast<NodeId>(nodes_.size());
+    }
+    const IRNode& node(NodeId id) const { return nodes_[id]; }
+    const NodeId* childrenBegin(NodeId id) const { return children_.data() + nodes_[id].child_begin; }
+    const NodeId* childrenEnd(NodeId id) const { return childrenBegin(id) + nodes_[id].child_count; }
+    NodeId child(NodeId id, size_t index = 0) const { return children_[nodes_[id].child_begin + index]; }
+
+    // Связь с деревом, из которого построено представление
+    const ASTNode* source(NodeId id) const { return sources_[id]; }
+    NodeId find(const ASTNode* node) const;  // NO_ID для узла другой грамматики
+
+    // Компоненты сильной связности графа ссылок между правилами: номер
+    // компоненты по id имени правила. Номера идут в обратном топологическом
+    // порядке: правило ссылается только на свою компоненту и меньшие номера
+    std::vector<uint32_t> ruleComponents() const;
+
+private:
+    std::vector<IRNode> nodes_;
+    std::vector<NodeId> children_;
+    std::vector<const ASTNode*> sources_;
+    std::unordered_map<const ASTNode*, NodeId> node_index_;
+    std::vector<IRRule> rules_;
+    std::vector<RuleId> definitions_;  // По SymbolId имени
+    SymbolTable symbols_;
+    SymbolTable literals_;
+    RuleId start_rule_ = NO_ID;
+    size_t rule_names_ = 0;
+
+    NodeId lowerNode(const ASTNode* node);
+};
+
+} // namespace bnf_parser_generator
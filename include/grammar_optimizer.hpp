@@ -0,0 +1,95 @@
+#pragma once
+
+#include "bnf_ast.hpp"
+#include "code_generator.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bnf_parser_generator {
+
+/**
+ * Настройки оптимизации грамматики перед генерацией кода
+ */
+struct OptimizerOptions {
+    // Раскрывать ссылки на небольшие нерекурсивные правила (не больше
+    // inline_max_nodes узлов) в месте вызова, если узел правила не виден
+    bool inline_rules = true;
+    size_t inline_max_nodes = 8;
+
+    // Выносить общий префикс соседних альтернатив: A B | A C -> A (B | C)
+    bool left_factor = true;
+
+    // Сливать соседние альтернативы из ASCII-символов и диапазонов символов
+    // внутри токенов в упорядоченные диапазоны: '0'..'9' | 'a' | 'b'..'f' -> '0'..'9' | 'a'..'f'
+    bool fold_char_classes = true;
+
+    // Убирать лишние группы и вложенные узлы: (A B) C -> A B C,
+    // A | (B | C) -> A | B | C, [A?] -> [A]
+    bool flatten = true;
+
+    // Удалять правила, недостижимые из стартового, правила пробелов и keep_rules
+    bool remove_unreachable = true;
+
+    // Правило пробелов и дополнительные правила-токены - как в GeneratorOptions
+    std::string whitespace_rule;
+    std::vector<std::string> token_rules;
+
+    // Узлы синтаксических правил видны пользователю (AST, события). В
+    // распознавателе (false) раскрываются и синтаксические правила
+    bool preserve_tree = true;
+
+    // Узлы правил внутри токенов видны в AST (STRING > ch, ch). Без дерева
+    // (распознаватель, события, --dfa-lexer) ссылки из токена в токен раскрываются
+    bool preserve_token_nodes = true;
+
+    // Правила, которые не раскрываются и не удаляются (например, stream_item)
+    std::vector<std::string> keep_rules;
+
+    // Настройки для грамматики, которую затем генерирует CodeGenerator с options:
+    // правило пробелов, токены, видимость узлов и правила, названные в options
+    static OptimizerOptions forGenerator(const GeneratorOptions& options);
+};
+
+/**
+ * Что изменила оптимизация: число изменений каждого прохода и их описания
+ */
+struct OptimizationReport {
+    size_t inlined = 0;    // Раскрытые ссылки на правила
+    size_t factored = 0;   // Альтернативы, слитые выносом общего префикса
+    size_t folded = 0;     // Альтернативы, слитые в диапазоны символов
+    size_t flattened = 0;  // Убранные группы и вложенные узлы
+    size_t removed = 0;    // Удалённые правила
+    std::vector<std::string> changes;  // По строке на изменение: "inline: digit into hex_digit"
+
+    size_t total() const { return inlined + factored + folded + flattened + removed; }
+};
+
+/**
+ * Оптимизация грамматики между BNFParser::validateGrammar и CodeGenerator::generate.
+ *
+ * Проходы сохраняют разбор PEG, которым работает сгенерированный парсер:
+ * упорядоченный выбор без возврата в уже выбранную альтернативу. Сохраняется
+ * и форма AST: узел создаётся для каждой ссылки на правило, поэтому правило
+ * раскрывается только там, где его узел не виден: внутри токенов (см.
+ * findLexicalRules), если дерево не строится, а в распознавателе - и в
+ * синтаксических правилах.
+ * Правила с параметрами и контекстными действиями не раскрываются, префиксы
+ * с контекстными действиями не выносятся.
+ */
+class GrammarOptimizer {
+public:
+    static OptimizationReport optimize(Grammar& grammar);
+    static OptimizationReport optimize(Grammar& grammar, const OptimizerOptions& options);
+
+    // Мономорфизация правил с параметрами: по правилу на каждую достижимую
+    // комбинацию значений параметров ENUM, BOOLEAN и без типа, которые известны
+    // при генерации. Правило noun[sing] - определения noun, принимающие sing,
+    // по порядку выбора. Параметры INTEGER остаются параметрами правила,
+    // образец-число (spaces[0]) становится проверкой {check(n == 0)}. Вызов
+    // правила без аргументов (в том числе стартовое правило) - выбор по всем
+    // значениям. Неразрешимый вызов - std::runtime_error
+    static std::unique_ptr<Grammar> specialize(const Grammar& grammar);
+};
+
+} // namespace bnf_parser_generator
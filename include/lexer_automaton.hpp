@@ -0,0 +1,63 @@
+#pragma once
+
+#include "bnf_ast.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bnf_parser_generator {
+
+/**
+ * Токен лексера: правая часть правила-токена либо терминал или диапазон
+ * символов из синтаксического правила
+ */
+struct LexerToken {
+    std::string name;                // Имя правила или описание литерала
+    const ASTNode* pattern = nullptr;
+};
+
+/**
+ * Минимизированный ДКА, распознающий все токены грамматики.
+ * Строится по байтам UTF-8: НКА Томпсона, построение подмножеств, минимизация
+ * Мура. Ссылки на другие правила раскрываются; диапазоны символов
+ * декодируются так же, как в сгенерированном парсере (visitCharRange).
+ *
+ * Самое длинное совпадение ДКА совпадает с разбором PEG, только если каждый
+ * выбор и повторение внутри токена определяются следующим байтом, а
+ * FIRST-множества разных токенов не пересекаются. Иначе, а также для
+ * рекурсивных и параметризованных правил, build() бросает std::runtime_error
+ * с описанием причины.
+ */
+class LexerAutomaton {
+public:
+    static constexpr uint32_t DEAD_STATE = 0;
+    static constexpr uint32_t START_STATE = 1;
+    static constexpr int NO_TOKEN = -1;
+
+    static LexerAutomaton build(const Grammar& grammar, const std::vector<LexerToken>& tokens);
+
+    size_t stateCount() const { return accepts_.size(); }
+    size_t classCount() const { return class_count_; }
+
+    // Класс эквивалентности байта: столбец таблицы переходов
+    const std::array<uint8_t, 256>& byteClasses() const { return byte_classes_; }
+    uint32_t next(uint32_t state, size_t byte_class) const {
+        return transitions_[state * class_count_ + byte_class];
+    }
+
+    // Индекс токена, принимаемого в состоянии, или NO_TOKEN
+    int accepts(uint32_t state) const { return accepts_[state]; }
+
+    // Самое длинное совпадение с позиции pos: индекс токена (или NO_TOKEN) и длина
+    int match(std::string_view input, size_t pos, size_t& length) const;
+
+private:
+    std::array<uint8_t, 256> byte_classes_{};
+    size_t class_count_ = 0;
+    std::vector<uint32_t> transitions_;  // stateCount() x classCount()
+    std::vector<int> accepts_;
+};
+
+} // namespace bnf_parser_generator
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstddef>
 #include <cstdint>
 
@@ -34,6 +35,54 @@ bool isValidSequence(const std::string& input, size_t pos, size_t length);
  */
 std::string extractChar(const std::string& input, size_t pos, size_t& charLength);
 
+/**
+ * @brief Символ UTF-8: кодовая точка и длина в байтах
+ */
+struct DecodedChar {
+    uint32_t codepoint;
+    size_t length;
+};
+
+/**
+ * @brief Декодирует UTF-8 символ без выделения памяти
+ * @param input Входная строка
+ * @param pos Позиция начала символа
+ * @return Кодовая точка и длина символа; {0, 0}, если pos в конце строки
+ *
+ * Правила те же, что у extractChar: невалидная последовательность - один
+ * байт, кодовая точка - его значение. Избыточно длинные формы и суррогаты
+ * не отвергаются, строгая проверка - isValid.
+ */
+inline DecodedChar decode(std::string_view input, size_t pos);
+
+// Не-ASCII символ и конец строки: медленный путь decode
+DecodedChar decodeMultibyte(std::string_view input, size_t pos);
+
+inline DecodedChar decode(std::string_view input, size_t pos) {
+    if (pos < input.size() && static_cast<unsigned char>(input[pos]) < 0x80) {
+        return {static_cast<unsigned char>(input[pos]), 1};
+    }
+    return decodeMultibyte(input, pos);
+}
+
+/**
+ * @brief Длина начального отрезка из ASCII-байтов
+ *
+ * Проверяет по 16 байт (SSE2) или по 8 байт за шаг.
+ */
+size_t asciiPrefix(std::string_view input);
+
+/**
+ * @brief Проверяет, что строка - корректный UTF-8 (RFC 3629)
+ * @return false при обрывах последовательностей, лишних байтах продолжения,
+ *         избыточно длинных формах, суррогатах и кодовых точках выше U+10FFFF
+ *
+ * ASCII-отрезки пропускаются блоками. При сборке с SSSE3 (-mssse3,
+ * -march=native) остальные блоки по 16 байт проверяются табличным методом
+ * Кейзера-Лемира, как в simdutf; без него - посимвольно.
+ */
+bool isValid(std::string_view input);
+
 /**
  * @brief Проверяет, является ли UTF-8 символ пробельным (ASCII whitespace)
  * @param utf8Char UTF-8 символ для проверки
@@ -43,12 +92,22 @@ std::string extractChar(const std::string& input, size_t pos, size_t& charLength
  */
 bool isWhitespace(const std::string& utf8Char);
 
+/**
+ * @brief isWhitespace для кодовой точки (результат decode)
+ */
+inline bool isWhitespace(uint32_t codepoint) {
+    return codepoint == ' ' || codepoint == '\t' || codepoint == '\n' || codepoint == '\r';
+}
+
 /**
  * @brief Подсчитывает количество UTF-8 символов (не байтов) в строке
  * @param str Строка для анализа
  * @return Количество UTF-8 символов
+ *
+ * Для корректного UTF-8 - число байтов, не являющихся байтами продолжения,
+ * считается блоками; невалидный вход считается посимвольно по правилам extractChar.
  */
-size_t length(const std::string& str);
+size_t length(std::string_view str);
 
 /**
  * @brief Преобразует Unicode codepoint в UTF-8 строку
@@ -84,6 +143,7 @@ public:
     
     bool atEnd() const;
     std::string current() const;
+    uint32_t codepoint() const;  // Кодовая точка текущего символа, без выделения памяти
     size_t position() const;  // Байтовая позиция
     size_t charIndex() const; // Номер символа
     void next();
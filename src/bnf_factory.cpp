@@ -6,10 +6,8 @@
 namespace bnf_parser_generator {
 
 std::unique_ptr<Grammar> BNFGrammarFactory::fromString(const std::string& bnfText) {
-    BNFLexer lexer(bnfText);
-    auto tokens = lexer.tokenize();
-    
-    BNFParser parser(tokens);
+    // Токены читаются по мере разбора и ссылаются на bnfText
+    BNFParser parser(bnfText);
     auto grammar = parser.parseGrammar();
     
     if (!grammar) {
@@ -33,7 +31,7 @@ std::unique_ptr<Grammar> BNFGrammarFactory::fromString(const std::string& bnfTex
 }
 
 std::unique_ptr<Grammar> BNFGrammarFactory::fromFile(const std::string& filename) {
-    std::ifstream file(filename);
+    std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Cannot open grammar file: " + filename);
     }
@@ -41,7 +39,7 @@ std::unique_ptr<Grammar> BNFGrammarFactory::fromFile(const std::string& filename
     std::string content((std::istreambuf_iterator<char>(file)),
                         std::istreambuf_iterator<char>());
     
-    return fromString(content);
+    return isBinary(content) ? fromBinary(content) : fromString(content);
 }
 
 std::unique_ptr<Grammar> BNFGrammarFactory::createJSONGrammar() {
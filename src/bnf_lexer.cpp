@@ -5,119 +5,84 @@
 
 namespace bnf_parser_generator {
 
-BNFLexer::BNFLexer(const std::string& input) 
+BNFLexer::BNFLexer(std::string_view input) 
     : input_(input), pos_(0), line_(1), column_(1) {}
 
 std::vector<BNFToken> BNFLexer::tokenize() {
     std::vector<BNFToken> tokens;
+    do {
+        tokens.push_back(next());
+    } while (tokens.back().type != TokenType::EOF_TOKEN);
+    return tokens;
+}
+
+BNFToken BNFLexer::next() {
+    skipWhitespace();
     
-    while (pos_ < input_.length()) {
-        skipWhitespace();
-        
-        if (pos_ >= input_.length()) break;
-        
-        char c = peek();
-        
-        // Комментарии
-        if (c == '#') {
-            tokens.push_back(readComment());
-            continue;
-        }
-        
-        // Переводы строк (важны для структуры грамматики)
-        if (c == '\n') {
-            tokens.emplace_back(TokenType::NEWLINE, "\\n", line_, column_);
-            advance();
-            continue;
-        }
-        
-        // Строковые литералы
-        if (c == '"' || c == '\'') {
-            tokens.push_back(readString());
-            continue;
-        }
-        
-        // Проверяем двухсимвольные операторы
-        if (c == ':' && peek(1) == ':' && peek(2) == '=') {
-            tokens.emplace_back(TokenType::DEFINE, "::=", line_, column_);
-            advance(); advance(); advance();
-            continue;
-        }
-        
-        if (c == '.' && peek(1) == '.') {
-            tokens.emplace_back(TokenType::DOT_DOT, "..", line_, column_);
-            advance(); advance();
-            continue;
-        }
-        
-        // Односимвольные операторы
-        switch (c) {
-            case '|':
-                tokens.emplace_back(TokenType::ALTERNATIVE, "|", line_, column_);
-                advance();
-                break;
-            case '(':
-                tokens.emplace_back(TokenType::LEFT_PAREN, "(", line_, column_);
-                advance();
-                break;
-            case ')':
-                tokens.emplace_back(TokenType::RIGHT_PAREN, ")", line_, column_);
-                advance();
-                break;
-            case '[':
-                tokens.emplace_back(TokenType::LEFT_BRACKET, "[", line_, column_);
-                advance();
-                break;
-            case ']':
-                tokens.emplace_back(TokenType::RIGHT_BRACKET, "]", line_, column_);
-                advance();
-                break;
-            case '{':
-                tokens.emplace_back(TokenType::LEFT_BRACE, "{", line_, column_);
-                advance();
-                break;
-            case '}':
-                tokens.emplace_back(TokenType::RIGHT_BRACE, "}", line_, column_);
-                advance();
-                break;
-            case '+':
-                tokens.emplace_back(TokenType::PLUS, "+", line_, column_);
-                advance();
-                break;
-            case '*':
-                tokens.emplace_back(TokenType::STAR, "*", line_, column_);
-                advance();
-                break;
-            case '?':
-                tokens.emplace_back(TokenType::QUESTION, "?", line_, column_);
-                advance();
-                break;
-            case ',':
-                tokens.emplace_back(TokenType::COMMA, ",", line_, column_);
-                advance();
-                break;
-            case ';':
-                tokens.emplace_back(TokenType::SEMICOLON, ";", line_, column_);
-                advance();
-                break;
-            case ':':
-                tokens.emplace_back(TokenType::COLON, ":", line_, column_);
-                advance();
-                break;
-            default:
-                // Идентификаторы и нетерминалы
-                if (isAlpha(c) || c == '_' || c == '<') {
-                    tokens.push_back(readIdentifier());
-                } else {
-                    tokens.emplace_back(TokenType::UNKNOWN, std::string(1, c), line_, column_);
-                    advance();
-                }
-                break;
+    if (pos_ >= input_.length()) {
+        return BNFToken(TokenType::EOF_TOKEN, std::string_view(), line_, column_);
+    }
+    
+    char c = peek();
+    
+    // Комментарии
+    if (c == '#') {
+        return readComment();
+    }
+    
+    // Переводы строк (важны для структуры грамматики)
+    if (c == '\n') {
+        BNFToken token(TokenType::NEWLINE, input_.substr(pos_, 1), line_, column_);
+        advance();
+        return token;
+    }
+    
+    // Строковые литералы
+    if (c == '"' || c == '\'') {
+        return readString();
+    }
+    
+    // Проверяем двухсимвольные операторы
+    if (c == ':' && peek(1) == ':' && peek(2) == '=') {
+        return symbol(TokenType::DEFINE, 3);
+    }
+    
+    if (c == '.' && peek(1) == '.') {
+        return symbol(TokenType::DOT_DOT, 2);
+    }
+    
+    // Целые числа - значения параметров: block[0], spaces[n-1]
+    if (isDigit(c)) {
+        size_t length = 1;
+        while (isDigit(peek(length))) {
+            ++length;
         }
+        return symbol(TokenType::NUMBER, length);
     }
     
-    tokens.emplace_back(TokenType::EOF_TOKEN, "", line_, column_);
-    return tokens;
+    // Односимвольные операторы
+    switch (c) {
+        case '|': return symbol(TokenType::ALTERNATIVE, 1);
+        case '(': return symbol(TokenType::LEFT_PAREN, 1);
+        case ')': return symbol(TokenType::RIGHT_PAREN, 1);
+        case '[': return symbol(TokenType::LEFT_BRACKET, 1);
+        case ']': return symbol(TokenType::RIGHT_BRACKET, 1);
+        case '{': return symbol(TokenType::LEFT_BRACE, 1);
+        case '}': return symbol(TokenType::RIGHT_BRACE, 1);
+        case '+': return symbol(TokenType::PLUS, 1);
+        case '*': return symbol(TokenType::STAR, 1);
+        case '?': return symbol(TokenType::QUESTION, 1);
+        case '^': return symbol(TokenType::CUT, 1);
+        case ',': return symbol(TokenType::COMMA, 1);
+        case ';': return symbol(TokenType::SEMICOLON, 1);
+        case ':': return symbol(TokenType::COLON, 1);
+        default:
+            // Идентификаторы и нетерминалы
+            if (isAlpha(c) || c == '_' || c == '<') {
+                return readIdentifier();
+            }
+            return symbol(TokenType::UNKNOWN, 1);
+    }
 }
 
 char BNFLexer::peek(size_t offset) const {
@@ -140,97 +105,121 @@ char BNFLexer::advance() {
 
 void BNFLexer::skipWhitespace() {
     while (pos_ < input_.length()) {
-        char c = peek();
+        char c = input_[pos_];
         if (c == ' ' || c == '\t' || c == '\r') {
-            advance();
+            ++pos_;
+            ++column_;
         } else {
             break;
         }
     }
 }
 
+// Токен из length символов без переводов строк
+BNFToken BNFLexer::symbol(TokenType type, size_t length) {
+    BNFToken token(type, input_.substr(pos_, length), line_, column_);
+    pos_ += length;
+    column_ += length;
+    return token;
+}
+
 BNFToken BNFLexer::readString() {
     size_t startLine = line_;
     size_t startColumn = column_;
     
     char quote = advance(); // Пропускаем открывающую кавычку
-    std::string value;
+    const size_t begin = pos_;
+    bool hasEscapes = false;
     
     while (pos_ < input_.length()) {
         char c = peek();
         
         if (c == quote) {
-            advance(); // Пропускаем закрывающую кавычку
             break;
         }
         
         if (c == '\\') {
+            hasEscapes = true;
             advance(); // Пропускаем обратный слеш
             char escaped = peek();
             
-            // Обработка Unicode escape-последовательностей \uXXXX или \UXXXXXXXX
+            // Unicode escape-последовательности \uXXXX или \UXXXXXXXX проверяются
+            // здесь, раскрываются в unescape()
             if (escaped == 'u' || escaped == 'U') {
-                bool isExtended = (escaped == 'U');
+                int hexDigits = escaped == 'U' ? 8 : 4;
                 advance(); // Пропускаем 'u' или 'U'
-                
-                // Читаем 4 или 8 шестнадцатеричных цифр
-                int hexDigits = isExtended ? 8 : 4;
-                std::string hexCode;
                 for (int i = 0; i < hexDigits; ++i) {
-                    char hexChar = peek();
-                    if ((hexChar >= '0' && hexChar <= '9') ||
-                        (hexChar >= 'a' && hexChar <= 'f') ||
-                        (hexChar >= 'A' && hexChar <= 'F')) {
-                        hexCode += advance();
-                    } else {
+                    if (!std::isxdigit(static_cast<unsigned char>(peek()))) {
                         throw std::runtime_error("Invalid Unicode escape sequence at line " + 
                                                 std::to_string(line_) + ", column " + 
                                                 std::to_string(column_));
                     }
+                    advance();
                 }
-                
-                // Преобразуем hex в число
-                uint32_t codepoint = 0;
-                for (char hexChar : hexCode) {
-                    codepoint = codepoint * 16;
-                    if (hexChar >= '0' && hexChar <= '9') {
-                        codepoint += (hexChar - '0');
-                    } else if (hexChar >= 'a' && hexChar <= 'f') {
-                        codepoint += (hexChar - 'a' + 10);
-                    } else if (hexChar >= 'A' && hexChar <= 'F') {
-                        codepoint += (hexChar - 'A' + 10);
-                    }
-                }
-                
-                // Используем utf8 утилиты для преобразования codepoint в UTF-8
-                value += utf8::codepointToUtf8(codepoint);
             } else {
                 advance();
-                switch (escaped) {
-                    case 'n': value += '\n'; break;
-                    case 't': value += '\t'; break;
-                    case 'r': value += '\r'; break;
-                    case '\\': value += '\\'; break;
-                    case '"': value += '"'; break;
-                    case '\'': value += '\''; break;
-                    default: 
-                        value += '\\';
-                        value += escaped;
-                        break;
-                }
             }
         } else {
-            value += advance();
+            advance();
         }
     }
     
-    return BNFToken(TokenType::TERMINAL, value, startLine, startColumn);
+    BNFToken token(TokenType::TERMINAL, input_.substr(begin, pos_ - begin), startLine, startColumn);
+    token.has_escapes = hasEscapes;
+    advance(); // Пропускаем закрывающую кавычку
+    return token;
+}
+
+std::string BNFLexer::unescape(std::string_view raw) {
+    std::string value;
+    value.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\') {
+            value += raw[i];
+            continue;
+        }
+        if (++i >= raw.size()) {
+            value += '\\';
+            break;
+        }
+        char escaped = raw[i];
+        if (escaped == 'u' || escaped == 'U') {
+            size_t hexDigits = escaped == 'U' ? 8 : 4;
+            uint32_t codepoint = 0;
+            for (size_t j = 0; j < hexDigits && i + 1 < raw.size(); ++j) {
+                char hexChar = raw[++i];
+                codepoint *= 16;
+                if (hexChar >= '0' && hexChar <= '9') {
+                    codepoint += static_cast<uint32_t>(hexChar - '0');
+                } else if (hexChar >= 'a' && hexChar <= 'f') {
+                    codepoint += static_cast<uint32_t>(hexChar - 'a' + 10);
+                } else if (hexChar >= 'A' && hexChar <= 'F') {
+                    codepoint += static_cast<uint32_t>(hexChar - 'A' + 10);
+                }
+            }
+            // Используем utf8 утилиты для преобразования codepoint в UTF-8
+            value += utf8::codepointToUtf8(codepoint);
+            continue;
+        }
+        switch (escaped) {
+            case 'n': value += '\n'; break;
+            case 't': value += '\t'; break;
+            case 'r': value += '\r'; break;
+            case '\\': value += '\\'; break;
+            case '"': value += '"'; break;
+            case '\'': value += '\''; break;
+            default: 
+                value += '\\';
+                value += escaped;
+                break;
+        }
+    }
+    return value;
 }
 
 BNFToken BNFLexer::readIdentifier() {
     size_t startLine = line_;
     size_t startColumn = column_;
-    std::string value;
     
     // Поддержка нетерминалов в угловых скобках: <identifier>
     bool inBrackets = false;
@@ -239,42 +228,37 @@ BNFToken BNFLexer::readIdentifier() {
         advance(); // Пропускаем <
     }
     
+    // Имя не содержит переводов строк: позиция и колонка сдвигаются вместе
+    const size_t begin = pos_;
     while (pos_ < input_.length()) {
-        char c = peek();
-        
-        if (inBrackets && c == '>') {
-            advance(); // Пропускаем >
-            break;
-        }
-        
-        if (!inBrackets && !isAlnum(c) && c != '_' && c != '-') {
-            break;
-        }
-        
-        if (inBrackets && (isAlnum(c) || c == '_' || c == '-' || c == ' ')) {
-            value += advance();
-        } else if (!inBrackets && (isAlnum(c) || c == '_' || c == '-')) {
-            value += advance();
+        char c = input_[pos_];
+        if (isAlnum(c) || c == '_' || c == '-' || (inBrackets && c == ' ')) {
+            ++pos_;
         } else {
             break;
         }
     }
+    column_ += pos_ - begin;
+    BNFToken token(TokenType::IDENTIFIER, input_.substr(begin, pos_ - begin), startLine, startColumn);
     
-    return BNFToken(TokenType::IDENTIFIER, value, startLine, startColumn);
+    if (inBrackets && peek() == '>') {
+        advance(); // Пропускаем >
+    }
+    return token;
 }
 
 BNFToken BNFLexer::readComment() {
     size_t startLine = line_;
     size_t startColumn = column_;
-    std::string value;
     
     advance(); // Пропускаем #
     
-    while (pos_ < input_.length() && peek() != '\n') {
-        value += advance();
-    }
-    
-    return BNFToken(TokenType::COMMENT, value, startLine, startColumn);
+    size_t end = input_.find('\n', pos_);
+    if (end == std::string_view::npos) end = input_.length();
+    BNFToken token(TokenType::COMMENT, input_.substr(pos_, end - pos_), startLine, startColumn);
+    column_ += end - pos_;
+    pos_ = end;
+    return token;
 }
 
 bool BNFLexer::isAlpha(char c) const {
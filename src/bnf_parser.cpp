@@ -4,12 +4,14 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
-#include <unordered_set>
 
 namespace bnf_parser_generator {
 
-BNFParser::BNFParser(const std::vector<BNFToken>& tokens) 
-    : tokens_(tokens), current_(0) {}
+BNFParser::BNFParser(std::string_view source)
+    : lexer_(std::in_place, source) {}
+
+BNFParser::BNFParser(std::vector<BNFToken> tokens) 
+    : tokens_(std::move(tokens)) {}
 
 std::unique_ptr<Grammar> BNFParser::parseGrammar() {
     auto grammar = std::make_unique<Grammar>();
@@ -59,8 +61,7 @@ std::unique_ptr<ProductionRule> BNFParser::parseRule() {
         return nullptr;
     }
     
-    BNFToken nameToken = advance();
-    std::string ruleName = nameToken.value;
+    std::string ruleName(advance().value);
     
     // Парсим параметры правила (опционально)
     std::vector<RuleParameter> parameters;
@@ -128,14 +129,14 @@ std::unique_ptr<ASTNode> BNFParser::parseSequence() {
     
     std::vector<std::unique_ptr<ASTNode>> elements;
     
-    while (!isAtEnd() && 
-           !check(TokenType::ALTERNATIVE) && 
-           !check(TokenType::RIGHT_PAREN) && 
-           !check(TokenType::RIGHT_BRACKET) && 
-           !check(TokenType::RIGHT_BRACE) &&
-           !check(TokenType::SEMICOLON) &&
-           !check(TokenType::NEWLINE) &&
-           !check(TokenType::EOF_TOKEN)) {
+    for (;;) {
+        const TokenType next = peek().type;
+        if (next == TokenType::EOF_TOKEN || next == TokenType::ALTERNATIVE ||
+            next == TokenType::RIGHT_PAREN || next == TokenType::RIGHT_BRACKET ||
+            next == TokenType::RIGHT_BRACE || next == TokenType::SEMICOLON ||
+            next == TokenType::NEWLINE) {
+            break;
+        }
         
         auto element = parseFactor();
         if (!element) {
@@ -170,6 +171,10 @@ std::unique_ptr<ASTNode> BNFParser::parseFactor() {
     }
     
     // EBNF постфиксные операторы
+    if (primary->is<Cut>() && (check(TokenType::PLUS) || check(TokenType::STAR) || check(TokenType::QUESTION))) {
+        error("Cut '^' cannot be repeated or made optional");
+        return nullptr;
+    }
     if (match(TokenType::PLUS)) {
         return std::make_unique<OneOrMore>(std::move(primary));
     } else if (match(TokenType::STAR)) {
@@ -182,7 +187,7 @@ std::unique_ptr<ASTNode> BNFParser::parseFactor() {
 }
 
 std::unique_ptr<ASTNode> BNFParser::parsePrimary() {
-    // primary ::= IDENTIFIER [params] | TERMINAL | char_range | '(' expression ')' | '[' expression ']' | '{' expression '}'
+    // primary ::= IDENTIFIER [params] | TERMINAL | char_range | '^' | '(' expression ')' | '[' expression ']' | '{' expression '}'
     
     if (check(TokenType::TERMINAL)) {
         return parseTerminalOrCharRange();
@@ -192,6 +197,10 @@ std::unique_ptr<ASTNode> BNFParser::parsePrimary() {
         return parseParameterizedNonTerminal();
     }
     
+    if (match(TokenType::CUT)) {
+        return std::make_unique<Cut>();
+    }
+    
     if (match(TokenType::LEFT_PAREN)) {
         auto expr = parseExpression();
         if (!expr) return nullptr;
@@ -212,19 +221,12 @@ std::unique_ptr<ASTNode> BNFParser::parsePrimary() {
         return std::make_unique<Optional>(std::move(expr));
     }
     
-    if (match(TokenType::LEFT_BRACE)) {
-        // Проверяем, не контекстное ли это действие
-        if (check(TokenType::IDENTIFIER)) {
-            size_t saved = current_;
-            advance();
-            if (check(TokenType::LEFT_PAREN)) {
-                // Это контекстное действие, откатываемся и вызываем соответствующий парсер
-                current_ = saved - 1; // Возвращаемся к '{'
-                return parseContextAction();
-            }
-            // Это не контекстное действие, откатываемся
-            current_ = saved - 1;
+    if (check(TokenType::LEFT_BRACE)) {
+        // Контекстное действие: '{' имя '('
+        if (peek(1).type == TokenType::IDENTIFIER && peek(2).type == TokenType::LEFT_PAREN) {
+            return parseContextAction();
         }
+        advance();
 
         auto expr = parseExpression();
         if (!expr) return nullptr;
@@ -240,17 +242,17 @@ std::unique_ptr<ASTNode> BNFParser::parsePrimary() {
 
 std::unique_ptr<ASTNode> BNFParser::parseTerminalOrCharRange() {
     // Диапазон символов: 'a'..'z'
-    size_t saved = current_;
-    BNFToken start = advance();
+    std::string start = tokenText(advance());
     
-    if (match(TokenType::DOT_DOT) && check(TokenType::TERMINAL)) {
-        BNFToken end = advance();
+    if (check(TokenType::DOT_DOT) && peek(1).type == TokenType::TERMINAL) {
+        advance();
+        std::string end = tokenText(advance());
         
         // Используем UTF-8 утилиты для определения количества символов
-        if (utf8::length(start.value) == 1 && utf8::length(end.value) == 1) {
+        if (utf8::length(start) == 1 && utf8::length(end) == 1) {
             // Извлекаем Unicode codepoints
-            uint32_t start_cp = utf8::utf8ToCodepoint(start.value);
-            uint32_t end_cp = utf8::utf8ToCodepoint(end.value);
+            uint32_t start_cp = utf8::utf8ToCodepoint(start);
+            uint32_t end_cp = utf8::utf8ToCodepoint(end);
             
             if (start_cp == 0 || end_cp == 0) {
                 error("Invalid UTF-8 character in range");
@@ -264,10 +266,8 @@ std::unique_ptr<ASTNode> BNFParser::parseTerminalOrCharRange() {
             return nullptr;
         }
     } else {
-        // Откат - это был обычный терминал
-        current_ = saved;
-        BNFToken token = advance();
-        return std::make_unique<Terminal>(token.value);
+        // Обычный терминал
+        return std::make_unique<Terminal>(start);
     }
 }
 
@@ -279,107 +279,155 @@ bool BNFParser::match(TokenType type) {
     return false;
 }
 
-bool BNFParser::check(TokenType type) const {
-    if (isAtEnd()) return false;
-    return peek().type == type;
+bool BNFParser::check(TokenType type) {
+    // EOF_TOKEN не проверяется: в конце текста check() всегда ложен
+    return type != TokenType::EOF_TOKEN && peek().type == type;
+}
+
+const BNFToken& BNFParser::advance() {
+    // В конце текста остаётся текущим EOF_TOKEN
+    previous_ = peek();
+    if (!isAtEnd()) {
+        head_ = (head_ + 1) % kLookahead;
+        --buffered_;
+    }
+    return previous_;
 }
 
-BNFToken BNFParser::advance() {
-    if (!isAtEnd()) current_++;
-    return tokens_[current_ - 1];
+void BNFParser::fill(size_t ahead) {
+    while (buffered_ <= ahead) {
+        window_[(head_ + buffered_) % kLookahead] = fetch();
+        ++buffered_;
+    }
 }
 
-BNFToken BNFParser::peek() const {
-    return tokens_[current_];
+BNFToken BNFParser::fetch() {
+    if (lexer_) {
+        return lexer_->next();
+    }
+    if (next_token_ < tokens_.size()) {
+        return tokens_[next_token_++];
+    }
+    // Список без EOF_TOKEN в конце
+    return tokens_.empty() ? BNFToken() : BNFToken(TokenType::EOF_TOKEN, std::string_view(),
+                                                   tokens_.back().line, tokens_.back().column);
 }
 
-bool BNFParser::isAtEnd() const {
-    return current_ >= tokens_.size() || peek().type == TokenType::EOF_TOKEN;
+bool BNFParser::isAtEnd() {
+    return peek().type == TokenType::EOF_TOKEN;
+}
+
+std::string BNFParser::tokenText(const BNFToken& token) {
+    return token.has_escapes ? BNFLexer::unescape(token.value) : std::string(token.value);
 }
 
 void BNFParser::error(const std::string& message) {
-    BNFToken token = peek();
+    const BNFToken& token = peek();
     error_ = "Parse error at line " + std::to_string(token.line) + 
              ", column " + std::to_string(token.column) + ": " + message;
 }
 
 // Валидация грамматики согласно классическим правилам BNF
 BNFParser::ValidationResult BNFParser::validateGrammar(const Grammar& grammar) {
+    if (grammar.rules.empty()) {
+        ValidationResult result;
+        result.isValid = false;
+        result.errors.push_back("Grammar is empty");
+        return result;
+    }
+    return validateGrammar(GrammarIR::lower(grammar));
+}
+
+BNFParser::ValidationResult BNFParser::validateGrammar(const GrammarIR& ir) {
     ValidationResult result;
     result.isValid = true;
     
-    if (grammar.rules.empty()) {
+    if (ir.rules().empty()) {
         result.errors.push_back("Grammar is empty");
         result.isValid = false;
         return result;
     }
     
-    // Собираем все нетерминалы и терминалы
-    std::unordered_set<std::string> definedNonTerminals;
-    std::unordered_set<std::string> usedNonTerminals;
-    std::unordered_set<std::string> terminals;
+    // Имена правил - id 0..k-1, остальные имена встречаются только в ссылках
+    const size_t defined = ir.ruleNameCount();
     
-    for (const auto& rule : grammar.rules) {
-        definedNonTerminals.insert(rule->leftSide);
-        collectSymbols(rule->rightSide.get(), usedNonTerminals, terminals);
+    // Проверка 1: Все используемые нетерминалы должны быть определены
+    std::vector<bool> reported(ir.symbols().size(), false);
+    std::vector<SymbolId> undefined;
+    for (NodeId node = 0; node < ir.nodeCount(); ++node) {
+        const IRNode& n = ir.node(node);
+        if (n.kind == NodeKind::NON_TERMINAL && n.rule == NO_ID && !reported[n.symbol]) {
+            reported[n.symbol] = true;
+            undefined.push_back(n.symbol);
+        }
+    }
+    for (SymbolId name : undefined) {
+        result.errors.push_back("Undefined non-terminal: " + ir.symbols().name(name));
+        result.isValid = false;
     }
     
-    // Проверка 1: Все используемые нетерминалы должны быть определены
-    for (const std::string& nonTerminal : usedNonTerminals) {
-        if (definedNonTerminals.find(nonTerminal) == definedNonTerminals.end()) {
-            result.errors.push_back("Undefined non-terminal: " + nonTerminal);
-            result.isValid = false;
+    // Ссылки правил на имена правил
+    std::vector<std::vector<SymbolId>> references(defined);
+    std::vector<std::vector<RuleId>> users(defined);
+    for (RuleId rule = 0; rule < ir.rules().size(); ++rule) {
+        for (NodeId node = ir.rule(rule).body; node < ir.bodyEnd(rule); ++node) {
+            const IRNode& n = ir.node(node);
+            if (n.kind == NodeKind::NON_TERMINAL && n.rule != NO_ID) {
+                references[ir.rule(rule).name].push_back(n.symbol);
+                if (users[n.symbol].empty() || users[n.symbol].back() != rule) {
+                    users[n.symbol].push_back(rule);
+                }
+            }
         }
     }
     
     // Проверка 2: Все определённые нетерминалы должны быть достижимы из стартового символа
-    std::unordered_set<std::string> reachable;
-    std::vector<std::string> toProcess = {grammar.startSymbol};
-    
+    std::vector<bool> reachable(defined, false);
+    std::vector<SymbolId> toProcess;
+    if (ir.startRule() != NO_ID) {
+        toProcess.push_back(ir.rule(ir.startRule()).name);
+        reachable[toProcess.back()] = true;
+    }
     while (!toProcess.empty()) {
-        std::string current = toProcess.back();
+        SymbolId current = toProcess.back();
         toProcess.pop_back();
-        
-        if (reachable.find(current) != reachable.end()) continue;
-        reachable.insert(current);
-        
-        const ProductionRule* rule = grammar.findRule(current);
-        if (rule) {
-            std::unordered_set<std::string> used, terms;
-            collectSymbols(rule->rightSide.get(), used, terms);
-            for (const std::string& nt : used) {
-                if (reachable.find(nt) == reachable.end()) {
-                    toProcess.push_back(nt);
-                }
+        for (SymbolId nt : references[current]) {
+            if (!reachable[nt]) {
+                reachable[nt] = true;
+                toProcess.push_back(nt);
             }
         }
     }
     
-    for (const std::string& nonTerminal : definedNonTerminals) {
-        if (reachable.find(nonTerminal) == reachable.end()) {
-            result.warnings.push_back("Unreachable non-terminal: " + nonTerminal);
+    for (SymbolId name = 0; name < defined; ++name) {
+        if (!reachable[name]) {
+            result.warnings.push_back("Unreachable non-terminal: " + ir.symbols().name(name));
         }
     }
     
-    // Проверка 3: Все нетерминалы должны быть продуктивными (выводить терминальные строки)
-    std::unordered_set<std::string> productive;
-    bool changed = true;
-    
-    while (changed) {
-        changed = false;
-        for (const auto& rule : grammar.rules) {
-            if (productive.find(rule->leftSide) == productive.end()) {
-                if (isProductive(rule->rightSide.get(), productive)) {
-                    productive.insert(rule->leftSide);
-                    changed = true;
-                }
+    // Проверка 3: Все нетерминалы должны быть продуктивными (выводить терминальные строки).
+    // Правило перепроверяется, только когда продуктивным стало правило, на которое оно ссылается
+    std::vector<bool> productive(defined, false);
+    std::vector<RuleId> queue;
+    for (RuleId rule = static_cast<RuleId>(ir.rules().size()); rule-- > 0;) {
+        queue.push_back(rule);
+    }
+    while (!queue.empty()) {
+        RuleId rule = queue.back();
+        queue.pop_back();
+        SymbolId name = ir.rule(rule).name;
+        if (productive[name] || !isProductive(ir, ir.rule(rule).body, productive)) continue;
+        productive[name] = true;
+        for (RuleId user : users[name]) {
+            if (!productive[ir.rule(user).name]) {
+                queue.push_back(user);
             }
         }
     }
     
-    for (const std::string& nonTerminal : definedNonTerminals) {
-        if (productive.find(nonTerminal) == productive.end()) {
-            result.errors.push_back("Non-productive non-terminal: " + nonTerminal);
+    for (SymbolId name = 0; name < defined; ++name) {
+        if (!productive[name]) {
+            result.errors.push_back("Non-productive non-terminal: " + ir.symbols().name(name));
             result.isValid = false;
         }
     }
@@ -387,66 +435,44 @@ BNFParser::ValidationResult BNFParser::validateGrammar(const Grammar& grammar) {
     return result;
 }
 
-void BNFParser::collectSymbols(const ASTNode* node, 
-                               std::unordered_set<std::string>& nonTerminals,
-                               std::unordered_set<std::string>& terminals) {
-    if (const auto* nt = dynamic_cast<const NonTerminal*>(node)) {
-        nonTerminals.insert(nt->name);
-    } else if (const auto* t = dynamic_cast<const Terminal*>(node)) {
-        terminals.insert(t->value);
-    } else if (const auto* alt = dynamic_cast<const Alternative*>(node)) {
-        for (const auto& choice : alt->choices) {
-            collectSymbols(choice.get(), nonTerminals, terminals);
-        }
-    } else if (const auto* seq = dynamic_cast<const Sequence*>(node)) {
-        for (const auto& element : seq->elements) {
-            collectSymbols(element.get(), nonTerminals, terminals);
-        }
-    } else if (const auto* group = dynamic_cast<const Group*>(node)) {
-        collectSymbols(group->content.get(), nonTerminals, terminals);
-    } else if (const auto* opt = dynamic_cast<const Optional*>(node)) {
-        collectSymbols(opt->content.get(), nonTerminals, terminals);
-    } else if (const auto* zeroMore = dynamic_cast<const ZeroOrMore*>(node)) {
-        collectSymbols(zeroMore->content.get(), nonTerminals, terminals);
-    } else if (const auto* oneMore = dynamic_cast<const OneOrMore*>(node)) {
-        collectSymbols(oneMore->content.get(), nonTerminals, terminals);
-    }
+GrammarAnalysis BNFParser::analyzeGrammar(const Grammar& grammar) {
+    return GrammarAnalysis::analyze(grammar);
 }
 
-bool BNFParser::isProductive(const ASTNode* node, 
-                            const std::unordered_set<std::string>& productive) {
-    if (const auto* nt = dynamic_cast<const NonTerminal*>(node)) {
-        return productive.find(nt->name) != productive.end();
-    } else if (dynamic_cast<const Terminal*>(node) || dynamic_cast<const CharRange*>(node)) {
-        return true; // Терминалы всегда продуктивны
-    } else if (const auto* alt = dynamic_cast<const Alternative*>(node)) {
-        // Альтернатива продуктивна, если хотя бы один выбор продуктивен
-        for (const auto& choice : alt->choices) {
-            if (isProductive(choice.get(), productive)) {
-                return true;
+bool BNFParser::isProductive(const GrammarIR& ir, NodeId node, const std::vector<bool>& productive) {
+    const IRNode& n = ir.node(node);
+    switch (n.kind) {
+        case NodeKind::NON_TERMINAL:
+            return n.rule != NO_ID && productive[n.symbol];
+        case NodeKind::TERMINAL:
+        case NodeKind::CHAR_RANGE:
+            return true; // Терминалы всегда продуктивны
+        case NodeKind::ALTERNATIVE:
+            // Альтернатива продуктивна, если хотя бы один выбор продуктивен
+            for (const NodeId* c = ir.childrenBegin(node); c != ir.childrenEnd(node); ++c) {
+                if (isProductive(ir, *c, productive)) {
+                    return true;
+                }
             }
-        }
-        return false;
-    } else if (const auto* seq = dynamic_cast<const Sequence*>(node)) {
-        // Последовательность продуктивна, если все элементы продуктивны
-        for (const auto& element : seq->elements) {
-            if (!isProductive(element.get(), productive)) {
-                return false;
+            return false;
+        case NodeKind::SEQUENCE:
+            // Последовательность продуктивна, если все элементы продуктивны
+            for (const NodeId* e = ir.childrenBegin(node); e != ir.childrenEnd(node); ++e) {
+                if (!isProductive(ir, *e, productive)) {
+                    return false;
+                }
             }
-        }
-        return true;
-    } else if (const auto* group = dynamic_cast<const Group*>(node)) {
-        return isProductive(group->content.get(), productive);
-    } else if (const auto* opt = dynamic_cast<const Optional*>(node)) {
-        (void)opt; // Подавляем предупреждение о неиспользуемой переменной
-        return true; // Опциональные элементы всегда продуктивны (могут быть пустыми)
-    } else if (const auto* zeroMore = dynamic_cast<const ZeroOrMore*>(node)) {
-        (void)zeroMore; // Подавляем предупреждение о неиспользуемой переменной
-        return true; // Повторение 0+ всегда продуктивно (может быть пустым)
-    } else if (const auto* oneMore = dynamic_cast<const OneOrMore*>(node)) {
-        return isProductive(oneMore->content.get(), productive);
+            return true;
+        case NodeKind::GROUP:
+        case NodeKind::ONE_OR_MORE:
+            return isProductive(ir, ir.child(node), productive);
+        case NodeKind::OPTIONAL:
+        case NodeKind::ZERO_OR_MORE:
+            return true; // Опциональные элементы и повторение 0+ могут быть пустыми
+        case NodeKind::CONTEXT_ACTION:
+        case NodeKind::CUT:
+            return true; // Действие и отсечение не потребляют вход: совпадают с пустой строкой
     }
-    
     return false;
 }
 
@@ -480,12 +506,16 @@ std::vector<RuleParameter> BNFParser::parseRuleParameters() {
 
 RuleParameter BNFParser::parseRuleParameter() {
     // param:type или param:enum{val1,val2} или просто param
+    // Целое число - образец для параметра INTEGER: spaces[0] ::= ""
+    if (check(TokenType::NUMBER)) {
+        return RuleParameter(std::string(advance().value), ParameterType::INTEGER);
+    }
     if (!check(TokenType::IDENTIFIER)) {
         error("Expected parameter name");
         return RuleParameter("", ParameterType::STRING);
     }
     
-    std::string paramName = advance().value;
+    std::string paramName(advance().value);
     
     // Если есть двоеточие, парсим тип
     if (match(TokenType::COLON)) {
@@ -511,7 +541,7 @@ ParameterType BNFParser::parseParameterType() {
         return ParameterType::STRING;
     }
     
-    std::string typeName = advance().value;
+    std::string typeName(advance().value);
     
     if (typeName == "int" || typeName == "integer") {
         return ParameterType::INTEGER;
@@ -542,7 +572,7 @@ std::vector<std::string> BNFParser::parseEnumValues() {
             error("Expected enum value");
             return values;
         }
-        values.push_back(advance().value);
+        values.emplace_back(advance().value);
         
         // Парсим остальные значения
         while (match(TokenType::COMMA)) {
@@ -550,7 +580,7 @@ std::vector<std::string> BNFParser::parseEnumValues() {
                 error("Expected enum value after ','");
                 break;
             }
-            values.push_back(advance().value);
+            values.emplace_back(advance().value);
         }
     }
     
@@ -572,19 +602,17 @@ std::vector<std::string> BNFParser::parseParameterValues() {
     
     // Парсим первое значение
     if (!check(TokenType::RIGHT_BRACKET)) {
-        if (!check(TokenType::IDENTIFIER)) {
+        if (!parseParameterValue(values)) {
             error("Expected parameter value");
             return values;
         }
-        values.push_back(advance().value);
         
         // Парсим остальные значения
         while (match(TokenType::COMMA)) {
-            if (!check(TokenType::IDENTIFIER)) {
+            if (!parseParameterValue(values)) {
                 error("Expected parameter value after ','");
                 break;
             }
-            values.push_back(advance().value);
         }
     }
     
@@ -595,6 +623,26 @@ std::vector<std::string> BNFParser::parseParameterValues() {
     return values;
 }
 
+bool BNFParser::parseParameterValue(std::vector<std::string>& values) {
+    // Имя, целое число или параметр со сдвигом. n-1 лексер читает одним
+    // именем ('-' допустим в именах), n+1 - именем, '+' и числом
+    if (check(TokenType::NUMBER)) {
+        values.emplace_back(advance().value);
+        return true;
+    }
+    if (!check(TokenType::IDENTIFIER)) {
+        return false;
+    }
+    std::string value(advance().value);
+    if (check(TokenType::PLUS) && peek(1).type == TokenType::NUMBER) {
+        advance();
+        value += "+";
+        value += advance().value;
+    }
+    values.push_back(std::move(value));
+    return true;
+}
+
 std::unique_ptr<ContextAction> BNFParser::parseContextAction() {
     // {store(name, value)} | {lookup(name)} | {check(condition)}
     if (!match(TokenType::LEFT_BRACE)) {
@@ -607,7 +655,7 @@ std::unique_ptr<ContextAction> BNFParser::parseContextAction() {
         return nullptr;
     }
     
-    std::string actionName = advance().value;
+    std::string actionName(advance().value);
     std::vector<std::string> arguments;
     
     if (!match(TokenType::LEFT_PAREN)) {
@@ -621,14 +669,14 @@ std::unique_ptr<ContextAction> BNFParser::parseContextAction() {
             error("Expected argument");
             return nullptr;
         }
-        arguments.push_back(advance().value);
+        arguments.emplace_back(advance().value);
         
         while (match(TokenType::COMMA)) {
             if (!check(TokenType::IDENTIFIER)) {
                 error("Expected argument after ','");
                 break;
             }
-            arguments.push_back(advance().value);
+            arguments.emplace_back(advance().value);
         }
     }
     
@@ -665,7 +713,7 @@ std::unique_ptr<NonTerminal> BNFParser::parseParameterizedNonTerminal() {
         return nullptr;
     }
     
-    std::string name = advance().value;
+    std::string name(advance().value);
     
     // Проверяем, есть ли параметры
     if (check(TokenType::LEFT_BRACKET)) {
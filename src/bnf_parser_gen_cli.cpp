@@ -1,10 +1,17 @@
 #include "bnf_parser.hpp"
 #include "code_generator.hpp"
+#include "corpus_generator.hpp"
+#include "generation_cache.hpp"
+#include "grammar_optimizer.hpp"
 #include "version.hpp"
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <optional>
 #include <cstring>
 #include <cctype>
+#include <cstdlib>
+#include <sstream>
 
 using namespace bnf_parser_generator;
 
@@ -22,18 +29,50 @@ struct CliOptions {
     bool show_version = false;
     bool generate_executable = false;
     bool compile = false;
+    bool memoize = false;
+    std::vector<std::string> memoize_rules;
+    std::vector<std::string> no_memoize_rules;
+    bool arena = false;
+    bool first_set_dispatch = true;
+    bool analyze = false;
+    bool lazy_positions = false;
+    bool char_class_scanners = true;
+    bool literal_tries = true;
+    bool dfa_lexer = false;
+    bool streaming = false;
+    bool incremental = false;
+    bool parallel = false;
+    bool recognizer = false;
+    bool events = false;
+    bool profile = false;
+    bool profile_timing = false;
+    bool explicit_stack = false;
+    size_t split_units = 0;
+    bool diagnostics = false;
+    bool optimize = true;
+    bool inline_rules = true;
+    bool left_factor = true;
+    bool fold_char_classes = true;
+    bool flatten = true;
+    bool remove_unreachable = true;
+    std::string stream_item;
+    std::string whitespace_rule;
+    std::vector<std::string> token_rules;
+    std::string cache_dir;
+    std::string save_binary;
 };
 
 void printHelp(const char* program_name) {
     std::cout << "BNF Parser Generator - Generate standalone parsers from BNF/EBNF grammars\n";
     std::cout << "\nUsage: " << program_name << " [options]\n";
+    std::cout << "       " << program_name << " corpus -i FILE [corpus options]  (see corpus --help)\n";
     std::cout << "\nOptions:\n";
     std::cout << "  -i, --input FILE       Input BNF/EBNF grammar file (required)\n";
     std::cout << "  -o, --output FILE      Output parser file name (without path)\n";
     std::cout << "  --output-dir DIR       Output directory for generated files\n";
     std::cout << "                         Default: generated/<bnf_name>/<format>/\n";
     std::cout << "                         For executables: generated/<bnf_name>/exec/<debug|release>/\n";
-    std::cout << "  -l, --language LANG    Target language: cpp, dart, java, clojure (default: cpp)\n";
+    std::cout << "  -l, --language LANG    Target language: cpp, cpp-templates (default: cpp)\n";
     std::cout << "  -n, --name NAME        Parser class name (default: GeneratedParser)\n";
     std::cout << "  --namespace NAME       Namespace/package name (optional)\n";
     std::cout << "  -f, --format FORMAT    Output format (default: source-only)\n";
@@ -46,6 +85,39 @@ void printHelp(const char* program_name) {
     std::cout << "  -v, --verbose          Verbose output\n";
     std::cout << "  -d, --debug            Generate debug code\n";
     std::cout << "  -e, --executable       Generate standalone executable (with main.cpp)\n";
+    std::cout << "  --memoize              Packrat memoization: each rule runs at most once per offset\n";
+    std::cout << "                         (leaf token rules are skipped unless listed explicitly)\n";
+    std::cout << "  --memoize-rule RULE    Always memoize RULE (repeatable)\n";
+    std::cout << "  --no-memoize-rule RULE Never memoize RULE (repeatable)\n";
+    std::cout << "  --arena                Allocate AST nodes from a reusable arena owned by the parser\n";
+    std::cout << "  --no-dispatch          Try alternatives in order instead of FIRST-set dispatch\n";
+    std::cout << "  --lazy-positions       Track byte offsets only; line/column computed on demand\n";
+    std::cout << "  --no-class-scan        Match repeated character classes one character at a time\n";
+    std::cout << "  --no-literal-trie      Match literal-only alternatives one literal at a time\n";
+    std::cout << "  --dfa-lexer            Tokenize with a generated DFA lexer, then parse the tokens\n";
+    std::cout << "  --streaming            Generate feed()/finish() for input that arrives in chunks\n";
+    std::cout << "  --stream-item RULE     Emit each parsed RULE while streaming (default: start rule)\n";
+    std::cout << "  --incremental          Generate reparse() that reuses subtrees unaffected by an edit\n";
+    std::cout << "  --parallel             Generate parseParallel() for start rules of the form item*\n";
+    std::cout << "  --recognizer           Only check the input: no AST, parse() returns success\n";
+    std::cout << "  --events               No AST: report rules and tokens to a handler (SAX style)\n";
+    std::cout << "  --profile              Count calls, failures and backtracked bytes per rule\n";
+    std::cout << "  --profile-timing       --profile plus inclusive/exclusive cycles per rule\n";
+    std::cout << "  --explicit-stack       Run rules on a heap stack: nesting depth is not limited by the C++ stack\n";
+    std::cout << "  --split N              Emit a header plus N .cpp files with the rule functions\n";
+    std::cout << "                         (mutually recursive rules share a file)\n";
+    std::cout << "  --diagnostics          Report the farthest failure and what was expected there\n";
+    std::cout << "  --no-optimize          Generate from the grammar as written (no optimizer passes)\n";
+    std::cout << "  --no-inline            Keep calls to small rules whose nodes are not visible\n";
+    std::cout << "  --no-left-factor       Keep shared prefixes of adjacent alternatives\n";
+    std::cout << "  --no-fold-classes      Keep character alternatives in token rules unmerged\n";
+    std::cout << "  --no-flatten           Keep redundant groups and nested sequences/alternatives\n";
+    std::cout << "  --no-remove-unreachable Keep rules unreachable from the start rule\n";
+    std::cout << "  --whitespace-rule RULE Rule skipped between tokens (default: WHITESPACE or TRIVIA)\n";
+    std::cout << "  --token-rule RULE      Treat RULE as a token: no whitespace skipped inside (repeatable)\n";
+    std::cout << "  --analyze              Print nullable/FIRST/FOLLOW sets and LL(1) conflicts per rule\n";
+    std::cout << "  --cache-dir DIR        Reuse generated code keyed by grammar, options and tool version\n";
+    std::cout << "  --save-binary FILE     Save the parsed grammar in binary form (load it with -i)\n";
     std::cout << "  -h, --help             Show this help message\n";
     std::cout << "  --version              Show version information\n";
     std::cout << "\nExamples:\n";
@@ -105,6 +177,75 @@ bool parseArgs(int argc, char* argv[], CliOptions& options) {
             options.debug_mode = true;
         } else if (arg == "-e" || arg == "--executable") {
             options.generate_executable = true;
+        } else if (arg == "--memoize") {
+            options.memoize = true;
+        } else if (arg == "--memoize-rule" && i + 1 < argc) {
+            options.memoize_rules.push_back(argv[++i]);
+        } else if (arg == "--no-memoize-rule" && i + 1 < argc) {
+            options.no_memoize_rules.push_back(argv[++i]);
+        } else if (arg == "--arena") {
+            options.arena = true;
+        } else if (arg == "--no-dispatch") {
+            options.first_set_dispatch = false;
+        } else if (arg == "--analyze") {
+            options.analyze = true;
+        } else if (arg == "--lazy-positions") {
+            options.lazy_positions = true;
+        } else if (arg == "--no-class-scan") {
+            options.char_class_scanners = false;
+        } else if (arg == "--no-literal-trie") {
+            options.literal_tries = false;
+        } else if (arg == "--dfa-lexer") {
+            options.dfa_lexer = true;
+        } else if (arg == "--streaming") {
+            options.streaming = true;
+        } else if (arg == "--stream-item" && i + 1 < argc) {
+            options.streaming = true;
+            options.stream_item = argv[++i];
+        } else if (arg == "--incremental") {
+            options.incremental = true;
+        } else if (arg == "--parallel") {
+            options.parallel = true;
+        } else if (arg == "--recognizer") {
+            options.recognizer = true;
+        } else if (arg == "--events") {
+            options.events = true;
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--profile-timing") {
+            options.profile = true;
+            options.profile_timing = true;
+        } else if (arg == "--explicit-stack") {
+            options.explicit_stack = true;
+        } else if (arg == "--split" && i + 1 < argc) {
+            char* end = nullptr;
+            options.split_units = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0') {
+                std::cerr << "Invalid --split value: " << argv[i] << "\n";
+                return false;
+            }
+        } else if (arg == "--diagnostics") {
+            options.diagnostics = true;
+        } else if (arg == "--no-optimize") {
+            options.optimize = false;
+        } else if (arg == "--no-inline") {
+            options.inline_rules = false;
+        } else if (arg == "--no-left-factor") {
+            options.left_factor = false;
+        } else if (arg == "--no-fold-classes") {
+            options.fold_char_classes = false;
+        } else if (arg == "--no-flatten") {
+            options.flatten = false;
+        } else if (arg == "--no-remove-unreachable") {
+            options.remove_unreachable = false;
+        } else if (arg == "--whitespace-rule" && i + 1 < argc) {
+            options.whitespace_rule = argv[++i];
+        } else if (arg == "--token-rule" && i + 1 < argc) {
+            options.token_rules.push_back(argv[++i]);
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            options.cache_dir = argv[++i];
+        } else if (arg == "--save-binary" && i + 1 < argc) {
+            options.save_binary = argv[++i];
         } else {
             std::cerr << "Unknown option: " << arg << "\n";
             return false;
@@ -114,6 +255,18 @@ bool parseArgs(int argc, char* argv[], CliOptions& options) {
     return true;
 }
 
+// Проходы оптимизатора из командной строки: входят в ключ кэша генерации
+std::string optimizerSettings(const CliOptions& options) {
+    if (!options.optimize) return "no-optimize";
+    std::string settings = "optimize";
+    if (!options.inline_rules) settings += ",no-inline";
+    if (!options.left_factor) settings += ",no-left-factor";
+    if (!options.fold_char_classes) settings += ",no-fold-classes";
+    if (!options.flatten) settings += ",no-flatten";
+    if (!options.remove_unreachable) settings += ",no-remove-unreachable";
+    return settings;
+}
+
 bool validateOptions(const CliOptions& options) {
     if (options.input_file.empty()) {
         std::cerr << "Error: Input file is required\n";
@@ -136,7 +289,168 @@ bool validateOptions(const CliOptions& options) {
     return true;
 }
 
+void printCorpusHelp(const char* program_name) {
+    std::cout << "Generate random sentences of a grammar, e.g. inputs for load tests\n";
+    std::cout << "\nUsage: " << program_name << " corpus -i FILE [options]\n";
+    std::cout << "\nOptions:\n";
+    std::cout << "  -i, --input FILE       Grammar file: BNF/EBNF text or binary form (required)\n";
+    std::cout << "  -o, --output FILE      Write the corpus to FILE (default: stdout)\n";
+    std::cout << "  --size SIZE            Target size in bytes, K, M or G suffix (default: 1M)\n";
+    std::cout << "  --seed N               Random seed; the same seed gives the same corpus (default: 1)\n";
+    std::cout << "  --max-depth N          Rule nesting depth before the shortest completions (default: 24)\n";
+    std::cout << "  --max-repeat N         Most repetitions of { } and X+ (default: 4)\n";
+    std::cout << "  --optional P           Probability of taking [ ] (default: 0.5)\n";
+    std::cout << "  --weight RULE=W1,W2    Weights of the top-level alternatives of RULE (repeatable)\n";
+    std::cout << "  --unicode RATIO        Share of non-ASCII characters from wide ranges (default: 0)\n";
+    std::cout << "  --validate             Re-generate items the bytecode interpreter rejects\n";
+    std::cout << "  --whitespace-rule RULE Rule skipped between tokens (default: WHITESPACE or TRIVIA)\n";
+    std::cout << "  --token-rule RULE      Treat RULE as a token (repeatable)\n";
+    std::cout << "  -v, --verbose          Print corpus statistics to stderr\n";
+    std::cout << "\nExample:\n";
+    std::cout << "  " << program_name << " corpus -i grammars/json.bnf --size 256M --max-depth 12 -o big.json\n";
+}
+
+// Размер с суффиксом K, M или G (десятичные, как MB в отчётах бенчмарков)
+bool parseSize(const std::string& text, size_t& bytes) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    std::string suffix = end;
+    double scale = 1.0;
+    if (suffix == "K" || suffix == "k") scale = 1e3;
+    else if (suffix == "M" || suffix == "m") scale = 1e6;
+    else if (suffix == "G" || suffix == "g") scale = 1e9;
+    else if (!suffix.empty()) return false;
+    if (end == text.c_str() || value < 0) return false;
+    bytes = static_cast<size_t>(value * scale);
+    return true;
+}
+
+// Подкоманда corpus: argv[0] - имя программы, argv[1] - "corpus"
+int runCorpus(int argc, char* argv[]) {
+    CorpusOptions corpus;
+    std::string input_file;
+    std::string output_file;
+    bool verbose = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        char* end = nullptr;
+        if (arg == "-h" || arg == "--help") {
+            printCorpusHelp(argv[0]);
+            return 0;
+        } else if ((arg == "-i" || arg == "--input") && has_value) {
+            input_file = argv[++i];
+        } else if ((arg == "-o" || arg == "--output") && has_value) {
+            output_file = argv[++i];
+        } else if (arg == "--size" && has_value) {
+            if (!parseSize(argv[++i], corpus.target_bytes)) {
+                std::cerr << "Invalid --size value: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if ((arg == "--seed" || arg == "--max-depth" || arg == "--max-repeat") && has_value) {
+            unsigned long long value = std::strtoull(argv[++i], &end, 10);
+            if (*end != '\0') {
+                std::cerr << "Invalid " << arg << " value: " << argv[i] << "\n";
+                return 1;
+            }
+            if (arg == "--seed") corpus.seed = value;
+            else if (arg == "--max-depth") corpus.max_depth = value;
+            else corpus.max_repeat = value;
+        } else if ((arg == "--optional" || arg == "--unicode") && has_value) {
+            double value = std::strtod(argv[++i], &end);
+            if (*end != '\0' || value < 0.0 || value > 1.0) {
+                std::cerr << "Invalid " << arg << " value (0..1): " << argv[i] << "\n";
+                return 1;
+            }
+            (arg == "--optional" ? corpus.optional_probability : corpus.unicode_ratio) = value;
+        } else if (arg == "--weight" && has_value) {
+            std::string spec = argv[++i];
+            size_t eq = spec.find('=');
+            if (eq == std::string::npos || eq == 0) {
+                std::cerr << "Invalid --weight value (RULE=W1,W2,...): " << spec << "\n";
+                return 1;
+            }
+            std::vector<double> weights;
+            std::stringstream list(spec.substr(eq + 1));
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                double weight = std::strtod(item.c_str(), &end);
+                if (item.empty() || *end != '\0' || weight < 0.0) {
+                    std::cerr << "Invalid weight in --weight " << spec << "\n";
+                    return 1;
+                }
+                weights.push_back(weight);
+            }
+            corpus.weights[spec.substr(0, eq)] = weights;
+        } else if (arg == "--validate") {
+            corpus.validate = true;
+        } else if (arg == "--whitespace-rule" && has_value) {
+            corpus.whitespace_rule = argv[++i];
+        } else if (arg == "--token-rule" && has_value) {
+            corpus.token_rules.push_back(argv[++i]);
+        } else if (arg == "-v" || arg == "--verbose") {
+            verbose = true;
+        } else {
+            std::cerr << "Unknown corpus option: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (input_file.empty()) {
+        std::cerr << "Error: Input file is required\n";
+        std::cerr << "Use corpus --help for usage information\n";
+        return 1;
+    }
+
+    try {
+        auto grammar = BNFGrammarFactory::fromFile(input_file);
+        if (!grammar) {
+            std::cerr << "Error: Failed to parse grammar file: " << input_file << "\n";
+            return 1;
+        }
+        auto validation = BNFParser::validateGrammar(*grammar);
+        if (!validation.isValid) {
+            std::cerr << "Error: Grammar validation failed\n";
+            for (const auto& error : validation.errors) {
+                std::cerr << "  - " << error << "\n";
+            }
+            return 1;
+        }
+
+        CorpusGenerator generator(*grammar, corpus);
+        std::ofstream file;
+        if (!output_file.empty() && output_file != "-") {
+            file.open(output_file, std::ios::binary);
+            if (!file) {
+                std::cerr << "Error: Cannot write " << output_file << "\n";
+                return 1;
+            }
+        }
+        std::ostream& out = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+        CorpusStats stats = generator.generate(out);
+        out.flush();
+        if (!out) {
+            std::cerr << "Error: Failed to write the corpus\n";
+            return 1;
+        }
+        if (verbose) {
+            std::cerr << "Generated " << stats.bytes << " bytes, " << stats.items << " items, nesting depth "
+                      << stats.max_depth << "\n";
+            if (corpus.validate) {
+                std::cerr << "Rejected by validation: " << stats.rejected << "\n";
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "corpus") == 0) {
+        return runCorpus(argc, argv);
+    }
+
     CliOptions options;
     
     if (!parseArgs(argc, argv, options)) {
@@ -164,57 +478,6 @@ int main(int argc, char* argv[]) {
             std::cout << "Language: " << options.language << "\n";
         }
         
-        // Парсинг BNF грамматики
-        if (options.verbose) {
-            std::cout << "\n[1/3] Parsing BNF grammar...\n";
-        }
-        
-        auto grammar = BNFGrammarFactory::fromFile(options.input_file);
-        if (!grammar) {
-            std::cerr << "Error: Failed to parse grammar file: " << options.input_file << "\n";
-            return 1;
-        }
-        
-        if (options.verbose) {
-            std::cout << "  ✓ Parsed " << grammar->rules.size() << " rules\n";
-            std::cout << "  ✓ Start symbol: " << grammar->startSymbol << "\n";
-        }
-        
-        // Валидация грамматики
-        if (options.verbose) {
-            std::cout << "\n[2/3] Validating grammar...\n";
-        }
-        
-        auto validation = BNFParser::validateGrammar(*grammar);
-        if (!validation.isValid) {
-            std::cerr << "Error: Grammar validation failed\n";
-            for (const auto& error : validation.errors) {
-                std::cerr << "  - " << error << "\n";
-            }
-            return 1;
-        }
-        
-        if (options.verbose) {
-            std::cout << "  ✓ Grammar is valid\n";
-            if (!validation.warnings.empty()) {
-                std::cout << "  Warnings:\n";
-                for (const auto& warning : validation.warnings) {
-                    std::cout << "    - " << warning << "\n";
-                }
-            }
-        }
-        
-        // Генерация кода
-        if (options.verbose) {
-            std::cout << "\n[3/3] Generating parser code...\n";
-        }
-        
-        auto generator = CodeGeneratorFactory::create(options.language);
-        if (!generator) {
-            std::cerr << "Error: Failed to create code generator for: " << options.language << "\n";
-            return 1;
-        }
-        
         GeneratorOptions gen_options;
         gen_options.target_language = options.language;
         
@@ -267,13 +530,176 @@ int main(int argc, char* argv[]) {
         gen_options.namespace_name = options.namespace_name;
         gen_options.debug_mode = options.debug_mode;
         gen_options.generate_executable = options.generate_executable;
+        gen_options.memoize = options.memoize;
+        gen_options.memoize_rules = options.memoize_rules;
+        gen_options.no_memoize_rules = options.no_memoize_rules;
+        gen_options.arena_allocation = options.arena;
+        gen_options.first_set_dispatch = options.first_set_dispatch;
+        gen_options.lazy_positions = options.lazy_positions;
+        gen_options.char_class_scanners = options.char_class_scanners;
+        gen_options.literal_tries = options.literal_tries;
+        gen_options.dfa_lexer = options.dfa_lexer;
+        gen_options.streaming = options.streaming;
+        gen_options.incremental = options.incremental;
+        gen_options.parallel = options.parallel;
+        gen_options.recognizer = options.recognizer;
+        gen_options.event_callbacks = options.events;
+        gen_options.profile = options.profile;
+        gen_options.profile_timing = options.profile_timing;
+        gen_options.explicit_stack = options.explicit_stack;
+        gen_options.split_units = options.split_units;
+        gen_options.diagnostics = options.diagnostics;
+        gen_options.stream_item = options.stream_item;
+        gen_options.whitespace_rule = options.whitespace_rule;
+        gen_options.token_rules = options.token_rules;
         
-        auto result = generator->generate(*grammar, gen_options);
-        
-        if (!result.success) {
-            std::cerr << "Error: Code generation failed: " << result.error_message << "\n";
+        // Текст грамматики: BNF или двоичная форма (--save-binary); он же входит в ключ кэша
+        std::ifstream grammar_file(options.input_file, std::ios::binary);
+        if (!grammar_file) {
+            std::cerr << "Error: Cannot open grammar file: " << options.input_file << "\n";
             return 1;
         }
+        std::string grammar_text((std::istreambuf_iterator<char>(grammar_file)),
+                                 std::istreambuf_iterator<char>());
+        
+        // Кэш генерации: при попадании разбор, валидация, оптимизация и генерация пропускаются
+        std::optional<GenerationCache> cache;
+        std::string cache_key;
+        GeneratedCode result;
+        bool cached = false;
+        if (!options.cache_dir.empty()) {
+            cache.emplace(options.cache_dir);
+            cache_key = GenerationCache::makeKey(grammar_text, gen_options, optimizerSettings(options));
+            if (auto entry = cache->load(cache_key)) {
+                result = std::move(*entry);
+                cached = true;
+            }
+        }
+        
+        // Грамматика нужна и при попадании в кэш, если её анализируют или сохраняют
+        std::unique_ptr<Grammar> grammar;
+        if (!cached || options.analyze || !options.save_binary.empty()) {
+            // Парсинг BNF грамматики
+            if (options.verbose) {
+                std::cout << "\n[1/4] Parsing BNF grammar...\n";
+            }
+        
+            grammar = BNFGrammarFactory::isBinary(grammar_text) ? BNFGrammarFactory::fromBinary(grammar_text)
+                                                                : BNFGrammarFactory::fromString(grammar_text);
+            if (!grammar) {
+                std::cerr << "Error: Failed to parse grammar file: " << options.input_file << "\n";
+                return 1;
+            }
+        
+            if (options.verbose) {
+                std::cout << "  ✓ Parsed " << grammar->rules.size() << " rules\n";
+                std::cout << "  ✓ Start symbol: " << grammar->startSymbol << "\n";
+            }
+        
+            // Валидация грамматики
+            if (options.verbose) {
+                std::cout << "\n[2/4] Validating grammar...\n";
+            }
+        
+            auto validation = BNFParser::validateGrammar(*grammar);
+            if (!validation.isValid) {
+                std::cerr << "Error: Grammar validation failed\n";
+                for (const auto& error : validation.errors) {
+                    std::cerr << "  - " << error << "\n";
+                }
+                return 1;
+            }
+        
+            if (options.verbose) {
+                std::cout << "  ✓ Grammar is valid\n";
+                if (!validation.warnings.empty()) {
+                    std::cout << "  Warnings:\n";
+                    for (const auto& warning : validation.warnings) {
+                        std::cout << "    - " << warning << "\n";
+                    }
+                }
+            }
+        }
+        
+        // Отчёт анализа грамматики
+        if (options.analyze) {
+            auto analysis = BNFParser::analyzeGrammar(*grammar);
+            std::cout << "\nGrammar analysis:\n";
+            for (const auto& rule : analysis.rules()) {
+                std::cout << "  " << rule.name << (rule.isLL1 ? "  [LL(1)]" : "  [not LL(1)]")
+                          << (rule.nullable ? "  nullable" : "") << "\n";
+                std::cout << "    FIRST:  " << GrammarAnalysis::describe(rule.first) << "\n";
+                std::cout << "    FOLLOW: " << GrammarAnalysis::describe(rule.follow) << "\n";
+                for (const auto& conflict : rule.conflicts) {
+                    std::cout << "    conflict: " << conflict << "\n";
+                }
+            }
+            std::cout << "  LL(1) rules: " << analysis.ll1Rules().size() << " of "
+                      << analysis.rules().size() << "\n";
+        }
+        
+        // Двоичная форма грамматики как написана, до оптимизации
+        if (!options.save_binary.empty()) {
+            std::ofstream binary_out(options.save_binary, std::ios::binary);
+            if (!(binary_out << BNFGrammarFactory::toBinary(*grammar))) {
+                std::cerr << "Error: Cannot write to file: " << options.save_binary << "\n";
+                return 1;
+            }
+            if (options.verbose) {
+                std::cout << "  ✓ Binary grammar: " << options.save_binary << "\n";
+            }
+        }
+        
+        if (cached) {
+            if (options.verbose) {
+                std::cout << "\n[cache] Reusing generated code: " << cache->entryPath(cache_key) << "\n";
+            }
+        } else {
+            // Генерация кода
+            auto generator = CodeGeneratorFactory::create(options.language);
+            if (!generator) {
+                std::cerr << "Error: Failed to create code generator for: " << options.language << "\n";
+                return 1;
+            }
+        
+            // Оптимизация грамматики: анализ выше описывает грамматику как написана
+            if (options.optimize) {
+                if (options.verbose) {
+                    std::cout << "\n[3/4] Optimizing grammar...\n";
+                }
+                OptimizerOptions optimizer_options = OptimizerOptions::forGenerator(gen_options);
+                optimizer_options.inline_rules = options.inline_rules;
+                optimizer_options.left_factor = options.left_factor;
+                optimizer_options.fold_char_classes = options.fold_char_classes;
+                optimizer_options.flatten = options.flatten;
+                optimizer_options.remove_unreachable = options.remove_unreachable;
+                auto report = GrammarOptimizer::optimize(*grammar, optimizer_options);
+                if (options.verbose) {
+                    for (const auto& change : report.changes) {
+                        std::cout << "  ✓ " << change << "\n";
+                    }
+                    std::cout << "  ✓ " << report.inlined << " inlined, " << report.factored << " factored, "
+                              << report.folded << " folded, " << report.flattened << " flattened, "
+                              << report.removed << " rules removed\n";
+                }
+            }
+        
+            if (options.verbose) {
+                std::cout << "\n[4/4] Generating parser code...\n";
+            }
+            result = generator->generate(*grammar, gen_options);
+        
+            if (!result.success) {
+                std::cerr << "Error: Code generation failed: " << result.error_message << "\n";
+                return 1;
+            }
+            if (cache && !cache->store(cache_key, result)) {
+                std::cerr << "Warning: Failed to write cache entry: " << cache->entryPath(cache_key) << "\n";
+            }
+        }
+        for (const auto& warning : result.warnings) {
+            std::cerr << "Warning: " << warning << "\n";
+        }
         
         // Определение выходной директории
         std::string output_dir = options.output_dir;
@@ -305,14 +731,16 @@ int main(int argc, char* argv[]) {
         }
         
         // Создаем выходную директорию
-        std::string mkdir_cmd = "mkdir -p " + output_dir;
-        if (system(mkdir_cmd.c_str()) != 0) {
+        std::error_code mkdir_error;
+        std::filesystem::create_directories(output_dir, mkdir_error);
+        if (mkdir_error) {
             std::cerr << "Warning: Failed to create directory: " << output_dir << "\n";
         }
         
-        // Определение имени выходного файла
+        // Определение имени выходного файла. Заголовок разбитого парсера
+        // сохраняет своё имя: его по имени включают файлы правил
         std::string output_file;
-        if (!options.output_file.empty()) {
+        if (!options.output_file.empty() && result.additional_files.empty()) {
             output_file = output_dir + "/" + options.output_file;
         } else {
             output_file = output_dir + "/" + result.parser_filename;
@@ -340,15 +768,18 @@ int main(int argc, char* argv[]) {
             }
         }
         
-        // Запись дополнительных файлов (заголовочные файлы и т.д.)
+        // Запись дополнительных файлов (файлы правил и т.д.) рядом с парсером
         for (const auto& [filename, content] : result.additional_files) {
-            std::ofstream additional_out(filename);
-            if (additional_out) {
-                additional_out << content;
-                additional_out.close();
-                if (options.verbose) {
-                    std::cout << "  ✓ Additional file: " << filename << "\n";
-                }
+            std::string additional_file = output_dir + "/" + filename;
+            std::ofstream additional_out(additional_file);
+            if (!additional_out) {
+                std::cerr << "Error: Cannot write to file: " << additional_file << "\n";
+                return 1;
+            }
+            additional_out << content;
+            additional_out.close();
+            if (options.verbose) {
+                std::cout << "  ✓ Additional file: " << additional_file << "\n";
             }
         }
         
@@ -370,6 +801,9 @@ int main(int argc, char* argv[]) {
         
         if (!options.verbose) {
             std::cout << "Generated in " << output_dir << ": " << result.parser_filename;
+            if (!result.additional_files.empty()) {
+                std::cout << ", " << result.additional_files.size() << " more files";
+            }
             if (!result.main_filename.empty()) {
                 std::cout << ", " << result.main_filename;
             }
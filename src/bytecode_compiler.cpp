@@ -0,0 +1,668 @@
+#include "bytecode_vm.hpp"
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+constexpr uint32_t kNoRule = UINT32_MAX;
+
+class BytecodeCompiler {
+public:
+    BytecodeCompiler(const Grammar& grammar, const GeneratorOptions& options)
+        : grammar_(grammar), options_(options) {}
+
+    BytecodeProgram compile() {
+        if (grammar_.isContextSensitive()) {
+            throw std::runtime_error("Bytecode interpreter does not support context-sensitive grammars");
+        }
+        program_.max_depth = static_cast<uint32_t>(options_.max_recursion_depth);
+        program_.builds_tree = !options_.recognizer;
+
+        // Номер правила - первое определение имени, как у grammar.findRule
+        for (const auto& rule : grammar_.rules) {
+            if (rule_ids_.count(rule->leftSide)) continue;
+            rule_ids_.emplace(rule->leftSide, static_cast<uint32_t>(program_.rule_names.size()));
+            program_.rule_names.push_back(rule->leftSide);
+        }
+        auto start = rule_ids_.find(grammar_.startSymbol);
+        if (start == rule_ids_.end()) {
+            throw std::runtime_error("Start rule not found: " + grammar_.startSymbol);
+        }
+        program_.start_rule = start->second;
+        program_.rule_entries.assign(program_.rule_names.size(), 0);
+
+        analysis_ = GrammarAnalysis::analyze(grammar_);
+        collectTrivia();
+        GrammarAnalysis::Options ws_options;
+        ws_options.skippedBeforeTokens = program_.skip_set;
+        if (!skip_is_class_) {
+            ws_options.skippedBeforeTokens = analysis_.first(grammar_.findRule(trivia_rule_)->rightSide.get());
+        }
+        ws_analysis_ = GrammarAnalysis::analyze(grammar_, ws_options);
+
+        program_.entry = emit(OpCode::CALL, program_.start_rule,
+                              program_.builds_tree ? BytecodeProgram::CALL_NODE : 0);
+        emitSkip();
+        emit(OpCode::END);
+
+        for (uint32_t id = 0; id < rule_ids_.size(); ++id) {
+            const ProductionRule* rule = grammar_.findRule(program_.rule_names[id]);
+            in_lexical_ = lexical_rules_.count(rule->leftSide) > 0;
+            program_.rule_entries[id] = here();
+            compileNode(rule->rightSide.get());
+            emit(OpCode::RETURN);
+        }
+        if (skip_rule_ != kNoRule) {
+            // (trivia)* без узлов: пропуск пробелов правилом с комментариями
+            program_.rule_entries[skip_rule_] = here();
+            const uint32_t choice = emit(OpCode::CHOICE);
+            const uint32_t loop = here();
+            emit(OpCode::CALL, rule_ids_.at(trivia_rule_), 0);
+            emit(OpCode::LOOP, loop);
+            program_.code[choice].a = here();
+            emit(OpCode::RETURN);
+        }
+        return std::move(program_);
+    }
+
+private:
+    const Grammar& grammar_;
+    const GeneratorOptions& options_;
+    BytecodeProgram program_;
+    std::unordered_map<std::string, uint32_t> rule_ids_;
+    std::unordered_map<std::string, uint32_t> literal_ids_;
+    GrammarAnalysis analysis_;
+    GrammarAnalysis ws_analysis_;  // FIRST с пробелами, пропускаемыми перед токенами
+
+    std::string trivia_rule_;
+    std::unordered_set<std::string> lexical_rules_;
+    bool skip_is_class_ = true;
+    uint32_t skip_rule_ = kNoRule;  // Псевдоправило пропуска, если пробелы - не класс байтов
+    bool in_lexical_ = false;
+
+    uint32_t here() const { return static_cast<uint32_t>(program_.code.size()); }
+
+    uint32_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0) {
+        program_.code.push_back(Instruction{op, a, b});
+        return here() - 1;
+    }
+
+    uint32_t addSet(const LookaheadSet& set) {
+        for (uint32_t i = 0; i < program_.sets.size(); ++i) {
+            if (program_.sets[i] == set) return i;
+        }
+        program_.sets.push_back(set);
+        return static_cast<uint32_t>(program_.sets.size() - 1);
+    }
+
+    uint32_t addLiteral(const std::string& text) {
+        auto [it, inserted] = literal_ids_.emplace(text, static_cast<uint32_t>(program_.literals.size()));
+        if (inserted) program_.literals.push_back(text);
+        return it->second;
+    }
+
+    // Правило пробелов и токены - так же, как CppCodeGenerator::collectTrivia
+    void collectTrivia() {
+        trivia_rule_ = findWhitespaceRule(grammar_, options_.whitespace_rule);
+        const ProductionRule* trivia = trivia_rule_.empty() ? nullptr : grammar_.findRule(trivia_rule_);
+        if (!trivia) {
+            if (!trivia_rule_.empty()) {
+                throw std::runtime_error("Whitespace rule not found: " + trivia_rule_);
+            }
+            for (unsigned char c : std::string(" \t\n\v\f\r")) {
+                program_.skip_set.set(c);
+            }
+            return;
+        }
+        lexical_rules_ = findLexicalRules(grammar_, trivia_rule_, options_.token_rules);
+
+        LookaheadSet bytes;
+        if (collectTriviaClass(trivia->rightSide.get(), bytes, 0) && bytes.any()) {
+            program_.skip_set = bytes;
+        } else {
+            skip_is_class_ = false;
+            skip_rule_ = static_cast<uint32_t>(program_.rule_names.size());
+            program_.rule_names.push_back("<whitespace>");
+            program_.rule_entries.push_back(0);
+        }
+    }
+
+    // Пропуск повторяется, пока находит пробел, поэтому X, X?, X* и X+ эквивалентны
+    bool collectTriviaClass(const ASTNode* node, LookaheadSet& bytes, size_t depth) const {
+        if (depth > 16) return false;
+        if (const auto* t = node_cast<Terminal>(node)) {
+            if (t->value.size() != 1) return false;
+            bytes.set(static_cast<unsigned char>(t->value[0]));
+            return true;
+        }
+        if (const auto* range = node_cast<CharRange>(node)) {
+            if (range->end >= 0x80 || range->start > range->end) return false;
+            for (uint32_t c = range->start; c <= range->end; ++c) bytes.set(c);
+            return true;
+        }
+        if (const auto* alt = node_cast<Alternative>(node)) {
+            for (const auto& choice : alt->choices) {
+                if (!collectTriviaClass(choice.get(), bytes, depth + 1)) return false;
+            }
+            return true;
+        }
+        if (const auto* nt = node_cast<NonTerminal>(node)) {
+            const ProductionRule* rule = grammar_.findRule(nt->name);
+            return rule && !rule->hasParameters() && collectTriviaClass(rule->rightSide.get(), bytes, depth + 1);
+        }
+        if (const auto* group = node_cast<Group>(node)) return collectTriviaClass(group->content.get(), bytes, depth + 1);
+        if (const auto* opt = node_cast<Optional>(node)) return collectTriviaClass(opt->content.get(), bytes, depth + 1);
+        if (const auto* star = node_cast<ZeroOrMore>(node)) return collectTriviaClass(star->content.get(), bytes, depth + 1);
+        if (const auto* plus = node_cast<OneOrMore>(node)) return collectTriviaClass(plus->content.get(), bytes, depth + 1);
+        return false;
+    }
+
+    // Без правила пробелов терминалы пропускают std::isspace во всех правилах
+    bool skipsBeforeTerminal() const { return trivia_rule_.empty() || !in_lexical_; }
+    bool skipsBeforeRange() const { return !trivia_rule_.empty() && !in_lexical_; }
+
+    void emitSkip() {
+        if (skip_is_class_) {
+            emit(OpCode::SKIP);
+        } else {
+            emit(OpCode::CALL, skip_rule_, BytecodeProgram::CALL_SKIP);
+        }
+    }
+
+    // Выражение, которое совпадает ровно с одним ASCII-байтом из bytes и
+    // ничего не пропускает перед ним. Ссылки раскрываются только внутри
+    // токенов, где они не создают узлов
+    bool collectByteSet(const ASTNode* node, LookaheadSet& bytes, size_t depth) const {
+        if (depth > 16) return false;
+        if (const auto* t = node_cast<Terminal>(node)) {
+            if (skipsBeforeTerminal() || t->value.size() != 1 || static_cast<unsigned char>(t->value[0]) >= 0x80) {
+                return false;
+            }
+            bytes.set(static_cast<unsigned char>(t->value[0]));
+            return true;
+        }
+        if (const auto* range = node_cast<CharRange>(node)) {
+            if (skipsBeforeRange() || range->start > range->end || range->end >= 0x80) return false;
+            for (uint32_t c = range->start; c <= range->end; ++c) bytes.set(c);
+            return true;
+        }
+        if (const auto* alt = node_cast<Alternative>(node)) {
+            for (const auto& choice : alt->choices) {
+                if (!collectByteSet(choice.get(), bytes, depth + 1)) return false;
+            }
+            return true;
+        }
+        if (const auto* group = node_cast<Group>(node)) {
+            return collectByteSet(group->content.get(), bytes, depth + 1);
+        }
+        if (const auto* nt = node_cast<NonTerminal>(node)) {
+            if (!in_lexical_ || nt->hasParameters()) return false;
+            const ProductionRule* rule = grammar_.findRule(nt->name);
+            return rule && !rule->hasParameters() && collectByteSet(rule->rightSide.get(), bytes, depth + 1);
+        }
+        return false;
+    }
+
+    void compileNode(const ASTNode* node) {
+        switch (node->kind()) {
+            case NodeKind::TERMINAL: {
+                const std::string& value = static_cast<const Terminal*>(node)->value;
+                if (skipsBeforeTerminal()) emitSkip();
+                if (value.size() == 1) {
+                    emit(OpCode::CHAR, static_cast<unsigned char>(value[0]));
+                } else if (!value.empty()) {
+                    emit(OpCode::STRING, addLiteral(value));
+                }
+                return;
+            }
+            case NodeKind::CHAR_RANGE: {
+                const auto* range = static_cast<const CharRange*>(node);
+                if (skipsBeforeRange()) emitSkip();
+                LookaheadSet bytes;
+                if (range->start <= range->end && range->end < 0x80) {
+                    for (uint32_t c = range->start; c <= range->end; ++c) bytes.set(c);
+                    emit(OpCode::SET, addSet(bytes));
+                } else {
+                    program_.ranges.emplace_back(range->start, range->end);
+                    emit(OpCode::RANGE, static_cast<uint32_t>(program_.ranges.size() - 1));
+                }
+                return;
+            }
+            case NodeKind::NON_TERMINAL: {
+                const auto* nt = static_cast<const NonTerminal*>(node);
+                auto it = rule_ids_.find(nt->name);
+                if (it == rule_ids_.end()) {
+                    throw std::runtime_error("Undefined rule: " + nt->name);
+                }
+                if (!in_lexical_ && nt->name != trivia_rule_ && lexical_rules_.count(nt->name)) {
+                    emitSkip();
+                }
+                const bool node_flag = program_.builds_tree && !in_lexical_;
+                emit(OpCode::CALL, it->second, node_flag ? BytecodeProgram::CALL_NODE : 0);
+                return;
+            }
+            case NodeKind::SEQUENCE:
+                for (const auto& element : static_cast<const Sequence*>(node)->elements) {
+                    compileNode(element.get());
+                }
+                return;
+            case NodeKind::GROUP:
+                compileNode(static_cast<const Group*>(node)->content.get());
+                return;
+            case NodeKind::OPTIONAL: {
+                const uint32_t choice = emit(OpCode::CHOICE);
+                compileNode(static_cast<const Optional*>(node)->content.get());
+                const uint32_t commit = emit(OpCode::COMMIT);
+                program_.code[choice].a = program_.code[commit].a = here();
+                return;
+            }
+            case NodeKind::ZERO_OR_MORE:
+                compileRepetition(static_cast<const ZeroOrMore*>(node)->content.get(), false);
+                return;
+            case NodeKind::ONE_OR_MORE:
+                compileRepetition(static_cast<const OneOrMore*>(node)->content.get(), true);
+                return;
+            case NodeKind::ALTERNATIVE:
+                compileAlternative(static_cast<const Alternative*>(node));
+                return;
+            case NodeKind::CONTEXT_ACTION:
+                throw std::runtime_error("Bytecode interpreter does not support context actions");
+            case NodeKind::CUT:
+                throw std::runtime_error("Bytecode interpreter does not support the cut operator");
+        }
+    }
+
+    void compileRepetition(const ASTNode* content, bool one_or_more) {
+        LookaheadSet bytes;
+        if (options_.char_class_scanners && collectByteSet(content, bytes, 0)) {
+            emit(OpCode::SPAN, addSet(bytes), one_or_more ? 1 : 0);
+            return;
+        }
+        // Повторение, не сдвинувшее позицию, завершает цикл, но его узлы остаются
+        const uint32_t choice = emit(one_or_more ? OpCode::PLUS_CHOICE : OpCode::CHOICE);
+        const uint32_t body = here();
+        compileNode(content);
+        emit(OpCode::LOOP, body);
+        program_.code[choice].a = here();
+    }
+
+    void compileAlternative(const Alternative* alt) {
+        const auto& choices = alt->choices;
+        LookaheadSet bytes;
+        if (collectByteSet(alt, bytes, 0)) {
+            emit(OpCode::SET, addSet(bytes));
+            return;
+        }
+        if (choices.size() == 1) {
+            compileNode(choices[0].get());
+            return;
+        }
+
+        // Выбор по следующему байту. Если пробелы - класс байтов и ни одна
+        // альтернатива с них не начинается, смотрим байт после пробелов
+        std::vector<LookaheadSet> viable;
+        bool dispatchable = options_.first_set_dispatch;
+        bool past_whitespace = false;
+        if (options_.first_set_dispatch) {
+            past_whitespace = skip_is_class_;
+            for (const auto& choice : choices) {
+                if ((analysis_.first(choice.get()) & program_.skip_set).any()) past_whitespace = false;
+            }
+            const GrammarAnalysis& analysis = past_whitespace ? analysis_ : ws_analysis_;
+            LookaheadSet seen;
+            for (const auto& choice : choices) {
+                LookaheadSet set = analysis.first(choice.get());
+                if (analysis.isNullable(choice.get())) {
+                    set.set();
+                    dispatchable = false;
+                }
+                if ((set & seen).any()) dispatchable = false;
+                seen |= set;
+                viable.push_back(set);
+            }
+        }
+
+        std::vector<uint32_t> jumps;
+        if (dispatchable) {
+            std::vector<uint32_t> table(LookaheadSet().size(), BytecodeProgram::FAIL_LABEL);
+            const uint32_t index = static_cast<uint32_t>(program_.dispatch.size());
+            program_.dispatch.emplace_back();
+            emit(past_whitespace ? OpCode::DISPATCH_WS : OpCode::DISPATCH, index);
+            for (size_t i = 0; i < choices.size(); ++i) {
+                const uint32_t label = here();
+                for (size_t b = 0; b < table.size(); ++b) {
+                    if (viable[i].test(b)) table[b] = label;
+                }
+                compileNode(choices[i].get());
+                if (i + 1 < choices.size()) jumps.push_back(emit(OpCode::JUMP));
+            }
+            program_.dispatch[index] = std::move(table);
+        } else {
+            for (size_t i = 0; i + 1 < choices.size(); ++i) {
+                uint32_t test = BytecodeProgram::FAIL_LABEL;
+                if (!viable.empty() && !viable[i].all()) {
+                    test = emit(past_whitespace ? OpCode::TEST_WS : OpCode::TEST, 0, addSet(viable[i]));
+                }
+                const uint32_t choice = emit(OpCode::CHOICE);
+                compileNode(choices[i].get());
+                jumps.push_back(emit(OpCode::COMMIT));
+                program_.code[choice].a = here();
+                if (test != BytecodeProgram::FAIL_LABEL) program_.code[test].a = here();
+            }
+            compileNode(choices.back().get());
+        }
+        for (uint32_t jump : jumps) {
+            program_.code[jump].a = here();
+        }
+    }
+};
+
+// Двоичная форма программы: сигнатура, затем таблицы и код. Числа - varint
+const char kMagic[] = {'\0', 'B', 'N', 'F', 'V', '\1'};
+constexpr size_t kMagicSize = sizeof(kMagic);
+constexpr size_t kSetBytes = (LookaheadSet().size() + 7) / 8;
+
+void writeVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void writeString(std::string& out, const std::string& text) {
+    writeVarint(out, text.size());
+    out += text;
+}
+
+void writeSet(std::string& out, const LookaheadSet& set) {
+    for (size_t i = 0; i < kSetBytes; ++i) {
+        unsigned char byte = 0;
+        for (size_t bit = 0; bit < 8 && i * 8 + bit < set.size(); ++bit) {
+            if (set.test(i * 8 + bit)) byte |= static_cast<unsigned char>(1u << bit);
+        }
+        out += static_cast<char>(byte);
+    }
+}
+
+class ProgramReader {
+public:
+    explicit ProgramReader(const std::string& data) : data_(data), pos_(kMagicSize) {}
+
+    BytecodeProgram read() {
+        BytecodeProgram program;
+        program.rule_names.resize(readCount());
+        for (auto& name : program.rule_names) name = readString();
+        program.rule_entries.resize(program.rule_names.size());
+        for (auto& entry : program.rule_entries) entry = readU32();
+        program.literals.resize(readCount());
+        for (auto& literal : program.literals) literal = readString();
+        program.sets.resize(readCount());
+        for (auto& set : program.sets) set = readSet();
+        program.ranges.resize(readCount());
+        for (auto& range : program.ranges) {
+            range.first = readU32();
+            range.second = readU32();
+        }
+        program.dispatch.resize(readCount());
+        for (auto& table : program.dispatch) {
+            table.resize(LookaheadSet().size());
+            for (auto& label : table) label = readU32();
+        }
+        program.skip_set = readSet();
+        program.start_rule = readU32();
+        program.entry = readU32();
+        program.max_depth = readU32();
+        program.builds_tree = readByte() != 0;
+        program.code.resize(readCount());
+        for (auto& instruction : program.code) {
+            const uint8_t op = readByte();
+            if (op > static_cast<uint8_t>(OpCode::END)) fail("unknown opcode " + std::to_string(op));
+            instruction.op = static_cast<OpCode>(op);
+            instruction.a = readU32();
+            instruction.b = readU32();
+        }
+        if (pos_ != data_.size()) fail("trailing data");
+        validate(program);
+        return program;
+    }
+
+private:
+    const std::string& data_;
+    size_t pos_;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("Invalid bytecode at byte " + std::to_string(pos_) + ": " + message);
+    }
+
+    uint8_t readByte() {
+        if (pos_ >= data_.size()) fail("unexpected end of data");
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint64_t readVarint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = readByte();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return value;
+        }
+        fail("malformed number");
+    }
+
+    uint32_t readU32() {
+        const uint64_t value = readVarint();
+        if (value > UINT32_MAX) fail("number out of range");
+        return static_cast<uint32_t>(value);
+    }
+
+    uint64_t readCount() {
+        const uint64_t count = readVarint();
+        if (count > data_.size() - pos_) fail("count exceeds data size");
+        return count;
+    }
+
+    std::string readString() {
+        const uint64_t size = readCount();
+        std::string text = data_.substr(pos_, size);
+        pos_ += size;
+        return text;
+    }
+
+    LookaheadSet readSet() {
+        LookaheadSet set;
+        for (size_t i = 0; i < kSetBytes; ++i) {
+            const uint8_t byte = readByte();
+            for (size_t bit = 0; bit < 8; ++bit) {
+                if ((byte >> bit) & 1) {
+                    if (i * 8 + bit >= set.size()) fail("set bit out of range");
+                    set.set(i * 8 + bit);
+                }
+            }
+        }
+        return set;
+    }
+
+    // Любая загруженная программа выполняется без выхода за таблицы и код
+    void validate(const BytecodeProgram& program) const {
+        const size_t size = program.code.size();
+        auto check = [this](bool ok, const std::string& message) {
+            if (!ok) fail(message);
+        };
+        check(size > 0, "empty code");
+        check(program.entry < size && program.start_rule < program.rule_names.size(), "bad entry point");
+        for (uint32_t entry : program.rule_entries) check(entry < size, "rule entry out of range");
+        for (const auto& table : program.dispatch) {
+            for (uint32_t label : table) {
+                check(label < size || label == BytecodeProgram::FAIL_LABEL, "dispatch label out of range");
+            }
+        }
+        for (size_t pc = 0; pc < size; ++pc) {
+            const Instruction& in = program.code[pc];
+            const std::string where = " at instruction " + std::to_string(pc);
+            switch (in.op) {
+                case OpCode::CHAR: check(in.a < 256, "bad byte" + where); break;
+                case OpCode::STRING: check(in.a < program.literals.size(), "bad literal" + where); break;
+                case OpCode::SET:
+                case OpCode::SPAN: check(in.a < program.sets.size(), "bad set" + where); break;
+                case OpCode::RANGE: check(in.a < program.ranges.size(), "bad range" + where); break;
+                case OpCode::TEST:
+                case OpCode::TEST_WS: check(in.b < program.sets.size(), "bad set" + where); [[fallthrough]];
+                case OpCode::CHOICE:
+                case OpCode::PLUS_CHOICE:
+                case OpCode::LOOP:
+                case OpCode::COMMIT:
+                case OpCode::JUMP: check(in.a < size, "label out of range" + where); break;
+                case OpCode::DISPATCH:
+                case OpCode::DISPATCH_WS: check(in.a < program.dispatch.size(), "bad dispatch table" + where); break;
+                case OpCode::CALL:
+                    check(in.a < program.rule_entries.size() && in.b <= 3, "bad call" + where);
+                    break;
+                case OpCode::SKIP:
+                case OpCode::FAIL:
+                case OpCode::RETURN:
+                case OpCode::END: break;
+            }
+        }
+        const OpCode last = program.code.back().op;
+        check(last == OpCode::RETURN || last == OpCode::END || last == OpCode::JUMP || last == OpCode::FAIL ||
+              last == OpCode::COMMIT || last == OpCode::DISPATCH || last == OpCode::DISPATCH_WS,
+              "code falls off the end");
+    }
+};
+
+const char* opName(OpCode op) {
+    switch (op) {
+        case OpCode::CHAR: return "CHAR";
+        case OpCode::STRING: return "STRING";
+        case OpCode::SET: return "SET";
+        case OpCode::RANGE: return "RANGE";
+        case OpCode::SPAN: return "SPAN";
+        case OpCode::SKIP: return "SKIP";
+        case OpCode::CHOICE: return "CHOICE";
+        case OpCode::PLUS_CHOICE: return "PLUS_CHOICE";
+        case OpCode::LOOP: return "LOOP";
+        case OpCode::COMMIT: return "COMMIT";
+        case OpCode::JUMP: return "JUMP";
+        case OpCode::TEST: return "TEST";
+        case OpCode::TEST_WS: return "TEST_WS";
+        case OpCode::DISPATCH: return "DISPATCH";
+        case OpCode::DISPATCH_WS: return "DISPATCH_WS";
+        case OpCode::FAIL: return "FAIL";
+        case OpCode::CALL: return "CALL";
+        case OpCode::RETURN: return "RETURN";
+        case OpCode::END: return "END";
+    }
+    return "?";
+}
+
+std::string quoteText(const std::string& text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            std::ostringstream hex;
+            hex << "\\x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c);
+            out += hex.str();
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + "\"";
+}
+
+} // namespace
+
+BytecodeProgram BytecodeProgram::compile(const Grammar& grammar, const GeneratorOptions& options) {
+    return BytecodeCompiler(grammar, options).compile();
+}
+
+std::string BytecodeProgram::serialize() const {
+    std::string out(kMagic, kMagicSize);
+    writeVarint(out, rule_names.size());
+    for (const auto& name : rule_names) writeString(out, name);
+    for (uint32_t entry : rule_entries) writeVarint(out, entry);
+    writeVarint(out, literals.size());
+    for (const auto& literal : literals) writeString(out, literal);
+    writeVarint(out, sets.size());
+    for (const auto& set : sets) writeSet(out, set);
+    writeVarint(out, ranges.size());
+    for (const auto& [start, end] : ranges) {
+        writeVarint(out, start);
+        writeVarint(out, end);
+    }
+    writeVarint(out, dispatch.size());
+    for (const auto& table : dispatch) {
+        for (uint32_t label : table) writeVarint(out, label);
+    }
+    writeSet(out, skip_set);
+    writeVarint(out, start_rule);
+    writeVarint(out, entry);
+    writeVarint(out, max_depth);
+    out += static_cast<char>(builds_tree ? 1 : 0);
+    writeVarint(out, code.size());
+    for (const auto& instruction : code) {
+        out += static_cast<char>(instruction.op);
+        writeVarint(out, instruction.a);
+        writeVarint(out, instruction.b);
+    }
+    return out;
+}
+
+BytecodeProgram BytecodeProgram::deserialize(const std::string& data) {
+    if (data.size() < kMagicSize || data.compare(0, kMagicSize, kMagic, kMagicSize) != 0) {
+        throw std::runtime_error("Invalid bytecode: missing signature");
+    }
+    return ProgramReader(data).read();
+}
+
+std::string BytecodeProgram::disassemble() const {
+    std::unordered_map<uint32_t, std::string> entry_names;
+    for (size_t i = 0; i < rule_entries.size(); ++i) {
+        entry_names.emplace(rule_entries[i], rule_names[i]);
+    }
+    std::ostringstream out;
+    out << "; start: " << rule_names[start_rule] << ", entry: " << entry << "\n";
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        auto name = entry_names.find(static_cast<uint32_t>(pc));
+        if (name != entry_names.end()) out << name->second << ":\n";
+        const Instruction& in = code[pc];
+        out << std::setw(6) << pc << "  " << opName(in.op);
+        switch (in.op) {
+            case OpCode::CHAR: out << ' ' << quoteText(std::string(1, static_cast<char>(in.a))); break;
+            case OpCode::STRING: out << ' ' << quoteText(literals[in.a]); break;
+            case OpCode::SET: out << ' ' << GrammarAnalysis::describe(sets[in.a]); break;
+            case OpCode::SPAN: out << ' ' << GrammarAnalysis::describe(sets[in.a]) << (in.b ? " +" : " *"); break;
+            case OpCode::RANGE:
+                out << std::hex << std::uppercase << " U+" << ranges[in.a].first << "..U+" << ranges[in.a].second
+                    << std::dec << std::nouppercase;
+                break;
+            case OpCode::TEST:
+            case OpCode::TEST_WS: out << ' ' << GrammarAnalysis::describe(sets[in.b]) << " else " << in.a; break;
+            case OpCode::CHOICE:
+            case OpCode::PLUS_CHOICE:
+            case OpCode::LOOP:
+            case OpCode::COMMIT:
+            case OpCode::JUMP: out << ' ' << in.a; break;
+            case OpCode::DISPATCH:
+            case OpCode::DISPATCH_WS: out << " table " << in.a; break;
+            case OpCode::CALL:
+                out << ' ' << rule_names[in.a];
+                if (in.b & CALL_NODE) out << " node";
+                if (in.b & CALL_SKIP) out << " skip";
+                break;
+            default: break;
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+} // namespace bnf_parser_generator
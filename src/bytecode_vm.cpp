@@ -0,0 +1,236 @@
+#include "bytecode_vm.hpp"
+#include <cstring>
+
+namespace bnf_parser_generator {
+
+size_t BytecodeParser::lookahead(size_t pos, bool past_whitespace) const {
+    if (past_whitespace) {
+        while (pos < input_.size() && program_.skip_set.test(static_cast<unsigned char>(input_[pos]))) {
+            ++pos;
+        }
+    }
+    return pos < input_.size() ? static_cast<unsigned char>(input_[pos]) : END_OF_INPUT;
+}
+
+size_t BytecodeParser::run() {
+    const Instruction* code = program_.code.data();
+    const char* data = input_.data();
+    const size_t size = input_.size();
+    size_t pos = 0;
+    size_t depth = 0;
+    uint32_t pc = program_.entry;
+
+    for (;;) {
+        const Instruction& in = code[pc];
+        // Удачная инструкция продолжает цикл, break из switch - неудача
+        switch (in.op) {
+            case OpCode::CHAR:
+                if (pos < size && static_cast<unsigned char>(data[pos]) == in.a) {
+                    ++pos;
+                    ++pc;
+                    continue;
+                }
+                break;
+            case OpCode::STRING: {
+                const std::string& literal = program_.literals[in.a];
+                if (size - pos >= literal.size() && std::memcmp(data + pos, literal.data(), literal.size()) == 0) {
+                    pos += literal.size();
+                    ++pc;
+                    continue;
+                }
+                break;
+            }
+            case OpCode::SET:
+                if (pos < size && program_.sets[in.a].test(static_cast<unsigned char>(data[pos]))) {
+                    ++pos;
+                    ++pc;
+                    continue;
+                }
+                break;
+            case OpCode::RANGE: {
+                if (pos >= size) break;
+                // Декодирование как в сгенерированном парсере: байт без
+                // ведущих битов длины - символ из одного байта
+                const unsigned char first = static_cast<unsigned char>(data[pos]);
+                size_t length = 1;
+                uint32_t cp = first;
+                if (first & 0x80) {
+                    if ((first & 0xE0) == 0xC0) length = 2;
+                    else if ((first & 0xF0) == 0xE0) length = 3;
+                    else if ((first & 0xF8) == 0xF0) length = 4;
+                    if (pos + length > size) break;
+                    auto next = [&](size_t i) { return static_cast<uint32_t>(static_cast<unsigned char>(data[pos + i]) & 0x3F); };
+                    if (length == 2) cp = ((first & 0x1Fu) << 6) | next(1);
+                    else if (length == 3) cp = ((first & 0x0Fu) << 12) | (next(1) << 6) | next(2);
+                    else if (length == 4) cp = ((first & 0x07u) << 18) | (next(1) << 12) | (next(2) << 6) | next(3);
+                }
+                const auto& range = program_.ranges[in.a];
+                if (cp < range.first || cp > range.second) break;
+                pos += length;
+                ++pc;
+                continue;
+            }
+            case OpCode::SPAN: {
+                const LookaheadSet& set = program_.sets[in.a];
+                const size_t start = pos;
+                while (pos < size && set.test(static_cast<unsigned char>(data[pos]))) ++pos;
+                if (pos - start < in.b) break;
+                ++pc;
+                continue;
+            }
+            case OpCode::SKIP:
+                while (pos < size && program_.skip_set.test(static_cast<unsigned char>(data[pos]))) ++pos;
+                ++pc;
+                continue;
+            case OpCode::CHOICE:
+                stack_.push_back(Entry{in.a, NO_NODE, pos, nodes_.size()});
+                ++pc;
+                continue;
+            case OpCode::PLUS_CHOICE:
+                stack_.push_back(Entry{PROPAGATE, NO_NODE, pos, nodes_.size()});
+                ++pc;
+                continue;
+            case OpCode::LOOP: {
+                if (stack_.empty()) break;
+                Entry& top = stack_.back();
+                if (pos == top.pos) {
+                    // Пустое повторение завершает цикл, его узлы остаются
+                    stack_.pop_back();
+                    ++pc;
+                    continue;
+                }
+                top.label = pc + 1;
+                top.pos = pos;
+                top.saved = nodes_.size();
+                pc = in.a;
+                continue;
+            }
+            case OpCode::COMMIT:
+                if (stack_.empty()) break;
+                stack_.pop_back();
+                pc = in.a;
+                continue;
+            case OpCode::JUMP:
+                pc = in.a;
+                continue;
+            case OpCode::TEST:
+            case OpCode::TEST_WS: {
+                const size_t next = lookahead(pos, in.op == OpCode::TEST_WS);
+                if (!program_.sets[in.b].test(next)) {
+                    if (pos > farthest_) farthest_ = pos;
+                    pc = in.a;
+                } else {
+                    ++pc;
+                }
+                continue;
+            }
+            case OpCode::DISPATCH:
+            case OpCode::DISPATCH_WS: {
+                const uint32_t target = program_.dispatch[in.a][lookahead(pos, in.op == OpCode::DISPATCH_WS)];
+                if (target == BytecodeProgram::FAIL_LABEL) break;
+                pc = target;
+                continue;
+            }
+            case OpCode::FAIL:
+                break;
+            case OpCode::CALL: {
+                const bool skip = (in.b & BytecodeProgram::CALL_SKIP) != 0;
+                if (!skip) {
+                    if (depth >= program_.max_depth) {
+                        depth_exceeded_ = true;
+                        break;
+                    }
+                    ++depth;
+                }
+                uint32_t node = NO_NODE;
+                if (in.b & BytecodeProgram::CALL_NODE) {
+                    node = static_cast<uint32_t>(nodes_.size());
+                    nodes_.push_back(Node{in.a, pos, pos, 0});
+                }
+                stack_.push_back(Entry{skip ? SKIP_FRAME : CALL_FRAME, node, pc + 1, skip ? farthest_ : 0});
+                pc = program_.rule_entries[in.a];
+                continue;
+            }
+            case OpCode::RETURN: {
+                if (stack_.empty() || (stack_.back().label != CALL_FRAME && stack_.back().label != SKIP_FRAME)) break;
+                const Entry frame = stack_.back();
+                stack_.pop_back();
+                if (frame.label == SKIP_FRAME) {
+                    farthest_ = frame.saved;
+                } else {
+                    --depth;
+                }
+                if (frame.rule_node != NO_NODE) {
+                    nodes_[frame.rule_node].end = pos;
+                    nodes_[frame.rule_node].next = nodes_.size();
+                }
+                pc = static_cast<uint32_t>(frame.pos);
+                continue;
+            }
+            case OpCode::END:
+                return pos;
+        }
+
+        // Неудача: откат к последней точке выбора
+        if (pos > farthest_ && in.op != OpCode::CALL) farthest_ = pos;
+        for (;;) {
+            if (stack_.empty()) return std::string_view::npos;
+            const Entry entry = stack_.back();
+            stack_.pop_back();
+            if (entry.label == CALL_FRAME) {
+                --depth;
+            } else if (entry.label == SKIP_FRAME) {
+                farthest_ = entry.saved;
+            } else if (entry.label != PROPAGATE) {
+                pos = entry.pos;
+                nodes_.resize(entry.saved);
+                pc = entry.label;
+                break;
+            }
+        }
+    }
+}
+
+bool BytecodeParser::parse(std::string_view input) {
+    input_ = input;
+    stack_.clear();
+    nodes_.clear();
+    farthest_ = 0;
+    depth_exceeded_ = false;
+    error_.clear();
+    error_offset_ = 0;
+
+    const size_t end = run();
+    if (end == std::string_view::npos) {
+        error_offset_ = farthest_;
+        error_ = depth_exceeded_ ? "Maximum recursion depth exceeded"
+                                 : "Parse failed at position " + std::to_string(farthest_);
+        nodes_.clear();
+        return false;
+    }
+    if (end != input.size()) {
+        error_offset_ = end;
+        error_ = "Unexpected input at position " + std::to_string(end);
+        nodes_.clear();
+        return false;
+    }
+    return true;
+}
+
+std::string BytecodeParser::toString(const Node& node, size_t indent) const {
+    std::string out(indent * 2, ' ');
+    out += ruleName(node);
+    const size_t index = static_cast<size_t>(&node - nodes_.data());
+    if (node.next == index + 1) {
+        out += ": \"";
+        out += text(node);
+        out += "\"";
+    }
+    out += "\n";
+    for (size_t child = index + 1; child < node.next; child = nodes_[child].next) {
+        out += toString(nodes_[child], indent + 1);
+    }
+    return out;
+}
+
+} // namespace bnf_parser_generator
@@ -1,5 +1,6 @@
 #include "code_generator.hpp"
 #include "cpp_backend.hpp"
+#include "cpp_templates_backend.hpp"
 #include <algorithm>
 #include <cctype>
 
@@ -87,6 +88,9 @@ std::unique_ptr<CodeGenerator> CodeGeneratorFactory::create(const std::string& l
     if (lang_lower == "cpp" || lang_lower == "c++" || lang_lower == "cxx") {
         return std::make_unique<CppCodeGenerator>();
     }
+    if (lang_lower == "cpp-templates") {
+        return std::make_unique<CppTemplatesCodeGenerator>();
+    }
     // Будущие языки:
     // else if (lang_lower == "dart") {
     //     return std::make_unique<DartCodeGenerator>();
@@ -104,6 +108,7 @@ std::unique_ptr<CodeGenerator> CodeGeneratorFactory::create(const std::string& l
 std::vector<std::string> CodeGeneratorFactory::getSupportedLanguages() {
     return {
         "cpp",
+        "cpp-templates",
         // Будущие языки:
         // "dart",
         // "java",
@@ -0,0 +1,806 @@
+#include "corpus_generator.hpp"
+#include "bnf_parser.hpp"
+#include "grammar_analysis.hpp"
+#include "grammar_optimizer.hpp"
+#include "utf8_utils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+constexpr size_t INF = std::numeric_limits<size_t>::max();
+// Вывод сбрасывается в поток между элементами, когда буфер достигает этого размера
+constexpr size_t FLUSH_BYTES = 64 * 1024;
+// Ключей слота, из которых {lookup} выбирает подстановку; остальные не запоминаются
+constexpr size_t MAX_SLOT_KEYS = 4096;
+// Подряд неудавшихся элементов, после которых повторение заканчивается
+constexpr size_t MAX_FAILED_ITEMS = 1000;
+
+// Блоки, из которых берутся символы вне ASCII: латиница, греческий,
+// кириллица, кана, CJK, хангыль, эмодзи
+const std::pair<uint32_t, uint32_t> kUnicodeBlocks[] = {
+    {0x00C0, 0x024F}, {0x0370, 0x03FF}, {0x0400, 0x04FF}, {0x3040, 0x30FF},
+    {0x4E00, 0x9FFF}, {0xAC00, 0xD7A3}, {0x1F300, 0x1F64F},
+};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isWord(unsigned char c) {
+    return std::isalnum(c) || c == '_' || c >= 0x80;
+}
+
+size_t plusOne(size_t value) {
+    return value == INF ? INF : value + 1;
+}
+
+// Значение параметра INTEGER или условия {check}: параметр текущего правила,
+// целый литерал, true/false, n-1, n+1, n == 0 (проверка специализации
+// spaces[0]); о другом имени ничего не известно - nullopt
+std::optional<long long> valueOf(const std::string& expression,
+                                 const std::vector<std::pair<std::string, long long>>& bindings) {
+    for (const auto& [name, value] : bindings) {
+        if (name == expression) return value;
+    }
+    if (size_t eq = expression.find(" == "); eq != std::string::npos) {
+        auto left = valueOf(expression.substr(0, eq), bindings);
+        auto right = valueOf(expression.substr(eq + 4), bindings);
+        if (!left || !right) return std::nullopt;
+        return *left == *right ? 1 : 0;
+    }
+    if (size_t op = expression.find_last_of("+-"); op != std::string::npos && op > 0) {
+        auto base = valueOf(expression.substr(0, op), bindings);
+        auto offset = valueOf(expression.substr(op + 1), bindings);
+        if (base && offset) return expression[op] == '+' ? *base + *offset : *base - *offset;
+    }
+    if (expression == "true") return 1;
+    if (expression == "false") return 0;
+    char* end = nullptr;
+    long long value = std::strtoll(expression.c_str(), &end, 10);
+    if (!expression.empty() && *end == '\0') return value;
+    return std::nullopt;
+}
+
+// Без правила пробелов токены - правила-слова: только односимвольные
+// терминалы, диапазоны и вызовы других правил-слов (identifier, number)
+std::unordered_set<std::string> wordRules(const Grammar& grammar) {
+    std::unordered_set<std::string> words;
+    for (const auto& rule : grammar.rules) {
+        words.insert(rule->leftSide);
+    }
+    auto isWordNode = [&words](const ASTNode* node, auto& self) -> bool {
+        if (const auto* terminal = node_cast<Terminal>(node)) return utf8::length(terminal->value) <= 1;
+        if (const auto* call = node_cast<NonTerminal>(node)) return words.count(call->name) > 0;
+        bool word = true;
+        forEachChild(node, [&](const ASTNode* child) { word = word && self(child, self); });
+        return word;
+    };
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (const auto& rule : grammar.rules) {
+            if (words.count(rule->leftSide) && !isWordNode(rule->rightSide.get(), isWordNode)) {
+                words.erase(rule->leftSide);
+                changed = true;
+            }
+        }
+    }
+    return words;
+}
+
+} // namespace
+
+CorpusGenerator::CorpusGenerator(const Grammar& grammar, CorpusOptions options)
+    : grammar_(GrammarOptimizer::specialize(grammar)), options_(std::move(options)), rng_(options_.seed) {
+    whitespace_rule_ = findWhitespaceRule(*grammar_, options_.whitespace_rule);
+    lexical_rules_ = whitespace_rule_.empty() ? wordRules(*grammar_)
+                                              : findLexicalRules(*grammar_, whitespace_rule_, options_.token_rules);
+
+    for (const auto& [name, weights] : options_.weights) {
+        const ProductionRule* rule = grammar_->findRule(name);
+        if (!rule) {
+            throw std::runtime_error("Alternative weights for unknown rule " + name);
+        }
+        const auto* alternative = node_cast<Alternative>(rule->rightSide.get());
+        size_t choices = alternative ? alternative->choices.size() : 1;
+        if (weights.size() != choices) {
+            throw std::runtime_error("Rule " + name + " has " + std::to_string(choices) + " alternatives, but " +
+                                     std::to_string(weights.size()) + " weights are given");
+        }
+        if (alternative) {
+            weights_[alternative] = weights;
+        }
+    }
+    // Вызовы разрешаются один раз: при порождении - только поиск по адресу узла
+    for (const auto& rule : grammar_->rules) {
+        RuleInfo& info = rule_info_[rule.get()];
+        info.rule = rule.get();
+        info.lexical = lexical_rules_.count(rule->leftSide) > 0;
+        info.whitespace = rule->leftSide == whitespace_rule_;
+        collectContextNames(rule->rightSide.get(), info.context_names);
+        info.frame = rule->hasParameters() || !info.context_names.empty();
+        auto visit = [this](const ASTNode* node, auto& self) -> void {
+            if (const auto* call = node_cast<NonTerminal>(node)) {
+                const ProductionRule* callee = grammar_->findRule(call->name);
+                calls_[call] = callee ? &rule_info_[callee] : nullptr;
+            }
+            forEachChild(node, [&](const ASTNode* child) { self(child, self); });
+        };
+        visit(rule->rightSide.get(), visit);
+    }
+
+    computeHeights();
+    computeDistances();
+
+    // Грамматика без проверки отвергается сразу, до вывода корпуса
+    if (options_.validate && grammar_->findRule(grammar_->startSymbol)) {
+        validator(grammar_->startSymbol);
+    }
+
+    // Разделитель - только пробельный символ, с которого начинается правило
+    // пробелов. Кратчайший текст правила из одних комментариев ('#' ...)
+    // поглотил бы следующий токен, поэтому тогда токены идут вплотную
+    token_separator_ = " ";
+    item_separator_ = "\n";
+    if (!whitespace_rule_.empty()) {
+        auto analysis = GrammarAnalysis::analyze(*grammar_);
+        const RuleAnalysis* whitespace = analysis.findRule(whitespace_rule_);
+        auto starts = [&](char c) { return whitespace && whitespace->first.test(static_cast<unsigned char>(c)); };
+        if (!starts(' ')) {
+            token_separator_ = starts('\t') ? "\t" : starts('\n') ? "\n" : "";
+        }
+        if (!starts('\n')) {
+            item_separator_ = token_separator_;
+        }
+    }
+}
+
+// Высота вывода: наибольшее число вложенных вызовов правил в кратчайшем
+// завершении узла. До неподвижной точки по правилам, затем по узлам
+void CorpusGenerator::computeHeights() {
+    for (const auto& rule : grammar_->rules) {
+        rule_height_.emplace(rule->leftSide, INF);
+    }
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (const auto& rule : grammar_->rules) {
+            if (grammar_->findRule(rule->leftSide) != rule.get()) continue;
+            size_t height = nodeHeight(rule->rightSide.get());
+            if (height < rule_height_[rule->leftSide]) {
+                rule_height_[rule->leftSide] = height;
+                changed = true;
+            }
+        }
+    }
+    auto visit = [this](const ASTNode* node, auto& self) -> void {
+        height_[node] = nodeHeight(node);
+        forEachChild(node, [&](const ASTNode* child) { self(child, self); });
+    };
+    for (const auto& rule : grammar_->rules) {
+        visit(rule->rightSide.get(), visit);
+    }
+}
+
+size_t CorpusGenerator::nodeHeight(const ASTNode* node) const {
+    switch (node->kind()) {
+        case NodeKind::NON_TERMINAL: {
+            auto it = rule_height_.find(static_cast<const NonTerminal*>(node)->name);
+            return it == rule_height_.end() ? INF : plusOne(it->second);
+        }
+        case NodeKind::SEQUENCE: {
+            size_t height = 0;
+            for (const auto& element : static_cast<const Sequence*>(node)->elements) {
+                height = std::max(height, nodeHeight(element.get()));
+            }
+            return height;
+        }
+        case NodeKind::ALTERNATIVE: {
+            size_t height = INF;
+            for (const auto& choice : static_cast<const Alternative*>(node)->choices) {
+                height = std::min(height, nodeHeight(choice.get()));
+            }
+            return height;
+        }
+        case NodeKind::GROUP:
+            return nodeHeight(static_cast<const Group*>(node)->content.get());
+        case NodeKind::ONE_OR_MORE:
+            return nodeHeight(static_cast<const OneOrMore*>(node)->content.get());
+        default:
+            return 0;  // Терминал, диапазон, [ ], { }, действие, ^
+    }
+}
+
+// Расстояние до основного повторения: число вызовов правил до { } или X+
+// синтаксического правила. Токены и правило пробелов его не содержат
+void CorpusGenerator::computeDistances() {
+    for (const auto& rule : grammar_->rules) {
+        rule_distance_.emplace(rule->leftSide, INF);
+    }
+    auto growable = [this](const std::string& name) {
+        return name != whitespace_rule_ && !lexical_rules_.count(name);
+    };
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (const auto& rule : grammar_->rules) {
+            if (grammar_->findRule(rule->leftSide) != rule.get() || !growable(rule->leftSide)) continue;
+            size_t distance = nodeDistance(rule->rightSide.get());
+            if (distance < rule_distance_[rule->leftSide]) {
+                rule_distance_[rule->leftSide] = distance;
+                changed = true;
+            }
+        }
+    }
+    auto visit = [this](const ASTNode* node, auto& self) -> void {
+        distance_[node] = nodeDistance(node);
+        forEachChild(node, [&](const ASTNode* child) { self(child, self); });
+    };
+    for (const auto& rule : grammar_->rules) {
+        if (growable(rule->leftSide)) {
+            visit(rule->rightSide.get(), visit);
+        }
+    }
+}
+
+size_t CorpusGenerator::nodeDistance(const ASTNode* node) const {
+    switch (node->kind()) {
+        case NodeKind::ZERO_OR_MORE:
+        case NodeKind::ONE_OR_MORE:
+            return 0;
+        case NodeKind::NON_TERMINAL: {
+            auto it = rule_distance_.find(static_cast<const NonTerminal*>(node)->name);
+            return it == rule_distance_.end() ? INF : plusOne(it->second);
+        }
+        case NodeKind::SEQUENCE:
+        case NodeKind::ALTERNATIVE:
+        case NodeKind::GROUP:
+        case NodeKind::OPTIONAL: {
+            size_t distance = INF;
+            forEachChild(node, [&](const ASTNode* child) {
+                distance = std::min(distance, nodeDistance(child));
+            });
+            return distance;
+        }
+        default:
+            return INF;
+    }
+}
+
+// Имена правил, тексты которых читают {store} и {lookup}
+void CorpusGenerator::collectContextNames(const ASTNode* node, std::unordered_set<std::string>& names) const {
+    if (const auto* action = node_cast<ContextAction>(node)) {
+        if (action->actionType != ContextAction::ActionType::CHECK) {
+            names.insert(action->arguments.begin(), action->arguments.end());
+        }
+        return;
+    }
+    forEachChild(node, [&](const ASTNode* child) { collectContextNames(child, names); });
+}
+
+CorpusStats CorpusGenerator::generate(std::ostream& out) {
+    out_ = &out;
+    stats_ = CorpusStats{};
+    buffer_.clear();
+    written_ = 0;
+    last_byte_ = '\n';
+    item_break_ = false;
+    last_keyword_ = false;
+    token_pending_ = false;
+
+    const ProductionRule* start = grammar_->findRule(grammar_->startSymbol);
+    if (!start) {
+        out_ = nullptr;
+        throw std::runtime_error("Start rule " + grammar_->startSymbol + " is not defined");
+    }
+    auto cannotDerive = [&]() {
+        out_ = nullptr;
+        return std::runtime_error("Cannot derive a sentence of " + start->leftSide);
+    };
+
+    // Путь к основному повторению: вывод дорастает до объёма внутри одного предложения
+    bool grown = false;
+    if (rule_distance_[start->leftSide] != INF) {
+        filling_ = true;
+        bool derived = generateRule(rule_info_.at(start), nullptr);
+        grown = !filling_;
+        filling_ = false;
+        if (!derived) throw cannotDerive();
+        if (!grown) {
+            emit("\n");
+            ++stats_.items;
+        }
+    }
+    // Иначе предложения по одному на строку
+    size_t failures = 0;
+    while (!grown && position() < options_.target_bytes) {
+        Mark before = mark();
+        size_t attempts = options_.validate ? std::max<size_t>(options_.max_attempts, 1) : 1;
+        bool derived = false;
+        for (size_t attempt = 0; attempt < attempts && !derived; ++attempt) {
+            derived = generateRule(rule_info_.at(start), nullptr) && accepted(start->leftSide, before.position);
+            if (!derived) restore(before);
+        }
+        if (!derived) {
+            if (++failures >= MAX_FAILED_ITEMS) throw cannotDerive();
+            continue;
+        }
+        failures = 0;
+        emit("\n");
+        ++stats_.items;
+        if (buffer_.size() >= FLUSH_BYTES) flush();
+    }
+    flush();
+    stats_.bytes = written_;
+    out_ = nullptr;
+    return stats_;
+}
+
+std::string CorpusGenerator::sentence() {
+    const ProductionRule* start = grammar_->findRule(grammar_->startSymbol);
+    if (!start) {
+        throw std::runtime_error("Start rule " + grammar_->startSymbol + " is not defined");
+    }
+    buffer_.clear();
+    written_ = 0;
+    last_byte_ = '\n';
+    item_break_ = false;
+    last_keyword_ = false;
+    token_pending_ = false;
+    Mark before = mark();
+    size_t attempts = options_.validate ? std::max<size_t>(options_.max_attempts, 1) : 1;
+    for (size_t failures = 0; failures < MAX_FAILED_ITEMS; ++failures) {
+        for (size_t attempt = 0; attempt < attempts; ++attempt) {
+            if (generateRule(rule_info_.at(start), nullptr) && accepted(start->leftSide, before.position)) {
+                return std::move(buffer_);
+            }
+            restore(before);
+        }
+    }
+    throw std::runtime_error("Cannot derive a sentence of " + start->leftSide);
+}
+
+bool CorpusGenerator::generateNode(const ASTNode* node) {
+    switch (node->kind()) {
+        case NodeKind::TERMINAL:
+            return generateTerminal(static_cast<const Terminal*>(node)->value);
+        case NodeKind::CHAR_RANGE:
+            return generateCodepoint(static_cast<const CharRange*>(node));
+        case NodeKind::NON_TERMINAL:
+            return generateCall(static_cast<const NonTerminal*>(node));
+        case NodeKind::SEQUENCE:
+            return generateSequence(static_cast<const Sequence*>(node));
+        case NodeKind::ALTERNATIVE:
+            return generateAlternative(static_cast<const Alternative*>(node));
+        case NodeKind::GROUP:
+            return generateNode(static_cast<const Group*>(node)->content.get());
+        case NodeKind::OPTIONAL: {
+            const ASTNode* content = static_cast<const Optional*>(node)->content.get();
+            bool take;
+            if (filling_ && distance_.count(node) && distance_.at(node) != INF) {
+                take = true;
+            } else if (closing()) {
+                take = false;
+            } else {
+                take = std::bernoulli_distribution(options_.optional_probability)(rng_);
+            }
+            if (take) {
+                Mark before = mark();
+                if (!generateNode(content)) restore(before);
+            }
+            return true;
+        }
+        case NodeKind::ZERO_OR_MORE:
+        case NodeKind::ONE_OR_MORE: {
+            bool spine = filling_ && distance_.count(node) && distance_.at(node) == 0;
+            const ASTNode* content = node->kind() == NodeKind::ZERO_OR_MORE
+                                         ? static_cast<const ZeroOrMore*>(node)->content.get()
+                                         : static_cast<const OneOrMore*>(node)->content.get();
+            return generateRepetition(content, node->kind() == NodeKind::ONE_OR_MORE ? 1 : 0, spine);
+        }
+        case NodeKind::CONTEXT_ACTION:
+            return generateAction(static_cast<const ContextAction*>(node));
+        case NodeKind::CUT:
+            return true;
+    }
+    return false;
+}
+
+// На пути к основному повторению он продолжается элементом с наименьшим
+// расстоянием, остальные элементы порождаются обычным образом
+bool CorpusGenerator::generateSequence(const Sequence* node) {
+    size_t carrier = INF;
+    if (filling_) {
+        size_t best = INF;
+        for (size_t i = 0; i < node->elements.size(); ++i) {
+            auto it = distance_.find(node->elements[i].get());
+            if (it != distance_.end() && it->second < best) {
+                best = it->second;
+                carrier = i;
+            }
+        }
+    }
+    for (size_t i = 0; i < node->elements.size(); ++i) {
+        bool filling = filling_;
+        if (i != carrier) filling_ = false;
+        bool ok = generateNode(node->elements[i].get());
+        if (i != carrier) filling_ = filling;
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Выбор по весам среди предпочтительных альтернатив: на пути к основному
+// повторению - ближайших к нему, глубже max_depth - наименьшей высоты.
+// Неудавшаяся альтернатива откатывается, затем пробуются остальные
+bool CorpusGenerator::generateAlternative(const Alternative* node) {
+    const auto& choices = node->choices;
+    auto weighted = weights_.find(node);
+    const std::vector<double>* weights = weighted == weights_.end() ? nullptr : &weighted->second;
+    auto weight = [weights](size_t i) { return weights ? (*weights)[i] : 1.0; };
+    std::vector<size_t> rank;
+    size_t best = 0;
+    if (filling_ || closing()) {
+        const auto& table = filling_ ? distance_ : height_;
+        rank.resize(choices.size(), INF);
+        best = INF;
+        for (size_t i = 0; i < choices.size(); ++i) {
+            auto it = table.find(choices[i].get());
+            if (it != table.end()) rank[i] = it->second;
+            if (weight(i) > 0) best = std::min(best, rank[i]);
+        }
+    }
+    auto preferred = [&](size_t i) { return weight(i) > 0 && (rank.empty() || rank[i] == best); };
+
+    // Обычно удаётся первый выбор: он берётся без построения порядка
+    double total = 0.0;
+    for (size_t i = 0; i < choices.size(); ++i) {
+        if (preferred(i)) total += weight(i);
+    }
+    if (total <= 0.0) return false;
+    double r = std::uniform_real_distribution<double>(0.0, total)(rng_);
+    size_t first = choices.size();
+    for (size_t i = 0; i < choices.size(); ++i) {
+        if (!preferred(i)) continue;
+        first = i;
+        if ((r -= weight(i)) < 0.0) break;
+    }
+    Mark before = mark();
+    if (generateNode(choices[first].get())) return true;
+    restore(before);
+
+    std::vector<size_t> group;
+    for (int pass = 0; pass < 2; ++pass) {
+        group.clear();
+        for (size_t i = 0; i < choices.size(); ++i) {
+            if (i != first && weight(i) > 0 && preferred(i) == (pass == 0)) group.push_back(i);
+        }
+        while (!group.empty()) {
+            std::vector<double> group_weights;
+            for (size_t i : group) group_weights.push_back(weight(i));
+            size_t k = pick(group_weights);
+            size_t i = group[k];
+            group.erase(group.begin() + static_cast<std::ptrdiff_t>(k));
+            if (generateNode(choices[i].get())) return true;
+            restore(before);
+        }
+    }
+    return false;
+}
+
+// Основное повторение растёт до target_bytes, вывод сбрасывается между его
+// элементами; обычное - от min_count до max_repeat раз
+bool CorpusGenerator::generateRepetition(const ASTNode* content, size_t min_count, bool spine) {
+    if (!spine) {
+        size_t count = min_count;
+        if (!closing()) {
+            count = std::uniform_int_distribution<size_t>(min_count, std::max(min_count, options_.max_repeat))(rng_);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            Mark before = mark();
+            if (!generateNode(content)) {
+                restore(before);
+                return i >= min_count;
+            }
+            if (position() == before.position) break;  // Пустое повторение заканчивает цикл разбора
+        }
+        return true;
+    }
+
+    filling_ = false;
+    bool in_item = in_item_;
+    size_t item_depth = item_depth_;
+    in_item_ = true;
+    item_depth_ = depth_;
+    size_t count = 0;
+    size_t failures = 0;
+    while ((position() < options_.target_bytes || count < min_count) && failures < MAX_FAILED_ITEMS) {
+        Mark before = mark();
+        item_break_ = count > 0;
+        if (!generateNode(content) || position() == before.position) {
+            restore(before);
+            ++failures;
+            continue;
+        }
+        failures = 0;
+        ++count;
+        ++stats_.items;
+        if (buffer_.size() >= FLUSH_BYTES) flush();
+    }
+    item_break_ = false;
+    in_item_ = in_item;
+    item_depth_ = item_depth;
+    return count >= min_count;
+}
+
+// Элемент основного повторения, который вызывает синтаксическое правило
+// прямо, проверяется и при отказе порождается заново. Текст вызова
+// запоминается для контекстных действий вызывающего правила
+bool CorpusGenerator::generateCall(const NonTerminal* node) {
+    const RuleInfo* callee = calls_.at(node);
+    if (!callee) return false;
+    const RuleInfo& info = *callee;
+    if (syntactic() && info.whitespace) {
+        return true;  // Пробелы вставляются перед следующим токеном
+    }
+    // Кратчайшее завершение после max_depth короче числа правил; глубже ведут
+    // только выборы в обход отвергнутого {check} (spaces[n-1] при n < 0)
+    if ((info.lexical ? lexical_depth_ : depth_) >= options_.max_depth + grammar_->rules.size()) {
+        return false;
+    }
+    bool lexical = info.lexical;
+    bool token = syntactic() && lexical;
+    if (token) {
+        // Первый байт токена ещё неизвестен: граница - у первого символа
+        token_pending_ = true;
+    }
+    size_t begin = position();
+    bool check = options_.validate && in_item_ && depth_ == item_depth_ && syntactic() && !lexical;
+    size_t attempts = check ? std::max<size_t>(options_.max_attempts, 1) : 1;
+    bool ok = false;
+    for (size_t attempt = 0; attempt < attempts && !ok; ++attempt) {
+        Mark before = mark();
+        ok = generateRule(info, node) && (!check || accepted(node->name, begin));
+        if (!ok) restore(before);
+    }
+    if (token) token_pending_ = false;  // Пустой токен
+    if (ok && current_ && !current_->context_names.empty() && current_->context_names.count(node->name)) {
+        while (begin < position() && begin >= written_ && isSpace(buffer_[begin - written_])) ++begin;
+        auto& spans = frames_.back().spans;
+        auto it = std::find_if(spans.begin(), spans.end(), [&](const Span& span) { return span.name == node->name; });
+        if (it == spans.end()) {
+            spans.push_back({node->name, begin, position()});
+        } else {
+            it->begin = begin;
+            it->end = position();
+        }
+    }
+    return ok;
+}
+
+// Кадр нужен только правилам с параметрами или контекстными действиями
+bool CorpusGenerator::generateRule(const RuleInfo& info, const NonTerminal* call) {
+    const ProductionRule* rule = info.rule;
+    if (info.frame) {
+        Frame frame;
+        for (size_t i = 0; i < rule->parameters.size(); ++i) {
+            long long value = 0;
+            if (call && i < call->parameterValues.size()) {
+                value = valueOf(call->parameterValues[i], bindings()).value_or(0);
+            }
+            frame.bindings.emplace_back(rule->parameters[i].name, value);
+        }
+        frames_.push_back(std::move(frame));
+    }
+    const RuleInfo* caller = current_;
+    current_ = &info;
+    size_t& depth = info.lexical ? lexical_depth_ : depth_;
+    ++depth;
+    stats_.max_depth = std::max(stats_.max_depth, depth_);
+    bool ok = generateNode(rule->rightSide.get());
+    --depth;
+    current_ = caller;
+    if (info.frame) frames_.pop_back();
+    return ok;
+}
+
+const std::vector<std::pair<std::string, long long>>& CorpusGenerator::bindings() const {
+    static const std::vector<std::pair<std::string, long long>> none;
+    return current_ && current_->frame ? frames_.back().bindings : none;
+}
+
+// {store} запоминает ключ в слоте; {lookup} при промахе заменяет только что
+// порождённый текст ключом слота, если он последний в выводе
+bool CorpusGenerator::generateAction(const ContextAction* node) {
+    if (node->arguments.empty()) return true;
+    const std::string& name = node->arguments[0];
+    if (node->actionType == ContextAction::ActionType::CHECK) {
+        return valueOf(name, bindings()).value_or(1) != 0;
+    }
+    Frame& frame = frames_.back();
+    Span* span = nullptr;
+    for (auto& candidate : frame.spans) {
+        if (candidate.name == name && candidate.begin >= written_ && candidate.end <= position()) {
+            span = &candidate;
+        }
+    }
+    std::string key = span ? std::string(text(span->begin, span->end)) : std::string();
+    if (node->actionType == ContextAction::ActionType::STORE) {
+        auto& keys = slot_keys_[name];
+        if (keys.size() < MAX_SLOT_KEYS) {
+            keys.push_back(key);
+            ++slot_counts_[name][key];
+            stored_.emplace_back(name, std::move(key));
+        }
+        return true;
+    }
+    if (slot_counts_[name].count(key)) return true;
+    const auto& keys = slot_keys_[name];
+    if (keys.empty() || !span || span->end != position()) return false;
+    const std::string& stored = keys[std::uniform_int_distribution<size_t>(0, keys.size() - 1)(rng_)];
+    buffer_.resize(span->begin - written_);
+    emit(stored);
+    span->end = position();
+    return true;
+}
+
+bool CorpusGenerator::generateTerminal(std::string_view text) {
+    if (text.empty()) return true;
+    unsigned char first = static_cast<unsigned char>(text[0]);
+    if (!beginToken(first, text.size() > 1 && isWord(first), true)) return false;
+    emit(text);
+    return true;
+}
+
+// Символ диапазона: вне ASCII с вероятностью unicode_ratio (или всегда,
+// если диапазон целиком вне ASCII), в ASCII - по возможности печатный
+bool CorpusGenerator::generateCodepoint(const CharRange* node) {
+    uint32_t low = std::min(node->start, node->end);
+    uint32_t high = std::min<uint32_t>(std::max(node->start, node->end), 0x10FFFF);
+    auto uniform = [this](uint32_t a, uint32_t b) { return std::uniform_int_distribution<uint32_t>(a, b)(rng_); };
+    bool wide = high >= 0x80 &&
+                (low >= 0x80 || std::bernoulli_distribution(std::clamp(options_.unicode_ratio, 0.0, 1.0))(rng_));
+    uint32_t codepoint;
+    if (!wide) {
+        uint32_t a = low, b = std::min<uint32_t>(high, 0x7F);
+        if (std::max<uint32_t>(a, 0x20) <= std::min<uint32_t>(b, 0x7E)) {
+            a = std::max<uint32_t>(a, 0x20);
+            b = std::min<uint32_t>(b, 0x7E);
+        }
+        codepoint = uniform(a, b);
+    } else {
+        uint32_t a = std::max<uint32_t>(low, 0x80);
+        std::vector<std::pair<uint32_t, uint32_t>> blocks;
+        for (const auto& [first, last] : kUnicodeBlocks) {
+            if (first <= high && last >= a) blocks.emplace_back(std::max(first, a), std::min(last, high));
+        }
+        if (!blocks.empty()) {
+            const auto& block = blocks[uniform(0, static_cast<uint32_t>(blocks.size() - 1))];
+            codepoint = uniform(block.first, block.second);
+        } else {
+            codepoint = uniform(a, high);
+            if (codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+                codepoint = high > 0xDFFF ? 0xE000 : a;  // Суррогаты не кодируются в UTF-8
+            }
+        }
+    }
+    std::string bytes = utf8::codepointToUtf8(codepoint);
+    if (!beginToken(static_cast<unsigned char>(bytes[0]), false, false)) return false;
+    emit(bytes);
+    return true;
+}
+
+// Граница токена: терминал или диапазон синтаксического правила либо первый
+// символ токена. С правилом пробелов перед токеном вставляется разделитель.
+// Без него парсер пропускает isspace только перед терминалами, в том числе
+// внутри слов, поэтому пробел не останавливает повторение предыдущего слова:
+// слово сразу за словом (кроме ключевого слова) и терминал с пробелом в
+// начале не порождаются (false), а разделители ставятся только перед терминалом
+bool CorpusGenerator::beginToken(unsigned char first, bool keyword, bool terminal) {
+    if (whitespace_rule_.empty() && terminal && isSpace(static_cast<char>(first))) return false;
+    if (!syntactic() && !token_pending_) return true;
+    token_pending_ = false;
+    bool item_break = item_break_;
+    item_break_ = false;
+    bool after_space = isSpace(buffer_.empty() ? last_byte_ : buffer_.back());
+    bool merge = isWord(static_cast<unsigned char>(buffer_.empty() ? last_byte_ : buffer_.back())) && isWord(first);
+    if (!whitespace_rule_.empty()) {
+        const std::string& separator = item_break ? item_separator_ : token_separator_;
+        // Без пробельного разделителя слово за словом слилось бы в одно
+        if (separator.empty() && merge) return false;
+        if (!after_space) emit(separator);
+        return true;
+    }
+    if (merge && !last_keyword_) return false;
+    if (terminal && (item_break || merge)) emit(item_break ? item_separator_ : token_separator_);
+    last_keyword_ = keyword;
+    return true;
+}
+
+size_t CorpusGenerator::pick(const std::vector<double>& weights) {
+    if (weights.size() == 1) return 0;
+    return std::discrete_distribution<size_t>(weights.begin(), weights.end())(rng_);
+}
+
+void CorpusGenerator::restore(const Mark& mark) {
+    if (mark.position < written_) {
+        throw std::runtime_error("Corpus generation backtracked past the streamed output");
+    }
+    buffer_.resize(mark.position - written_);
+    while (stored_.size() > mark.stored) {
+        auto& [slot, key] = stored_.back();
+        slot_keys_[slot].pop_back();
+        auto& counts = slot_counts_[slot];
+        if (--counts[key] == 0) counts.erase(key);
+        stored_.pop_back();
+    }
+    item_break_ = mark.item_break;
+    last_keyword_ = mark.last_keyword;
+    token_pending_ = mark.token_pending;
+    filling_ = mark.filling;
+    stats_.items = mark.items;
+}
+
+std::string_view CorpusGenerator::text(size_t begin, size_t end) const {
+    if (begin < written_) {
+        throw std::runtime_error("Corpus text is already streamed");
+    }
+    return std::string_view(buffer_).substr(begin - written_, end - begin);
+}
+
+void CorpusGenerator::emit(std::string_view bytes) {
+    buffer_.append(bytes);
+}
+
+void CorpusGenerator::flush() {
+    if (!out_ || buffer_.empty()) return;
+    out_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    written_ += buffer_.size();
+    last_byte_ = buffer_.back();
+    buffer_.clear();
+}
+
+// Интерпретатор байт-кода для правила: компилируется при первом обращении.
+// Грамматику, которую он не принимает (параметры, действия, ^), проверить
+// нельзя - это ошибка, а не тихий пропуск проверки
+BytecodeParser& CorpusGenerator::validator(const std::string& rule) {
+    auto it = validators_.find(rule);
+    if (it == validators_.end()) {
+        Validator validator;
+        try {
+            if (!validation_grammar_) {
+                validation_grammar_ = BNFGrammarFactory::fromBinary(BNFGrammarFactory::toBinary(*grammar_));
+            }
+            validation_grammar_->startSymbol = rule;
+            GeneratorOptions options;
+            options.whitespace_rule = options_.whitespace_rule;
+            options.token_rules = options_.token_rules;
+            options.recognizer = true;
+            validator.program = std::make_unique<BytecodeProgram>(BytecodeProgram::compile(*validation_grammar_, options));
+            validator.parser = std::make_unique<BytecodeParser>(*validator.program);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Cannot validate the corpus: the bytecode interpreter does not accept rule " +
+                                     rule + ": " + e.what());
+        }
+        it = validators_.emplace(rule, std::move(validator)).first;
+    }
+    return *it->second.parser;
+}
+
+// Проверка текста правила интерпретатором байт-кода
+bool CorpusGenerator::accepted(const std::string& rule, size_t begin) {
+    if (!options_.validate) return true;
+    BytecodeParser& parser = validator(rule);
+    std::string_view sentence = text(begin, position());
+    while (!sentence.empty() && isSpace(sentence.front())) sentence.remove_prefix(1);
+    stats_.validated = true;
+    if (parser.parse(sentence)) return true;
+    ++stats_.rejected;
+    return false;
+}
+
+} // namespace bnf_parser_generator
@@ -1,47 +1,476 @@
 #include "cpp_backend.hpp"
+#include "grammar_optimizer.hpp"
 #include <sstream>
 #include <algorithm>
+#include <iomanip>
+#include <map>
 
 namespace bnf_parser_generator {
 
-GeneratedCode CppCodeGenerator::generate(const Grammar& grammar, const GeneratorOptions& options) {
+namespace {
+
+void collectReferences(const ASTNode* node, std::vector<std::string>& names) {
+    if (const auto* nt = node_cast<NonTerminal>(node)) {
+        names.push_back(nt->name);
+    } else if (const auto* alt = node_cast<Alternative>(node)) {
+        for (const auto& choice : alt->choices) collectReferences(choice.get(), names);
+    } else if (const auto* seq = node_cast<Sequence>(node)) {
+        for (const auto& element : seq->elements) collectReferences(element.get(), names);
+    } else if (const auto* group = node_cast<Group>(node)) {
+        collectReferences(group->content.get(), names);
+    } else if (const auto* opt = node_cast<Optional>(node)) {
+        collectReferences(opt->content.get(), names);
+    } else if (const auto* zeroMore = node_cast<ZeroOrMore>(node)) {
+        collectReferences(zeroMore->content.get(), names);
+    } else if (const auto* oneMore = node_cast<OneOrMore>(node)) {
+        collectReferences(oneMore->content.get(), names);
+    }
+}
+
+// Аргументы {store} и {lookup} в порядке появления; first_only - только
+// первые, то есть имена слотов
+void collectContextArguments(const ASTNode* node, std::vector<std::string>& names, bool first_only) {
+    if (const auto* action = node_cast<ContextAction>(node)) {
+        if (action->actionType == ContextAction::ActionType::CHECK || action->arguments.empty()) return;
+        names.insert(names.end(), action->arguments.begin(),
+                     first_only ? action->arguments.begin() + 1 : action->arguments.end());
+        return;
+    }
+    forEachChild(node, [&](const ASTNode* child) { collectContextArguments(child, names, first_only); });
+}
+
+// Отсечение внутри node действует на его область: ^ самой последовательности
+// или группы, но не вложенных выборов, [ ], { } и вызванных правил
+bool passesCut(const ASTNode* node) {
+    if (node_cast<Cut>(node)) {
+        return true;
+    }
+    if (const auto* seq = node_cast<Sequence>(node)) {
+        return std::any_of(seq->elements.begin(), seq->elements.end(),
+                           [](const auto& element) { return passesCut(element.get()); });
+    }
+    if (const auto* group = node_cast<Group>(node)) {
+        return passesCut(group->content.get());
+    }
+    return false;
+}
+
+// ^ до первого потребляющего вход элемента: альтернатива отсекает выбор, даже
+// если следующий байт не из её FIRST, поэтому таблица выбора её не пропускает
+bool cutBeforeInput(const ASTNode* node, const GrammarAnalysis& sets) {
+    if (node_cast<Cut>(node)) {
+        return true;
+    }
+    if (const auto* seq = node_cast<Sequence>(node)) {
+        for (const auto& element : seq->elements) {
+            if (cutBeforeInput(element.get(), sets)) return true;
+            if (!sets.isNullable(element.get())) return false;
+        }
+        return false;
+    }
+    if (const auto* group = node_cast<Group>(node)) {
+        return cutBeforeInput(group->content.get(), sets);
+    }
+    return false;
+}
+
+bool containsCut(const ASTNode* node) {
+    bool found = node_cast<Cut>(node) != nullptr;
+    forEachChild(node, [&](const ASTNode* child) { found = found || containsCut(child); });
+    return found;
+}
+
+// Терминалы, диапазоны символов и ссылки на правила в порядке появления
+void collectLeaves(const ASTNode* node, std::vector<const ASTNode*>& leaves) {
+    if (node_cast<Terminal>(node) || node_cast<CharRange>(node) ||
+        node_cast<NonTerminal>(node)) {
+        leaves.push_back(node);
+    } else if (const auto* alt = node_cast<Alternative>(node)) {
+        for (const auto& choice : alt->choices) collectLeaves(choice.get(), leaves);
+    } else if (const auto* seq = node_cast<Sequence>(node)) {
+        for (const auto& element : seq->elements) collectLeaves(element.get(), leaves);
+    } else if (const auto* group = node_cast<Group>(node)) {
+        collectLeaves(group->content.get(), leaves);
+    } else if (const auto* opt = node_cast<Optional>(node)) {
+        collectLeaves(opt->content.get(), leaves);
+    } else if (const auto* zeroMore = node_cast<ZeroOrMore>(node)) {
+        collectLeaves(zeroMore->content.get(), leaves);
+    } else if (const auto* oneMore = node_cast<OneOrMore>(node)) {
+        collectLeaves(oneMore->content.get(), leaves);
+    }
+}
+
+// Бор литералов альтернативы. В узле - номер первого по порядку литерала,
+// который в нём кончается, и наименьший номер литерала в поддереве: ветви,
+// где нет литералов раньше уже найденного, не проверяются
+struct LiteralTrie {
+    struct Node {
+        std::map<unsigned char, size_t> children;
+        size_t literal = SIZE_MAX;
+        size_t min_literal = SIZE_MAX;
+    };
+    std::vector<Node> nodes;
+
+    explicit LiteralTrie(const std::vector<std::string>& literals) : nodes(1) {
+        for (size_t i = 0; i < literals.size(); ++i) {
+            size_t node = 0;
+            nodes[node].min_literal = std::min(nodes[node].min_literal, i);
+            for (unsigned char c : literals[i]) {
+                auto it = nodes[node].children.find(c);
+                if (it == nodes[node].children.end()) {
+                    size_t child = nodes.size();
+                    nodes.emplace_back();
+                    it = nodes[node].children.emplace(c, child).first;
+                }
+                node = it->second;
+                nodes[node].min_literal = std::min(nodes[node].min_literal, i);
+            }
+            nodes[node].literal = std::min(nodes[node].literal, i);
+        }
+    }
+};
+
+std::string byteLabel(unsigned char c) {
+    if (c >= 0x20 && c < 0x7F && c != '\'' && c != '\\') {
+        return std::string("'") + static_cast<char>(c) + "'";
+    }
+    std::ostringstream out;
+    out << "0x" << std::hex << std::uppercase << static_cast<unsigned>(c);
+    return out.str();
+}
+
+// Строковый литерал C++ с произвольными байтами: восьмеричные escape-последовательности
+// не захватывают следующий символ, в отличие от \x
+std::string quoteBytes(const std::string& bytes) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : bytes) {
+        if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\' && c != '?') {
+            out << static_cast<char>(c);
+        } else {
+            out << '\\' << std::oct << ((c >> 6) & 7) << ((c >> 3) & 7) << (c & 7) << std::dec;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+// Узел бора на глубине depth: p, n - вход от начала литералов; best - первый
+// по порядку литерал, совпавший на пути к узлу. Каждая ветвь кончается return
+void emitTrieNode(const LiteralTrie& trie, size_t node, size_t depth, size_t best,
+                  const std::string& indent, std::ostringstream& ss) {
+    const auto& current = trie.nodes[node];
+    best = std::min(best, current.literal);
+    std::string result = best == SIZE_MAX ? "-1" : std::to_string(best);
+    std::vector<std::pair<unsigned char, size_t>> next;
+    for (const auto& [c, child] : current.children) {
+        if (trie.nodes[child].min_literal < best) {
+            next.emplace_back(c, child);
+        }
+    }
+    if (next.empty()) {
+        ss << indent << "return " << result << ";\n";
+        return;
+    }
+    if (next.size() == 1) {
+        // Цепочка без развилок и концов литералов проверяется одним сравнением
+        std::string bytes(1, static_cast<char>(next[0].first));
+        size_t child = next[0].second;
+        while (trie.nodes[child].literal == SIZE_MAX && trie.nodes[child].children.size() == 1) {
+            const auto& [c, grandchild] = *trie.nodes[child].children.begin();
+            bytes += static_cast<char>(c);
+            child = grandchild;
+        }
+        size_t end = depth + bytes.size();
+        if (bytes.size() == 1) {
+            ss << indent << "if (n > " << depth << " && static_cast<unsigned char>(p[" << depth << "]) == "
+               << byteLabel(next[0].first) << ") {\n";
+        } else {
+            ss << indent << "if (n >= " << end << " && std::memcmp(p + " << depth << ", " << quoteBytes(bytes)
+               << ", " << bytes.size() << ") == 0) {\n";
+        }
+        emitTrieNode(trie, child, end, best, indent + "    ", ss);
+        ss << indent << "}\n";
+        ss << indent << "return " << result << ";\n";
+        return;
+    }
+    ss << indent << "if (n > " << depth << ") {\n";
+    ss << indent << "    switch (static_cast<unsigned char>(p[" << depth << "])) {\n";
+    for (const auto& [c, child] : next) {
+        ss << indent << "        case " << byteLabel(c) << ": {\n";
+        emitTrieNode(trie, child, depth + 1, best, indent + "            ", ss);
+        ss << indent << "        }\n";
+    }
+    ss << indent << "        default:\n";
+    ss << indent << "            break;\n";
+    ss << indent << "    }\n";
+    ss << indent << "}\n";
+    ss << indent << "return " << result << ";\n";
+}
+
+} // namespace
+
+GeneratedCode CppCodeGenerator::generate(const Grammar& source, const GeneratorOptions& options) {
     GeneratedCode result;
     options_ = options;
     
     // Валидация грамматики
-    if (grammar.rules.empty()) {
+    if (source.rules.empty()) {
         result.success = false;
         result.error_message = "Grammar has no rules";
         return result;
     }
     
-    if (grammar.startSymbol.empty()) {
+    if (source.startSymbol.empty()) {
         result.success = false;
         result.error_message = "Grammar has no start symbol";
         return result;
     }
     
+    // Параметры, известные при генерации, подставляются: по функции на
+    // комбинацию значений, проверки параметров сворачиваются в выбор правила
+    specialized_.reset();
+    if (hasParameterizedRules(source)) {
+        try {
+            specialized_ = GrammarOptimizer::specialize(source);
+        } catch (const std::runtime_error& e) {
+            result.success = false;
+            result.error_message = e.what();
+            return result;
+        }
+    }
+    const Grammar& grammar = specialized_ ? *specialized_ : source;
+    
+    // Окно потокового разбора сдвигается после каждого feed(): смещения в узлах
+    // и токены лексера на ДКА относились бы к уже удалённому входу
+    stream_item_.clear();
+    if (options_.streaming) {
+        stream_item_ = options_.stream_item.empty() ? grammar.startSymbol : options_.stream_item;
+        if (!grammar.findRule(stream_item_)) {
+            result.success = false;
+            result.error_message = "Stream item rule not found: " + stream_item_;
+            return result;
+        }
+        if (options_.lazy_positions) {
+            options_.lazy_positions = false;
+            result.warnings.push_back("Lazy positions disabled: streaming tracks line and column while parsing");
+        }
+        if (options_.dfa_lexer) {
+            options_.dfa_lexer = false;
+            result.warnings.push_back("DFA lexer disabled: streaming parses the input window character by character");
+        }
+    }
+    
+    // Переиспользование поддеревьев между разборами: узлы живут в memo, а не в
+    // арене; смещения считаются относительно родителя и не устаревают после правки
+    if (options_.incremental) {
+        if (options_.streaming) {
+            result.success = false;
+            result.error_message = "Streaming and incremental reparsing cannot be combined";
+            return result;
+        }
+        options_.memoize = true;
+        options_.lazy_positions = true;
+        if (options_.arena_allocation) {
+            options_.arena_allocation = false;
+            result.warnings.push_back("Arena allocation disabled: incremental reparsing keeps subtrees between parses");
+        }
+        if (options_.dfa_lexer) {
+            options_.dfa_lexer = false;
+            result.warnings.push_back("DFA lexer disabled: incremental reparsing works on the characters of the input");
+        }
+    }
+    
+    // Без AST позиции узлов не нужны: в горячем пути остаётся только смещение,
+    // строка и столбец ошибки - через positionAt()
+    if (options_.recognizer || options_.event_callbacks) {
+        if (options_.recognizer && options_.event_callbacks) {
+            result.success = false;
+            result.error_message = "Recognizer and event callback modes cannot be combined";
+            return result;
+        }
+        if (options_.arena_allocation) {
+            options_.arena_allocation = false;
+            result.warnings.push_back("Arena allocation disabled: no AST is built");
+        }
+        if (!options_.streaming) {
+            options_.lazy_positions = true;
+        }
+    }
+    
+    // События пишутся в журнал, который откатывается вместе с backtracking, и
+    // доставляются обработчику по порядку входа после успешного разбора
+    if (options_.event_callbacks) {
+        if (options_.incremental) {
+            result.success = false;
+            result.error_message = "Event callbacks and incremental reparsing cannot be combined";
+            return result;
+        }
+        if (options_.memoize || !options_.memoize_rules.empty()) {
+            options_.memoize = false;
+            options_.memoize_rules.clear();
+            result.warnings.push_back("Memoization disabled: a memo hit would skip the events of the memoized rule");
+        }
+        if (options_.dfa_lexer) {
+            options_.dfa_lexer = false;
+            result.warnings.push_back("DFA lexer disabled: event spans are taken from the characters of the input");
+        }
+        if (options_.parallel) {
+            options_.parallel = false;
+            result.warnings.push_back("Parallel parsing disabled: events are delivered in input order on the calling thread");
+        }
+    }
+    
+    // Куски разбираются независимо: нужны весь вход сразу и позиции, не зависящие
+    // от предыдущих разборов; лексер на ДКА был бы последовательным проходом
+    if (options_.parallel) {
+        if (options_.streaming || options_.incremental) {
+            result.success = false;
+            result.error_message = "Parallel parsing cannot be combined with streaming or incremental reparsing";
+            return result;
+        }
+        if (options_.dfa_lexer) {
+            options_.dfa_lexer = false;
+            result.warnings.push_back("DFA lexer disabled: parallel parsing splits the characters of the input");
+        }
+    }
+    
+    // Время правил измеряется вместе со счётчиками
+    if (options_.profile_timing) {
+        options_.profile = true;
+    }
+    
+    // Правила с параметрами генерируются обычными функциями
+    if (options_.explicit_stack && hasParameterizedRules(grammar)) {
+        options_.explicit_stack = false;
+        result.warnings.push_back("Explicit stack disabled: parameterized rules are generated as ordinary functions");
+    }
+    
+    // Функции шаблона класса нельзя определить в отдельных файлах без явного
+    // инстанцирования для каждого обработчика
+    if (options_.split_units > 0 && options_.event_callbacks) {
+        options_.split_units = 0;
+        result.warnings.push_back("Split output disabled: the event parser is a class template");
+    }
+    
+    // Переиспользованное при reparse() поддерево не повторило бы свои действия
+    if (options_.incremental && hasContextActions(grammar)) {
+        options_.incremental = false;
+        result.warnings.push_back("Incremental reparsing disabled: reused subtrees would skip their context actions");
+    }
+    
+    // Дальняя ошибка отслеживается только в разборе всего входа одним вызовом:
+    // элементы потока, переиспользованные поддеревья и куски разбираются отдельно
+    if (options_.diagnostics && (options_.streaming || options_.incremental || options_.parallel)) {
+        options_.diagnostics = false;
+        result.warnings.push_back("Diagnostics disabled: only parse() of the whole input tracks the farthest failure");
+    }
+    
+    grammar_ = &grammar;
+    collectContextSlots(grammar);
+    scan_classes_.clear();
+    literal_tries_.clear();
+    expected_items_.clear();
+    expected_item_.clear();
+    expected_groups_.clear();
+    has_char_ranges_ = false;
+    for (const auto& rule : grammar.rules) {
+        std::vector<const ASTNode*> leaves;
+        collectLeaves(rule->rightSide.get(), leaves);
+        for (const ASTNode* leaf : leaves) {
+            if (node_cast<CharRange>(leaf)) has_char_ranges_ = true;
+        }
+    }
+    // Представление строится один раз: его используют оба анализа и номера правил
+    ir_ = std::make_shared<const GrammarIR>(GrammarIR::lower(grammar));
+    collectMemoizedRules(grammar);
+    analysis_ = GrammarAnalysis::analyze(ir_, GrammarAnalysis::Options{});
+    
     try {
-        // Генерация различных частей парсера
+        collectTrivia(grammar);
+        GrammarAnalysis::Options ws_options;
+        ws_options.skippedBeforeTokens = skip_class_;
+        ws_analysis_ = GrammarAnalysis::analyze(ir_, ws_options);
+        planLexer(grammar, result);
+        planParallel(grammar, result);
+        planSplit();
+        
+        // Генерация различных частей парсера. Класс парсера генерируется первым:
+        // набор include зависит от найденных при этом классов символов
+        std::string parser_class = generateParserClass(grammar);
         std::ostringstream code;
         
         code << generateHeader();
+        if (split_units_ > 0) {
+            code << "#pragma once\n\n";
+        }
         code << generateIncludes();
         code << "\n";
         code << generateASTNodeClasses(grammar);
         code << "\n";
-        code << generateParserClass(grammar);
+        code << parser_class;
         code << "\n";
         code << generateFooter();
         
         result.parser_code = code.str();
-        // Имя файла в snake_case: JsonParser -> json_parser.cpp
-        result.parser_filename = camelToSnake(options_.parser_name) + ".cpp";
+        if (split_units_ > 0) {
+            // Заголовок json_parser.hpp и файлы правил json_parser_rules_N.cpp
+            result.parser_filename = headerFilename();
+            for (size_t unit = 0; unit < split_units_; ++unit) {
+                result.additional_files.emplace_back(
+                    camelToSnake(options_.parser_name) + "_rules_" + std::to_string(unit) + ".cpp",
+                    generateRuleUnit(unit));
+            }
+        } else {
+            // Имя файла в snake_case: JsonParser -> json_parser.cpp
+            result.parser_filename = camelToSnake(options_.parser_name) + ".cpp";
+        }
         result.success = true;
         
         result.messages.push_back("Generated C++ parser successfully");
         result.messages.push_back("Total rules: " + std::to_string(grammar.rules.size()));
         result.messages.push_back("Start symbol: " + grammar.startSymbol);
+        if (!memoized_rules_.empty()) {
+            result.messages.push_back("Memoized rules: " + std::to_string(memoized_rules_.size()));
+        }
+        if (!scan_classes_.empty()) {
+            result.messages.push_back("Character class scanners: " + std::to_string(scan_classes_.size()));
+        }
+        if (!literal_tries_.empty()) {
+            result.messages.push_back("Literal tries: " + std::to_string(literal_tries_.size()));
+        }
+        if (options_.streaming) {
+            result.messages.push_back("Stream item: " + stream_item_);
+        }
+        if (!parallel_item_.empty()) {
+            result.messages.push_back("Parallel item: " + parallel_item_);
+        }
+        if (options_.recognizer) {
+            result.messages.push_back("Recognizer: no AST is built");
+        } else if (options_.event_callbacks) {
+            result.messages.push_back("Event callbacks: no AST is built");
+        }
+        if (options_.profile) {
+            result.messages.push_back(std::string("Profiling: per-rule counters") +
+                                      (options_.profile_timing ? " and cycles" : ""));
+        }
+        if (options_.explicit_stack) {
+            result.messages.push_back("Explicit stack: rules run as coroutines on a heap-allocated frame stack");
+        }
+        if (options_.diagnostics) {
+            result.messages.push_back("Diagnostics: " + std::to_string(expected_items_.size()) +
+                                      " expected items in " + std::to_string(expected_groups_.size()) + " groups");
+        }
+        if (split_units_ > 0) {
+            result.messages.push_back("Translation units: " + result.parser_filename + " and " +
+                                      std::to_string(split_units_) + " rule files");
+        }
+        if (!trivia_rule_.empty()) {
+            result.messages.push_back("Whitespace rule: " + trivia_rule_ + " (" +
+                                      std::to_string(lexical_rules_.size()) + " token rules)");
+        }
+        result.messages.push_back("LL(1) rules: " + std::to_string(analysis_.ll1Rules().size()) +
+                                  " of " + std::to_string(analysis_.rules().size()));
         
         // Генерация main.cpp если требуется исполняемый файл
         if (options_.generate_executable) {
@@ -72,11 +501,67 @@ std::string CppCodeGenerator::generateHeader() {
 std::string CppCodeGenerator::generateIncludes() {
     std::ostringstream ss;
     ss << "#include <string>\n";
+    ss << "#include <string_view>\n";
+    ss << "#include <cstring>\n";
+    ss << "#include <cstdint>\n";
+    ss << "#include <cctype>\n";
     ss << "#include <vector>\n";
     ss << "#include <memory>\n";
     ss << "#include <stdexcept>\n";
     ss << "#include <sstream>\n";
     ss << "#include <iostream>\n";
+    if (!memoized_rules_.empty() || !context_slots_.empty()) {
+        ss << "#include <unordered_map>\n";
+    }
+    if (!context_slots_.empty() && options_.streaming) {
+        ss << "#include <deque>\n";
+    }
+    if (options_.streaming) {
+        ss << "#include <functional>\n";
+    }
+    if (!parallel_item_.empty()) {
+        ss << "#include <thread>\n";
+    }
+    if (options_.diagnostics) {
+        ss << "#include <bitset>\n";
+    }
+    if (!scan_classes_.empty()) {
+        ss << "#if defined(__AVX2__)\n";
+        ss << "#include <immintrin.h>\n";
+        ss << "#elif defined(__SSE2__)\n";
+        ss << "#include <emmintrin.h>\n";
+        ss << "#elif defined(__ARM_NEON)\n";
+        ss << "#include <arm_neon.h>\n";
+        ss << "#endif\n";
+    } else if (skipUsesSimd()) {
+        ss << "#if defined(__SSE2__)\n";
+        ss << "#include <emmintrin.h>\n";
+        ss << "#endif\n";
+    }
+    if (options_.arena_allocation) {
+        ss << "#include <new>\n";
+    }
+    if (options_.arena_allocation || options_.lazy_positions || !parallel_item_.empty() || options_.profile ||
+        options_.explicit_stack) {
+        ss << "#include <algorithm>\n";
+    }
+    if (options_.explicit_stack) {
+        ss << "#include <coroutine>\n";
+        ss << "#include <cstddef>\n";
+        ss << "#include <exception>\n";
+        ss << "#include <utility>\n";
+    }
+    if (options_.profile) {
+        ss << "#include <iomanip>\n";
+    }
+    if (options_.profile_timing) {
+        ss << "#include <chrono>\n";
+        ss << "#if defined(_MSC_VER)\n";
+        ss << "#include <intrin.h>\n";
+        ss << "#elif defined(__x86_64__) || defined(__i386__)\n";
+        ss << "#include <x86intrin.h>\n";
+        ss << "#endif\n";
+    }
     ss << "\n";
     return ss.str();
 }
@@ -90,17 +575,101 @@ std::string CppCodeGenerator::generateASTNodeClasses(const Grammar& grammar) {
         ss << "namespace " << ns << " {\n\n";
     }
     
+    if (options_.arena_allocation) {
+        ss << generateArenaClasses();
+    }
+    if (!context_slots_.empty()) {
+        ss << generateContextStoreClass();
+    }
+    
+    // Без AST правило возвращает только признак успеха: проверки вида
+    // if (!child) и return nullptr генерируются так же, как для указателей
+    if (!buildsTree()) {
+        ss << "// Rules report only whether they matched; no AST is built\n";
+        ss << "struct Match {\n";
+        ss << "    bool matched = false;\n";
+        ss << "\n";
+        ss << "    constexpr Match() = default;\n";
+        ss << "    constexpr Match(std::nullptr_t) {}\n";
+        ss << "    constexpr explicit Match(bool value) : matched(value) {}\n";
+        ss << "    constexpr operator bool() const { return matched; }\n";
+        ss << "    constexpr bool operator==(std::nullptr_t) const { return !matched; }\n";
+        ss << "};\n";
+        ss << "using NodePtr = Match;\n";
+        ss << "\n";
+        if (options_.event_callbacks) {
+            ss << generateEventTypes(grammar);
+        }
+        if (!ns.empty()) {
+            ss << "} // namespace " << ns << "\n\n";
+        }
+        return ss.str();
+    }
+    
     ss << "// AST Node base class\n";
+    ss << "class ASTNode;\n";
+    if (options_.arena_allocation) {
+        ss << "// Nodes live in the parser's arena until the next parse() or reset()\n";
+        ss << "using NodePtr = ASTNode*;\n";
+    } else if (memoized_rules_.empty()) {
+        ss << "using NodePtr = std::unique_ptr<ASTNode>;\n";
+    } else {
+        ss << "// Memoized subtrees are shared between the memo table and the tree\n";
+        ss << "using NodePtr = std::shared_ptr<ASTNode>;\n";
+    }
+    ss << "\n";
+    // Смещения детей с ленивым сдвигом: reparse() правит дерево на месте
+    bool child_offsets = options_.incremental && options_.track_positions;
+    if (child_offsets) {
+        ss << generateChildOffsetsClass();
+    }
     ss << "class ASTNode {\n";
     ss << "public:\n";
     ss << "    virtual ~ASTNode() = default;\n";
     ss << "    virtual std::string toString() const = 0;\n";
+    if (child_offsets) {
+        ss << "\n";
+        ss << "    // In the base class, so that reparse() can update any node in place\n";
+        ss << "    std::vector<NodePtr> children;\n";
+        ss << "    ChildOffsets child_offsets;\n";
+    }
+    // Деревья глубже системного стека освобождаются без рекурсии деструкторов
+    bool iterative_free = options_.explicit_stack && !options_.arena_allocation;
+    if (iterative_free) {
+        ss << "    // Moves the children out, so that freeChildren() can free them\n";
+        ss << "    virtual void takeChildren(std::vector<NodePtr>& out) = 0;\n";
+    }
     
-    if (options_.track_positions) {
-        ss << "    size_t line = 0;\n";
-        ss << "    size_t column = 0;\n";
+    if (options_.track_positions && !options_.incremental) {
+        if (options_.lazy_positions) {
+            ss << "    size_t offset = 0; // Byte offset; line/column via the parser's positionAt()\n";
+        } else {
+            ss << "    size_t line = 0;\n";
+            ss << "    size_t column = 0;\n";
+        }
     }
     
+    if (iterative_free) {
+        ss << "\n";
+        ss << "protected:\n";
+        ss << "    // Trees of the explicit stack parser may be deeper than the C++ stack:\n";
+        ss << "    // subtrees are unlinked into a worklist instead of recursive destructors\n";
+        ss << "    static void freeChildren(std::vector<NodePtr>& children) {\n";
+        ss << "        std::vector<NodePtr> pending = std::move(children);\n";
+        ss << "        children.clear();\n";
+        ss << "        while (!pending.empty()) {\n";
+        ss << "            NodePtr node = std::move(pending.back());\n";
+        ss << "            pending.pop_back();\n";
+        if (memoized_rules_.empty()) {
+            ss << "            if (node) {\n";
+        } else {
+            ss << "            if (node && node.use_count() == 1) { // Shared subtrees are freed by their last owner\n";
+        }
+        ss << "                node->takeChildren(pending);\n";
+        ss << "            }\n";
+        ss << "        }\n";
+        ss << "    }\n";
+    }
     ss << "};\n\n";
     
     // Генерация узлов для каждого правила грамматики
@@ -109,12 +678,35 @@ std::string CppCodeGenerator::generateASTNodeClasses(const Grammar& grammar) {
         ss << "// AST Node for rule: " << rule->leftSide << "\n";
         ss << "class " << class_name << " : public ASTNode {\n";
         ss << "public:\n";
-        ss << "    std::vector<std::unique_ptr<ASTNode>> children;\n";
-        ss << "    std::string value;\n";
+        if (options_.arena_allocation) {
+            // Деструкторы узлов в арене не вызываются: все поля тривиально разрушаемы
+            ss << "    ArenaVector<NodePtr> children;\n";
+            ss << "    std::string_view value;\n";
+            ss << "\n";
+            ss << "    explicit " << class_name << "(Arena& arena) : children(arena) {}\n";
+        } else {
+            if (!child_offsets) {
+                ss << "    std::vector<NodePtr> children;\n";
+            }
+            ss << "    std::string value;\n";
+        }
         ss << "\n";
+        if (iterative_free) {
+            ss << "    ~" << class_name << "() override { freeChildren(children); }\n";
+            ss << "\n";
+        }
         ss << "    std::string toString() const override {\n";
         ss << "        return \"" << rule->leftSide << "\";\n";
         ss << "    }\n";
+        if (iterative_free) {
+            ss << "\n";
+            ss << "    void takeChildren(std::vector<NodePtr>& out) override {\n";
+            ss << "        for (auto& child : children) {\n";
+            ss << "            out.push_back(std::move(child));\n";
+            ss << "        }\n";
+            ss << "        children.clear();\n";
+            ss << "    }\n";
+        }
         ss << "};\n\n";
     }
     
@@ -134,37 +726,265 @@ std::string CppCodeGenerator::generateParserClass(const Grammar& grammar) {
         ss << "namespace " << ns << " {\n\n";
     }
     
-    ss << "// Parser class\n";
+    if (options_.profile) {
+        ss << generateProfileTypes();
+    }
+    if (options_.event_callbacks) {
+        // Обработчик - параметр шаблона: вызовы хуков разрешаются при компиляции
+        ss << "// Parser class; Handler receives the events of a successful parse\n";
+        ss << "template <typename Handler = NoEvents>\n";
+    } else {
+        ss << "// Parser class\n";
+    }
     ss << "class " << options_.parser_name << " {\n";
+    if (lexer_mode_) {
+        ss << "public:\n";
+        ss << generateTokenTypes();
+        ss << "\n";
+    }
     ss << "private:\n";
-    ss << "    std::string input_;\n";
+    if (options_.incremental) {
+        ss << "    // Owned copy: the input of the std::string constructors or of reparse()\n";
+    } else {
+        ss << "    // Owned copy, used only by the std::string constructors\n";
+    }
+    ss << "    std::string storage_;\n";
+    ss << "    // Input being parsed: either a view of storage_ or of caller-owned memory\n";
+    ss << "    std::string_view input_;\n";
+    if (lexer_mode_) {
+        ss << "    // Tokens of the input; the parser position is an index into them\n";
+        ss << "    std::vector<Token> tokens_;\n";
+    }
     ss << "    size_t pos_ = 0;\n";
-    ss << "    size_t line_ = 1;\n";
-    ss << "    size_t column_ = 1;\n";
+    if (options_.lazy_positions) {
+        ss << "    // Offsets of line starts, built on the first positionAt() call\n";
+        ss << "    mutable std::vector<size_t> line_starts_;\n";
+    }
+    if (tracksLineColumn()) {
+        ss << "    size_t line_ = 1;\n";
+        ss << "    size_t column_ = 1;\n";
+    }
     ss << "    std::string error_message_;\n";
+    ss << "    size_t error_offset_ = 0;\n";
     ss << "    size_t recursion_depth_ = 0;\n";
+    if (!memoized_rules_.empty()) {
+        ss << "    // A memo entry is valid only at depths where its rule stays under the\n";
+        ss << "    // limit; results that hit the limit depend on the caller and are not stored\n";
+        ss << "    size_t depth_limit_hits_ = 0;\n";
+        ss << "    size_t peak_depth_ = 0;\n";
+    }
+    if (options_.arena_allocation) {
+        ss << "    // Owns every node of the current tree; capacity is kept between parses\n";
+        ss << "    Arena arena_;\n";
+    }
+    if (options_.incremental) {
+        ss << "    // One past the farthest offset the current rule looked at\n";
+        ss << "    mutable size_t examined_ = 0;\n";
+        ss << "    // reparse() edits storage_ as a gap buffer: input_ views the text before\n";
+        ss << "    // the gap, the rest of the text starts at input_.size() + gap_size_\n";
+        ss << "    size_t gap_size_ = 0;\n";
+        if (resumesInTree()) {
+            ss << "    // Tree of the last successful parse, which reparse() updates in place\n";
+            ss << "    NodePtr root_;\n";
+            ss << "    size_t root_length_ = 0;\n";
+            ss << "    size_t tree_height_ = 0; // Upper bound of the tree's nesting depth\n";
+        }
+    }
+    if (options_.streaming) {
+        ss << "    // Streaming: unparsed tail of the input and the items' consumer\n";
+        ss << "    std::string window_;\n";
+        ss << "    size_t stream_offset_ = 0; // Offset of window_[0] in the whole stream\n";
+        ss << "    bool stream_failed_ = false;\n";
+        ss << "    std::function<void(NodePtr)> item_callback_;\n";
+        ss << "    // Set when the parser looks at the end of the window: only then could\n";
+        ss << "    // more input change the outcome\n";
+        ss << "    mutable bool hit_end_ = false;\n";
+        ss << "    // An item cut off by the end of the window is retried once the window\n";
+        ss << "    // has doubled: a large item costs O(size) over all feeds, not O(size^2)\n";
+        ss << "    size_t retry_size_ = 0;\n";
+    }
+    if (!parallel_item_.empty()) {
+        ss << "    // Parallel parsing: items a worker parsed from its guessed chunk start\n";
+        ss << "    struct SpeculativeItem {\n";
+        ss << "        size_t start;\n";
+        ss << "        size_t end;\n";
+        if (tracksLineColumn()) {
+            ss << "        size_t end_line;\n";
+            ss << "        size_t end_column;\n";
+        }
+        ss << "        NodePtr node;\n";
+        ss << "    };\n";
+        ss << "    std::vector<SpeculativeItem> speculative_;\n";
+        ss << "    bool speculative_stopped_ = false; // An item failed before the chunk limit\n";
+        ss << "    // Parsers of chunks 1..n-1; their nodes belong to the last parallel tree\n";
+        ss << "    std::vector<std::unique_ptr<" << options_.parser_name << ">> workers_;\n";
+    }
+    ss << generateMemoTables(grammar);
+    if (!context_slots_.empty()) {
+        ss << generateContextStorage();
+    }
+    if (options_.event_callbacks) {
+        ss << generateEventMethods();
+    }
+    if (options_.profile) {
+        ss << generateProfileMembers();
+    }
+    if (options_.explicit_stack) {
+        ss << generateExplicitStackTypes();
+    }
     ss << "\n";
     ss << "public:\n";
-    ss << "    explicit " << options_.parser_name << "(const std::string& input)\n";
-    ss << "        : input_(input) {}\n";
+    // Обработчик передаётся последним аргументом конструктора и хранится по значению
+    std::string handler_param = options_.event_callbacks ? ", Handler handler = Handler()" : "";
+    std::string handler_init = options_.event_callbacks ? ", handler_(std::move(handler))" : "";
+    if (options_.streaming) {
+        ss << "    // Streaming parser: input arrives through feed()\n";
+        ss << "    " << options_.parser_name << "() = default;\n";
+        if (options_.event_callbacks) {
+            ss << "\n";
+            ss << "    explicit " << options_.parser_name << "(Handler handler)\n";
+            ss << "        : handler_(std::move(handler)) {}\n";
+        }
+        ss << "\n";
+    }
+    ss << "    // Copies the input; the parser owns it\n";
+    ss << "    explicit " << options_.parser_name << "(const std::string& input" << handler_param << ")\n";
+    ss << "        : storage_(input), input_(storage_)" << handler_init << " {}\n";
+    ss << "\n";
+    ss << "    explicit " << options_.parser_name << "(std::string&& input" << handler_param << ")\n";
+    ss << "        : storage_(std::move(input)), input_(storage_)" << handler_init << " {}\n";
+    ss << "\n";
+    ss << "    // Zero-copy: the caller keeps the memory alive while the parser is in use\n";
+    ss << "    explicit " << options_.parser_name << "(std::string_view input" << handler_param << ")\n";
+    ss << "        : input_(input)" << handler_init << " {}\n";
+    ss << "\n";
+    ss << "    " << options_.parser_name << "(const char* data, size_t size" << handler_param << ")\n";
+    ss << "        : input_(data, size)" << handler_init << " {}\n";
+    ss << "\n";
+    ss << "    explicit " << options_.parser_name << "(const char* input" << handler_param << ")\n";
+    ss << "        : input_(input)" << handler_init << " {}\n";
+    ss << "\n";
+    ss << "    // input_ may view storage_, so a copy would dangle\n";
+    ss << "    " << options_.parser_name << "(const " << options_.parser_name << "&) = delete;\n";
+    ss << "    " << options_.parser_name << "& operator=(const " << options_.parser_name << "&) = delete;\n";
     ss << "\n";
     
     // Главный метод парсинга
-    ss << generateMainParseMethod(grammar);
+    if (options_.incremental) {
+        ss << generateIncrementalMethods(grammar);
+    } else {
+        ss << generateMainParseMethod(grammar);
+    }
     ss << "\n";
     
+    if (!parallel_item_.empty()) {
+        ss << generateParallelMethods();
+        ss << "\n";
+    }
     ss << "    const std::string& getError() const { return error_message_; }\n";
+    ss << "    // Byte offset reported by getError()\n";
+    ss << "    size_t errorOffset() const { return error_offset_; }\n";
+    ss << "\n";
+    if (!context_slots_.empty()) {
+        ss << "    // Context slots: one per name used in {store} and {lookup}\n";
+        for (size_t i = 0; i < context_slots_.size(); ++i) {
+            ss << "    static constexpr size_t CONTEXT_" << makeIdentifier(context_slots_[i]) << " = " << i << ";\n";
+        }
+        ss << "\n";
+        ss << "    // Value stored under key in a context slot by the last parse; nullptr if none\n";
+        ss << "    const std::string_view* contextValue(size_t slot, std::string_view key) const {\n";
+        ss << "        return context_.find(slot, key);\n";
+        ss << "    }\n";
+        ss << "\n";
+    }
+    if (options_.explicit_stack) {
+        ss << "    // Nesting limit; by default only memory bounds the depth\n";
+        ss << "    void setMaxDepth(size_t depth) { max_depth_ = depth; }\n";
+        ss << "\n";
+    }
+    if (options_.profile) {
+        ss << generateProfileMethods();
+    }
+    if (options_.event_callbacks) {
+        ss << "    Handler& handler() { return handler_; }\n";
+        ss << "    const Handler& handler() const { return handler_; }\n";
+        ss << "\n";
+    }
+    if (lexer_mode_) {
+        ss << generateTokenizer();
+    }
+    ss << generatePositionLookup();
+    ss << "    // Reuse the parser for another caller-owned input, keeping allocated capacity\n";
+    ss << "    void reset(std::string_view input) {\n";
+    ss << "        storage_.clear();\n";
+    ss << "        input_ = input;\n";
+    if (options_.lazy_positions) {
+        ss << "        line_starts_.clear();\n";
+    }
+    if (options_.arena_allocation) {
+        ss << "        arena_.reset(); // Frees the previous tree in one step\n";
+    }
+    if (options_.incremental) {
+        ss << "        memo_columns_.clear();\n";
+        ss << "        gap_size_ = 0;\n";
+        if (resumesInTree()) {
+            ss << "        root_ = nullptr;\n";
+        }
+    }
+    if (!context_slots_.empty()) {
+        ss << "        context_.clear();\n";
+    }
+    if (options_.streaming) {
+        ss << "        window_.clear();\n";
+        ss << "        stream_offset_ = 0;\n";
+        ss << "        stream_failed_ = false;\n";
+        ss << "        retry_size_ = 0;\n";
+        ss << "        line_ = 1;\n";
+        ss << "        column_ = 1;\n";
+    }
+    ss << "    }\n";
     ss << "\n";
+    if (options_.streaming) {
+        ss << generateStreamingMethods();
+    }
     ss << "private:\n";
+    if (options_.streaming) {
+        ss << generateStreamItems();
+    }
+    if (options_.incremental) {
+        ss << generateMainParseMethod(grammar, "parseInput");
+        ss << "\n";
+    }
+    if (!parallel_item_.empty()) {
+        ss << generateParallelChunks();
+    }
     
-    // Генерация функций для каждого правила
-    for (const auto& rule : grammar.rules) {
-        ss << generateRuleFunction(*rule);
+    // Генерация функций для каждого правила; при разбиении в классе остаются
+    // объявления, а определения собираются по файлам правил
+    for (size_t i = 0; i < grammar.rules.size(); ++i) {
+        std::string function = generateRuleFunction(*grammar.rules[i]);
+        if (function.empty()) {
+            continue;
+        }
+        if (split_units_ > 0) {
+            rule_functions_[i] = std::move(function);
+        } else {
+            ss << function;
+            ss << "\n";
+        }
+    }
+    if (split_units_ > 0) {
+        ss << "    // Rule functions, defined in " << camelToSnake(options_.parser_name) << "_rules_*.cpp\n";
+        ss << rule_declarations_;
         ss << "\n";
     }
     
     // Вспомогательные методы
     ss << generateHelperMethods();
+    if (options_.diagnostics) {
+        // Элементы известны только после генерации функций правил
+        ss << generateDiagnostics();
+    }
     
     ss << "};\n\n";
     
@@ -175,33 +995,105 @@ std::string CppCodeGenerator::generateParserClass(const Grammar& grammar) {
     return ss.str();
 }
 
-std::string CppCodeGenerator::generateMainParseMethod(const Grammar& grammar) {
+std::string CppCodeGenerator::generateMainParseMethod(const Grammar& grammar, const std::string& name) {
     std::ostringstream ss;
     
-    ss << "    // Main parsing method\n";
-    ss << "    std::unique_ptr<ASTNode> parse() {\n";
+    if (options_.incremental) {
+        ss << "    // Parse the whole input; memo columns prepared by parse() or reparse()\n";
+    } else {
+        ss << "    // Main parsing method\n";
+    }
+    ss << "    NodePtr " << name << "() {\n";
+    if (lexer_mode_) {
+        ss << "        tokenize();\n";
+    }
     ss << "        pos_ = 0;\n";
-    ss << "        line_ = 1;\n";
-    ss << "        column_ = 1;\n";
+    if (tracksLineColumn()) {
+        ss << "        line_ = 1;\n";
+        ss << "        column_ = 1;\n";
+    }
     ss << "        error_message_.clear();\n";
     ss << "        recursion_depth_ = 0;\n";
+    if (options_.arena_allocation) {
+        ss << "        arena_.reset();\n";
+    }
+    if (options_.event_callbacks) {
+        ss << "        rollbackEvents(0);\n";
+    }
+    if (!context_slots_.empty()) {
+        ss << "        context_.clear();\n";
+    }
+    if (options_.diagnostics) {
+        ss << "        farthest_ = 0;\n";
+        ss << "        expected_.reset();\n";
+    }
+    if (options_.incremental) {
+        ss << "        examined_ = 0;\n";
+        if (resumesInTree()) {
+            ss << "        peak_depth_ = 0;\n";
+            ss << "        root_ = nullptr;\n";
+        }
+    } else {
+        for (const auto& rule : grammar.rules) {
+            if (isMemoized(rule->leftSide)) {
+                ss << "        memo_" << makeIdentifier(rule->leftSide) << "_.clear();\n";
+            }
+        }
+    }
     ss << "\n";
-    ss << "        auto result = parse_" << makeIdentifier(grammar.startSymbol) << "();\n";
+    std::string start = makeIdentifier(grammar.startSymbol);
+    ss << "        auto result = " << ruleCall(grammar.startSymbol, "parse_" + start, false, entryArguments(grammar.startSymbol))
+       << ";\n";
+    if (resumesInTree()) {
+        ss << "        root_length_ = pos_;\n";
+    }
     ss << "\n";
+    // Позиция в сообщениях - смещение в байтах и при разборе по токенам
+    std::string offset = lexer_mode_ ? "tokens_[pos_].offset" : "pos_";
+    std::string farthest = lexer_mode_ ? "tokens_[farthest_].offset" : "farthest_";
     ss << "        if (!result) {\n";
-    ss << "            if (error_message_.empty()) {\n";
-    ss << "                error_message_ = \"Parse failed at position \" + std::to_string(pos_);\n";
-    ss << "            }\n";
+    if (options_.diagnostics) {
+        // Сообщение собирается один раз, из отметок неудач разбора
+        ss << "            error_offset_ = " << farthest << ";\n";
+        ss << "            if (error_message_.empty()) {\n";
+        ss << "                error_message_ = expectedMessage();\n";
+        ss << "            }\n";
+    } else {
+        ss << "            error_offset_ = " << offset << ";\n";
+        ss << "            if (error_message_.empty()) {\n";
+        ss << "                error_message_ = \"Parse failed at position \" + std::to_string(" << offset << ");\n";
+        ss << "            }\n";
+    }
     ss << "            return nullptr;\n";
     ss << "        }\n";
     ss << "\n";
     ss << "        // Check if we consumed all input\n";
     ss << "        skipWhitespace();\n";
-    ss << "        if (pos_ < input_.size()) {\n";
-    ss << "            error_message_ = \"Unexpected input at position \" + std::to_string(pos_);\n";
+    if (lexer_mode_) {
+        ss << "        if (tokens_[pos_].kind != TOKEN_END) {\n";
+    } else {
+        ss << "        if (pos_ < input_.size()) {\n";
+    }
+    if (options_.diagnostics) {
+        // Остаток входа: что ожидалось там, где разбор продвинулся дальше всего
+        ss << "            if (farthest_ >= pos_) {\n";
+        ss << "                error_offset_ = " << farthest << ";\n";
+        ss << "                error_message_ = expectedMessage();\n";
+        ss << "                return nullptr;\n";
+        ss << "            }\n";
+    }
+    ss << "            error_offset_ = " << offset << ";\n";
+    ss << "            error_message_ = \"Unexpected input at position \" + std::to_string(" << offset << ");\n";
     ss << "            return nullptr;\n";
     ss << "        }\n";
     ss << "\n";
+    if (options_.event_callbacks) {
+        ss << "        deliverEvents();\n";
+    }
+    if (resumesInTree()) {
+        ss << "        root_ = result;\n";
+        ss << "        tree_height_ = peak_depth_;\n";
+    }
     ss << "        return result;\n";
     ss << "    }\n";
     
@@ -209,274 +1101,3565 @@ std::string CppCodeGenerator::generateMainParseMethod(const Grammar& grammar) {
 }
 
 std::string CppCodeGenerator::generateRuleFunction(const ProductionRule& rule) {
-    // Если правило имеет параметры, используем специальную генерацию
-    if (rule.hasParameters()) {
-        return generateParameterizedFunction(rule);
+    // Токены разбирает лексер; вспомогательные правила токенов раскрыты в его ДКА
+    if (lexer_mode_ && lexical_rules_.count(rule.leftSide)) {
+        std::string function = generateTokenRuleFunction(rule);
+        if (function.empty() || !options_.profile) {
+            return function;
+        }
+        return generateProfiledWrapper(rule) + "\n" + function;
     }
     
+    // Профилирование: parse_X() ведёт счётчики, правило разбирается в ruleEntryName()
+    std::string profiled = options_.profile ? generateProfiledWrapper(rule) + "\n" : "";
+    
     std::ostringstream ss;
+    ss << profiled;
     
     // Сброс счетчика переменных для каждой функции
     variable_counter_ = 0;
+    in_lexical_rule_ = lexical_rules_.count(rule.leftSide) > 0;
     
-    std::string func_name = "parse_" + makeIdentifier(rule.leftSide);
+    std::string func_name = ruleEntryName(rule.leftSide);
+    
+    // Мемоизированное правило: parse_X() проверяет таблицу, разбор - в parse_X_uncached()
+    if (isMemoized(rule.leftSide)) {
+        ss << generateMemoizedWrapper(rule);
+        ss << "\n";
+        func_name = "parse_" + makeIdentifier(rule.leftSide) + "_uncached";
+    }
     
     ss << "    // Parse rule: " << rule.leftSide << "\n";
-    ss << "    std::unique_ptr<ASTNode> " << func_name << "() {\n";
+    std::string ret = ruleReturn(rule.leftSide);
+    ss << ruleSignature(ruleReturnType(rule.leftSide), func_name + "(" + generateParameterDeclarations(rule.parameters) + ")");
     ss << "        // Recursion depth check\n";
-    ss << "        if (++recursion_depth_ > " << options_.max_recursion_depth << ") {\n";
+    ss << "        if (++recursion_depth_ > " << depthLimit() << ") {\n";
     ss << "            error_message_ = \"Maximum recursion depth exceeded\";\n";
+    if (!memoized_rules_.empty()) {
+        ss << "            ++depth_limit_hits_;\n";
+    }
     ss << "            --recursion_depth_;\n";
-    ss << "            return nullptr;\n";
+    ss << "            " << ret << " nullptr;\n";
     ss << "        }\n";
+    if (!memoized_rules_.empty()) {
+        ss << "        peak_depth_ = std::max(peak_depth_, recursion_depth_);\n";
+    }
     ss << "\n";
-    ss << "        size_t saved_pos = pos_;\n";
-    ss << "        size_t saved_line = line_;\n";
-    ss << "        size_t saved_column = column_;\n";
+    ss << generatePositionSave("saved", "        ");
+    if (arenaRewindEnabled()) {
+        ss << "        auto saved_mark = arena_.mark();\n";
+    }
+    // События правил-токенов пишет место вызова: внутренности токена не сообщаются
+    bool rule_events = options_.event_callbacks && !in_lexical_rule_;
+    if (rule_events) {
+        ss << generateRuleEnter(rule.leftSide, "saved_event");
+    }
+    ss << generateContextSpans(rule);
     ss << "\n";
     
     // Генерация кода для правой части правила
-    std::string on_failure_action = 
-        "pos_ = saved_pos; line_ = saved_line; column_ = saved_column; --recursion_depth_; return nullptr;";
+    std::string on_failure_action = generatePositionRestore("saved") + " ";
+    if (arenaRewindEnabled()) {
+        on_failure_action += "arena_.rewind(saved_mark); ";
+    }
+    if (rule_events) {
+        on_failure_action += "rollbackEvents(saved_event); ";
+    }
+    on_failure_action += "--recursion_depth_; " + ret + " nullptr;";
+    if (options_.profile) {
+        // Разобранное до неудачи - работа, потерянная при backtracking
+        std::string consumed = lexer_mode_ ? "tokens_[pos_].offset - tokens_[saved_pos].offset" : "pos_ - saved_pos";
+        on_failure_action = "profile_[" + std::to_string(profileIndex(rule.leftSide)) + "].failed_bytes += " +
+                            consumed + "; " + on_failure_action;
+    }
+    
+    if (!buildsTree()) {
+        ss << visitNode(rule.rightSide.get(), on_failure_action);
+        ss << "\n";
+        if (rule_events) {
+            ss << "        exitRule(saved_event);\n";
+        }
+        ss << "        --recursion_depth_;\n";
+        ss << "        " << ret << " NodePtr(true);\n";
+        ss << "    }\n";
+        return ss.str();
+    }
     
-    ss << "        auto node = std::make_unique<" << makeIdentifier(rule.leftSide) << "Node>();\n";
+    ss << "        auto node = " << generateNodeAllocation(rule.leftSide) << ";\n";
+    if (options_.track_positions && !options_.incremental) {
+        // Позиция узла - начало правила (до пропуска пробелов терминалом)
+        if (lexer_mode_) {
+            ss << generateTokenPosition("tokens_[saved_pos]");
+        } else if (options_.lazy_positions) {
+            ss << "        node->offset = saved_pos;\n";
+        } else {
+            ss << "        node->line = saved_line;\n";
+            ss << "        node->column = saved_column;\n";
+        }
+    }
     ss << visitNode(rule.rightSide.get(), on_failure_action);
     ss << "\n";
     ss << "        --recursion_depth_;\n";
-    ss << "        return node;\n";
+    ss << "        " << ret << " node;\n";
     ss << "    }\n";
     
     return ss.str();
 }
 
-// Обобщённый метод визитации узлов
-std::string CppCodeGenerator::visitNode(const ASTNode* node, const std::string& on_failure_action) {
-    if (const auto* term = dynamic_cast<const Terminal*>(node)) {
-        return visitTerminal(term, on_failure_action);
-    } else if (const auto* nonterm = dynamic_cast<const NonTerminal*>(node)) {
-        return visitNonTerminal(nonterm, on_failure_action);
-    } else if (const auto* range = dynamic_cast<const CharRange*>(node)) {
-        return visitCharRange(range, on_failure_action);
-    } else if (const auto* alt = dynamic_cast<const Alternative*>(node)) {
-        return visitAlternative(alt, on_failure_action);
-    } else if (const auto* seq = dynamic_cast<const Sequence*>(node)) {
-        return visitSequence(seq, on_failure_action);
-    } else if (const auto* group = dynamic_cast<const Group*>(node)) {
-        return visitGroup(group, on_failure_action);
-    } else if (const auto* opt = dynamic_cast<const Optional*>(node)) {
-        return visitOptional(opt, on_failure_action);
-    } else if (const auto* zero = dynamic_cast<const ZeroOrMore*>(node)) {
-        return visitZeroOrMore(zero, on_failure_action);
-    } else if (const auto* one = dynamic_cast<const OneOrMore*>(node)) {
-        return visitOneOrMore(one, on_failure_action);
-    } else if (const auto* action = dynamic_cast<const ContextAction*>(node)) {
-        return visitContextAction(action, on_failure_action);
+// Packrat-мемоизация
+
+void CppCodeGenerator::collectMemoizedRules(const Grammar& grammar) {
+    memoized_rules_.clear();
+    
+    std::unordered_set<std::string> forced(options_.memoize_rules.begin(), options_.memoize_rules.end());
+    std::unordered_set<std::string> excluded(options_.no_memoize_rules.begin(), options_.no_memoize_rules.end());
+    
+    // Результат из таблицы не повторил бы {store}, а {lookup} зависит не только
+    // от позиции: правила, из которых достижимо действие, не мемоизируются
+    if (hasContextActions(grammar)) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (const auto& rule : grammar.rules) {
+                if (excluded.count(rule->leftSide)) continue;
+                std::vector<std::string> refs;
+                collectReferences(rule->rightSide.get(), refs);
+                bool reaches = hasContextActionsInNode(rule->rightSide.get()) ||
+                    std::any_of(refs.begin(), refs.end(), [&](const std::string& name) { return excluded.count(name) > 0; });
+                if (reaches) {
+                    excluded.insert(rule->leftSide);
+                    changed = true;
+                }
+            }
+        }
+    }
+    
+    for (const auto& rule : grammar.rules) {
+        // Параметризованные правила генерируются отдельно и пока не мемоизируются
+        if (rule->hasParameters() || excluded.count(rule->leftSide)) {
+            continue;
+        }
+        if (forced.count(rule->leftSide)) {
+            memoized_rules_.insert(rule->leftSide);
+        } else if (options_.memoize && grammar.hasNonTerminalReferences(rule->rightSide.get())) {
+            // Листовые (токенные) правила дешевле разобрать заново, чем искать в таблице
+            memoized_rules_.insert(rule->leftSide);
+        }
+    }
+    
+    // Колонка memo правила в инкрементальном режиме: число мемоизированных
+    // определений перед первым определением правила
+    memo_index_.assign(ir_->rules().size(), 0);
+    size_t index = 0;
+    for (RuleId rule = 0; rule < ir_->rules().size(); ++rule) {
+        memo_index_[rule] = index;
+        if (isMemoized(grammar.rules[rule]->leftSide)) ++index;
+    }
+}
+
+bool CppCodeGenerator::isMemoized(const std::string& rule_name) const {
+    return memoized_rules_.count(rule_name) != 0;
+}
+
+// Точки возврата
+
+std::string CppCodeGenerator::generateCheckpoint(const std::string& prefix, const std::string& indent) const {
+    std::ostringstream ss;
+    ss << generatePositionSave(prefix, indent);
+    if (!context_slots_.empty()) {
+        ss << indent << "size_t " << prefix << "_context = context_.mark();\n";
+    }
+    if (!buildsTree()) {
+        // Откатывать нужно только журнал событий
+        if (options_.event_callbacks) {
+            ss << indent << "size_t " << prefix << "_events = eventMark();\n";
+        }
+    } else if (options_.arena_allocation) {
+        ss << indent << "auto " << prefix << "_children = node->children.state();\n";
+        if (arenaRewindEnabled()) {
+            ss << indent << "auto " << prefix << "_mark = arena_.mark();\n";
+        }
+    } else {
+        ss << indent << "size_t " << prefix << "_children_size = node->children.size();\n";
+    }
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateRestore(const std::string& prefix) const {
+    std::string code = generatePositionRestore(prefix);
+    if (!context_slots_.empty()) {
+        code += " context_.rewind(" + prefix + "_context);";
+    }
+    if (!buildsTree()) {
+        if (options_.event_callbacks) {
+            code += " rollbackEvents(" + prefix + "_events);";
+        }
+    } else if (options_.arena_allocation) {
+        // Откат одним сбросом метки арены вместо поэлементного освобождения
+        code += " node->children.restore(" + prefix + "_children);";
+        if (arenaRewindEnabled()) {
+            code += " arena_.rewind(" + prefix + "_mark);";
+        }
+    } else {
+        code += " while (node->children.size() > " + prefix + "_children_size) { node->children.pop_back(); }";
+        if (options_.incremental && options_.track_positions) {
+            code += " node->child_offsets.resize(node->children.size());";
+        }
+    }
+    return code;
+}
+
+std::string CppCodeGenerator::generatePositionSave(const std::string& prefix, const std::string& indent) const {
+    std::ostringstream ss;
+    ss << indent << "size_t " << prefix << "_pos = pos_;\n";
+    if (tracksLineColumn()) {
+        ss << indent << "size_t " << prefix << "_line = line_;\n";
+        ss << indent << "size_t " << prefix << "_column = column_;\n";
+    }
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generatePositionRestore(const std::string& prefix) const {
+    if (!tracksLineColumn()) {
+        return "pos_ = " + prefix + "_pos;";
+    }
+    return "pos_ = " + prefix + "_pos; line_ = " + prefix + "_line; column_ = " + prefix + "_column;";
+}
+
+std::string CppCodeGenerator::generatePositionLookup() const {
+    if (!options_.lazy_positions) {
+        return "";
+    }
+    
+    std::ostringstream ss;
+    ss << "    struct SourcePosition {\n";
+    ss << "        size_t line;   // 1-based\n";
+    ss << "        size_t column; // 1-based, in bytes\n";
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    // Line/column of a byte offset; the line index is built once per input\n";
+    ss << "    SourcePosition positionAt(size_t offset) const {\n";
+    ss << "        if (line_starts_.empty()) {\n";
+    ss << "            line_starts_.push_back(0);\n";
+    if (options_.incremental) {
+        // После reparse() текст разделён промежутком правки
+        ss << "            // The text before and after the edit gap; memchr is vectorized by the C library\n";
+        ss << "            size_t base = 0;\n";
+        ss << "            for (std::string_view part : {input_, textAfterGap()}) {\n";
+        ss << "                const char* begin = part.data();\n";
+        ss << "                const char* end = begin + part.size();\n";
+        ss << "                for (const char* p = begin; p < end;) {\n";
+        ss << "                    const void* nl = std::memchr(p, '\\n', static_cast<size_t>(end - p));\n";
+        ss << "                    if (!nl) break;\n";
+        ss << "                    p = static_cast<const char*>(nl) + 1;\n";
+        ss << "                    line_starts_.push_back(base + static_cast<size_t>(p - begin));\n";
+        ss << "                }\n";
+        ss << "                base += part.size();\n";
+        ss << "            }\n";
+        ss << "        }\n";
+        ss << "        offset = std::min(offset, textSize());\n";
+    } else {
+        ss << "            // memchr is vectorized by the C library\n";
+        ss << "            const char* begin = input_.data();\n";
+        ss << "            const char* end = begin + input_.size();\n";
+        ss << "            for (const char* p = begin; p < end;) {\n";
+        ss << "                const void* nl = std::memchr(p, '\\n', static_cast<size_t>(end - p));\n";
+        ss << "                if (!nl) break;\n";
+        ss << "                p = static_cast<const char*>(nl) + 1;\n";
+        ss << "                line_starts_.push_back(static_cast<size_t>(p - begin));\n";
+        ss << "            }\n";
+        ss << "        }\n";
+        ss << "        offset = std::min(offset, input_.size());\n";
+    }
+    ss << "        auto it = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);\n";
+    ss << "        size_t line = static_cast<size_t>(it - line_starts_.begin());\n";
+    ss << "        return SourcePosition{line, offset - line_starts_[line - 1] + 1};\n";
+    ss << "    }\n";
+    ss << "\n";
+    if (options_.track_positions && !options_.incremental && buildsTree()) {
+        ss << "    SourcePosition positionOf(const ASTNode& node) const { return positionAt(node.offset); }\n";
+        ss << "\n";
+    }
+    return ss.str();
+}
+
+// Владение узлами AST
+
+std::string CppCodeGenerator::generateNodeAllocation(const std::string& rule_name) const {
+    std::string node_type = makeIdentifier(rule_name) + "Node";
+    if (options_.arena_allocation) {
+        return "arena_.create<" + node_type + ">(arena_)";
+    }
+    if (!memoized_rules_.empty()) {
+        return "std::make_shared<" + node_type + ">()";
+    }
+    return "std::make_unique<" + node_type + ">()";
+}
+
+std::string CppCodeGenerator::generateArenaClasses() {
+    std::ostringstream ss;
+    
+    ss << "// Monotonic bump allocator: nodes are never freed one by one.\n";
+    ss << "// rewind() drops everything allocated after a mark, reset() drops all\n";
+    ss << "// allocations; both keep the blocks for reuse.\n";
+    ss << "class Arena {\n";
+    ss << "public:\n";
+    ss << "    struct Mark {\n";
+    ss << "        size_t block;\n";
+    ss << "        size_t offset;\n";
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    explicit Arena(size_t block_size = 64 * 1024) : block_size_(block_size) {}\n";
+    ss << "    Arena(const Arena&) = delete;\n";
+    ss << "    Arena& operator=(const Arena&) = delete;\n";
+    ss << "\n";
+    ss << "    void* allocate(size_t size, size_t align) {\n";
+    ss << "        while (true) {\n";
+    ss << "            if (current_ == blocks_.size()) {\n";
+    ss << "                size_t block_size = std::max(block_size_, size + align);\n";
+    ss << "                blocks_.push_back(Block{std::unique_ptr<char[]>(new char[block_size]), block_size});\n";
+    ss << "                offset_ = 0;\n";
+    ss << "            }\n";
+    ss << "            Block& block = blocks_[current_];\n";
+    ss << "            size_t offset = (offset_ + align - 1) & ~(align - 1);\n";
+    ss << "            if (offset + size <= block.size) {\n";
+    ss << "                offset_ = offset + size;\n";
+    ss << "                return block.data.get() + offset;\n";
+    ss << "            }\n";
+    ss << "            ++current_;\n";
+    ss << "            offset_ = 0;\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    template<typename T, typename... Args>\n";
+    ss << "    T* create(Args&&... args) {\n";
+    ss << "        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    Mark mark() const { return Mark{current_, offset_}; }\n";
+    ss << "    void rewind(const Mark& m) { current_ = m.block; offset_ = m.offset; }\n";
+    ss << "    void reset() { current_ = 0; offset_ = 0; }\n";
+    ss << "\n";
+    ss << "private:\n";
+    ss << "    struct Block {\n";
+    ss << "        std::unique_ptr<char[]> data;\n";
+    ss << "        size_t size;\n";
+    ss << "    };\n";
+    ss << "    std::vector<Block> blocks_;\n";
+    ss << "    size_t block_size_;\n";
+    ss << "    size_t current_ = 0;\n";
+    ss << "    size_t offset_ = 0;\n";
+    ss << "};\n\n";
+    
+    ss << "// Growable array stored in an Arena. Growing copies into a fresh chunk and\n";
+    ss << "// leaves the old one intact, so restore() of an earlier state stays valid.\n";
+    ss << "template<typename T>\n";
+    ss << "class ArenaVector {\n";
+    ss << "public:\n";
+    ss << "    struct State {\n";
+    ss << "        T* data;\n";
+    ss << "        size_t size;\n";
+    ss << "        size_t capacity;\n";
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    explicit ArenaVector(Arena& arena) : arena_(&arena) {}\n";
+    ss << "\n";
+    ss << "    void push_back(T value) {\n";
+    ss << "        if (size_ == capacity_) {\n";
+    ss << "            size_t new_capacity = capacity_ ? capacity_ * 2 : 4;\n";
+    ss << "            T* new_data = static_cast<T*>(arena_->allocate(new_capacity * sizeof(T), alignof(T)));\n";
+    ss << "            if (size_ > 0) {\n";
+    ss << "                std::memcpy(static_cast<void*>(new_data), data_, size_ * sizeof(T));\n";
+    ss << "            }\n";
+    ss << "            data_ = new_data;\n";
+    ss << "            capacity_ = new_capacity;\n";
+    ss << "        }\n";
+    ss << "        data_[size_++] = value;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    void pop_back() { --size_; }\n";
+    ss << "    size_t size() const { return size_; }\n";
+    ss << "    bool empty() const { return size_ == 0; }\n";
+    ss << "    T& operator[](size_t i) { return data_[i]; }\n";
+    ss << "    const T& operator[](size_t i) const { return data_[i]; }\n";
+    ss << "    T* begin() { return data_; }\n";
+    ss << "    T* end() { return data_ + size_; }\n";
+    ss << "    const T* begin() const { return data_; }\n";
+    ss << "    const T* end() const { return data_ + size_; }\n";
+    ss << "\n";
+    ss << "    State state() const { return State{data_, size_, capacity_}; }\n";
+    ss << "    void restore(const State& s) { data_ = s.data; size_ = s.size; capacity_ = s.capacity; }\n";
+    ss << "\n";
+    ss << "private:\n";
+    ss << "    Arena* arena_;\n";
+    ss << "    T* data_ = nullptr;\n";
+    ss << "    size_t size_ = 0;\n";
+    ss << "    size_t capacity_ = 0;\n";
+    ss << "};\n\n";
+    
+    return ss.str();
+}
+
+bool CppCodeGenerator::arenaRewindEnabled() const {
+    // Узлы из memo-таблиц должны пережить откат внешней альтернативы,
+    // поэтому при мемоизации арена только растёт до конца разбора
+    return options_.arena_allocation && memoized_rules_.empty();
+}
+
+std::string CppCodeGenerator::generateMemoRelease(const Grammar& grammar) const {
+    // Инкрементальные колонки переживают правки и не вытесняются
+    bool has_cuts = std::any_of(grammar.rules.begin(), grammar.rules.end(),
+                                [](const auto& rule) { return containsCut(rule->rightSide.get()); });
+    if (!has_cuts || options_.incremental) {
+        return "";
+    }
+    std::ostringstream ss;
+    ss << "\n";
+    ss << "    // A cut at p commits its scope: entries before p are evicted. Only an\n";
+    ss << "    // enclosing scope backtracking past the cut would use them, and then\n";
+    ss << "    // re-parses; the tables stay bounded by the input since the last cut\n";
+    ss << "    void releaseMemo(size_t p) {\n";
+    for (const auto& rule : grammar.rules) {
+        if (!isMemoized(rule->leftSide)) continue;
+        std::string table = "memo_" + makeIdentifier(rule->leftSide) + "_";
+        ss << "        for (auto it = " << table << ".begin(); it != " << table << ".end();) {\n";
+        ss << "            it = it->first < p ? " << table << ".erase(it) : std::next(it);\n";
+        ss << "        }\n";
+    }
+    ss << "    }\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateMemoTables(const Grammar& grammar) {
+    if (memoized_rules_.empty() && !options_.incremental) {
+        return "";
+    }
+    
+    std::ostringstream ss;
+    ss << "\n";
+    if (options_.incremental) {
+        // Колонка на каждое смещение: правка сдвигает колонки после себя вместе
+        // с результатами, которые от неё не зависят
+        ss << "    // Packrat memoization by start offset. Lengths are relative, so an entry\n";
+        ss << "    // stays valid when an edit before it moves the column\n";
+        ss << "    struct MemoEntry {\n";
+        ss << "        int rule;\n";
+        ss << "        bool success;\n";
+        ss << "        size_t length;\n";
+        ss << "        size_t examined; // Bytes looked at from the start, for invalidation\n";
+        ss << "        size_t height;   // Deepest nesting below the caller\n";
+        ss << "        NodePtr node;\n";
+        ss << "    };\n";
+        ss << "    struct MemoColumn {\n";
+        ss << "        std::vector<MemoEntry> entries;\n";
+        ss << "        size_t reach = 0; // Largest examined among the entries\n";
+        ss << "    };\n";
+        ss << "    // One column per offset of the input and one for its end, laid out like\n";
+        ss << "    // storage_: the columns of the gap are empty and the ones after it move\n";
+        ss << "    // with their text\n";
+        ss << "    std::vector<MemoColumn> memo_columns_;\n";
+        ss << "    // Max segment tree over blocks of 64 columns: the largest column + reach in\n";
+        ss << "    // each subtree, so that an edit finds the entries that looked into it\n";
+        ss << "    // without scanning the columns before it\n";
+        ss << "    std::vector<size_t> reach_tree_;\n";
+        ss << "    size_t reach_leaves_ = 0;\n";
+        ss << "    bool reach_stale_ = false; // Only the leaves are up to date, see buildReach()\n";
+        ss << "\n";
+        ss << "    // Column of a text offset: the offsets after the gap skip it\n";
+        ss << "    size_t columnIndex(size_t pos) const {\n";
+        ss << "        return pos < input_.size() ? pos : pos + gap_size_;\n";
+        ss << "    }\n";
+        ss << "\n";
+        ss << "    const MemoEntry* findMemo(size_t pos, int rule) const {\n";
+        ss << "        for (const MemoEntry& entry : memo_columns_[columnIndex(pos)].entries) {\n";
+        ss << "            if (entry.rule == rule) return &entry;\n";
+        ss << "        }\n";
+        ss << "        return nullptr;\n";
+        ss << "    }\n";
+        ss << "\n";
+        ss << "    void storeMemo(size_t pos, MemoEntry entry) {\n";
+        ss << "        size_t index = columnIndex(pos);\n";
+        ss << "        MemoColumn& column = memo_columns_[index];\n";
+        ss << "        column.reach = std::max(column.reach, entry.examined);\n";
+        ss << "        column.entries.push_back(std::move(entry));\n";
+        ss << "        raiseReach(index, index + column.reach);\n";
+        ss << "    }\n";
+        ss << "\n";
+        ss << "    // Offset input_.size() stands for the end of input\n";
+        ss << "    void noteExamined(size_t end) const {\n";
+        ss << "        examined_ = std::max(examined_, std::min(end, input_.size() + 1));\n";
+        ss << "    }\n";
+        ss << "\n";
+        ss << generateEditGap();
+        if (resumesInTree()) {
+            ss << "\n";
+            ss << generateResumeMethods(grammar);
+        }
+        return ss.str();
+    }
+    ss << "    // Packrat memoization: outcome of a rule at a given start offset\n";
+    ss << "    struct MemoEntry {\n";
+    ss << "        bool success;\n";
+    ss << "        size_t end_pos;\n";
+    if (tracksLineColumn()) {
+        ss << "        size_t end_line;\n";
+        ss << "        size_t end_column;\n";
+    }
+    ss << "        size_t height; // Deepest nesting below the caller\n";
+    ss << "        NodePtr node;\n";
+    ss << "    };\n";
+    for (const auto& rule : grammar.rules) {
+        if (isMemoized(rule->leftSide)) {
+            ss << "    std::unordered_map<size_t, MemoEntry> memo_" << makeIdentifier(rule->leftSide) << "_;\n";
+        }
+    }
+    ss << generateMemoRelease(grammar);
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateMemoizedWrapper(const ProductionRule& rule) {
+    std::ostringstream ss;
+    std::string id = makeIdentifier(rule.leftSide);
+    std::string table = "memo_" + id + "_";
+    
+    // Попадание в таблицу считается в профиле правила
+    std::string memo_hit = options_.profile
+        ? "profile_[" + std::to_string(profileIndex(rule.leftSide)) + "].memo_hits;" : "";
+    
+    ss << "    // Parse rule: " << rule.leftSide << " (memoized)\n";
+    std::string ret = ruleReturn(rule.leftSide);
+    std::string uncached = ruleCall(rule.leftSide, "parse_" + id + "_uncached", true);
+    ss << ruleSignature(ruleReturnType(rule.leftSide), ruleEntryName(rule.leftSide) + "()");
+    if (options_.incremental) {
+        // examined_ на время правила отсчитывается от его начала и затем
+        // объединяется с охватом внешнего правила
+        size_t index = memoIndex(rule.leftSide);
+        ss << "        const MemoEntry* entry = findMemo(pos_, " << index << ");\n";
+        ss << "        if (entry && recursion_depth_ + entry->height <= " << depthLimit() << ") {\n";
+        if (!memo_hit.empty()) {
+            ss << "            ++" << memo_hit << "\n";
+        }
+        ss << "            peak_depth_ = std::max(peak_depth_, recursion_depth_ + entry->height);\n";
+        ss << "            examined_ = std::max(examined_, pos_ + entry->examined);\n";
+        ss << "            if (!entry->success) {\n";
+        ss << "                " << ret << " nullptr;\n";
+        ss << "            }\n";
+        ss << "            pos_ += entry->length;\n";
+        ss << "            " << ret << " entry->node;\n";
+        ss << "        }\n";
+        ss << "\n";
+        ss << "        size_t start_pos = pos_;\n";
+        ss << "        size_t outer_examined = examined_;\n";
+        ss << "        examined_ = start_pos;\n";
+        ss << generateDepthWatch();
+        ss << "        NodePtr result = " << uncached << ";\n";
+        ss << "        if (!entry && depth_limit_hits_ == hits) {\n";
+        ss << "            storeMemo(start_pos, MemoEntry{" << index << ", result != nullptr, pos_ - start_pos, examined_ - start_pos,\n";
+        ss << "                                           peak_depth_ - recursion_depth_, result});\n";
+        ss << "        }\n";
+        ss << "        peak_depth_ = std::max(peak_depth_, outer_peak);\n";
+        ss << "        examined_ = std::max(examined_, outer_examined);\n";
+        ss << "        " << ret << " result;\n";
+        ss << "    }\n";
+        return ss.str();
+    }
+    ss << "        auto memo_it = " << table << ".find(pos_);\n";
+    ss << "        if (memo_it != " << table << ".end() && recursion_depth_ + memo_it->second.height <= " << depthLimit()
+       << ") {\n";
+    ss << "            const MemoEntry& entry = memo_it->second;\n";
+    if (!memo_hit.empty()) {
+        ss << "            ++" << memo_hit << "\n";
+    }
+    ss << "            peak_depth_ = std::max(peak_depth_, recursion_depth_ + entry.height);\n";
+    ss << "            if (!entry.success) {\n";
+    ss << "                " << ret << " nullptr;\n";
+    ss << "            }\n";
+    ss << "            pos_ = entry.end_pos;\n";
+    if (tracksLineColumn()) {
+        ss << "            line_ = entry.end_line;\n";
+        ss << "            column_ = entry.end_column;\n";
+    }
+    ss << "            " << ret << " entry.node;\n";
+    ss << "        }\n";
+    ss << "\n";
+    ss << "        size_t start_pos = pos_;\n";
+    ss << generateDepthWatch();
+    ss << "        NodePtr result = " << uncached << ";\n";
+    ss << "        if (depth_limit_hits_ == hits) {\n";
+    if (!tracksLineColumn()) {
+        ss << "            " << table << "[start_pos] = MemoEntry{result != nullptr, pos_, peak_depth_ - recursion_depth_, result};\n";
+    } else {
+        ss << "            " << table << "[start_pos] =\n";
+        ss << "                MemoEntry{result != nullptr, pos_, line_, column_, peak_depth_ - recursion_depth_, result};\n";
+    }
+    ss << "        }\n";
+    ss << "        peak_depth_ = std::max(peak_depth_, outer_peak);\n";
+    ss << "        " << ret << " result;\n";
+    ss << "    }\n";
+    
+    return ss.str();
+}
+
+// Перед разбором правила в обёртке: глубина отсчитывается заново от вызывающего,
+// а упор в предел глубины где-то внутри не даёт сохранить результат
+std::string CppCodeGenerator::generateDepthWatch() const {
+    std::ostringstream ss;
+    ss << "        size_t hits = depth_limit_hits_;\n";
+    ss << "        size_t outer_peak = peak_depth_;\n";
+    ss << "        peak_depth_ = recursion_depth_;\n";
+    return ss.str();
+}
+
+// Инкрементальный разбор
+
+size_t CppCodeGenerator::memoIndex(const std::string& rule_name) const {
+    RuleId rule = ir_->findRule(rule_name);
+    return rule != NO_ID ? memo_index_[rule] : 0;
+}
+
+bool CppCodeGenerator::resumesInTree() const {
+    return options_.incremental && options_.track_positions && buildsTree() && !memoized_rules_.empty();
+}
+
+std::string CppCodeGenerator::generateChildOffsetsClass() const {
+    std::ostringstream ss;
+    ss << "// Start of each child relative to the start of its parent. reparse() shifts\n";
+    ss << "// the children after an edited one lazily: the offsets from split_ on are\n";
+    ss << "// stored without the pending shift_, and moving split_ touches only the\n";
+    ss << "// children in between\n";
+    ss << "class ChildOffsets {\n";
+    ss << "public:\n";
+    ss << "    size_t size() const { return children_.size(); }\n";
+    ss << "    bool empty() const { return children_.empty(); }\n";
+    ss << "    // Unsigned arithmetic wraps, so a shift that shortens the text adds up too\n";
+    ss << "    size_t operator[](size_t i) const { return children_[i].offset + (i >= split_ ? shift_ : 0); }\n";
+    ss << "    // Bytes from the child's start that the parent had looked at before the\n";
+    ss << "    // child: an edit past them leaves the parent's way to the child as it was\n";
+    ss << "    size_t seen(size_t i) const { return children_[i].seen; }\n";
+    ss << "\n";
+    ss << "    void push_back(size_t offset, size_t seen) { children_.push_back(Child{offset - shift_, seen}); }\n";
+    ss << "    void resize(size_t size) { children_.resize(size); }\n";
+    ss << "\n";
+    ss << "    // Add delta to the offsets of the children from `from` on\n";
+    ss << "    void shift(size_t from, size_t delta) {\n";
+    ss << "        for (; split_ < from; ++split_) children_[split_].offset += shift_;\n";
+    ss << "        for (; split_ > from; --split_) children_[split_ - 1].offset -= shift_;\n";
+    ss << "        shift_ += delta;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "private:\n";
+    ss << "    struct Child {\n";
+    ss << "        size_t offset;\n";
+    ss << "        size_t seen;\n";
+    ss << "    };\n";
+    ss << "    std::vector<Child> children_;\n";
+    ss << "    size_t split_ = 0;\n";
+    ss << "    size_t shift_ = 0;\n";
+    ss << "};\n";
+    ss << "\n";
+    return ss.str();
+}
+
+// Текст правится в промежутке (gap buffer) у места последней правки, и колонки
+// мемоизации лежат так же: правка сдвигает только текст между ней и прошлой
+std::string CppCodeGenerator::generateEditGap() const {
+    std::ostringstream ss;
+    ss << "    // Text after the gap; empty until reparse() edits the input\n";
+    ss << "    std::string_view textAfterGap() const {\n";
+    ss << "        if (input_.data() != storage_.data()) return {};\n";
+    ss << "        return std::string_view(storage_).substr(input_.size() + gap_size_);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    size_t textSize() const { return input_.size() + textAfterGap().size(); }\n";
+    ss << "\n";
+    ss << "    // Move the gap to text offset `to`; the columns move with their text\n";
+    ss << "    void moveGap(size_t to) {\n";
+    ss << "        size_t from = input_.size();\n";
+    ss << "        char* text = storage_.data();\n";
+    ss << "        if (to < from) {\n";
+    ss << "            std::memmove(text + to + gap_size_, text + to, from - to);\n";
+    ss << "            for (size_t c = from; c-- > to;) std::swap(memo_columns_[c], memo_columns_[c + gap_size_]);\n";
+    ss << "        } else {\n";
+    ss << "            std::memmove(text + from, text + from + gap_size_, to - from);\n";
+    ss << "            for (size_t c = from; c < to; ++c) std::swap(memo_columns_[c], memo_columns_[c + gap_size_]);\n";
+    ss << "        }\n";
+    ss << "        if (gap_size_ > 0) {\n";
+    ss << "            // The moved columns left one side of the gap for the other\n";
+    ss << "            refreshReach(std::min(from, to), std::max(from, to));\n";
+    ss << "            refreshReach(std::min(from, to) + gap_size_, std::max(from, to) + gap_size_);\n";
+    ss << "        }\n";
+    ss << "        input_ = std::string_view(text, to);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Grow the gap to at least `size` bytes. The text after it moves only when\n";
+    ss << "    // the gap runs out, and it grows with the text\n";
+    ss << "    void reserveGap(size_t size) {\n";
+    ss << "        if (gap_size_ >= size) return;\n";
+    ss << "        size_t at = input_.size();\n";
+    ss << "        size_t grow = size - gap_size_ + storage_.size() / 8 + 64;\n";
+    ss << "        storage_.insert(at, grow, '\\0');\n";
+    ss << "        memo_columns_.insert(memo_columns_.begin() + static_cast<std::ptrdiff_t>(at), grow, MemoColumn{});\n";
+    ss << "        gap_size_ += grow;\n";
+    ss << "        input_ = std::string_view(storage_.data(), at);\n";
+    ss << "        sizeReach();\n";
+    ss << "        for (size_t block = 0; block < reach_leaves_; ++block) {\n";
+    ss << "            reach_tree_[reach_leaves_ + block] = blockReach(block);\n";
+    ss << "        }\n";
+    ss << "        buildReach();\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // An empty reach tree for the current columns. parse() stores entries\n";
+    ss << "    // left to right and fills only the leaves; reparse() builds the rest\n";
+    ss << "    void sizeReach() {\n";
+    ss << "        size_t blocks = memo_columns_.size() / 64 + 1;\n";
+    ss << "        reach_leaves_ = 1;\n";
+    ss << "        while (reach_leaves_ < blocks) reach_leaves_ *= 2;\n";
+    ss << "        reach_tree_.assign(2 * reach_leaves_, 0);\n";
+    ss << "        reach_stale_ = true;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    void buildReach() {\n";
+    ss << "        for (size_t node = reach_leaves_; node-- > 1;) {\n";
+    ss << "            reach_tree_[node] = std::max(reach_tree_[2 * node], reach_tree_[2 * node + 1]);\n";
+    ss << "        }\n";
+    ss << "        reach_stale_ = false;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Largest column + reach in a block, 0 if no entry looked ahead\n";
+    ss << "    size_t blockReach(size_t block) const {\n";
+    ss << "        size_t end = 0;\n";
+    ss << "        size_t last = std::min(block * 64 + 64, memo_columns_.size());\n";
+    ss << "        for (size_t c = block * 64; c < last; ++c) {\n";
+    ss << "            if (memo_columns_[c].reach > 0) end = std::max(end, c + memo_columns_[c].reach);\n";
+    ss << "        }\n";
+    ss << "        return end;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    void raiseReach(size_t column, size_t end) {\n";
+    ss << "        for (size_t node = reach_leaves_ + column / 64; node > 0 && reach_tree_[node] < end; node /= 2) {\n";
+    ss << "            reach_tree_[node] = end;\n";
+    ss << "            if (reach_stale_) break;\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Recompute the blocks of the columns [first, last) after their entries changed\n";
+    ss << "    void refreshReach(size_t first, size_t last) {\n";
+    ss << "        for (size_t block = first / 64; block * 64 < last; ++block) {\n";
+    ss << "            size_t node = reach_leaves_ + block;\n";
+    ss << "            reach_tree_[node] = blockReach(block);\n";
+    ss << "            if (reach_stale_) continue;\n";
+    ss << "            for (node /= 2; node > 0; node /= 2) {\n";
+    ss << "                reach_tree_[node] = std::max(reach_tree_[2 * node], reach_tree_[2 * node + 1]);\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Drop the entries of the columns before `limit` that looked past `bound`,\n";
+    ss << "    // visiting only the subtrees of the reach tree that reach past it\n";
+    ss << "    void dropReaching(size_t limit, size_t bound) { dropReaching(1, 0, reach_leaves_, limit, bound); }\n";
+    ss << "\n";
+    ss << "    void dropReaching(size_t node, size_t first_block, size_t blocks, size_t limit, size_t bound) {\n";
+    ss << "        if (reach_tree_[node] <= bound || first_block * 64 >= limit) return;\n";
+    ss << "        if (blocks > 1) {\n";
+    ss << "            dropReaching(2 * node, first_block, blocks / 2, limit, bound);\n";
+    ss << "            dropReaching(2 * node + 1, first_block + blocks / 2, blocks / 2, limit, bound);\n";
+    ss << "            reach_tree_[node] = std::max(reach_tree_[2 * node], reach_tree_[2 * node + 1]);\n";
+    ss << "            return;\n";
+    ss << "        }\n";
+    ss << "        size_t last = std::min({first_block * 64 + 64, limit, memo_columns_.size()});\n";
+    ss << "        for (size_t c = first_block * 64; c < last; ++c) {\n";
+    ss << "            MemoColumn& column = memo_columns_[c];\n";
+    ss << "            if (c + column.reach <= bound) continue;\n";
+    ss << "            auto& entries = column.entries;\n";
+    ss << "            entries.erase(std::remove_if(entries.begin(), entries.end(),\n";
+    ss << "                [&](const MemoEntry& entry) { return c + entry.examined > bound; }), entries.end());\n";
+    ss << "            column.reach = 0;\n";
+    ss << "            for (const MemoEntry& entry : entries) {\n";
+    ss << "                column.reach = std::max(column.reach, entry.examined);\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "        reach_tree_[node] = blockReach(first_block);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Put the edit into the text; memo entries that looked at the edited\n";
+    ss << "    // bytes are dropped, the others stay in their columns\n";
+    ss << "    void applyEdit(size_t offset, size_t removed, std::string_view inserted) {\n";
+    ss << "        moveGap(offset);\n";
+    ss << "        dropReaching(offset, offset);\n";
+    ss << "        // The columns of the removed bytes go into the gap with them\n";
+    ss << "        size_t first = offset + gap_size_;\n";
+    ss << "        for (size_t c = first; c < first + removed; ++c) memo_columns_[c] = MemoColumn{};\n";
+    ss << "        refreshReach(first, first + removed);\n";
+    ss << "        gap_size_ += removed;\n";
+    ss << "        reserveGap(inserted.size());\n";
+    ss << "        if (!inserted.empty()) std::memcpy(storage_.data() + offset, inserted.data(), inserted.size());\n";
+    ss << "        gap_size_ -= inserted.size();\n";
+    ss << "        input_ = std::string_view(storage_.data(), offset + inserted.size());\n";
+    ss << "    }\n";
+    return ss.str();
+}
+
+// Разбор с узла вокруг правки: предки остаются на месте, поддерево заменяется
+std::string CppCodeGenerator::generateResumeMethods(const Grammar& grammar) const {
+    std::ostringstream ss;
+    ss << "    // A node of the last tree on the way to an edit, with its memo entry;\n";
+    ss << "    // entry.rule is -1 when the node did not come from a memoized rule\n";
+    ss << "    struct PathStep {\n";
+    ss << "        ASTNode* node;\n";
+    ss << "        size_t start;\n";
+    ss << "        size_t index; // Among the parent's children\n";
+    ss << "        MemoEntry entry;\n";
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    MemoEntry entryOf(size_t start, const ASTNode* node) const {\n";
+    ss << "        for (const MemoEntry& entry : memo_columns_[columnIndex(start)].entries) {\n";
+    ss << "            if (entry.success && entry.node.get() == node) return entry;\n";
+    ss << "        }\n";
+    ss << "        return MemoEntry{-1, false, 0, 0, 0, nullptr};\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Whether a child's text covers the edit, and its parent had not looked at\n";
+    ss << "    // the edit before the child. An insertion may also go at the child's end\n";
+    ss << "    bool childCovers(const PathStep& parent, size_t index, size_t offset, size_t removed, MemoEntry& entry) const {\n";
+    ss << "        const ChildOffsets& offsets = parent.node->child_offsets;\n";
+    ss << "        size_t start = parent.start + offsets[index];\n";
+    ss << "        if (start + offsets.seen(index) > offset) return false;\n";
+    ss << "        entry = entryOf(start, parent.node->children[index].get());\n";
+    ss << "        return entry.rule >= 0 && start + entry.length >= offset + removed;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Nodes of the last tree from the root down to the deepest one that a\n";
+    ss << "    // parse could resume in\n";
+    ss << "    void findEditPath(size_t offset, size_t removed, std::vector<PathStep>& path) const {\n";
+    ss << "        path.clear();\n";
+    ss << "        if (!root_ || root_length_ < offset + removed) return;\n";
+    ss << "        path.push_back(PathStep{root_.get(), 0, 0, entryOf(0, root_.get())});\n";
+    ss << "        // The nodes above the resumed one are updated in place, so none of\n";
+    ss << "        // them may start at an insertion, where its column keeps old entries\n";
+    ss << "        while (path.back().start < offset || removed > 0) {\n";
+    ss << "            const PathStep& parent = path.back();\n";
+    ss << "            const ChildOffsets& offsets = parent.node->child_offsets;\n";
+    ss << "            size_t low = 0;\n";
+    ss << "            size_t high = offsets.size();\n";
+    ss << "            while (low < high) {\n";
+    ss << "                size_t middle = (low + high) / 2;\n";
+    ss << "                if (parent.start + offsets[middle] <= offset) {\n";
+    ss << "                    low = middle + 1;\n";
+    ss << "                } else {\n";
+    ss << "                    high = middle;\n";
+    ss << "                }\n";
+    ss << "            }\n";
+    ss << "            if (low == 0) break;\n";
+    ss << "            size_t index = low - 1;\n";
+    ss << "            MemoEntry entry;\n";
+    ss << "            if (!childCovers(parent, index, offset, removed, entry)) {\n";
+    ss << "                // An insertion at a child's start may extend the child before it\n";
+    ss << "                bool at_start = removed == 0 && parent.start + offsets[index] == offset;\n";
+    ss << "                if (!at_start || index == 0 || !childCovers(parent, index - 1, offset, removed, entry)) break;\n";
+    ss << "                --index;\n";
+    ss << "            }\n";
+    ss << "            size_t start = parent.start + offsets[index];\n";
+    ss << "            path.push_back(PathStep{parent.node->children[index].get(), start, index, std::move(entry)});\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Parse the deepest node on the path again, if its rule still ends where\n";
+    ss << "    // the old node did shifted by the edit, and put the new subtree in place\n";
+    ss << "    // of the old one. Returns nullptr when only a parse from the start is left\n";
+    ss << "    NodePtr resume(const std::vector<PathStep>& path, size_t delta) {\n";
+    ss << "        for (size_t level = path.size(); level-- > 1;) {\n";
+    ss << "            const PathStep& step = path[level];\n";
+    ss << "            // The text up to the old node's reach is before the gap\n";
+    ss << "            size_t reach = std::min(step.start + step.entry.examined + delta, textSize());\n";
+    ss << "            if (reach > input_.size()) moveGap(reach);\n";
+    ss << "            NodePtr result;\n";
+    ss << "            size_t hits = 0;\n";
+    ss << "            while (true) {\n";
+    ss << "                pos_ = step.start;\n";
+    ss << "                recursion_depth_ = 0;\n";
+    ss << "                peak_depth_ = 0;\n";
+    ss << "                examined_ = step.start;\n";
+    ss << "                error_message_.clear();\n";
+    ss << "                hits = depth_limit_hits_;\n";
+    ss << "                result = parseMemoized(step.entry.rule);\n";
+    ss << "                if (examined_ <= input_.size() || input_.size() == textSize()) break;\n";
+    ss << "                // The rule looked further, and took the gap for the end of input\n";
+    ss << "                size_t gap = input_.size();\n";
+    ss << "                moveGap(textSize());\n";
+    ss << "                dropReaching(gap + 1, gap);\n";
+    ss << "            }\n";
+    ss << "            const MemoEntry* entry = result ? findMemo(step.start, step.entry.rule) : nullptr;\n";
+    ss << "            if (!entry || depth_limit_hits_ != hits || pos_ != step.start + step.entry.length + delta) continue;\n";
+    ss << "            // A deeper subtree must keep the whole tree within the depth limit\n";
+    ss << "            size_t grown = entry->height > step.entry.height ? entry->height - step.entry.height : 0;\n";
+    ss << "            if (tree_height_ + grown > " << depthLimit() << ") continue;\n";
+    ss << "            size_t examined_end = step.start + entry->examined;\n";
+    ss << "\n";
+    ss << "            // The ancestors keep their nodes: the children after the path shift\n";
+    ss << "            // with the text and the memo entries grow with the nodes\n";
+    ss << "            path[level - 1].node->children[step.index] = result;\n";
+    ss << "            for (size_t j = level; j-- > 0;) {\n";
+    ss << "                const PathStep& parent = path[j];\n";
+    ss << "                parent.node->child_offsets.shift(path[j + 1].index + 1, delta);\n";
+    ss << "                if (parent.entry.rule < 0) continue;\n";
+    ss << "                MemoEntry updated = parent.entry;\n";
+    ss << "                updated.length += delta;\n";
+    ss << "                updated.examined = std::max(updated.examined + delta, examined_end - parent.start);\n";
+    ss << "                updated.height += grown;\n";
+    ss << "                auto& entries = memo_columns_[columnIndex(parent.start)].entries;\n";
+    ss << "                entries.erase(std::remove_if(entries.begin(), entries.end(),\n";
+    ss << "                    [&](const MemoEntry& old) { return old.rule == updated.rule; }), entries.end());\n";
+    ss << "                storeMemo(parent.start, std::move(updated));\n";
+    ss << "            }\n";
+    ss << "            tree_height_ += grown;\n";
+    ss << "            root_length_ += delta;\n";
+    ss << "            return root_;\n";
+    ss << "        }\n";
+    ss << "        return nullptr;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Run a memoized rule by its index in the memo entries\n";
+    ss << "    NodePtr parseMemoized(int rule) {\n";
+    ss << "        switch (rule) {\n";
+    std::unordered_set<std::string> seen;
+    for (const auto& rule : grammar.rules) {
+        if (!isMemoized(rule->leftSide) || !seen.insert(rule->leftSide).second) {
+            continue;
+        }
+        ss << "        case " << memoIndex(rule->leftSide) << ": return "
+           << ruleCall(rule->leftSide, "parse_" + makeIdentifier(rule->leftSide), false) << ";\n";
+    }
+    ss << "        default: return nullptr;\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateIncrementalMethods(const Grammar& /* grammar */) {
+    std::ostringstream ss;
+    
+    ss << "    // Main parsing method: parses the whole input from scratch\n";
+    ss << "    NodePtr parse() {\n";
+    ss << "        if (input_.data() == storage_.data()) {\n";
+    ss << "            moveGap(textSize()); // All of the text edited by reparse() in input_\n";
+    ss << "        }\n";
+    ss << "        memo_columns_.clear();\n";
+    ss << "        memo_columns_.resize(input_.size() + gap_size_ + 1);\n";
+    ss << "        sizeReach();\n";
+    ss << "        return parseInput();\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Replace `removed` bytes at `offset` with `inserted` and parse again.\n";
+    ss << "    // Memoized results that never looked at the edited bytes are reused;\n";
+    ss << "    // the parser keeps its own copy of the edited input\n";
+    ss << "    NodePtr reparse(size_t offset, size_t removed, std::string_view inserted) {\n";
+    ss << "        if (input_.data() != storage_.data()) {\n";
+    ss << "            storage_.assign(input_.data(), input_.size());\n";
+    ss << "            input_ = storage_;\n";
+    ss << "        }\n";
+    ss << "        if (memo_columns_.size() != storage_.size() + 1) {\n";
+    ss << "            memo_columns_.clear(); // Never parsed, or reset() since\n";
+    ss << "            memo_columns_.resize(storage_.size() + 1);\n";
+    ss << "            sizeReach();\n";
+    if (resumesInTree()) {
+        ss << "            root_ = nullptr;\n";
+    }
+    ss << "        }\n";
+    ss << "        if (reach_stale_) buildReach();\n";
+    ss << "        offset = std::min(offset, textSize());\n";
+    ss << "        removed = std::min(removed, textSize() - offset);\n";
+    if (resumesInTree()) {
+        ss << "        std::vector<PathStep> path;\n";
+        ss << "        findEditPath(offset, removed, path);\n";
+    }
+    ss << "        applyEdit(offset, removed, inserted);\n";
+    ss << "        line_starts_.clear();\n";
+    if (resumesInTree()) {
+        ss << "        if (NodePtr root = resume(path, inserted.size() - removed)) return root;\n";
+    }
+    ss << "        moveGap(textSize());\n";
+    ss << "        return parseInput();\n";
+    ss << "    }\n";
+    
+    return ss.str();
+}
+
+// Параллельный разбор
+
+void CppCodeGenerator::planParallel(const Grammar& grammar, GeneratedCode& result) {
+    parallel_item_.clear();
+    parallel_one_or_more_ = false;
+    parallel_skip_ = false;
+    parallel_first_.reset();
+    if (!options_.parallel) {
+        return;
+    }
+    auto disable = [&result](const std::string& reason) {
+        result.warnings.push_back("Parallel parsing disabled: " + reason);
+    };
+    
+    // Кусок можно разобрать с любого начала элемента, только если разбор элемента
+    // зависит лишь от позиции: без контекстных действий и параметров
+    if (hasContextActions(grammar)) {
+        disable("context actions make items depend on earlier input");
+        return;
+    }
+    const ProductionRule* start = grammar.findRule(grammar.startSymbol);
+    const ASTNode* content = nullptr;
+    if (start && !start->hasParameters() && !lexical_rules_.count(start->leftSide)) {
+        if (const auto* zero = node_cast<ZeroOrMore>(start->rightSide.get())) {
+            content = zero->content.get();
+        } else if (const auto* one = node_cast<OneOrMore>(start->rightSide.get())) {
+            content = one->content.get();
+            parallel_one_or_more_ = true;
+        }
+    }
+    const auto* item = node_cast<NonTerminal>(content);
+    if (!item || item->hasParameters()) {
+        disable("start rule " + grammar.startSymbol + " is not of the form item* or item+");
+        return;
+    }
+    if (analysis_.isNullable(item)) {
+        disable("item rule " + item->name + " can match empty input");
+        return;
+    }
+    
+    parallel_item_ = item->name;
+    // Повторение в стартовом правиле пропускает пробелы перед ссылкой на токен
+    parallel_skip_ = !trivia_rule_.empty() && lexical_rules_.count(item->name) && item->name != trivia_rule_;
+    parallel_first_ = analysis_.first(item);
+}
+
+std::string CppCodeGenerator::generateParallelMethods() const {
+    std::ostringstream ss;
+    
+    ss << "    // Parse on several threads; the tree is the one parse() builds. The input is\n";
+    ss << "    // split at line starts that may begin an item, each chunk is parsed from\n";
+    ss << "    // there on its own thread, and the chunks are then stitched in order:\n";
+    ss << "    // items that start where the previous chunk really ended are correct, the\n";
+    ss << "    // ones before are parsed again. Needs the whole input in memory\n";
+    ss << "    NodePtr parseParallel(unsigned threads = 0) {\n";
+    ss << "        if (threads == 0) {\n";
+    ss << "            threads = std::max(1u, std::thread::hardware_concurrency());\n";
+    ss << "        }\n";
+    ss << "        const size_t size = input_.size();\n";
+    ss << "        const size_t min_chunk = size_t{1} << 20;\n";
+    ss << "        size_t chunks = std::min<size_t>(threads, size / min_chunk);\n";
+    ss << "        if (chunks < 2) {\n";
+    ss << "            return parse();\n";
+    ss << "        }\n";
+    ss << "        std::vector<size_t> starts{0};\n";
+    ss << "        for (size_t k = 1; k < chunks; ++k) {\n";
+    ss << "            size_t guess = findItemStart(size / chunks * k);\n";
+    ss << "            if (guess > starts.back() && guess < size) {\n";
+    ss << "                starts.push_back(guess);\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "        chunks = starts.size();\n";
+    ss << "        starts.push_back(size);\n";
+    ss << "        while (workers_.size() + 1 < chunks) {\n";
+    ss << "            workers_.push_back(std::make_unique<" << options_.parser_name << ">(input_));\n";
+    ss << "        }\n";
+    ss << "        for (auto& worker : workers_) {\n";
+    ss << "            worker->reset(input_);\n";
+    ss << "        }\n";
+    ss << "\n";
+    ss << "        // Chunk 0 runs on the calling thread\n";
+    ss << "        auto run = [chunks](const auto& task) {\n";
+    ss << "            std::vector<std::thread> pool;\n";
+    ss << "            for (size_t k = 1; k < chunks; ++k) {\n";
+    ss << "                pool.emplace_back(task, k);\n";
+    ss << "            }\n";
+    ss << "            task(0);\n";
+    ss << "            for (auto& thread : pool) {\n";
+    ss << "                thread.join();\n";
+    ss << "            }\n";
+    ss << "        };\n";
+    if (tracksLineColumn()) {
+        ss << "        // Line of each chunk start: the chunks start at line starts\n";
+        ss << "        std::vector<size_t> lines(chunks + 1, 0);\n";
+        ss << "        run([&](size_t k) {\n";
+        ss << "            lines[k + 1] = static_cast<size_t>(std::count(input_.data() + starts[k], input_.data() + starts[k + 1], '\\n'));\n";
+        ss << "        });\n";
+        ss << "        lines[0] = 1;\n";
+        ss << "        for (size_t k = 1; k <= chunks; ++k) {\n";
+        ss << "            lines[k] += lines[k - 1];\n";
+        ss << "        }\n";
+        ss << "        run([&](size_t k) {\n";
+        ss << "            (k == 0 ? *this : *workers_[k - 1]).parseChunk(starts[k], starts[k + 1], lines[k]);\n";
+        ss << "        });\n";
+    } else {
+        ss << "        run([&](size_t k) {\n";
+        ss << "            (k == 0 ? *this : *workers_[k - 1]).parseChunk(starts[k], starts[k + 1]);\n";
+        ss << "        });\n";
+    }
+    ss << "\n";
+    ss << "        pos_ = 0;\n";
+    if (tracksLineColumn()) {
+        ss << "        line_ = 1;\n";
+        ss << "        column_ = 1;\n";
+    }
+    ss << "        recursion_depth_ = 1; // Items are parsed inside the start rule\n";
+    // Без AST от корня нужен только счёт элементов (для item+)
+    std::string add_items = "node->children.push_back(std::move(next->node));";
+    std::string add_item = "node->children.push_back(std::move(item));";
+    std::string no_items = "node->children.empty()";
+    if (!buildsTree()) {
+        ss << "        size_t item_count = 0;\n";
+        add_items = "++item_count;";
+        add_item = "++item_count;";
+        no_items = "item_count == 0";
+    } else {
+        ss << "        auto node = " << generateNodeAllocation(grammar_->startSymbol) << ";\n";
+    }
+    if (options_.track_positions && buildsTree()) {
+        if (options_.lazy_positions) {
+            ss << "        node->offset = 0;\n";
+        } else {
+            ss << "        node->line = 1;\n";
+            ss << "        node->column = 1;\n";
+        }
+    }
+    ss << "        bool stopped = false;\n";
+    ss << "        for (size_t k = 0; k < chunks && !stopped; ++k) {\n";
+    ss << "            auto& worker = k == 0 ? *this : *workers_[k - 1];\n";
+    ss << "            auto& items = worker.speculative_;\n";
+    ss << "            auto next = std::lower_bound(items.begin(), items.end(), pos_,\n";
+    ss << "                [](const SpeculativeItem& item, size_t p) { return item.start < p; });\n";
+    ss << "            while (!stopped) {\n";
+    ss << "                if (next != items.end() && next->start == pos_) {\n";
+    ss << "                    // The guess joined the real item sequence: the rest of the chunk is right\n";
+    ss << "                    for (; next != items.end(); ++next) {\n";
+    ss << "                        " << add_items << "\n";
+    ss << "                    }\n";
+    ss << "                    pos_ = items.back().end;\n";
+    if (tracksLineColumn()) {
+        ss << "                    line_ = items.back().end_line;\n";
+        ss << "                    column_ = items.back().end_column;\n";
+    }
+    ss << "                    stopped = worker.speculative_stopped_;\n";
+    ss << "                    break;\n";
+    ss << "                }\n";
+    ss << "                if (pos_ >= starts[k + 1]) {\n";
+    ss << "                    break;\n";
+    ss << "                }\n";
+    ss << "                // Wrong guess: parse the real item here\n";
+    ss << "                NodePtr item = parseNextItem();\n";
+    ss << "                if (!item) {\n";
+    ss << "                    stopped = true;\n";
+    ss << "                    break;\n";
+    ss << "                }\n";
+    ss << "                " << add_item << "\n";
+    ss << "                while (next != items.end() && next->start < pos_) {\n";
+    ss << "                    ++next;\n";
+    ss << "                }\n";
+    ss << "            }\n";
+    ss << "            items.clear();\n";
+    ss << "        }\n";
+    ss << "        recursion_depth_ = 0;\n";
+    ss << "\n";
+    ss << "        // Errors are reported by the sequential parse, with its exact message\n";
+    ss << "        skipWhitespace();\n";
+    ss << "        if (pos_ < input_.size()" << (parallel_one_or_more_ ? " || " + no_items : "") << ") {\n";
+    ss << "            return parse();\n";
+    ss << "        }\n";
+    ss << "        return " << (buildsTree() ? "node" : "NodePtr(true)") << ";\n";
+    ss << "    }\n";
+    
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateParallelChunks() const {
+    std::ostringstream ss;
+    std::string item = makeIdentifier(parallel_item_);
+    
+    ss << "    // One item as the start rule's repetition parses it; the position is\n";
+    ss << "    // unchanged when it fails\n";
+    ss << "    NodePtr parseNextItem() {\n";
+    ss << generatePositionSave("item", "        ");
+    if (parallel_skip_) {
+        ss << "        skipWhitespace();\n";
+    }
+    ss << "        NodePtr item = " << ruleCall(parallel_item_, "parse_" + item, false) << ";\n";
+    ss << "        if (!item) {\n";
+    ss << "            " << generatePositionRestore("item") << "\n";
+    ss << "        }\n";
+    ss << "        return item;\n";
+    ss << "    }\n";
+    ss << "\n";
+    
+    ss << "    // First line start after p whose first byte can begin an item\n";
+    ss << "    size_t findItemStart(size_t p) const {\n";
+    ss << "        static constexpr bool can_start[256] = {";
+    for (size_t b = 0; b < 256; ++b) {
+        if (b % 32 == 0) ss << "\n            ";
+        ss << (parallel_first_.test(b) ? "1" : "0") << (b + 1 < 256 ? "," : "");
+    }
+    ss << "\n        };\n";
+    ss << "        const char* data = input_.data();\n";
+    ss << "        const size_t size = input_.size();\n";
+    ss << "        while (p < size) {\n";
+    ss << "            const void* nl = std::memchr(data + p, '\\n', size - p);\n";
+    ss << "            if (!nl) break;\n";
+    ss << "            p = static_cast<size_t>(static_cast<const char*>(nl) - data) + 1;\n";
+    ss << "            if (p < size && can_start[static_cast<unsigned char>(data[p])]) {\n";
+    ss << "                return p;\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "        return size;\n";
+    ss << "    }\n";
+    ss << "\n";
+    
+    ss << "    // Worker: parse items from a guessed item start until one starts at or after limit\n";
+    if (tracksLineColumn()) {
+        ss << "    void parseChunk(size_t begin, size_t limit, size_t line) {\n";
+    } else {
+        ss << "    void parseChunk(size_t begin, size_t limit) {\n";
+    }
+    ss << "        pos_ = begin;\n";
+    if (tracksLineColumn()) {
+        ss << "        line_ = line;\n";
+        ss << "        column_ = 1;\n";
+    }
+    ss << "        error_message_.clear();\n";
+    ss << "        recursion_depth_ = 1; // Items are parsed inside the start rule\n";
+    if (options_.arena_allocation) {
+        ss << "        arena_.reset();\n";
+    }
+    for (const auto& rule : grammar_->rules) {
+        if (isMemoized(rule->leftSide)) {
+            ss << "        memo_" << makeIdentifier(rule->leftSide) << "_.clear();\n";
+        }
+    }
+    ss << "        speculative_.clear();\n";
+    ss << "        speculative_stopped_ = false;\n";
+    ss << "        while (pos_ < limit) {\n";
+    ss << "            size_t start = pos_;\n";
+    ss << "            NodePtr item = parseNextItem();\n";
+    ss << "            if (!item) {\n";
+    ss << "                speculative_stopped_ = true;\n";
+    ss << "                return;\n";
+    ss << "            }\n";
+    if (tracksLineColumn()) {
+        ss << "            speculative_.push_back(SpeculativeItem{start, pos_, line_, column_, std::move(item)});\n";
+    } else {
+        ss << "            speculative_.push_back(SpeculativeItem{start, pos_, std::move(item)});\n";
+    }
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    
+    return ss.str();
+}
+
+// Обобщённый метод визитации узлов
+std::string CppCodeGenerator::visitNode(const ASTNode* node, const std::string& on_failure_action) {
+    switch (node->kind()) {
+        case NodeKind::TERMINAL:
+            return visitTerminal(static_cast<const Terminal*>(node), on_failure_action);
+        case NodeKind::NON_TERMINAL:
+            return visitNonTerminal(static_cast<const NonTerminal*>(node), on_failure_action);
+        case NodeKind::CHAR_RANGE:
+            return visitCharRange(static_cast<const CharRange*>(node), on_failure_action);
+        case NodeKind::ALTERNATIVE:
+            return visitAlternative(static_cast<const Alternative*>(node), on_failure_action);
+        case NodeKind::SEQUENCE:
+            return visitSequence(static_cast<const Sequence*>(node), on_failure_action);
+        case NodeKind::GROUP:
+            return visitGroup(static_cast<const Group*>(node), on_failure_action);
+        case NodeKind::OPTIONAL:
+            return visitOptional(static_cast<const Optional*>(node), on_failure_action);
+        case NodeKind::ZERO_OR_MORE:
+            return visitZeroOrMore(static_cast<const ZeroOrMore*>(node), on_failure_action);
+        case NodeKind::ONE_OR_MORE:
+            return visitOneOrMore(static_cast<const OneOrMore*>(node), on_failure_action);
+        case NodeKind::CONTEXT_ACTION:
+            return visitContextAction(static_cast<const ContextAction*>(node), on_failure_action);
+        case NodeKind::CUT:
+            return visitCut(static_cast<const Cut*>(node));
+    }
+    
+    return "        // Unknown node type\n";
+}
+
+std::string CppCodeGenerator::visitTerminal(const Terminal* node, const std::string& on_failure_action) {
+    std::ostringstream ss;
+    if (lexer_mode_) {
+        ss << "        // Match token: \"" << escapeString(node->value) << "\"\n";
+        ss << "        skipWhitespace();\n";
+        if (!node->value.empty()) {
+            ss << "        if (!matchToken(" << tokenKind("literal:" + node->value) << ")) {\n";
+            ss << "            " << noteFailure(node) << on_failure_action << "\n";
+            ss << "        }\n";
+        }
+        return ss.str();
+    }
+    ss << "        // Match terminal: \"" << escapeString(node->value) << "\"\n";
+    if (skipsBeforeToken()) {
+        ss << "        skipWhitespace();\n";
+    }
+    ss << "        if (!matchString(\"" << escapeString(node->value) << "\")) {\n";
+    ss << "            " << noteFailure(node) << on_failure_action << "\n";
+    ss << "        }\n";
+    if (options_.event_callbacks && !in_lexical_rule_ && !node->value.empty()) {
+        // matchString() сдвигает позицию ровно на длину терминала
+        ss << "        recordToken(pos_ - " << node->value.size() << ");\n";
+    }
+    return ss.str();
+}
+
+std::string CppCodeGenerator::visitNonTerminal(const NonTerminal* node, const std::string& on_failure_action) {
+    std::ostringstream ss;
+    std::string child_var = "child_" + std::to_string(variable_counter_++);
+    ss << "        // Parse non-terminal: " << node->name;
+    
+    if (node->hasParameters()) {
+        ss << " with parameters [";
+        for (size_t i = 0; i < node->parameterValues.size(); ++i) {
+            if (i > 0) ss << ", ";
+            ss << node->parameterValues[i];
+        }
+        ss << "]";
+    }
+    ss << "\n";
+    
+    // Перед ссылкой на токен пропускаем пробелы; само правило пробелов их и разбирает
+    if (skipsBeforeToken() && lexical_rules_.count(node->name) && node->name != trivia_rule_) {
+        ss << "        skipWhitespace();\n";
+    }
+    
+    // Текст для контекстного действия начинается с первого токена: пробелы
+    // перед ним пропускаются здесь, а не внутри правила
+    bool context_span = context_spans_.count(node->name) > 0;
+    if (context_span) {
+        if ((skipsBeforeToken() || trivia_rule_.empty()) && !lexical_rules_.count(node->name)) {
+            ss << "        skipWhitespace();\n";
+        }
+        ss << "        size_t " << child_var << "_text = pos_;\n";
+    }
+    
+    // Смещение ребёнка относительно узла: поддерево не хранит абсолютных позиций
+    bool child_offsets = options_.incremental && options_.track_positions && buildsTree();
+    if (child_offsets) {
+        ss << "        size_t " << child_var << "_start = pos_;\n";
+        ss << "        size_t " << child_var << "_seen = examined_ > pos_ ? examined_ - pos_ : 0;\n";
+    }
+    
+    // Токен сообщается одним правилом со спаном, без событий внутри него
+    bool token_events = options_.event_callbacks && !in_lexical_rule_ &&
+                        lexical_rules_.count(node->name) && node->name != trivia_rule_;
+    if (token_events) {
+        ss << generateRuleEnter(node->name, child_var + "_event");
+    }
+    
+    // Аргументы остались только у параметров времени выполнения (см. GrammarOptimizer::specialize)
+    ss << "        auto " << child_var << " = "
+       << ruleCall(node->name, "parse_" + makeIdentifier(node->name), true, node->parameterValues) << ";\n";
+    ss << "        if (!" << child_var << ") {\n";
+    // Неудавшийся токен отмечается целиком, с начала: pos_ уже восстановлен
+    bool token_call = lexical_rules_.count(node->name) && node->name != trivia_rule_;
+    ss << "            " << (token_call ? noteFailure(node) : "") << on_failure_action << "\n";
+    ss << "        }\n";
+    if (token_events) {
+        ss << "        exitRule(" << child_var << "_event);\n";
+    }
+    if (context_span) {
+        ss << "        ctx_" << makeIdentifier(node->name) << " = input_.substr(" << child_var << "_text, pos_ - "
+           << child_var << "_text);\n";
+    }
+    if (!buildsTree()) {
+        return ss.str();
+    }
+    ss << "        node->children.push_back(std::move(" << child_var << "));\n";
+    if (child_offsets) {
+        ss << "        node->child_offsets.push_back(" << child_var << "_start - saved_pos, " << child_var << "_seen);\n";
+    }
+    return ss.str();
+}
+
+std::string CppCodeGenerator::visitCharRange(const CharRange* node, const std::string& on_failure) {
+    std::ostringstream ss;
+    const std::string on_failure_action = noteFailure(node) + on_failure;
+    ss << "        // Match character range: U+" << std::hex << std::uppercase 
+       << node->start << " .. U+" << node->end << std::dec << std::nouppercase << "\n";
+    if (lexer_mode_) {
+        ss << "        skipWhitespace();\n";
+        ss << "        if (!matchToken(" << tokenKind(rangeKey(node)) << ")) {\n";
+        ss << "            " << on_failure_action << "\n";
+        ss << "        }\n";
+        return ss.str();
+    }
+    if (skipsBeforeToken()) {
+        ss << "        skipWhitespace();\n";
+    }
+    ss << "        {\n";
+    if (options_.incremental) {
+        ss << "        noteExamined(pos_ + 1);\n";
+    }
+    ss << "        if (pos_ >= input_.size()) {\n";
+    if (options_.streaming) {
+        ss << "            hit_end_ = true;\n";
+    }
+    ss << "            " << on_failure_action << "\n";
+    ss << "        }\n";
+    ss << "        uint32_t cp = 0;\n";
+    ss << "        const size_t char_len = decodeUtf8(pos_, cp);\n";
+    if (options_.incremental) {
+        ss << "        noteExamined(pos_ + char_len);\n";
+    }
+    ss << "        if (pos_ + char_len > input_.size()) {\n";
+    if (options_.streaming) {
+        ss << "            hit_end_ = true;\n";
+    }
+    ss << "            " << on_failure_action << "\n";
+    ss << "        }\n";
+    ss << "        if (cp < " << node->start << "U || cp > " << node->end << "U) {\n";
+    ss << "            " << on_failure_action << "\n";
+    ss << "        }\n";
+    ss << "        // Advance by character length\n";
+    if (options_.lazy_positions) {
+        ss << "        pos_ += char_len;\n";
+    } else {
+        ss << "        for (size_t i = 0; i < char_len; ++i) {\n";
+        ss << "            advance();\n";
+        ss << "        }\n";
+    }
+    if (options_.event_callbacks && !in_lexical_rule_) {
+        ss << "        recordToken(pos_ - char_len);\n";
+    }
+    ss << "        }\n";
+    return ss.str();
+}
+
+
+std::string CppCodeGenerator::visitAlternative(const Alternative* node, const std::string& on_failure_action) {
+    std::ostringstream ss;
+    std::string label_base = std::to_string(variable_counter_++);
+    
+    std::vector<std::string> literals;
+    if (collectLiterals(node, literals)) {
+        return generateLiteralAlternative(literals, noteFailure(node) + on_failure_action);
+    }
+    
+    std::vector<uint64_t> choice_bits;
+    std::string dispatch = generateAlternativeDispatch(node, label_base, choice_bits);
+    
+    ss << "        // Try alternatives\n";
+    ss << "        {\n";
+    ss << "            bool alt_matched_" << label_base << " = false;\n";
+    ss << dispatch;
+    
+    // Неудача после ^ в альтернативе - неудача всего выбора
+    cut_scopes_.push_back(CutScope{generateRestore("alt") + " goto alt_cut_" + label_base + ";"});
+    for (size_t i = 0; i < node->choices.size(); ++i) {
+        if (dispatch.empty()) {
+            ss << "            if (!alt_matched_" << label_base << ") {\n";
+        } else {
+            ss << "            if (!alt_matched_" << label_base << " && (alt_viable_" << label_base
+               << " & 0x" << std::hex << choice_bits[i] << std::dec << "u)) {\n";
+        }
+        ss << generateCheckpoint("alt", "                ");
+        
+        ss << "                do { // Alternative " << (i + 1) << "\n";
+        
+        std::string alt_label = "alt_failed_" + label_base + "_" + std::to_string(i);
+        std::string on_alt_failure = generateRestore("alt") + " goto " + alt_label + ";";
+        
+        std::string body = visitNode(node->choices[i].get(), on_alt_failure);
+        ss << "                " << body << "\n";
+        ss << "                alt_matched_" << label_base << " = true;\n";
+        ss << "                } while(false);\n";
+        ss << "            }\n";
+        // После ^ в начале альтернативы её собственная метка не нужна
+        if (body.find(alt_label + ";") != std::string::npos || !containsCut(node->choices[i].get())) {
+            ss << "            " << alt_label << ":; // Label for this alternative\n";
+        }
+    }
+    if (cut_scopes_.back().used) {
+        ss << "            alt_cut_" << label_base << ":; // Failure after a cut skips the remaining alternatives\n";
+    }
+    cut_scopes_.pop_back();
+    
+    ss << "            if (!alt_matched_" << label_base << ") {\n";
+    if (!dispatch.empty() && options_.diagnostics && !in_lexical_rule_) {
+        // Отсечённые таблицей альтернативы своих терминалов не пробовали: их
+        // первые элементы отмечаются там, где таблица смотрела байт
+        bool past_whitespace = dispatchPastWhitespace(node);
+        std::string note = noteFailure(node, past_whitespace ? "whitespaceEnd()" : "pos_");
+        if (!note.empty()) {
+            note.pop_back();
+            ss << "                " << note << "\n";
+        }
+    }
+    ss << "                " << on_failure_action << "\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateAlternativeDispatch(const Alternative* node, const std::string& label_base,
+                                                          std::vector<uint64_t>& choice_bits) {
+    const size_t count = node->choices.size();
+    if (!options_.first_set_dispatch || count < 2 || count > 64) {
+        return "";
+    }
+    
+    bool past_whitespace = dispatchPastWhitespace(node);
+    const GrammarAnalysis& sets = past_whitespace ? analysis_ : ws_analysis_;
+    
+    // Маска альтернатив, допустимых для каждого байта; пустые альтернативы допустимы всегда
+    std::vector<uint64_t> table(257, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const ASTNode* choice = node->choices[i].get();
+        uint64_t bit = uint64_t{1} << i;
+        choice_bits.push_back(bit);
+        LookaheadSet first = sets.first(choice);
+        bool nullable = sets.isNullable(choice) || cutBeforeInput(choice, sets);
+        for (size_t b = 0; b < table.size(); ++b) {
+            if (nullable || first.test(b)) {
+                table[b] |= bit;
+            }
+        }
+    }
+    
+    uint64_t all = count == 64 ? ~uint64_t{0} : (uint64_t{1} << count) - 1;
+    if (std::all_of(table.begin(), table.end(), [all](uint64_t mask) { return mask == all; })) {
+        return ""; // Таблица ничего не отсекает
+    }
+    
+    std::string mask_type = count <= 32 ? "uint32_t" : "uint64_t";
+    std::ostringstream ss;
+    ss << "            // FIRST-set dispatch: alternatives viable for the next byte, in order\n";
+    ss << "            static constexpr " << mask_type << " alt_dispatch_" << label_base << "[257] = {";
+    for (size_t b = 0; b < table.size(); ++b) {
+        if (b % 16 == 0) ss << "\n                ";
+        ss << "0x" << std::hex << table[b] << std::dec << (count <= 32 ? "u" : "ull");
+        if (b + 1 < table.size()) ss << ", ";
+    }
+    ss << "\n            };\n";
+    ss << "            const " << mask_type << " alt_viable_" << label_base << " = alt_dispatch_" << label_base
+       << "[" << (past_whitespace ? "lookaheadPastWhitespace()" : "lookahead()") << "];\n";
+    return ss.str();
+}
+
+bool CppCodeGenerator::dispatchPastWhitespace(const Alternative* node) const {
+    // Если ни одна альтернатива не начинается с пробела напрямую, пробелы перед
+    // токенами (их пропускает skipWhitespace) можно пропустить и при выборе.
+    // Иначе берём байт в текущей позиции и FIRST-множества с учётом пропуска.
+    bool past_whitespace = skip_is_class_ || lexer_mode_;
+    for (const auto& choice : node->choices) {
+        if ((analysis_.first(choice.get()) & skip_class_).any()) {
+            past_whitespace = false;
+        }
+    }
+    return past_whitespace;
+}
+
+void CppCodeGenerator::collectExpected(const ASTNode* node, std::vector<size_t>& items,
+                                       std::unordered_set<std::string>& visiting) {
+    if (const auto* terminal = node_cast<Terminal>(node)) {
+        if (!terminal->value.empty()) {
+            items.push_back(expectedItem("\"" + terminal->value + "\""));
+        }
+    } else if (const auto* range = node_cast<CharRange>(node)) {
+        // Печатные ASCII-символы - как в грамматике, остальные - кодовыми точками
+        auto character = [](uint32_t c) {
+            if (c >= 0x20 && c < 0x7F) return "'" + std::string(1, static_cast<char>(c)) + "'";
+            std::ostringstream cp;
+            cp << "U+" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << c;
+            return cp.str();
+        };
+        std::string label = character(range->start);
+        if (range->end != range->start) label += ".." + character(range->end);
+        items.push_back(expectedItem(label));
+    } else if (const auto* ref = node_cast<NonTerminal>(node)) {
+        // Токен ожидается целиком; синтаксическое правило - своими первыми элементами
+        if (ref->name == trivia_rule_) return;
+        if (lexical_rules_.count(ref->name)) {
+            items.push_back(expectedItem(ref->name));
+            return;
+        }
+        const ProductionRule* rule = grammar_->findRule(ref->name);
+        if (rule && visiting.insert(ref->name).second) {
+            collectExpected(rule->rightSide.get(), items, visiting);
+            visiting.erase(ref->name);
+        }
+    } else if (const auto* sequence = node_cast<Sequence>(node)) {
+        for (const auto& element : sequence->elements) {
+            collectExpected(element.get(), items, visiting);
+            if (!analysis_.isNullable(element.get())) break;
+        }
+    } else if (const auto* alt = node_cast<Alternative>(node)) {
+        for (const auto& choice : alt->choices) {
+            collectExpected(choice.get(), items, visiting);
+        }
+    } else if (const auto* group = node_cast<Group>(node)) {
+        collectExpected(group->content.get(), items, visiting);
+    } else if (const auto* optional = node_cast<Optional>(node)) {
+        collectExpected(optional->content.get(), items, visiting);
+    } else if (const auto* star = node_cast<ZeroOrMore>(node)) {
+        collectExpected(star->content.get(), items, visiting);
+    } else if (const auto* plus = node_cast<OneOrMore>(node)) {
+        collectExpected(plus->content.get(), items, visiting);
+    }
+}
+
+size_t CppCodeGenerator::expectedItem(const std::string& label) {
+    auto [it, inserted] = expected_item_.emplace(label, expected_items_.size());
+    if (inserted) {
+        expected_items_.push_back(label);
+    }
+    return it->second;
+}
+
+size_t CppCodeGenerator::expectedGroup(std::vector<size_t> items) {
+    std::sort(items.begin(), items.end());
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+    size_t index = std::find(expected_groups_.begin(), expected_groups_.end(), items) - expected_groups_.begin();
+    if (index == expected_groups_.size()) {
+        expected_groups_.push_back(std::move(items));
+    }
+    return index;
+}
+
+std::string CppCodeGenerator::noteFailure(const ASTNode* node, const std::string& at) {
+    // Внутри токена неудачи не отмечаются: токен ожидается целиком
+    if (!options_.diagnostics || in_lexical_rule_) {
+        return "";
+    }
+    std::vector<size_t> items;
+    std::unordered_set<std::string> visiting;
+    collectExpected(node, items, visiting);
+    if (items.empty()) {
+        return "";
+    }
+    return noteFailure(expectedGroup(std::move(items)), at);
+}
+
+std::string CppCodeGenerator::noteFailure(size_t group, const std::string& at) const {
+    // Единственная проверка на пути неудачи; отстающая позиция ничего не пишет
+    if (at == "pos_") {
+        return "if (pos_ >= farthest_) { expect(pos_, " + std::to_string(group) + "); } ";
+    }
+    return "{ const size_t failed_at = " + at + "; if (failed_at >= farthest_) { expect(failed_at, " +
+           std::to_string(group) + "); } } ";
+}
+
+std::string CppCodeGenerator::generateDiagnostics() const {
+    const size_t items = std::max<size_t>(expected_items_.size(), 1);
+    std::ostringstream ss;
+    ss << "    // Farthest failure: its position and the items expected there. Failed\n";
+    ss << "    // matches behind farthest_ are dropped by the caller's single compare\n";
+    ss << "    size_t farthest_ = 0;\n";
+    ss << "    std::bitset<" << items << "> expected_;\n";
+    ss << "\n";
+    ss << "    static constexpr const char* EXPECTED_ITEMS[" << items << "] = {";
+    for (size_t i = 0; i < expected_items_.size(); ++i) {
+        if (i % 8 == 0) ss << "\n        ";
+        ss << "\"" << escapeString(expected_items_[i]) << "\"" << (i + 1 < expected_items_.size() ? ", " : "");
+    }
+    if (expected_items_.empty()) ss << "\"\"";
+    ss << "\n    };\n";
+    // Группа места неудачи - отрезок EXPECTED_GROUP_ITEMS от её начала до начала следующей
+    std::vector<size_t> begins{0};
+    std::vector<size_t> flat;
+    for (const auto& group : expected_groups_) {
+        flat.insert(flat.end(), group.begin(), group.end());
+        begins.push_back(flat.size());
+    }
+    if (flat.empty()) flat.push_back(0);
+    ss << "    // Items of each failure site: EXPECTED_GROUP_ITEMS[EXPECTED_GROUPS[g] .. EXPECTED_GROUPS[g + 1])\n";
+    ss << "    static constexpr uint32_t EXPECTED_GROUPS[" << begins.size() << "] = {";
+    for (size_t i = 0; i < begins.size(); ++i) {
+        if (i % 16 == 0) ss << "\n        ";
+        ss << begins[i] << (i + 1 < begins.size() ? ", " : "");
+    }
+    ss << "\n    };\n";
+    ss << "    static constexpr uint32_t EXPECTED_GROUP_ITEMS[" << flat.size() << "] = {";
+    for (size_t i = 0; i < flat.size(); ++i) {
+        if (i % 16 == 0) ss << "\n        ";
+        ss << flat[i] << (i + 1 < flat.size() ? ", " : "");
+    }
+    ss << "\n    };\n";
+    ss << "\n";
+    ss << "    // A match of group's items failed at p >= farthest_\n";
+    ss << "    void expect(size_t p, size_t group) {\n";
+    ss << "        if (p > farthest_) {\n";
+    ss << "            farthest_ = p;\n";
+    ss << "            expected_.reset();\n";
+    ss << "        }\n";
+    ss << "        for (uint32_t i = EXPECTED_GROUPS[group]; i < EXPECTED_GROUPS[group + 1]; ++i) {\n";
+    ss << "            expected_.set(EXPECTED_GROUP_ITEMS[i]);\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    if (lexer_mode_) {
+        ss << "    // Position after the whitespace tokens that skipWhitespace() would skip\n";
+        ss << "    size_t whitespaceEnd() const {\n";
+        ss << "        size_t i = pos_;\n";
+        ss << "        while (tokens_[i].kind == " << tokenKind(trivia_rule_) << ") {\n";
+        ss << "            ++i;\n";
+        ss << "        }\n";
+        ss << "        return i;\n";
+        ss << "    }\n";
+        ss << "\n";
+    } else if (skip_is_class_) {
+        ss << "    // Offset after the whitespace that skipWhitespace() would skip\n";
+        ss << "    size_t whitespaceEnd() const {\n";
+        ss << "        size_t p = pos_;\n";
+        ss << "        while (p < input_.size() && isSkippedByte(static_cast<unsigned char>(input_[p]))) {\n";
+        ss << "            ++p;\n";
+        ss << "        }\n";
+        ss << "        return p;\n";
+        ss << "    }\n";
+        ss << "\n";
+    }
+    std::string offset = lexer_mode_ ? "tokens_[farthest_].offset" : "farthest_";
+    std::string at_end = lexer_mode_ ? "tokens_[farthest_].kind == TOKEN_END" : "farthest_ >= input_.size()";
+    ss << "    // Error message for the farthest failure, built once after the parse failed\n";
+    ss << "    std::string expectedMessage() const {\n";
+    ss << "        std::string message = \"Parse failed at position \" + std::to_string(" << offset << ");\n";
+    ss << "        if (" << at_end << ") {\n";
+    ss << "            message += \" (end of input)\";\n";
+    ss << "        }\n";
+    ss << "        const size_t count = expected_.count();\n";
+    ss << "        if (count == 0) {\n";
+    ss << "            return message;\n";
+    ss << "        }\n";
+    ss << "        message += \": expected \";\n";
+    ss << "        size_t listed = 0;\n";
+    ss << "        for (size_t i = 0; i < expected_.size(); ++i) {\n";
+    ss << "            if (!expected_.test(i)) continue;\n";
+    ss << "            if (listed > 0) {\n";
+    ss << "                message += listed + 1 == count ? \" or \" : \", \";\n";
+    ss << "            }\n";
+    ss << "            message += EXPECTED_ITEMS[i];\n";
+    ss << "            ++listed;\n";
+    ss << "        }\n";
+    ss << "        return message;\n";
+    ss << "    }\n";
+    ss << "\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::visitSequence(const Sequence* node, const std::string& on_failure_action) {
+    std::ostringstream ss;
+    ss << "        // Parse sequence\n";
+    ss << "        { // Sequence block\n";
+    // Провал любого элемента - это провал всей последовательности: внешнее
+    // действие само восстанавливает состояние до своей точки сохранения.
+    // Блок не должен быть циклом, иначе break из внешнего действия
+    // завершит только последовательность.
+    // После ^ неудача выходит из области отсечения целиком
+    bool committed = false;
+    for (const auto& element : node->elements) {
+        if (committed) {
+            cut_scopes_.back().used = true;
+        }
+        ss << visitNode(element.get(), committed ? cut_scopes_.back().committed : on_failure_action);
+        committed = committed || (!cut_scopes_.empty() && passesCut(element.get()));
+    }
+    ss << "        } // End of sequence block\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::visitGroup(const Group* node, const std::string& on_failure_action) {
+    return visitNode(node->content.get(), on_failure_action);
+}
+
+std::string CppCodeGenerator::visitOptional(const Optional* node, const std::string& on_failure_action) {
+    std::ostringstream ss;
+    // Без ^ внутри номер не расходуется: код прочих грамматик не меняется
+    std::string cut = containsCut(node->content.get()) ? "opt_cut_" + std::to_string(variable_counter_++) : "";
+    std::string on_opt_failure = generateRestore("opt") + " break;"; // break from do-while
+    
+    // Неудача после ^ - неудача самой [ ]: флаг проверяется после цикла
+    cut_scopes_.push_back(CutScope{generateRestore("opt") + " " + cut + " = true; break;"});
+    std::string body = visitNode(node->content.get(), on_opt_failure);
+    bool used = cut_scopes_.back().used;
+    cut_scopes_.pop_back();
+    
+    ss << "        // Optional\n";
+    if (used) {
+        ss << "        {\n";
+        ss << "        bool " << cut << " = false;\n";
+    }
+    ss << "        do {\n";
+    ss << generateCheckpoint("opt", "            ");
+    ss << "            " << body << "\n";
+    ss << "        } while(false);\n";
+    if (used) {
+        ss << "        if (" << cut << ") {\n";
+        ss << "            " << on_failure_action << "\n";
+        ss << "        }\n";
+        ss << "        }\n";
+    }
+    
+    return ss.str();
+}
+
+std::string CppCodeGenerator::visitZeroOrMore(const ZeroOrMore* node, const std::string& on_failure_action) {
+    std::string scan = generateClassRepetition(node->content.get(), false, on_failure_action);
+    if (!scan.empty()) {
+        return scan;
+    }
+    
+    std::ostringstream ss;
+    std::string cut = containsCut(node->content.get()) ? "rep_cut_" + std::to_string(variable_counter_++) : "";
+    std::string on_rep_failure = generateRestore("rep") + " break;";
+    
+    // Неудача после ^ в повторении - неудача всего { }
+    cut_scopes_.push_back(CutScope{generateRestore("rep") + " " + cut + " = true; break;"});
+    std::string body = visitNode(node->content.get(), on_rep_failure);
+    bool used = cut_scopes_.back().used;
+    cut_scopes_.pop_back();
+    
+    ss << "        // Zero or more repetitions\n";
+    if (used) {
+        ss << "        {\n";
+        ss << "        bool " << cut << " = false;\n";
     }
+    ss << "        while (true) {\n";
+    ss << generateCheckpoint("rep", "            ");
+    ss << body;
+    ss << "            if (pos_ == rep_pos) break; // Empty match: stop repeating\n";
     
-    return "        // Unknown node type\n";
+    ss << "        }\n";
+    if (used) {
+        ss << "        if (" << cut << ") {\n";
+        ss << "            " << on_failure_action << "\n";
+        ss << "        }\n";
+        ss << "        }\n";
+    }
+    
+    return ss.str();
+}
+
+std::string CppCodeGenerator::visitOneOrMore(const OneOrMore* node, const std::string& on_failure_action) {
+    std::string scan = generateClassRepetition(node->content.get(), true, on_failure_action);
+    if (!scan.empty()) {
+        return scan;
+    }
+    
+    std::ostringstream ss;
+    std::string cut = containsCut(node->content.get()) ? "rep_cut_" + std::to_string(variable_counter_++) : "";
+    std::string on_rep_failure = generateRestore("rep") + " break;";
+    
+    cut_scopes_.push_back(CutScope{generateRestore("rep") + " " + cut + " = true; break;"});
+    std::string body = visitNode(node->content.get(), on_rep_failure);
+    bool used = cut_scopes_.back().used;
+    cut_scopes_.pop_back();
+    
+    ss << "        // One or more repetitions\n";
+    ss << "        {\n";
+    ss << "            int match_count = 0;\n";
+    if (used) {
+        ss << "            bool " << cut << " = false;\n";
+    }
+    ss << "            while (true) {\n";
+    ss << generateCheckpoint("rep", "                ");
+    ss << body;
+
+    ss << "                match_count++;\n";
+    ss << "                if (pos_ == rep_pos) break; // Empty match: stop repeating\n";
+    ss << "            }\n";
+    if (used) {
+        ss << "            if (" << cut << ") {\n";
+        ss << "                " << on_failure_action << "\n";
+        ss << "            }\n";
+    }
+    ss << "            if (match_count == 0) {\n";
+    ss << "                " << on_failure_action << "\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    
+    return ss.str();
+}
+
+// Повторения классов символов: сканирование блоками
+
+const ProductionRule* CppCodeGenerator::inlinableClassRule(const ASTNode* node) const {
+    // Раскрываются только ссылки внутри токенов на правила-токены и только без
+    // дерева: в AST у каждой ссылки свой узел (STRING > ch, ch), и повторение
+    // такого правила остаётся циклом. Пропуск пробелов внутри раскрытого
+    // правила остаётся прежним
+    const auto* nt = node_cast<NonTerminal>(node);
+    if (!nt || buildsTree() || !in_lexical_rule_ || !lexical_rules_.count(nt->name) || nt->hasParameters()) {
+        return nullptr;
+    }
+    const ProductionRule* rule = grammar_->findRule(nt->name);
+    return rule && !rule->hasParameters() ? rule : nullptr;
+}
+
+bool CppCodeGenerator::collectCharClass(const ASTNode* node, CharClass& cls, size_t depth) const {
+    if (depth > 16) {
+        return false;
+    }
+    if (const auto* t = node_cast<Terminal>(node)) {
+        // В прежнем режиме matchString пропускает пробелы перед каждым терминалом
+        if (trivia_rule_.empty() || t->value.size() != 1 || static_cast<unsigned char>(t->value[0]) >= 0x80) {
+            return false;
+        }
+        cls.ascii.set(static_cast<unsigned char>(t->value[0]));
+        return true;
+    }
+    if (const auto* range = node_cast<CharRange>(node)) {
+        if (range->start > range->end) return false;
+        for (uint32_t c = range->start; c <= range->end && c < 0x80; ++c) {
+            cls.ascii.set(c);
+        }
+        // Не-ASCII байт декодируется так же, как в visitCharRange; избыточная
+        // кодировка ASCII-символа (0xC0 0xB0) в класс не входит
+        if (range->end >= 0x80) {
+            cls.ranges.emplace_back(std::max<uint32_t>(range->start, 0x80), range->end);
+        }
+        return true;
+    }
+    if (const auto* alt = node_cast<Alternative>(node)) {
+        for (const auto& choice : alt->choices) {
+            if (!collectCharClass(choice.get(), cls, depth + 1)) return false;
+        }
+        return true;
+    }
+    if (const auto* group = node_cast<Group>(node)) {
+        return collectCharClass(group->content.get(), cls, depth + 1);
+    }
+    if (const ProductionRule* rule = inlinableClassRule(node)) {
+        return collectCharClass(rule->rightSide.get(), cls, depth + 1);
+    }
+    return false;
+}
+
+std::string CppCodeGenerator::generateClassRepetition(const ASTNode* content, bool one_or_more,
+                                                      const std::string& on_failure_action) {
+    // В синтаксических правилах пробелы пропускаются перед каждым символом;
+    // с ^ внутри повторение остаётся циклом с областью отсечения
+    if (!options_.char_class_scanners || skipsBeforeToken() || containsCut(content)) {
+        return "";
+    }
+    
+    const ASTNode* body = content;
+    for (size_t depth = 0; depth < 16; ++depth) {
+        if (const auto* group = node_cast<Group>(body)) {
+            body = group->content.get();
+        } else if (const ProductionRule* rule = inlinableClassRule(body)) {
+            body = rule->rightSide.get();
+        } else {
+            break;
+        }
+    }
+    
+    // Весь элемент - класс символов, либо выбор из классов и одной другой
+    // альтернативы (json_char ::= unescaped_char | escape_sequence)
+    CharClass cls;
+    const ASTNode* other = nullptr;
+    if (!collectCharClass(body, cls, 0)) {
+        const auto* alt = node_cast<Alternative>(body);
+        if (!alt) return "";
+        cls = CharClass{};
+        for (const auto& choice : alt->choices) {
+            if (collectCharClass(choice.get(), cls, 0)) continue;
+            if (other) return "";
+            other = choice.get();
+        }
+        if (!other || (cls.ascii.none() && cls.ranges.empty())) return "";
+        
+        // Другая альтернатива пробуется там, где класс остановился. Порядок выбора
+        // не важен, только если её FIRST не пересекается с байтами класса
+        LookaheadSet class_first = cls.ascii;
+        if (!cls.ranges.empty()) {
+            for (size_t b = 0x80; b < 0x100; ++b) class_first.set(b);
+        }
+        std::vector<std::string> refs;
+        collectReferences(other, refs);
+        bool all_lexical = in_lexical_rule_;
+        std::unordered_set<std::string> seen;
+        while (all_lexical && !refs.empty()) {
+            std::string name = refs.back();
+            refs.pop_back();
+            if (!seen.insert(name).second) continue;
+            const ProductionRule* rule = grammar_->findRule(name);
+            if (!lexical_rules_.count(name) || !rule) {
+                all_lexical = false;
+            } else {
+                collectReferences(rule->rightSide.get(), refs);
+            }
+        }
+        const GrammarAnalysis& sets = all_lexical ? analysis_ : ws_analysis_;
+        if (sets.isNullable(other) || (sets.first(other) & class_first).any()) return "";
+    }
+    
+    std::sort(cls.ranges.begin(), cls.ranges.end());
+    std::vector<std::pair<uint32_t, uint32_t>> merged;
+    for (const auto& range : cls.ranges) {
+        if (!merged.empty() && range.first <= merged.back().second + 1) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    cls.ranges = merged;
+    
+    size_t index = 0;
+    while (index < scan_classes_.size() &&
+           (scan_classes_[index].ascii != cls.ascii || scan_classes_[index].ranges != cls.ranges)) {
+        ++index;
+    }
+    if (index == scan_classes_.size()) {
+        scan_classes_.push_back(cls);
+    }
+    std::string scan = "scanClass" + std::to_string(index) + "(pos_)";
+    
+    // В синтаксическом правиле отрезок класса сообщается одним токеном
+    bool token_events = options_.event_callbacks && !in_lexical_rule_;
+    
+    std::ostringstream ss;
+    ss << "        // " << (one_or_more ? "One" : "Zero") << " or more: character class scanned in bulk\n";
+    if (!other) {
+        if (!one_or_more && !token_events) {
+            ss << "        advanceTo(" << scan << ");\n";
+            return ss.str();
+        }
+        ss << "        {\n";
+        ss << "            const size_t scan_end = " << scan << ";\n";
+        if (one_or_more) {
+            ss << "            if (scan_end == pos_) {\n";
+            ss << "                " << noteFailure(content) << on_failure_action << "\n";
+            ss << "            }\n";
+        }
+        if (token_events) {
+            ss << "            if (scan_end != pos_) {\n";
+            ss << "                const size_t run_start = pos_;\n";
+            ss << "                advanceTo(scan_end);\n";
+            ss << "                recordToken(run_start);\n";
+            ss << "            }\n";
+        } else {
+            ss << "            advanceTo(scan_end);\n";
+        }
+        ss << "        }\n";
+        return ss.str();
+    }
+    
+    ss << "        {\n";
+    if (one_or_more) {
+        ss << "            const size_t rep_start = pos_;\n";
+    }
+    ss << "            while (true) {\n";
+    if (token_events) {
+        ss << "                const size_t run_start = pos_;\n";
+        ss << "                advanceTo(" << scan << ");\n";
+        ss << "                if (pos_ != run_start) recordToken(run_start);\n";
+    } else {
+        ss << "                advanceTo(" << scan << ");\n";
+    }
+    ss << generateCheckpoint("rep", "                ");
+    ss << visitNode(other, generateRestore("rep") + " break;");
+    ss << "                if (pos_ == rep_pos) break; // Empty match: stop repeating\n";
+    ss << "            }\n";
+    if (one_or_more) {
+        ss << "            if (pos_ == rep_start) {\n";
+        ss << "                " << noteFailure(content) << on_failure_action << "\n";
+        ss << "            }\n";
+    }
+    ss << "        }\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateClassScanner(size_t index) const {
+    const CharClass& cls = scan_classes_[index];
+    
+    // Непрерывные отрезки ASCII-байтов класса: по сравнению (или паре) на отрезок
+    std::vector<std::pair<unsigned, unsigned>> runs;
+    for (unsigned b = 0; b < 0x80; ++b) {
+        if (!cls.ascii.test(b)) continue;
+        if (!runs.empty() && runs.back().second + 1 == b) {
+            runs.back().second = b;
+        } else {
+            runs.emplace_back(b, b);
+        }
+    }
+    auto hex = [](uint32_t value) {
+        std::ostringstream out;
+        out << "0x" << std::hex << std::uppercase << value;
+        return out.str();
+    };
+    
+    std::ostringstream description;
+    for (const auto& run : runs) {
+        if (description.tellp() > 0) description << " | ";
+        description << hex(run.first);
+        if (run.second != run.first) description << ".." << hex(run.second);
+    }
+    for (const auto& range : cls.ranges) {
+        if (description.tellp() > 0) description << " | ";
+        description << "U+" << std::hex << std::uppercase << range.first
+                    << "..U+" << range.second << std::dec << std::nouppercase;
+    }
+    
+    std::ostringstream ss;
+    ss << "    // Character class " << description.str() << ": end of the longest run from p\n";
+    ss << "    size_t scanClass" << index << "(size_t p) const {\n";
+    ss << "        const char* data = input_.data();\n";
+    ss << "        const size_t size = input_.size();\n";
+    if (runs.size() > 4) {
+        ss << "        static constexpr bool ascii[128] = {";
+        for (size_t b = 0; b < 0x80; ++b) {
+            if (b % 32 == 0) ss << "\n            ";
+            ss << (cls.ascii.test(b) ? "1" : "0") << (b + 1 < 0x80 ? "," : "");
+        }
+        ss << "\n        };\n";
+    }
+    ss << "        while (p < size) {\n";
+    
+    // Блочная проверка: все байты блока - ASCII-члены класса. Знаковое сравнение
+    // x86 отсекает байты >= 0x80, так как нижняя граница отрезка не меньше -1
+    if (!runs.empty() && runs.size() <= 8) {
+        auto x86 = [&](const std::string& p, size_t width) {
+            std::ostringstream out;
+            std::string vec = "__m" + std::to_string(width * 8) + "i";
+            out << "            while (p + " << width << " <= size) {\n";
+            out << "                const " << vec << " chunk = " << p << "loadu_si" << width * 8
+                << "(reinterpret_cast<const " << vec << "*>(data + p));\n";
+            for (size_t i = 0; i < runs.size(); ++i) {
+                std::string test;
+                if (runs[i].first == runs[i].second) {
+                    test = p + "cmpeq_epi8(chunk, " + p + "set1_epi8(" + hex(runs[i].first) + "))";
+                } else {
+                    test = p + "cmpgt_epi8(chunk, " + p + "set1_epi8(" +
+                           (runs[i].first == 0 ? std::string("-1") : hex(runs[i].first - 1)) + "))";
+                    if (runs[i].second < 0x7F) {
+                        test = p + "and_si" + std::to_string(width * 8) + "(" + test + ", " + p +
+                               "cmpgt_epi8(" + p + "set1_epi8(" + hex(runs[i].second + 1) + "), chunk))";
+                    }
+                }
+                out << "                " << (i == 0 ? vec + " hit = " + test + ";"
+                                                     : "hit = " + p + "or_si" + std::to_string(width * 8) +
+                                                           "(hit, " + test + ");") << "\n";
+            }
+            out << "                const unsigned other = ~static_cast<unsigned>(" << p << "movemask_epi8(hit))"
+                << (width == 16 ? " & 0xFFFFu" : "") << ";\n";
+            out << "                if (other != 0) {\n";
+            out << "                    p += static_cast<size_t>(__builtin_ctz(other));\n";
+            out << "                    break;\n";
+            out << "                }\n";
+            out << "                p += " << width << ";\n";
+            out << "            }\n";
+            return out.str();
+        };
+        ss << "#if defined(__AVX2__)\n";
+        ss << "            // 32 bytes per step while every byte is an ASCII member\n";
+        ss << x86("_mm256_", 32);
+        ss << "#endif\n";
+        ss << "#if defined(__SSE2__)\n";
+        ss << "            // 16 bytes per step while every byte is an ASCII member\n";
+        ss << x86("_mm_", 16);
+        ss << "#elif defined(__ARM_NEON)\n";
+        ss << "            // 16 bytes per step; the narrowed mask has 4 bits per byte\n";
+        ss << "            while (p + 16 <= size) {\n";
+        ss << "                const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + p));\n";
+        for (size_t i = 0; i < runs.size(); ++i) {
+            std::string test;
+            if (runs[i].first == runs[i].second) {
+                test = "vceqq_u8(chunk, vdupq_n_u8(" + hex(runs[i].first) + "))";
+            } else {
+                test = "vandq_u8(vcgeq_u8(chunk, vdupq_n_u8(" + hex(runs[i].first) +
+                       ")), vcleq_u8(chunk, vdupq_n_u8(" + hex(runs[i].second) + ")))";
+            }
+            ss << "                " << (i == 0 ? "uint8x16_t hit = " + test + ";" : "hit = vorrq_u8(hit, " + test + ");")
+               << "\n";
+        }
+        ss << "                const uint64_t other = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);\n";
+        ss << "                if (other != 0) {\n";
+        ss << "                    p += static_cast<size_t>(__builtin_ctzll(other) >> 2);\n";
+        ss << "                    break;\n";
+        ss << "                }\n";
+        ss << "                p += 16;\n";
+        ss << "            }\n";
+        ss << "#endif\n";
+        ss << "            if (p >= size) break;\n";
+    }
+    
+    // Скалярный остаток: ASCII по отрезкам или таблице, остальное - декодирование UTF-8
+    ss << "            const unsigned char c = static_cast<unsigned char>(data[p]);\n";
+    ss << "            if (c < 0x80) {\n";
+    if (runs.empty()) {
+        ss << "                break;\n";
+    } else {
+        ss << "                if (!(";
+        if (runs.size() > 4) {
+            ss << "ascii[c]";
+        } else {
+            for (size_t i = 0; i < runs.size(); ++i) {
+                if (i > 0) ss << " || ";
+                if (runs[i].first == runs[i].second) {
+                    ss << "c == " << hex(runs[i].first);
+                } else {
+                    ss << "(c >= " << hex(runs[i].first) << " && c <= " << hex(runs[i].second) << ")";
+                }
+            }
+        }
+        ss << ")) break;\n";
+        ss << "                ++p;\n";
+        ss << "                continue;\n";
+    }
+    ss << "            }\n";
+    if (cls.ranges.empty()) {
+        ss << "            break;\n";
+    } else {
+        ss << "            uint32_t cp = 0;\n";
+        ss << "            const size_t len = decodeUtf8(p, cp);\n";
+        ss << "            if (p + len > size) break;\n";
+        ss << "            if (!(";
+        for (size_t i = 0; i < cls.ranges.size(); ++i) {
+            if (i > 0) ss << " || ";
+            ss << "(cp >= " << cls.ranges[i].first << "U && cp <= " << cls.ranges[i].second << "U)";
+        }
+        ss << ")) break;\n";
+        ss << "            p += len;\n";
+    }
+    ss << "        }\n";
+    if (options_.streaming) {
+        ss << "        if (size - p < 4) {\n";
+        ss << "            hit_end_ = true; // The run, or a split character, may continue\n";
+        ss << "        }\n";
+    }
+    if (options_.incremental) {
+        if (cls.ranges.empty()) {
+            ss << "        noteExamined(p + 1); // The stop byte\n";
+        } else {
+            ss << "        // The stop byte, or the character it starts\n";
+            ss << "        noteExamined(p + (p < size && static_cast<unsigned char>(data[p]) < 0x80 ? 1 : 4));\n";
+        }
+    }
+    ss << "        return p;\n";
+    ss << "    }\n";
+    ss << "\n";
+    return ss.str();
+}
+
+// Альтернативы из одних литералов
+
+bool CppCodeGenerator::collectLiterals(const Alternative* node, std::vector<std::string>& literals) const {
+    // Лексер на ДКА уже распознаёт литералы за один проход; для пары литералов
+    // хватает FIRST-диспетчеризации
+    if (!options_.literal_tries || lexer_mode_ || node->choices.size() < 3) {
+        return false;
+    }
+    literals.clear();
+    for (const auto& choice : node->choices) {
+        const ASTNode* inner = choice.get();
+        while (const auto* group = node_cast<Group>(inner)) {
+            inner = group->content.get();
+        }
+        const auto* terminal = node_cast<Terminal>(inner);
+        if (!terminal) {
+            return false;
+        }
+        literals.push_back(terminal->value);
+    }
+    return true;
+}
+
+std::string CppCodeGenerator::generateLiteralAlternative(const std::vector<std::string>& literals,
+                                                         const std::string& on_failure_action) {
+    size_t index = std::find(literal_tries_.begin(), literal_tries_.end(), literals) - literal_tries_.begin();
+    if (index == literal_tries_.size()) {
+        literal_tries_.push_back(literals);
+    }
+    std::string id = std::to_string(index);
+    std::string var = "lit_" + std::to_string(variable_counter_++);
+    std::string all = std::to_string(literals.size());
+    
+    // Как перебор matchString(): пробелы пропускаются один раз, литерал - первый
+    // совпавший по порядку, конец входа и просмотренные байты - по всем проверенным
+    std::ostringstream ss;
+    ss << "        // Match one of " << literals.size() << " literals in a single pass (trie " << id << ")\n";
+    if (skipsBeforeToken() || trivia_rule_.empty()) {
+        ss << "        skipWhitespace();\n";
+    }
+    ss << "        {\n";
+    ss << "            const int " << var << " = matchLiterals" << id << "();\n";
+    if (options_.streaming) {
+        ss << "            if (literal_reach_" << id << "[" << var << " < 0 ? " << all << " : " << var
+           << "] > input_.size() - pos_) {\n";
+        ss << "                hit_end_ = true;\n";
+        ss << "            }\n";
+    }
+    if (options_.incremental) {
+        ss << "            noteExamined(pos_ + literal_reach_" << id << "[" << var << " < 0 ? " << all << " : "
+           << var << " + 1]);\n";
+    }
+    ss << "            if (" << var << " < 0) {\n";
+    ss << "                " << on_failure_action << "\n";
+    ss << "            }\n";
+    ss << "            const size_t " << var << "_length = literal_lengths_" << id << "[" << var << "];\n";
+    if (options_.lazy_positions) {
+        ss << "            pos_ += " << var << "_length;\n";
+    } else {
+        ss << "            for (size_t i = 0; i < " << var << "_length; ++i) {\n";
+        ss << "                advance();\n";
+        ss << "            }\n";
+    }
+    if (options_.event_callbacks && !in_lexical_rule_) {
+        ss << "            if (" << var << "_length > 0) {\n";
+        ss << "                recordToken(pos_ - " << var << "_length);\n";
+        ss << "            }\n";
+    }
+    ss << "        }\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateLiteralMatcher(size_t index) const {
+    const auto& literals = literal_tries_[index];
+    std::string id = std::to_string(index);
+    
+    std::string description;
+    for (size_t i = 0; i < literals.size() && i < 8; ++i) {
+        description += (i > 0 ? " | \"" : "\"") + escapeString(literals[i]) + "\"";
+    }
+    if (literals.size() > 8) {
+        description += " | ...";
+    }
+    
+    std::ostringstream ss;
+    ss << "    // Literal trie " << id << ": " << description << "\n";
+    ss << "    // Index of the first literal, in grammar order, that the input at pos_ starts with; -1 if none\n";
+    ss << "    static constexpr size_t literal_lengths_" << id << "[] = {";
+    for (size_t i = 0; i < literals.size(); ++i) {
+        ss << (i > 0 ? ", " : "") << literals[i].size();
+    }
+    ss << "};\n";
+    if (options_.streaming || options_.incremental) {
+        // Длиннейший из первых i литералов: все они проверены до совпадения литерала i
+        ss << "    static constexpr size_t literal_reach_" << id << "[] = {0";
+        size_t reach = 0;
+        for (const auto& literal : literals) {
+            reach = std::max(reach, literal.size());
+            ss << ", " << reach;
+        }
+        ss << "};\n";
+    }
+    ss << "    int matchLiterals" << id << "() const {\n";
+    ss << "        const char* p = input_.data() + pos_;\n";
+    ss << "        const size_t n = input_.size() - pos_;\n";
+    ss << "        (void)p;\n";
+    emitTrieNode(LiteralTrie(literals), 0, 0, SIZE_MAX, "        ", ss);
+    ss << "    }\n";
+    ss << "\n";
+    return ss.str();
+}
+
+// Потоковый разбор
+
+std::string CppCodeGenerator::generateStreamingMethods() {
+    std::ostringstream ss;
+    ss << "    // Streaming input: feed() chunks in order, then finish(). Each complete\n";
+    ss << "    // " << stream_item_ << " is passed to the callback as soon as more input can no\n";
+    ss << "    // longer change it; only the unparsed tail of the input stays in memory\n";
+    ss << "    void onItem(std::function<void(NodePtr)> callback) { item_callback_ = std::move(callback); }\n";
+    ss << "\n";
+    ss << "    // false once the stream has a syntax error (see getError())\n";
+    ss << "    bool feed(std::string_view chunk) {\n";
+    ss << "        if (stream_failed_) {\n";
+    ss << "            return false;\n";
+    ss << "        }\n";
+    ss << "        window_.append(chunk.data(), chunk.size());\n";
+    ss << "        if (window_.size() < retry_size_) {\n";
+    ss << "            return true;\n";
+    ss << "        }\n";
+    ss << "        return parseStreamItems(false);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    bool finish() {\n";
+    ss << "        if (stream_failed_) {\n";
+    ss << "            return false;\n";
+    ss << "        }\n";
+    ss << "        return parseStreamItems(true);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Bytes of the stream consumed by the items passed to the callback\n";
+    ss << "    size_t streamOffset() const { return stream_offset_; }\n";
+    ss << "\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateStreamItems() {
+    std::string id = makeIdentifier(stream_item_);
+    std::ostringstream ss;
+    ss << "    // Parse every item of the window whose outcome no longer depends on\n";
+    ss << "    // input that has not arrived yet, then drop the consumed bytes\n";
+    ss << "    bool parseStreamItems(bool last) {\n";
+    ss << "        storage_.clear();\n";
+    ss << "        input_ = window_;\n";
+    ss << "        pos_ = 0;\n";
+    ss << "        bool ok = true;\n";
+    ss << "        while (true) {\n";
+    ss << "            size_t start = pos_;\n";
+    ss << "            size_t start_line = line_;\n";
+    ss << "            size_t start_column = column_;\n";
+    ss << "            if (last) {\n";
+    ss << "                // Trailing whitespace after the last item\n";
+    ss << "                skipWhitespace();\n";
+    ss << "                if (pos_ == input_.size()) break;\n";
+    ss << "                pos_ = start;\n";
+    ss << "                line_ = start_line;\n";
+    ss << "                column_ = start_column;\n";
+    ss << "            } else if (pos_ == input_.size()) {\n";
+    ss << "                break;\n";
+    ss << "            }\n";
+    ss << "            hit_end_ = false;\n";
+    ss << "            error_message_.clear();\n";
+    ss << "            recursion_depth_ = 0;\n";
+    if (options_.arena_allocation) {
+        ss << "            arena_.reset(); // The previous item is no longer referenced\n";
+    }
+    if (options_.event_callbacks) {
+        ss << "            rollbackEvents(0); // Events of an attempt to be retried\n";
+    }
+    for (const auto& rule : grammar_->rules) {
+        if (isMemoized(rule->leftSide)) {
+            ss << "            memo_" << makeIdentifier(rule->leftSide) << "_.clear();\n";
+        }
+    }
+    if (!context_slots_.empty()) {
+        ss << "            size_t start_context = context_.mark();\n";
+    }
+    ss << "            auto item = " << ruleCall(stream_item_, "parse_" + id, false, entryArguments(stream_item_)) << ";\n";
+    ss << "            if (hit_end_ && !last) {\n";
+    ss << "                // Retry when more input arrives\n";
+    if (!context_slots_.empty()) {
+        ss << "                context_.rewind(start_context);\n";
+    }
+    ss << "                pos_ = start;\n";
+    ss << "                line_ = start_line;\n";
+    ss << "                column_ = start_column;\n";
+    ss << "                break;\n";
+    ss << "            }\n";
+    ss << "            if (!item || pos_ == start) {\n";
+    ss << "                error_offset_ = stream_offset_ + start;\n";
+    ss << "                if (error_message_.empty()) {\n";
+    ss << "                    error_message_ = \"Parse failed at position \" + std::to_string(stream_offset_ + start);\n";
+    ss << "                }\n";
+    ss << "                stream_failed_ = true;\n";
+    ss << "                ok = false;\n";
+    ss << "                break;\n";
+    ss << "            }\n";
+    if (options_.event_callbacks) {
+        // Спаны указывают в окно: события доставляются до удаления разобранного
+        ss << "            deliverEvents();\n";
+    }
+    if (!context_slots_.empty()) {
+        ss << "            context_.commit(); // The item will not be retried\n";
+    }
+    ss << "            if (item_callback_) {\n";
+    ss << "                item_callback_(std::move(item));\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "        stream_offset_ += pos_;\n";
+    ss << "        window_.erase(0, pos_);\n";
+    ss << "        // The window now starts with the unfinished item, if any\n";
+    ss << "        retry_size_ = ok && !last && !window_.empty() ? 2 * window_.size() : 0;\n";
+    ss << "        input_ = window_;\n";
+    ss << "        pos_ = 0;\n";
+    ss << "        return ok;\n";
+    ss << "    }\n";
+    ss << "\n";
+    return ss.str();
+}
+
+// Разбор без AST: распознаватель и события
+
+bool CppCodeGenerator::buildsTree() const {
+    return !options_.recognizer && !options_.event_callbacks;
+}
+
+std::string CppCodeGenerator::depthLimit() const {
+    return options_.explicit_stack ? "max_depth_" : std::to_string(options_.max_recursion_depth);
+}
+
+std::string CppCodeGenerator::generateEventTypes(const Grammar& grammar) const {
+    std::ostringstream ss;
+    ss << "// Rules of the grammar as reported to event handlers\n";
+    ss << "enum RuleKind : uint16_t {\n";
+    for (const auto& rule : grammar.rules) {
+        ss << "    RULE_" << makeIdentifier(rule->leftSide) << ",\n";
+    }
+    ss << "};\n";
+    ss << "\n";
+    ss << "inline const char* ruleName(RuleKind rule) {\n";
+    ss << "    static constexpr const char* names[] = {";
+    for (size_t i = 0; i < grammar.rules.size(); ++i) {
+        ss << (i % 4 == 0 ? "\n        " : " ") << "\"" << escapeString(grammar.rules[i]->leftSide) << "\"";
+        ss << (i + 1 < grammar.rules.size() ? "," : "");
+    }
+    ss << "\n    };\n";
+    ss << "    return names[rule];\n";
+    ss << "}\n";
+    ss << "\n";
+    ss << "// Event handler with no hooks: the parser generates no event code and only\n";
+    ss << "// recognizes the input. A handler declares any of\n";
+    ss << "//   void onEnter(RuleKind rule);\n";
+    ss << "//   void onExit(RuleKind rule, std::string_view span);\n";
+    ss << "//   void onToken(std::string_view span);\n";
+    ss << "struct NoEvents {};\n";
+    ss << "\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateEventMethods() const {
+    std::ostringstream ss;
+    // Тело генерируемого кода зависит от хуков обработчика через if constexpr:
+    // без хуков журнал не ведётся и разбор совпадает с распознавателем
+    ss << "\n";
+    ss << "    // Hooks the handler declares; a missing hook generates no code\n";
+    ss << "    static constexpr bool has_enter_hook = requires(Handler& h, RuleKind rule) { h.onEnter(rule); };\n";
+    ss << "    static constexpr bool has_exit_hook =\n";
+    ss << "        requires(Handler& h, RuleKind rule, std::string_view span) { h.onExit(rule, span); };\n";
+    ss << "    static constexpr bool has_token_hook = requires(Handler& h, std::string_view span) { h.onToken(span); };\n";
+    ss << "    static constexpr bool logs_rules = has_enter_hook || has_exit_hook;\n";
+    ss << "    static constexpr bool logs_events = logs_rules || has_token_hook;\n";
+    ss << "\n";
+    ss << "    // Events of the current parse in input order. Backtracking truncates the\n";
+    ss << "    // log, so the handler only sees the rules and tokens of the final parse\n";
+    ss << "    static constexpr uint32_t token_event = 0xFFFFFFFFu;\n";
+    ss << "    struct Event {\n";
+    ss << "        size_t begin;\n";
+    ss << "        size_t end;\n";
+    ss << "        uint32_t rule;  // RuleKind, or token_event\n";
+    ss << "        uint32_t size;  // 1 + number of events nested in the rule\n";
+    ss << "    };\n";
+    ss << "    std::vector<Event> events_;\n";
+    ss << "    std::vector<size_t> open_events_; // Rules entered but not yet exited by deliverEvents()\n";
+    ss << "    [[no_unique_address]] Handler handler_;\n";
+    ss << "\n";
+    ss << "    size_t eventMark() const {\n";
+    ss << "        if constexpr (logs_events) {\n";
+    ss << "            return events_.size();\n";
+    ss << "        } else {\n";
+    ss << "            return 0;\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    void rollbackEvents(size_t mark) {\n";
+    ss << "        if constexpr (logs_events) {\n";
+    ss << "            events_.resize(mark);\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    size_t enterRule(RuleKind rule) {\n";
+    ss << "        size_t mark = eventMark();\n";
+    ss << "        if constexpr (logs_rules) {\n";
+    ss << "            events_.push_back(Event{pos_, pos_, rule, 1});\n";
+    ss << "        }\n";
+    ss << "        return mark;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // The span starts at the first nested event, after any skipped whitespace\n";
+    ss << "    void exitRule(size_t mark) {\n";
+    ss << "        if constexpr (logs_rules) {\n";
+    ss << "            Event& event = events_[mark];\n";
+    ss << "            event.size = static_cast<uint32_t>(events_.size() - mark);\n";
+    ss << "            if (mark + 1 < events_.size()) {\n";
+    ss << "                event.begin = events_[mark + 1].begin;\n";
+    ss << "            }\n";
+    ss << "            event.end = pos_;\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    void recordToken(size_t begin) {\n";
+    ss << "        if constexpr (logs_events) {\n";
+    ss << "            events_.push_back(Event{begin, pos_, token_event, 1});\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Pass the logged events to the handler and clear the log\n";
+    ss << "    void deliverEvents() {\n";
+    ss << "        if constexpr (logs_events) {\n";
+    ss << "            for (size_t i = 0; i < events_.size(); ++i) {\n";
+    ss << "                closeEvents(i);\n";
+    ss << "                const Event& event = events_[i];\n";
+    ss << "                if (event.rule == token_event) {\n";
+    ss << "                    if constexpr (has_token_hook) {\n";
+    ss << "                        handler_.onToken(input_.substr(event.begin, event.end - event.begin));\n";
+    ss << "                    }\n";
+    ss << "                    continue;\n";
+    ss << "                }\n";
+    ss << "                if constexpr (has_enter_hook) {\n";
+    ss << "                    handler_.onEnter(static_cast<RuleKind>(event.rule));\n";
+    ss << "                }\n";
+    ss << "                open_events_.push_back(i);\n";
+    ss << "            }\n";
+    ss << "            closeEvents(events_.size());\n";
+    ss << "            events_.clear();\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Exit the open rules whose nested events end before index i\n";
+    ss << "    void closeEvents(size_t i) {\n";
+    ss << "        while (!open_events_.empty() && open_events_.back() + events_[open_events_.back()].size <= i) {\n";
+    ss << "            if constexpr (has_exit_hook) {\n";
+    ss << "                const Event& event = events_[open_events_.back()];\n";
+    ss << "                handler_.onExit(static_cast<RuleKind>(event.rule), input_.substr(event.begin, event.end - event.begin));\n";
+    ss << "            }\n";
+    ss << "            open_events_.pop_back();\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateRuleEnter(const std::string& rule_name, const std::string& mark) const {
+    return "        size_t " + mark + " = enterRule(RULE_" + makeIdentifier(rule_name) + ");\n";
 }
 
-std::string CppCodeGenerator::visitTerminal(const Terminal* node, const std::string& on_failure_action) {
+// Профилирование правил
+
+size_t CppCodeGenerator::profileIndex(const std::string& rule_name) const {
+    RuleId rule = ir_->findRule(rule_name);
+    return rule != NO_ID ? rule : 0;
+}
+
+std::string CppCodeGenerator::ruleEntryName(const std::string& rule_name) const {
+    // С профилированием parse_X() - обёртка со счётчиками, разбор - под другим именем
+    std::string name = "parse_" + makeIdentifier(rule_name);
+    return options_.profile ? name + "_unprofiled" : name;
+}
+
+std::string CppCodeGenerator::generateProfileTypes() const {
     std::ostringstream ss;
-    ss << "        // Match terminal: \"" << escapeString(node->value) << "\"\n";
-    ss << "        if (!matchString(\"" << escapeString(node->value) << "\")) {\n";
-    ss << "            " << on_failure_action << "\n";
+    ss << "// Counters of one rule in a parser generated with --profile\n";
+    ss << "struct RuleProfile {\n";
+    ss << "    const char* rule = \"\";\n";
+    ss << "    uint64_t calls = 0;\n";
+    ss << "    uint64_t successes = 0;\n";
+    ss << "    uint64_t failures = 0;\n";
+    ss << "    uint64_t failed_bytes = 0;     // Input consumed by attempts that then failed\n";
+    ss << "    uint64_t memo_hits = 0;        // Calls answered from the memo table\n";
+    ss << "    uint64_t inclusive_cycles = 0; // --profile-timing: in the rule and its callees\n";
+    ss << "    uint64_t exclusive_cycles = 0; // --profile-timing: in the rule itself\n";
+    ss << "\n";
+    ss << "    RuleProfile& operator+=(const RuleProfile& other) {\n";
+    ss << "        calls += other.calls;\n";
+    ss << "        successes += other.successes;\n";
+    ss << "        failures += other.failures;\n";
+    ss << "        failed_bytes += other.failed_bytes;\n";
+    ss << "        memo_hits += other.memo_hits;\n";
+    ss << "        inclusive_cycles += other.inclusive_cycles;\n";
+    ss << "        exclusive_cycles += other.exclusive_cycles;\n";
+    ss << "        return *this;\n";
+    ss << "    }\n";
+    ss << "};\n";
+    ss << "\n";
+    // Стоимость правила: собственное время, если оно измерялось, иначе
+    // работа, потерянная при backtracking
+    ss << "// Print the rules that were called, most expensive first: by exclusive time\n";
+    ss << "// if it was measured, otherwise by backtracked bytes and then by calls\n";
+    ss << "inline void printProfileReport(std::ostream& out, std::vector<RuleProfile> report) {\n";
+    ss << "    bool timed = false;\n";
+    ss << "    uint64_t total_cycles = 0;\n";
+    ss << "    size_t width = 4;\n";
+    ss << "    for (const RuleProfile& r : report) {\n";
+    ss << "        timed = timed || r.inclusive_cycles != 0;\n";
+    ss << "        total_cycles += r.exclusive_cycles;\n";
+    ss << "        width = std::max(width, std::strlen(r.rule));\n";
+    ss << "    }\n";
+    ss << "    std::stable_sort(report.begin(), report.end(), [timed](const RuleProfile& a, const RuleProfile& b) {\n";
+    ss << "        if (timed && a.exclusive_cycles != b.exclusive_cycles) return a.exclusive_cycles > b.exclusive_cycles;\n";
+    ss << "        if (a.failed_bytes != b.failed_bytes) return a.failed_bytes > b.failed_bytes;\n";
+    ss << "        return a.calls > b.calls;\n";
+    ss << "    });\n";
+    ss << "    std::ios_base::fmtflags flags = out.flags();\n";
+    ss << "    out << std::left << std::setw(static_cast<int>(width)) << \"rule\" << std::right\n";
+    ss << "        << std::setw(12) << \"calls\" << std::setw(12) << \"success\" << std::setw(12) << \"fail\"\n";
+    ss << "        << std::setw(14) << \"fail bytes\" << std::setw(12) << \"memo hits\";\n";
+    ss << "    if (timed) {\n";
+    ss << "        out << std::setw(16) << \"incl cycles\" << std::setw(16) << \"excl cycles\" << std::setw(8) << \"excl %\";\n";
+    ss << "    }\n";
+    ss << "    out << \"\\n\";\n";
+    ss << "    for (const RuleProfile& r : report) {\n";
+    ss << "        if (r.calls == 0) continue;\n";
+    ss << "        out << std::left << std::setw(static_cast<int>(width)) << r.rule << std::right\n";
+    ss << "            << std::setw(12) << r.calls << std::setw(12) << r.successes << std::setw(12) << r.failures\n";
+    ss << "            << std::setw(14) << r.failed_bytes << std::setw(12) << r.memo_hits;\n";
+    ss << "        if (timed) {\n";
+    ss << "            double share = total_cycles ? 100.0 * static_cast<double>(r.exclusive_cycles) / static_cast<double>(total_cycles) : 0.0;\n";
+    ss << "            out << std::setw(16) << r.inclusive_cycles << std::setw(16) << r.exclusive_cycles\n";
+    ss << "                << std::setw(8) << std::fixed << std::setprecision(1) << share;\n";
     ss << "        }\n";
+    ss << "        out << \"\\n\";\n";
+    ss << "    }\n";
+    ss << "    out.flags(flags);\n";
+    ss << "}\n";
+    ss << "\n";
     return ss.str();
 }
 
-std::string CppCodeGenerator::visitNonTerminal(const NonTerminal* node, const std::string& on_failure_action) {
+std::string CppCodeGenerator::generateProfileMembers() const {
     std::ostringstream ss;
-    std::string child_var = "child_" + std::to_string(variable_counter_++);
-    ss << "        // Parse non-terminal: " << node->name;
-    
-    if (node->hasParameters()) {
-        ss << " with parameters [";
-        for (size_t i = 0; i < node->parameterValues.size(); ++i) {
-            if (i > 0) ss << ", ";
-            ss << node->parameterValues[i];
-        }
-        ss << "]";
+    ss << "\n";
+    ss << "    // Profiling: counters of each rule in grammar order, accumulated over\n";
+    ss << "    // parses until resetProfile()\n";
+    ss << "    RuleProfile profile_[" << grammar_->rules.size() << "];\n";
+    if (options_.profile_timing) {
+        ss << "    uint64_t profile_child_cycles_ = 0; // Inclusive time of the running rule's callees\n";
+        ss << "\n";
+        ss << "    // Time stamp counter on x86, steady_clock ticks elsewhere\n";
+        ss << "    static uint64_t profileClock() {\n";
+        ss << "#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)\n";
+        ss << "        return __rdtsc();\n";
+        ss << "#else\n";
+        ss << "        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());\n";
+        ss << "#endif\n";
+        ss << "    }\n";
     }
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateProfileMethods() const {
+    std::ostringstream ss;
+    const size_t count = grammar_->rules.size();
+    ss << "    // Counters of every rule in grammar order";
+    ss << (parallel_item_.empty() ? "\n" : ", including the parallel workers\n");
+    ss << "    std::vector<RuleProfile> profile() const {\n";
+    ss << "        static constexpr const char* names[] = {";
+    for (size_t i = 0; i < count; ++i) {
+        ss << (i % 4 == 0 ? "\n            " : " ") << "\"" << escapeString(grammar_->rules[i]->leftSide) << "\"";
+        ss << (i + 1 < count ? "," : "");
+    }
+    ss << "\n        };\n";
+    ss << "        std::vector<RuleProfile> report(profile_, profile_ + " << count << ");\n";
+    ss << "        for (size_t i = 0; i < report.size(); ++i) {\n";
+    ss << "            report[i].rule = names[i];\n";
+    if (!parallel_item_.empty()) {
+        ss << "            for (const auto& worker : workers_) {\n";
+        ss << "                report[i] += worker->profile_[i];\n";
+        ss << "            }\n";
+    }
+    ss << "        }\n";
+    ss << "        return report;\n";
+    ss << "    }\n";
     ss << "\n";
-    
-    // Генерируем вызов функции с параметрами или без
-    ss << "        auto " << child_var << " = parse_" << makeIdentifier(node->name) << "(";
-    
-    if (node->hasParameters()) {
-        ss << generateParameterPassing(node->parameterValues);
+    ss << "    void resetProfile() {\n";
+    ss << "        for (RuleProfile& counters : profile_) {\n";
+    ss << "            counters = RuleProfile();\n";
+    ss << "        }\n";
+    if (!parallel_item_.empty()) {
+        ss << "        for (auto& worker : workers_) {\n";
+        ss << "            worker->resetProfile();\n";
+        ss << "        }\n";
     }
-    
-    ss << ");\n";
-    ss << "        if (!" << child_var << ") {\n";
-    ss << "            " << on_failure_action << "\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Table of the called rules, most expensive first\n";
+    ss << "    void printProfile(std::ostream& out) const {\n";
+    ss << "        printProfileReport(out, profile());\n";
+    ss << "    }\n";
+    ss << "\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateProfiledWrapper(const ProductionRule& rule) const {
+    std::ostringstream ss;
+    ss << "    // Parse rule: " << rule.leftSide << " (profiled)\n";
+    std::string ret = ruleReturn(rule.leftSide);
+    ss << ruleSignature(ruleReturnType(rule.leftSide),
+                        "parse_" + makeIdentifier(rule.leftSide) + "(" + generateParameterDeclarations(rule.parameters) + ")");
+    ss << "        RuleProfile& counters = profile_[" << profileIndex(rule.leftSide) << "];\n";
+    ss << "        ++counters.calls;\n";
+    if (options_.profile_timing) {
+        // Время вызванных правил копится в profile_child_cycles_ и вычитается
+        // из включающего времени: остаётся собственное время правила
+        ss << "        uint64_t outer_child_cycles = profile_child_cycles_;\n";
+        ss << "        profile_child_cycles_ = 0;\n";
+        ss << "        uint64_t start_cycles = profileClock();\n";
+    }
+    std::vector<std::string> arguments;
+    for (const auto& param : rule.parameters) {
+        arguments.push_back(param.name);
+    }
+    ss << "        NodePtr result = " << ruleCall(rule.leftSide, ruleEntryName(rule.leftSide), true, arguments) << ";\n";
+    if (options_.profile_timing) {
+        ss << "        uint64_t cycles = profileClock() - start_cycles;\n";
+        ss << "        counters.inclusive_cycles += cycles;\n";
+        ss << "        counters.exclusive_cycles += cycles - profile_child_cycles_;\n";
+        ss << "        profile_child_cycles_ = outer_child_cycles + cycles;\n";
+    }
+    ss << "        if (result) {\n";
+    ss << "            ++counters.successes;\n";
+    ss << "        } else {\n";
+    ss << "            ++counters.failures;\n";
     ss << "        }\n";
-    ss << "        node->children.push_back(std::move(" << child_var << "));\n";
+    ss << "        " << ret << " result;\n";
+    ss << "    }\n";
     return ss.str();
 }
 
-std::string CppCodeGenerator::visitCharRange(const CharRange* node, const std::string& on_failure_action) {
+// Явный стек: правила-корутины
+
+bool CppCodeGenerator::ruleIsCoroutine(const std::string& rule_name) const {
+    // Правило-токен лексера на ДКА ничего не вызывает и остаётся обычной функцией
+    return options_.explicit_stack && !(lexer_mode_ && lexical_rules_.count(rule_name));
+}
+
+std::string CppCodeGenerator::ruleReturnType(const std::string& rule_name) const {
+    return ruleIsCoroutine(rule_name) ? "RuleTask" : "NodePtr";
+}
+
+std::string CppCodeGenerator::ruleReturn(const std::string& rule_name) const {
+    return ruleIsCoroutine(rule_name) ? "co_return" : "return";
+}
+
+std::string CppCodeGenerator::ruleCall(const std::string& rule_name, const std::string& function,
+                                       bool from_rule, const std::vector<std::string>& arguments) const {
+    std::string call = function + "(" + generateParameterPassing(arguments) + ")";
+    if (!ruleIsCoroutine(rule_name)) {
+        return call;
+    }
+    // Из правила вызов приостанавливает вызывающего; из обычного кода
+    // правило выполняется до конца циклом диспетчера
+    return from_rule ? "(co_await " + call + ")" : call + ".run()";
+}
+
+std::string CppCodeGenerator::generateExplicitStackTypes() const {
     std::ostringstream ss;
-    ss << "        // Match character range: U+" << std::hex << std::uppercase 
-       << node->start << " .. U+" << node->end << std::dec << std::nouppercase << "\n";
-    ss << "        if (pos_ >= input_.size()) {\n";
-    ss << "            " << on_failure_action << "\n";
+    const std::string& parser = options_.parser_name;
+    
+    // Кадры корутин освобождаются в обратном порядке: вызванное правило
+    // завершается раньше вызвавшего, поэтому стек кадров - блоки с вершиной
+    ss << "\n";
+    ss << "    // Explicit stack: every rule is a coroutine. A rule call suspends the\n";
+    ss << "    // caller and the driver loop in RuleTask::run() resumes the callee, so\n";
+    ss << "    // the C++ stack stays flat at any nesting depth\n";
+    ss << "    class FrameStack {\n";
+    ss << "    public:\n";
+    ss << "        void* allocate(size_t size) {\n";
+    ss << "            size = frameSize(size);\n";
+    ss << "            if (blocks_.empty() || top_ + size > blocks_[current_].size) {\n";
+    ss << "                nextBlock(size);\n";
+    ss << "            }\n";
+    ss << "            char* frame = blocks_[current_].data.get() + top_;\n";
+    ss << "            top_ += size;\n";
+    ss << "            *reinterpret_cast<FrameStack**>(frame) = this;\n";
+    ss << "            return frame + kHeader;\n";
     ss << "        }\n";
-    ss << "        // Extract current codepoint\n";
-    ss << "        size_t char_len = 1;\n";
-    ss << "        uint32_t cp = static_cast<unsigned char>(input_[pos_]);\n";
-    ss << "        if ((input_[pos_] & 0x80) != 0) {\n";
-    ss << "            // UTF-8 multi-byte character\n";
-    ss << "            unsigned char firstByte = static_cast<unsigned char>(input_[pos_]);\n";
-    ss << "            if ((firstByte & 0xE0) == 0xC0) char_len = 2;\n";
-    ss << "            else if ((firstByte & 0xF0) == 0xE0) char_len = 3;\n";
-    ss << "            else if ((firstByte & 0xF8) == 0xF0) char_len = 4;\n";
-    ss << "            if (pos_ + char_len > input_.size()) {\n";
-    ss << "                " << on_failure_action << "\n";
+    ss << "\n";
+    ss << "        // Frames are released in reverse order of allocation\n";
+    ss << "        static void release(void* frame, size_t size) {\n";
+    ss << "            FrameStack* stack = *reinterpret_cast<FrameStack**>(static_cast<char*>(frame) - kHeader);\n";
+    ss << "            stack->top_ -= frameSize(size);\n";
+    ss << "            while (stack->top_ == 0 && stack->current_ > 0) {\n";
+    ss << "                --stack->current_;\n";
+    ss << "                stack->top_ = stack->blocks_[stack->current_].used;\n";
     ss << "            }\n";
-    ss << "            // Decode UTF-8 codepoint\n";
-    ss << "            if (char_len == 2) {\n";
-    ss << "                cp = ((firstByte & 0x1F) << 6) | (static_cast<unsigned char>(input_[pos_ + 1]) & 0x3F);\n";
-    ss << "            } else if (char_len == 3) {\n";
-    ss << "                cp = ((firstByte & 0x0F) << 12) | ((static_cast<unsigned char>(input_[pos_ + 1]) & 0x3F) << 6) | (static_cast<unsigned char>(input_[pos_ + 2]) & 0x3F);\n";
-    ss << "            } else if (char_len == 4) {\n";
-    ss << "                cp = ((firstByte & 0x07) << 18) | ((static_cast<unsigned char>(input_[pos_ + 1]) & 0x3F) << 12) | ((static_cast<unsigned char>(input_[pos_ + 2]) & 0x3F) << 6) | (static_cast<unsigned char>(input_[pos_ + 3]) & 0x3F);\n";
+    ss << "        }\n";
+    ss << "\n";
+    ss << "    private:\n";
+    ss << "        // Each frame starts with its owner, for release()\n";
+    ss << "        static constexpr size_t kHeader = alignof(std::max_align_t);\n";
+    ss << "\n";
+    ss << "        struct Block {\n";
+    ss << "            std::unique_ptr<char[]> data;\n";
+    ss << "            size_t size;\n";
+    ss << "            size_t used; // Top of the block when the next one was entered\n";
+    ss << "        };\n";
+    ss << "\n";
+    ss << "        static size_t frameSize(size_t size) {\n";
+    ss << "            return (size + 2 * kHeader - 1) / kHeader * kHeader;\n";
+    ss << "        }\n";
+    ss << "\n";
+    ss << "        // Blocks are kept between parses; a block too small for the frame is replaced\n";
+    ss << "        void nextBlock(size_t size) {\n";
+    ss << "            if (!blocks_.empty()) {\n";
+    ss << "                blocks_[current_].used = top_;\n";
+    ss << "                ++current_;\n";
     ss << "            }\n";
+    ss << "            if (current_ == blocks_.size() || blocks_[current_].size < size) {\n";
+    ss << "                size_t capacity = std::max(size, blocks_.empty() ? size_t(64 * 1024) : blocks_.back().size * 2);\n";
+    ss << "                blocks_.resize(current_);\n";
+    ss << "                blocks_.push_back(Block{std::unique_ptr<char[]>(new char[capacity]), capacity, 0});\n";
+    ss << "            }\n";
+    ss << "            top_ = 0;\n";
     ss << "        }\n";
-    ss << "        if (cp < " << node->start << "U || cp > " << node->end << "U) {\n";
-    ss << "            " << on_failure_action << "\n";
+    ss << "\n";
+    ss << "        std::vector<Block> blocks_;\n";
+    ss << "        size_t current_ = 0;\n";
+    ss << "        size_t top_ = 0;\n";
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    FrameStack frames_;\n";
+    ss << "    std::coroutine_handle<> next_frame_; // Frame the driver loop resumes next\n";
+    ss << "    size_t max_depth_ = SIZE_MAX;\n";
+    ss << "\n";
+    ss << "    // Result of a rule coroutine: co_await from another rule, run() elsewhere\n";
+    ss << "    class RuleTask {\n";
+    ss << "    public:\n";
+    ss << "        struct promise_type {\n";
+    ss << "            " << parser << "* parser;\n";
+    ss << "            std::coroutine_handle<> caller; // Suspended until this rule returns\n";
+    ss << "            NodePtr value{};\n";
+    ss << "            std::exception_ptr error;\n";
+    ss << "\n";
+    ss << "            // Rules are members: the parser is the coroutine's first argument\n";
+    ss << "            explicit promise_type(" << parser << "& owner) : parser(&owner) {}\n";
+    ss << "\n";
+    ss << "            static void* operator new(size_t size, " << parser << "& owner) {\n";
+    ss << "                return owner.frames_.allocate(size);\n";
+    ss << "            }\n";
+    ss << "            static void operator delete(void* frame, size_t size) {\n";
+    ss << "                FrameStack::release(frame, size);\n";
+    ss << "            }\n";
+    ss << "\n";
+    ss << "            RuleTask get_return_object() {\n";
+    ss << "                return RuleTask(std::coroutine_handle<promise_type>::from_promise(*this));\n";
+    ss << "            }\n";
+    ss << "            std::suspend_always initial_suspend() noexcept { return {}; }\n";
+    ss << "\n";
+    ss << "            // A finished rule hands the driver loop back to its caller\n";
+    ss << "            struct ReturnToCaller {\n";
+    ss << "                bool await_ready() noexcept { return false; }\n";
+    ss << "                void await_suspend(std::coroutine_handle<promise_type> self) noexcept {\n";
+    ss << "                    self.promise().parser->next_frame_ = self.promise().caller;\n";
+    ss << "                }\n";
+    ss << "                void await_resume() noexcept {}\n";
+    ss << "            };\n";
+    ss << "            ReturnToCaller final_suspend() noexcept { return {}; }\n";
+    ss << "\n";
+    ss << "            void return_value(NodePtr result) { value = std::move(result); }\n";
+    ss << "            void unhandled_exception() { error = std::current_exception(); }\n";
+    ss << "        };\n";
+    ss << "\n";
+    ss << "        explicit RuleTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}\n";
+    ss << "        RuleTask(RuleTask&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}\n";
+    ss << "        RuleTask(const RuleTask&) = delete;\n";
+    ss << "        RuleTask& operator=(const RuleTask&) = delete;\n";
+    ss << "        ~RuleTask() {\n";
+    ss << "            if (handle_) handle_.destroy();\n";
     ss << "        }\n";
-    ss << "        // Advance by character length\n";
-    ss << "        for (size_t i = 0; i < char_len; ++i) {\n";
-    ss << "            advance();\n";
+    ss << "\n";
+    ss << "        // Symmetric transfer would keep native frames at -O0; the driver\n";
+    ss << "        // loop resumes the callee instead\n";
+    ss << "        bool await_ready() const noexcept { return false; }\n";
+    ss << "        void await_suspend(std::coroutine_handle<> caller) noexcept {\n";
+    ss << "            handle_.promise().caller = caller;\n";
+    ss << "            handle_.promise().parser->next_frame_ = handle_;\n";
+    ss << "        }\n";
+    ss << "        NodePtr await_resume() {\n";
+    ss << "            promise_type& promise = handle_.promise();\n";
+    ss << "            if (promise.error) {\n";
+    ss << "                std::rethrow_exception(promise.error);\n";
+    ss << "            }\n";
+    ss << "            return std::move(promise.value);\n";
+    ss << "        }\n";
+    ss << "\n";
+    ss << "        // Run the rule to completion from ordinary code\n";
+    ss << "        NodePtr run() {\n";
+    ss << "            " << parser << "& owner = *handle_.promise().parser;\n";
+    ss << "            owner.next_frame_ = handle_;\n";
+    ss << "            while (std::coroutine_handle<> frame = std::exchange(owner.next_frame_, nullptr)) {\n";
+    ss << "                frame.resume();\n";
+    ss << "            }\n";
+    ss << "            return await_resume();\n";
     ss << "        }\n";
+    ss << "\n";
+    ss << "    private:\n";
+    ss << "        std::coroutine_handle<promise_type> handle_;\n";
+    ss << "    };\n";
     return ss.str();
 }
 
+// Разбиение на единицы трансляции
 
-std::string CppCodeGenerator::visitAlternative(const Alternative* node, const std::string& on_failure_action) {
-    std::ostringstream ss;
-    std::string label_base = std::to_string(variable_counter_++);
+void CppCodeGenerator::planSplit() {
+    split_units_ = options_.split_units;
+    rule_unit_.clear();
+    rule_functions_.clear();
+    rule_declarations_.clear();
+    if (split_units_ == 0) {
+        return;
+    }
+    rule_functions_.resize(ir_->rules().size());
     
-    ss << "        // Try alternatives\n";
-    ss << "        {\n";
-    ss << "            bool alt_matched_" << label_base << " = false;\n";
+    // Взаимно рекурсивные правила - в одном файле. Файл компоненты - хеш FNV-1a
+    // имени её первого правила: он не зависит от размеров и порядка остальных
+    // компонент, и правка одного правила меняет только его файл
+    std::vector<uint32_t> component = ir_->ruleComponents();
+    std::vector<size_t> component_unit(component.size(), SIZE_MAX);
+    rule_unit_.resize(component.size());
+    for (SymbolId name = 0; name < component.size(); ++name) {
+        size_t& unit = component_unit[component[name]];
+        if (unit == SIZE_MAX) {
+            uint64_t hash = 14695981039346656037ull;
+            for (unsigned char c : ir_->symbols().name(name)) {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+            unit = static_cast<size_t>(hash % split_units_);
+        }
+        rule_unit_[name] = unit;
+    }
+}
+
+std::string CppCodeGenerator::ruleSignature(const std::string& return_type, const std::string& declarator) const {
+    if (split_units_ == 0) {
+        return "    " + return_type + " " + declarator + " {\n";
+    }
+    // Определение вне класса: вложенный тип возврата квалифицируется именем парсера
+    rule_declarations_ += "    " + return_type + " " + declarator + ";\n";
+    std::string type = return_type == "RuleTask" ? options_.parser_name + "::RuleTask" : return_type;
+    return "    " + type + " " + options_.parser_name + "::" + declarator + " {\n";
+}
+
+std::string CppCodeGenerator::headerFilename() const {
+    return camelToSnake(options_.parser_name) + ".hpp";
+}
+
+std::string CppCodeGenerator::generateRuleUnit(size_t unit) const {
+    std::ostringstream prologue;
+    prologue << "// Generated by BNF Parser Generator\n";
+    prologue << "// Parser: " << options_.parser_name << "\n";
+    prologue << "// Rule functions, file " << unit + 1 << " of " << split_units_ << "\n";
+    prologue << "\n";
+    prologue << "#include \"" << headerFilename() << "\"\n";
+    prologue << "\n";
+    if (!options_.namespace_name.empty()) {
+        prologue << "namespace " << options_.namespace_name << " {\n\n";
+    }
+    std::string epilogue = options_.namespace_name.empty() ? "" : "} // namespace " + options_.namespace_name + "\n";
     
-    for (size_t i = 0; i < node->choices.size(); ++i) {
-        ss << "            if (!alt_matched_" << label_base << ") {\n";
-        ss << "                size_t alt_pos = pos_;\n";
-        ss << "                size_t alt_line = line_;\n";
-        ss << "                size_t alt_column = column_;\n";
-        
-        ss << "                do { // Alternative " << (i + 1) << "\n";
-        
-        std::string alt_label = "alt_failed_" + label_base + "_" + std::to_string(i);
-        std::string on_alt_failure =
-            "pos_ = alt_pos; line_ = alt_line; column_ = alt_column; goto " + alt_label + ";";
-        
-        ss << "                " << visitNode(node->choices[i].get(), on_alt_failure) << "\n";
-        ss << "                alt_matched_" << label_base << " = true;\n";
-        ss << "                } while(false);\n";
-        ss << "            }\n";
-        ss << "            " << "alt_failed_" << label_base << "_" << i << ":; // Label for this alternative\n";
+    // Файл собирается в буфер, размер которого известен заранее
+    size_t size = prologue.str().size() + epilogue.size();
+    for (RuleId rule = 0; rule < rule_functions_.size(); ++rule) {
+        if (rule_unit_[ir_->rule(rule).name] == unit) {
+            size += rule_functions_[rule].size() + 1;
+        }
+    }
+    std::string code;
+    code.reserve(size);
+    code += prologue.str();
+    for (RuleId rule = 0; rule < rule_functions_.size(); ++rule) {
+        const std::string& function = rule_functions_[rule];
+        if (function.empty() || rule_unit_[ir_->rule(rule).name] != unit) {
+            continue;
+        }
+        // Функции сгенерированы с отступом тела класса: вне класса он снимается
+        for (size_t start = 0; start < function.size();) {
+            size_t end = function.find('\n', start);
+            end = end == std::string::npos ? function.size() : end + 1;
+            if (function.compare(start, 4, "    ") == 0) {
+                start += 4;
+            }
+            code.append(function, start, end - start);
+            start = end;
+        }
+        code += "\n";
+    }
+    code += epilogue;
+    return code;
+}
+
+// Лексер на ДКА
+
+void CppCodeGenerator::planLexer(const Grammar& grammar, GeneratedCode& result) {
+    lexer_mode_ = false;
+    token_kinds_.clear();
+    token_kind_.clear();
+    if (!options_.dfa_lexer) {
+        return;
     }
     
-    ss << "            if (!alt_matched_" << label_base << ") {\n";
-    ss << "                " << on_failure_action << "\n";
-    ss << "            }\n";
-    ss << "        }\n";
+    auto disable = [&](const std::string& reason) {
+        token_kinds_.clear();
+        token_kind_.clear();
+        result.warnings.push_back("DFA lexer disabled: " + reason);
+    };
+    if (trivia_rule_.empty()) {
+        disable("the grammar has no whitespace rule (WHITESPACE, TRIVIA or --whitespace-rule)");
+        return;
+    }
+    if (hasParameterizedRules(grammar) || hasContextActions(grammar)) {
+        disable("parameterized rules and context actions need the character-level parser");
+        return;
+    }
+    
+    // Токены: правило пробелов, правила-токены и терминалы синтаксических правил.
+    // Терминал с тем же текстом, что и правило из одного терминала, - тот же вид
+    std::vector<LexerToken> tokens;
+    std::unordered_map<std::string, size_t> literal_rules;
+    auto addKind = [&](const std::string& key, const std::string& enumerator,
+                       const std::string& description, const ASTNode* pattern) {
+        token_kind_[key] = token_kinds_.size();
+        token_kinds_.push_back({enumerator, description});
+        tokens.push_back({description, pattern});
+    };
+    auto addRule = [&](const std::string& name) {
+        const ProductionRule* rule = grammar.findRule(name);
+        if (!rule || token_kind_.count(name)) return;
+        addKind(name, "TOKEN_" + makeIdentifier(name), name, rule->rightSide.get());
+        const ASTNode* body = rule->rightSide.get();
+        while (const auto* group = node_cast<Group>(body)) {
+            body = group->content.get();
+        }
+        if (const auto* t = node_cast<Terminal>(body)) {
+            literal_rules.emplace(t->value, token_kind_[name]);
+        }
+    };
+    
+    std::vector<const ASTNode*> leaves;
+    for (const auto& rule : grammar.rules) {
+        if (!lexical_rules_.count(rule->leftSide)) {
+            collectLeaves(rule->rightSide.get(), leaves);
+        }
+    }
+    addRule(trivia_rule_);
+    for (const ASTNode* leaf : leaves) {
+        const auto* nt = node_cast<NonTerminal>(leaf);
+        if (nt && lexical_rules_.count(nt->name)) {
+            addRule(nt->name);
+        }
+    }
+    size_t literal_count = 0;
+    size_t range_count = 0;
+    for (const ASTNode* leaf : leaves) {
+        if (const auto* t = node_cast<Terminal>(leaf)) {
+            std::string key = "literal:" + t->value;
+            if (t->value.empty() || token_kind_.count(key)) continue;
+            auto alias = literal_rules.find(t->value);
+            if (alias != literal_rules.end()) {
+                token_kind_[key] = alias->second;
+            } else {
+                addKind(key, "TOKEN_LITERAL_" + std::to_string(literal_count++),
+                        "\"" + escapeString(t->value) + "\"", t);
+            }
+        } else if (const auto* range = node_cast<CharRange>(leaf)) {
+            std::string key = rangeKey(range);
+            if (token_kind_.count(key)) continue;
+            std::ostringstream description;
+            description << "U+" << std::hex << std::uppercase << range->start << "..U+" << range->end;
+            addKind(key, "TOKEN_RANGE_" + std::to_string(range_count++), description.str(), range);
+        }
+    }
     
+    try {
+        lexer_ = LexerAutomaton::build(grammar, tokens);
+    } catch (const std::exception& e) {
+        disable(e.what());
+        return;
+    }
+    lexer_mode_ = true;
+    result.messages.push_back("DFA lexer: " + std::to_string(token_kinds_.size()) + " token kinds, " +
+                              std::to_string(lexer_.stateCount()) + " states, " +
+                              std::to_string(lexer_.classCount()) + " byte classes");
+}
+
+std::string CppCodeGenerator::rangeKey(const CharRange* node) const {
+    return "range:" + std::to_string(node->start) + ".." + std::to_string(node->end);
+}
+
+std::string CppCodeGenerator::tokenKind(const std::string& key) const {
+    auto it = token_kind_.find(key);
+    if (it == token_kind_.end()) {
+        throw std::runtime_error("No token kind for " + key);
+    }
+    return token_kinds_[it->second].enumerator;
+}
+
+bool CppCodeGenerator::tracksLineColumn() const {
+    // При разборе по токенам строку и столбец хранит каждый токен
+    return !options_.lazy_positions && !lexer_mode_;
+}
+
+std::string CppCodeGenerator::generateTokenTypes() const {
+    std::ostringstream ss;
+    ss << "    // Token kinds of the DFA lexer\n";
+    ss << "    enum TokenKind : uint16_t {\n";
+    ss << "        TOKEN_END,   // End of input\n";
+    ss << "        TOKEN_ERROR, // No token matches here; tokenize() stops\n";
+    for (const auto& kind : token_kinds_) {
+        ss << "        " << kind.enumerator << ", // " << kind.description << "\n";
+    }
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    struct Token {\n";
+    ss << "        size_t offset; // Byte offset in the input\n";
+    ss << "        uint32_t length; // In bytes; a longer match is a TOKEN_ERROR\n";
+    ss << "        TokenKind kind;\n";
+    if (!options_.lazy_positions) {
+        ss << "        size_t line;\n";
+        ss << "        size_t column;\n";
+    }
+    ss << "    };\n";
     return ss.str();
 }
 
-std::string CppCodeGenerator::visitSequence(const Sequence* node, const std::string& on_failure_action) {
+std::string CppCodeGenerator::generateTokenizer() const {
+    const size_t states = lexer_.stateCount();
+    const size_t classes = lexer_.classCount();
+    std::string state_type = states <= 256 ? "uint8_t" : "uint16_t";
+    std::string kind_type = token_kinds_.size() + 2 <= 256 ? "uint8_t" : "uint16_t";
+    
     std::ostringstream ss;
-    ss << "        // Parse sequence\n";
-    ss << "        do { // Sequence block\n";
-    bool first = true;
-    for (const auto& element : node->elements) {
-        if (first) {
-            ss << visitNode(element.get(), on_failure_action);
-            first = false;
-        } else {
-            // Для последующих элементов выход из блока - это провал всей последовательности
-            ss << visitNode(element.get(), "break;");
+    ss << "    // Split the whole input into tokens (longest match); the last token is\n";
+    ss << "    // TOKEN_END, or TOKEN_ERROR where no token matches\n";
+    ss << "    const std::vector<Token>& tokenize() {\n";
+    ss << "        // Minimized DFA: " << states << " states x " << classes
+       << " byte classes; state 0 rejects, state 1 starts a token\n";
+    ss << "        static constexpr uint8_t byte_class[256] = {";
+    for (size_t b = 0; b < 256; ++b) {
+        if (b % 32 == 0) ss << "\n            ";
+        ss << static_cast<unsigned>(lexer_.byteClasses()[b]) << (b + 1 < 256 ? "," : "");
+    }
+    ss << "\n        };\n";
+    ss << "        static constexpr " << state_type << " next_state[" << states << "][" << classes << "] = {\n";
+    for (uint32_t state = 0; state < states; ++state) {
+        ss << "            {";
+        for (size_t c = 0; c < classes; ++c) {
+            ss << lexer_.next(state, c) << (c + 1 < classes ? "," : "");
         }
+        ss << "}" << (state + 1 < states ? "," : "") << "\n";
+    }
+    ss << "        };\n";
+    ss << "        // Token kind accepted in each state, TOKEN_END (0) if none\n";
+    ss << "        static constexpr " << kind_type << " accepts[" << states << "] = {";
+    for (uint32_t state = 0; state < states; ++state) {
+        if (state % 32 == 0) ss << "\n            ";
+        int token = lexer_.accepts(state);
+        ss << (token == LexerAutomaton::NO_TOKEN ? 0 : token + 2) << (state + 1 < states ? "," : "");
+    }
+    ss << "\n        };\n";
+    ss << "\n";
+    ss << "        tokens_.clear();\n";
+    ss << "        tokens_.reserve(input_.size() / 8 + 1); // Growing a large token vector costs more than lexing\n";
+    ss << "        const unsigned char* data = reinterpret_cast<const unsigned char*>(input_.data());\n";
+    ss << "        const size_t size = input_.size();\n";
+    ss << "        size_t p = 0;\n";
+    if (!options_.lazy_positions) {
+        ss << "        size_t line = 1;\n";
+        ss << "        size_t column = 1;\n";
+    }
+    ss << "        while (p < size) {\n";
+    ss << "            unsigned state = 1;\n";
+    ss << "            unsigned kind = TOKEN_ERROR;\n";
+    ss << "            size_t end = p;\n";
+    ss << "            for (size_t q = p; q < size;) {\n";
+    ss << "                state = next_state[state][byte_class[data[q]]];\n";
+    ss << "                if (state == 0) break;\n";
+    ss << "                ++q;\n";
+    ss << "                if (accepts[state] != 0) {\n";
+    ss << "                    kind = accepts[state];\n";
+    ss << "                    end = q;\n";
+    ss << "                }\n";
+    ss << "            }\n";
+    ss << "            if (end - p > UINT32_MAX) {\n";
+    ss << "                kind = TOKEN_ERROR;\n";
+    ss << "                end = p;\n";
+    ss << "            }\n";
+    std::string position = options_.lazy_positions ? "" : ", line, column";
+    ss << "            tokens_.push_back(Token{p, static_cast<uint32_t>(end - p), static_cast<TokenKind>(kind)" << position << "});\n";
+    ss << "            if (kind == TOKEN_ERROR) {\n";
+    ss << "                return tokens_;\n";
+    ss << "            }\n";
+    if (!options_.lazy_positions) {
+        ss << "            const char* text = input_.data() + p;\n";
+        ss << "            const char* stop = input_.data() + end;\n";
+        ss << "            while (const void* nl = std::memchr(text, '\\n', static_cast<size_t>(stop - text))) {\n";
+        ss << "                ++line;\n";
+        ss << "                column = 1;\n";
+        ss << "                text = static_cast<const char*>(nl) + 1;\n";
+        ss << "            }\n";
+        ss << "            column += static_cast<size_t>(stop - text);\n";
     }
-    ss << "        } while(false); // End of sequence block\n";
+    ss << "            p = end;\n";
+    ss << "        }\n";
+    ss << "        tokens_.push_back(Token{size, 0, TOKEN_END" << position << "});\n";
+    ss << "        return tokens_;\n";
+    ss << "    }\n";
+    ss << "\n";
     return ss.str();
 }
 
-std::string CppCodeGenerator::visitGroup(const Group* node, const std::string& on_failure_action) {
-    return visitNode(node->content.get(), on_failure_action);
+std::string CppCodeGenerator::generateTokenHelpers() const {
+    std::string trivia = tokenKind(trivia_rule_);
+    std::ostringstream ss;
+    ss << "    // Whitespace between tokens: tokens of rule " << trivia_rule_ << "\n";
+    ss << "    void skipWhitespace() {\n";
+    ss << "        while (tokens_[pos_].kind == " << trivia << ") {\n";
+    ss << "            ++pos_;\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    bool matchToken(TokenKind kind) {\n";
+    ss << "        if (tokens_[pos_].kind != kind) {\n";
+    ss << "            return false;\n";
+    ss << "        }\n";
+    ss << "        ++pos_;\n";
+    ss << "        return true;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // First byte of the next token for FIRST-set dispatch, 256 at end of input\n";
+    ss << "    size_t lookahead() const {\n";
+    ss << "        const Token& token = tokens_[pos_];\n";
+    ss << "        return token.length > 0 ? static_cast<unsigned char>(input_[token.offset]) : 256;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // First byte of the next token after whitespace tokens\n";
+    ss << "    size_t lookaheadPastWhitespace() const {\n";
+    ss << "        size_t i = pos_;\n";
+    ss << "        while (tokens_[i].kind == " << trivia << ") {\n";
+    ss << "            ++i;\n";
+    ss << "        }\n";
+    ss << "        const Token& token = tokens_[i];\n";
+    ss << "        return token.length > 0 ? static_cast<unsigned char>(input_[token.offset]) : 256;\n";
+    ss << "    }\n";
+    return ss.str();
 }
 
-std::string CppCodeGenerator::visitOptional(const Optional* node, [[maybe_unused]] const std::string& on_failure_action) {
+std::string CppCodeGenerator::generateTokenRuleFunction(const ProductionRule& rule) {
+    auto kind = token_kind_.find(rule.leftSide);
+    if (kind == token_kind_.end()) {
+        return "";
+    }
     std::ostringstream ss;
-    ss << "        // Optional\n";
-    ss << "        do {\n";
-    ss << "            size_t opt_pos = pos_;\n";
-    ss << "            size_t opt_line = line_;\n";
-    ss << "            size_t opt_column = column_;\n";
-    ss << "            size_t opt_children_size = node->children.size();\n";
+    ss << "    // Token rule: " << rule.leftSide << " (matched by the lexer)\n";
+    ss << ruleSignature("NodePtr", ruleEntryName(rule.leftSide) + "()");
+    ss << "        const Token& token = tokens_[pos_];\n";
+    ss << "        if (token.kind != " << token_kinds_[kind->second].enumerator << ") {\n";
+    ss << "            return nullptr;\n";
+    ss << "        }\n";
+    if (!buildsTree()) {
+        ss << "        ++pos_;\n";
+        ss << "        return NodePtr(true);\n";
+        ss << "    }\n";
+        return ss.str();
+    }
+    ss << "        auto node = " << generateNodeAllocation(rule.leftSide) << ";\n";
+    if (options_.track_positions) {
+        ss << generateTokenPosition("token");
+    }
+    ss << "        node->value = input_.substr(token.offset, token.length);\n";
+    ss << "        ++pos_;\n";
+    ss << "        return node;\n";
+    ss << "    }\n";
+    return ss.str();
+}
+
+std::string CppCodeGenerator::generateTokenPosition(const std::string& token) const {
+    if (options_.lazy_positions) {
+        return "        node->offset = " + token + ".offset;\n";
+    }
+    return "        node->line = " + token + ".line;\n"
+           "        node->column = " + token + ".column;\n";
+}
+
+// Пропуск пробелов между токенами
+
+void CppCodeGenerator::collectTrivia(const Grammar& grammar) {
+    trivia_rule_.clear();
+    lexical_rules_.clear();
+    skip_class_.reset();
+    skip_is_class_ = true;
+    in_lexical_rule_ = false;
     
-    std::string on_opt_failure = 
-        "pos_ = opt_pos; line_ = opt_line; column_ = opt_column; "
-        "while (node->children.size() > opt_children_size) { node->children.pop_back(); } "
-        "break;"; // break from do-while
+    std::string name = findWhitespaceRule(grammar, options_.whitespace_rule);
+    const ProductionRule* trivia = name.empty() ? nullptr : grammar.findRule(name);
+    if (!trivia) {
+        if (!name.empty()) {
+            throw std::runtime_error("Whitespace rule not found: " + name);
+        }
+        // Прежний режим: matchString пропускает std::isspace перед каждым терминалом
+        for (unsigned char c : std::string(" \t\n\v\f\r")) {
+            skip_class_.set(c);
+        }
+        return;
+    }
+    trivia_rule_ = name;
+    lexical_rules_ = findLexicalRules(grammar, trivia_rule_, options_.token_rules);
+    
+    // Правило вида (' ' | '\t' | ...)+ сводится к классу байтов и пропускается
+    // циклом; иначе (например, с комментариями) вызывается само правило
+    LookaheadSet bytes;
+    if (collectByteClass(trivia->rightSide.get(), grammar, bytes, 0) && bytes.any()) {
+        skip_class_ = bytes;
+    } else {
+        skip_is_class_ = false;
+        skip_class_ = analysis_.first(trivia->rightSide.get());
+    }
+}
+
+bool CppCodeGenerator::collectByteClass(const ASTNode* node, const Grammar& grammar,
+                                        LookaheadSet& bytes, size_t depth) const {
+    if (depth > 16) {
+        return false;
+    }
+    if (const auto* t = node_cast<Terminal>(node)) {
+        if (t->value.size() != 1) return false;
+        bytes.set(static_cast<unsigned char>(t->value[0]));
+        return true;
+    }
+    if (const auto* range = node_cast<CharRange>(node)) {
+        if (range->end >= 0x80 || range->start > range->end) return false;
+        for (uint32_t c = range->start; c <= range->end; ++c) {
+            bytes.set(c);
+        }
+        return true;
+    }
+    if (const auto* alt = node_cast<Alternative>(node)) {
+        for (const auto& choice : alt->choices) {
+            if (!collectByteClass(choice.get(), grammar, bytes, depth + 1)) return false;
+        }
+        return true;
+    }
+    if (const auto* nt = node_cast<NonTerminal>(node)) {
+        const ProductionRule* rule = grammar.findRule(nt->name);
+        return rule && !rule->hasParameters() &&
+               collectByteClass(rule->rightSide.get(), grammar, bytes, depth + 1);
+    }
+    // Пропуск повторяется, пока находит пробел, поэтому X, X?, X* и X+ эквивалентны
+    if (const auto* group = node_cast<Group>(node)) {
+        return collectByteClass(group->content.get(), grammar, bytes, depth + 1);
+    }
+    if (const auto* opt = node_cast<Optional>(node)) {
+        return collectByteClass(opt->content.get(), grammar, bytes, depth + 1);
+    }
+    if (const auto* zeroMore = node_cast<ZeroOrMore>(node)) {
+        return collectByteClass(zeroMore->content.get(), grammar, bytes, depth + 1);
+    }
+    if (const auto* oneMore = node_cast<OneOrMore>(node)) {
+        return collectByteClass(oneMore->content.get(), grammar, bytes, depth + 1);
+    }
+    return false;
+}
 
-    ss << "            " << visitNode(node->content.get(), on_opt_failure) << "\n";
-    ss << "        } while(false);\n";
-    
-    return ss.str();
+bool CppCodeGenerator::skipsBeforeToken() const {
+    return !trivia_rule_.empty() && !in_lexical_rule_;
 }
 
-std::string CppCodeGenerator::visitZeroOrMore(const ZeroOrMore* node, [[maybe_unused]] const std::string& on_failure_action) {
-    std::ostringstream ss;
-    ss << "        // Zero or more repetitions\n";
-    ss << "        while (true) {\n";
-    ss << "            size_t rep_pos = pos_;\n";
-    ss << "            size_t rep_line = line_;\n";
-    ss << "            size_t rep_column = column_;\n";
-    ss << "            size_t rep_children_size = node->children.size();\n";
-    
-    std::string on_rep_failure = 
-        "pos_ = rep_pos; line_ = rep_line; column_ = rep_column; "
-        "while (node->children.size() > rep_children_size) { node->children.pop_back(); } "
-        "break;";
-        
-    ss << visitNode(node->content.get(), on_rep_failure);
-    
-    ss << "        }\n";
-    
-    return ss.str();
+bool CppCodeGenerator::skipUsesSimd() const {
+    // Сравнение с каждым байтом класса: выгодно для небольших классов
+    return !lexer_mode_ && skip_is_class_ && skip_class_.count() <= 8;
 }
 
-std::string CppCodeGenerator::visitOneOrMore(const OneOrMore* node, const std::string& on_failure_action) {
+std::string CppCodeGenerator::generateSkipWhitespace() {
     std::ostringstream ss;
-    ss << "        // One or more repetitions\n";
-    ss << "        {\n";
-    ss << "            int match_count = 0;\n";
-    ss << "            while (true) {\n";
-    ss << "                size_t rep_pos = pos_;\n";
-    ss << "                size_t rep_line = line_;\n";
-    ss << "                size_t rep_column = column_;\n";
-    ss << "                size_t rep_children_size = node->children.size();\n";
-    
-    std::string on_rep_failure = 
-        "pos_ = rep_pos; line_ = rep_line; column_ = rep_column; "
-        "while (node->children.size() > rep_children_size) { node->children.pop_back(); } "
-        "break;";
-        
-    ss << visitNode(node->content.get(), on_rep_failure);
-
-    ss << "                match_count++;\n";
-    ss << "            }\n";
-    ss << "            if (match_count == 0) {\n";
-    ss << "                " << on_failure_action << "\n";
-    ss << "            }\n";
-    ss << "        }\n";
     
+    if (!skip_is_class_) {
+        std::string id = makeIdentifier(trivia_rule_);
+        ss << "    // Skip whitespace between tokens: repeat rule " << trivia_rule_ << " while it consumes input\n";
+        ss << "    void skipWhitespace() {\n";
+        ss << "        while (pos_ < input_.size()) {\n";
+        ss << "            size_t before = pos_;\n";
+        if (arenaRewindEnabled()) {
+            ss << "            auto mark = arena_.mark();\n";
+        }
+        ss << "            bool matched = " << ruleCall(trivia_rule_, "parse_" + id, false) << " != nullptr;\n";
+        if (arenaRewindEnabled()) {
+            ss << "            arena_.rewind(mark); // Trivia nodes are discarded\n";
+        }
+        ss << "            if (!matched || pos_ == before) break;\n";
+        ss << "        }\n";
+        if (options_.streaming) {
+            ss << "        if (pos_ == input_.size()) {\n";
+            ss << "            hit_end_ = true;\n";
+            ss << "        }\n";
+        }
+        ss << "    }\n";
+        ss << "\n";
+        return ss.str();
+    }
+    
+    std::vector<unsigned char> members;
+    for (size_t b = 0; b < 256; ++b) {
+        if (skip_class_.test(b)) members.push_back(static_cast<unsigned char>(b));
+    }
+    auto charLiteral = [](unsigned char c) {
+        std::ostringstream lit;
+        switch (c) {
+            case '\t': return std::string("'\\t'");
+            case '\n': return std::string("'\\n'");
+            case '\r': return std::string("'\\r'");
+            case '\v': return std::string("'\\v'");
+            case '\f': return std::string("'\\f'");
+            case '\'': return std::string("'\\''");
+            case '\\': return std::string("'\\\\'");
+            default: break;
+        }
+        if (c >= 0x20 && c < 0x7F) {
+            lit << "'" << static_cast<char>(c) << "'";
+        } else {
+            lit << "'\\x" << std::hex << static_cast<unsigned>(c) << "'";
+        }
+        return lit.str();
+    };
+    
+    ss << "    // Whitespace between tokens: "
+       << (trivia_rule_.empty() ? std::string("std::isspace") : "rule " + trivia_rule_) << "\n";
+    ss << "    static bool isSkippedByte(unsigned char c) {\n";
+    if (members.size() <= 8) {
+        ss << "        return ";
+        for (size_t i = 0; i < members.size(); ++i) {
+            if (i > 0) ss << " || ";
+            ss << "c == " << charLiteral(members[i]);
+        }
+        ss << ";\n";
+    } else {
+        ss << "        static constexpr bool table[256] = {";
+        for (size_t b = 0; b < 256; ++b) {
+            if (b % 32 == 0) ss << "\n            ";
+            ss << (skip_class_.test(b) ? "1" : "0") << (b + 1 < 256 ? "," : "");
+        }
+        ss << "\n        };\n";
+        ss << "        return table[c];\n";
+    }
+    ss << "    }\n";
+    ss << "\n";
+    
+    ss << "    void skipWhitespace() {\n";
+    ss << "        const char* data = input_.data();\n";
+    ss << "        const size_t size = input_.size();\n";
+    ss << "        size_t p = pos_;\n";
+    if (options_.incremental) {
+        ss << "        noteExamined(p + 1);\n";
+    }
+    if (options_.streaming) {
+        ss << "        if (p >= size) {\n";
+        ss << "            hit_end_ = true;\n";
+        ss << "            return;\n";
+        ss << "        }\n";
+    }
+    ss << "        if (p >= size || !isSkippedByte(static_cast<unsigned char>(data[p]))) {\n";
+    ss << "            return; // Common case between compact tokens\n";
+    ss << "        }\n";
+    if (skipUsesSimd()) {
+        ss << "#if defined(__SSE2__)\n";
+        ss << "        // 16 bytes per step: stop at the first byte outside the whitespace class\n";
+        ss << "        while (p + 16 <= size) {\n";
+        ss << "            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + p));\n";
+        for (size_t i = 0; i < members.size(); ++i) {
+            ss << "            " << (i == 0 ? "__m128i hit = " : "hit = _mm_or_si128(hit, ")
+               << "_mm_cmpeq_epi8(chunk, _mm_set1_epi8(" << charLiteral(members[i]) << "))"
+               << (i == 0 ? ";" : ");") << "\n";
+        }
+        ss << "            unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(hit)) & 0xFFFFu;\n";
+        ss << "            if (other != 0) {\n";
+        ss << "                p += static_cast<size_t>(__builtin_ctz(other));\n";
+        ss << "                break;\n";
+        ss << "            }\n";
+        ss << "            p += 16;\n";
+        ss << "        }\n";
+        ss << "#endif\n";
+    }
+    ss << "        while (p < size && isSkippedByte(static_cast<unsigned char>(data[p]))) {\n";
+    ss << "            ++p;\n";
+    ss << "        }\n";
+    if (options_.incremental) {
+        ss << "        noteExamined(p + 1);\n";
+    }
+    if (options_.streaming) {
+        ss << "        if (p == size) {\n";
+        ss << "            hit_end_ = true;\n";
+        ss << "        }\n";
+    }
+    ss << "        advanceTo(p);\n";
+    ss << "    }\n";
+    ss << "\n";
     return ss.str();
 }
 
@@ -484,41 +4667,135 @@ std::string CppCodeGenerator::generateHelperMethods() {
     std::ostringstream ss;
     
     ss << "    // Helper methods\n";
-    ss << "    void skipWhitespace() {\n";
-    ss << "        // This is a basic whitespace skipper. A real implementation would\n";
-    ss << "        // use the WHITESPACE rule from the grammar if it exists.\n";
-    ss << "        while (pos_ < input_.size() && std::isspace(input_[pos_])) {\n";
-    ss << "            if (input_[pos_] == '\\n') {\n";
-    ss << "                ++line_;\n";
-    ss << "                column_ = 1;\n";
-    ss << "            } else {\n";
-    ss << "                ++column_;\n";
-    ss << "            }\n";
-    ss << "            ++pos_;\n";
-    ss << "        }\n";
-    ss << "    }\n";
+    if (lexer_mode_) {
+        ss << generateTokenHelpers();
+        return ss.str();
+    }
+    ss << generateSkipWhitespace();
     ss << "\n";
     ss << "    void advance() {\n";
     ss << "        if (pos_ < input_.size()) {\n";
-    ss << "            if (input_[pos_] == '\\n') {\n";
-    ss << "                ++line_;\n";
-    ss << "                column_ = 1;\n";
-    ss << "            } else {\n";
-    ss << "                ++column_;\n";
-    ss << "            }\n";
+    if (!options_.lazy_positions) {
+        ss << "            if (input_[pos_] == '\\n') {\n";
+        ss << "                ++line_;\n";
+        ss << "                column_ = 1;\n";
+        ss << "            } else {\n";
+        ss << "                ++column_;\n";
+        ss << "            }\n";
+    }
     ss << "            ++pos_;\n";
     ss << "        }\n";
     ss << "    }\n";
     ss << "\n";
-    ss << "    bool matchString(const std::string& str) {\n";
-    ss << "        skipWhitespace();\n";
+    ss << "    // Jump forward to offset p over bytes already matched\n";
+    ss << "    void advanceTo(size_t p) {\n";
+    if (!options_.lazy_positions) {
+        ss << "        // Keep line/column in sync: only the newlines in the span matter\n";
+        ss << "        const char* q = input_.data() + pos_;\n";
+        ss << "        const char* stop = input_.data() + p;\n";
+        ss << "        while (const void* nl = std::memchr(q, '\\n', static_cast<size_t>(stop - q))) {\n";
+        ss << "            ++line_;\n";
+        ss << "            column_ = 1;\n";
+        ss << "            q = static_cast<const char*>(nl) + 1;\n";
+        ss << "        }\n";
+        ss << "        column_ += static_cast<size_t>(stop - q);\n";
+    }
+    ss << "        pos_ = p;\n";
+    ss << "    }\n";
+    ss << "\n";
+    if (has_char_ranges_) {
+        ss << "    // Length of the UTF-8 character at p < input size; its codepoint goes to cp.\n";
+        ss << "    // A byte that cannot start a sequence is a character by itself. A sequence\n";
+        ss << "    // cut off by the end of input keeps its full length and leaves cp unset,\n";
+        ss << "    // so callers check p + length against the input size\n";
+        ss << "    size_t decodeUtf8(size_t p, uint32_t& cp) const {\n";
+        ss << "        const unsigned char* s = reinterpret_cast<const unsigned char*>(input_.data()) + p;\n";
+        ss << "        const unsigned char c = s[0];\n";
+        ss << "        if (c < 0x80 || c >= 0xF8 || (c & 0xC0) == 0x80) {\n";
+        ss << "            cp = c;\n";
+        ss << "            return 1;\n";
+        ss << "        }\n";
+        ss << "        const size_t len = c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : 2);\n";
+        ss << "        if (p + len > input_.size()) {\n";
+        ss << "            return len;\n";
+        ss << "        }\n";
+        ss << "        if (len == 2) {\n";
+        ss << "            cp = ((c & 0x1Fu) << 6) | (s[1] & 0x3Fu);\n";
+        ss << "        } else if (len == 3) {\n";
+        ss << "            cp = ((c & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);\n";
+        ss << "        } else {\n";
+        ss << "            cp = ((c & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) | ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);\n";
+        ss << "        }\n";
+        ss << "        return len;\n";
+        ss << "    }\n";
+        ss << "\n";
+    }
+    for (size_t i = 0; i < scan_classes_.size(); ++i) {
+        ss << generateClassScanner(i);
+    }
+    for (size_t i = 0; i < literal_tries_.size(); ++i) {
+        ss << generateLiteralMatcher(i);
+    }
+    ss << "    // Next byte for FIRST-set dispatch, 256 at end of input\n";
+    ss << "    size_t lookahead() const {\n";
+    if (options_.incremental) {
+        ss << "        noteExamined(pos_ + 1);\n";
+    }
+    if (options_.streaming) {
+        ss << "        if (pos_ < input_.size()) {\n";
+        ss << "            return static_cast<unsigned char>(input_[pos_]);\n";
+        ss << "        }\n";
+        ss << "        hit_end_ = true;\n";
+        ss << "        return 256;\n";
+    } else {
+        ss << "        return pos_ < input_.size() ? static_cast<unsigned char>(input_[pos_]) : 256;\n";
+    }
+    ss << "    }\n";
+    ss << "\n";
+    if (skip_is_class_) {
+        ss << "    // Next byte after the whitespace that skipWhitespace() would skip\n";
+        ss << "    size_t lookaheadPastWhitespace() const {\n";
+        ss << "        size_t p = pos_;\n";
+        ss << "        while (p < input_.size() && isSkippedByte(static_cast<unsigned char>(input_[p]))) {\n";
+        ss << "            ++p;\n";
+        ss << "        }\n";
+        if (options_.incremental) {
+            ss << "        noteExamined(p + 1);\n";
+        }
+        if (options_.streaming) {
+            ss << "        if (p < input_.size()) {\n";
+            ss << "            return static_cast<unsigned char>(input_[p]);\n";
+            ss << "        }\n";
+            ss << "        hit_end_ = true;\n";
+            ss << "        return 256;\n";
+        } else {
+            ss << "        return p < input_.size() ? static_cast<unsigned char>(input_[p]) : 256;\n";
+        }
+        ss << "    }\n";
+        ss << "\n";
+    }
+    ss << "    bool matchString(std::string_view str) {\n";
+    if (trivia_rule_.empty()) {
+        ss << "        skipWhitespace();\n";
+    }
+    if (options_.incremental) {
+        ss << "        noteExamined(pos_ + str.size());\n";
+    }
     ss << "        if (pos_ + str.size() > input_.size()) {\n";
+    if (options_.streaming) {
+        ss << "            hit_end_ = true;\n";
+    }
     ss << "            return false;\n";
     ss << "        }\n";
-    ss << "        if (input_.substr(pos_, str.size()) == str) {\n";
-    ss << "            for (size_t i = 0; i < str.size(); ++i) {\n";
-    ss << "                advance();\n";
-    ss << "            }\n";
+    ss << "        // Compare in place: no temporary string per terminal attempt\n";
+    ss << "        if (std::memcmp(input_.data() + pos_, str.data(), str.size()) == 0) {\n";
+    if (options_.lazy_positions) {
+        ss << "            pos_ += str.size();\n";
+    } else {
+        ss << "            for (size_t i = 0; i < str.size(); ++i) {\n";
+        ss << "                advance();\n";
+        ss << "            }\n";
+    }
     ss << "            return true;\n";
     ss << "        }\n";
     ss << "        return false;\n";
@@ -541,6 +4818,8 @@ std::string CppCodeGenerator::generateComment(const std::string& comment) const
 
 std::string CppCodeGenerator::generateMainCpp(const Grammar& /* grammar */) {
     std::ostringstream ss;
+    // Событийный парсер - шаблон: исполняемый файл только проверяет вход
+    std::string parser_type = options_.parser_name + (options_.event_callbacks ? "<>" : "");
     
     ss << "// Generated main.cpp for " << options_.parser_name << "\n";
     ss << "// This file provides a command-line interface for the parser\n\n";
@@ -549,29 +4828,63 @@ std::string CppCodeGenerator::generateMainCpp(const Grammar& /* grammar */) {
     ss << "#include <fstream>\n";
     ss << "#include <sstream>\n";
     ss << "#include <string>\n";
-    ss << "#include <cstring>\n\n";
+    ss << "#include <string_view>\n";
+    ss << "#include <cstring>\n";
+    ss << "#include <algorithm>\n";
+    ss << "#include <chrono>\n";
+    ss << "#include <deque>\n";
+    ss << "#include <filesystem>\n";
+    ss << "#include <iomanip>\n";
+    ss << "#include <mutex>\n";
+    ss << "#include <thread>\n";
+    ss << "#include <vector>\n";
+    ss << "#if defined(__unix__) || defined(__APPLE__)\n";
+    ss << "#include <fcntl.h>\n";
+    ss << "#include <sys/mman.h>\n";
+    ss << "#include <sys/stat.h>\n";
+    ss << "#include <unistd.h>\n";
+    ss << "#define BNF_PARSER_HAVE_MMAP 1\n";
+    ss << "#endif\n\n";
     
     ss << "// Include the generated parser\n";
-    ss << "#include \"" << camelToSnake(options_.parser_name) << ".cpp\"\n\n";
+    if (split_units_ > 0) {
+        // Функции правил компонуются из файлов правил
+        ss << "#include \"" << headerFilename() << "\"\n\n";
+    } else {
+        ss << "#include \"" << camelToSnake(options_.parser_name) << ".cpp\"\n\n";
+    }
     
     if (!options_.namespace_name.empty()) {
         ss << "using namespace " << options_.namespace_name << ";\n\n";
     }
     
     ss << "struct CommandLineOptions {\n";
-    ss << "    std::string input_file;\n";
+    ss << "    std::vector<std::string> inputs;  // Files or directories\n";
+    ss << "    std::string list_file;            // Newline-delimited input paths, \"-\" for stdin\n";
+    ss << "    unsigned jobs = 0;                // Batch worker threads, 0 for one per core\n";
+    ss << "    bool batch = false;\n";
     ss << "    bool show_ast = false;\n";
     ss << "    bool verbose = false;\n";
+    if (options_.profile) {
+        ss << "    bool profile_report = false;      // Print the per-rule profile after parsing\n";
+    }
     ss << "    bool help = false;\n";
     ss << "};\n\n";
     
     ss << "void printHelp(const char* program_name) {\n";
     ss << "    std::cout << \"" << options_.parser_name << " - Generated parser\\n\\n\";\n";
-    ss << "    std::cout << \"Usage: \" << program_name << \" [options] <input_file>\\n\\n\";\n";
+    ss << "    std::cout << \"Usage: \" << program_name << \" [options] <input>...\\n\\n\";\n";
+    ss << "    std::cout << \"Several inputs, directories (searched recursively), a list or -j\\n\";\n";
+    ss << "    std::cout << \"start a batch: files are parsed in parallel and a summary is printed.\\n\\n\";\n";
     ss << "    std::cout << \"Options:\\n\";\n";
-    ss << "    std::cout << \"  -a, --ast       Show parsed AST\\n\";\n";
-    ss << "    std::cout << \"  -v, --verbose   Verbose output\\n\";\n";
-    ss << "    std::cout << \"  -h, --help      Show this help\\n\";\n";
+    ss << "    std::cout << \"  -a, --ast        Show parsed AST\\n\";\n";
+    ss << "    std::cout << \"  -v, --verbose    Verbose output\\n\";\n";
+    ss << "    std::cout << \"  -j, --jobs N     Batch worker threads (default: one per core)\\n\";\n";
+    ss << "    std::cout << \"  -l, --list FILE  Read input paths from FILE, one per line (- for stdin)\\n\";\n";
+    if (options_.profile) {
+        ss << "    std::cout << \"  --profile-report Print calls, failures and cost per rule to stderr\\n\";\n";
+    }
+    ss << "    std::cout << \"  -h, --help       Show this help\\n\";\n";
     ss << "}\n\n";
     
     ss << "CommandLineOptions parseArgs(int argc, char* argv[]) {\n";
@@ -585,59 +4898,199 @@ std::string CppCodeGenerator::generateMainCpp(const Grammar& /* grammar */) {
     ss << "            opts.show_ast = true;\n";
     ss << "        } else if (arg == \"-v\" || arg == \"--verbose\") {\n";
     ss << "            opts.verbose = true;\n";
+    if (options_.profile) {
+        ss << "        } else if (arg == \"--profile-report\") {\n";
+        ss << "            opts.profile_report = true;\n";
+    }
+    ss << "        } else if ((arg == \"-j\" || arg == \"--jobs\") && i + 1 < argc) {\n";
+    ss << "            opts.jobs = static_cast<unsigned>(std::stoul(argv[++i]));\n";
+    ss << "            opts.batch = true;\n";
+    ss << "        } else if (arg.size() > 2 && arg.compare(0, 2, \"-j\") == 0) {\n";
+    ss << "            opts.jobs = static_cast<unsigned>(std::stoul(arg.substr(2)));\n";
+    ss << "            opts.batch = true;\n";
+    ss << "        } else if ((arg == \"-l\" || arg == \"--list\") && i + 1 < argc) {\n";
+    ss << "            opts.list_file = argv[++i];\n";
+    ss << "            opts.batch = true;\n";
     ss << "        } else if (arg[0] != '-') {\n";
-    ss << "            opts.input_file = arg;\n";
+    ss << "            opts.inputs.push_back(arg);\n";
     ss << "        }\n";
     ss << "    }\n";
+    ss << "    std::error_code ec;\n";
+    ss << "    if (opts.inputs.size() > 1 || (opts.inputs.size() == 1 && std::filesystem::is_directory(opts.inputs[0], ec))) {\n";
+    ss << "        opts.batch = true;\n";
+    ss << "    }\n";
     ss << "    \n";
     ss << "    return opts;\n";
     ss << "}\n\n";
     
-    ss << "std::string readFile(const std::string& filename) {\n";
-    ss << "    std::ifstream file(filename);\n";
-    ss << "    if (!file) {\n";
-    ss << "        throw std::runtime_error(\"Cannot open file: \" + filename);\n";
+    ss << "// Read-only view of a file: memory-mapped where available, read into memory otherwise\n";
+    ss << "class InputFile {\n";
+    ss << "public:\n";
+    ss << "    explicit InputFile(const std::string& filename) {\n";
+    ss << "#ifdef BNF_PARSER_HAVE_MMAP\n";
+    ss << "        int fd = ::open(filename.c_str(), O_RDONLY);\n";
+    ss << "        if (fd < 0) {\n";
+    ss << "            throw std::runtime_error(\"Cannot open file: \" + filename);\n";
+    ss << "        }\n";
+    ss << "        struct stat st{};\n";
+    ss << "        const bool is_regular = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);\n";
+    ss << "        if (is_regular && st.st_size > 0) {\n";
+    ss << "            void* addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);\n";
+    ss << "            if (addr != MAP_FAILED) {\n";
+    ss << "                mapped_ = addr;\n";
+    ss << "                mapped_size_ = static_cast<size_t>(st.st_size);\n";
+    ss << "                ::madvise(addr, mapped_size_, MADV_SEQUENTIAL);\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "        ::close(fd);\n";
+    ss << "        if (mapped_ || (is_regular && st.st_size == 0)) {\n";
+    ss << "            return;\n";
+    ss << "        }\n";
+    ss << "#endif\n";
+    ss << "        // Fallback for pipes and platforms without mmap\n";
+    ss << "        std::ifstream file(filename, std::ios::binary);\n";
+    ss << "        if (!file) {\n";
+    ss << "            throw std::runtime_error(\"Cannot open file: \" + filename);\n";
+    ss << "        }\n";
+    ss << "        std::stringstream buffer;\n";
+    ss << "        buffer << file.rdbuf();\n";
+    ss << "        buffer_ = buffer.str();\n";
     ss << "    }\n";
-    ss << "    std::stringstream buffer;\n";
-    ss << "    buffer << file.rdbuf();\n";
-    ss << "    return buffer.str();\n";
-    ss << "}\n\n";
+    ss << "\n";
+    ss << "    ~InputFile() {\n";
+    ss << "#ifdef BNF_PARSER_HAVE_MMAP\n";
+    ss << "        if (mapped_) {\n";
+    ss << "            ::munmap(mapped_, mapped_size_);\n";
+    ss << "        }\n";
+    ss << "#endif\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    InputFile(const InputFile&) = delete;\n";
+    ss << "    InputFile& operator=(const InputFile&) = delete;\n";
+    ss << "\n";
+    ss << "    std::string_view view() const {\n";
+    ss << "        if (mapped_) {\n";
+    ss << "            return std::string_view(static_cast<const char*>(mapped_), mapped_size_);\n";
+    ss << "        }\n";
+    ss << "        return buffer_;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "private:\n";
+    ss << "    void* mapped_ = nullptr;\n";
+    ss << "    size_t mapped_size_ = 0;\n";
+    ss << "    std::string buffer_;\n";
+    ss << "};\n\n";
+    
+    ss << generateBatchDriver();
     
     ss << "int main(int argc, char* argv[]) {\n";
     ss << "    try {\n";
     ss << "        auto opts = parseArgs(argc, argv);\n";
     ss << "        \n";
-    ss << "        if (opts.help || opts.input_file.empty()) {\n";
+    ss << "        if (opts.help || (opts.inputs.empty() && opts.list_file.empty())) {\n";
     ss << "            printHelp(argv[0]);\n";
     ss << "            return opts.help ? 0 : 1;\n";
     ss << "        }\n";
-    ss << "        \n";
-    ss << "        if (opts.verbose) {\n";
-    ss << "            std::cout << \"Parsing file: \" << opts.input_file << \"\\n\";\n";
-    ss << "        }\n";
-    ss << "        \n";
-    ss << "        std::string input = readFile(opts.input_file);\n";
-    ss << "        \n";
-    ss << "        if (opts.verbose) {\n";
-    ss << "            std::cout << \"Input size: \" << input.size() << \" bytes\\n\";\n";
-    ss << "        }\n";
-    ss << "        \n";
-    ss << "        " << options_.parser_name << " parser(input);\n";
-    ss << "        auto result = parser.parse();\n";
-    ss << "        \n";
-    ss << "        if (!result) {\n";
-    ss << "            std::cerr << \"Parse error: \" << parser.getError() << \"\\n\";\n";
-    ss << "            return 1;\n";
+    ss << "        if (opts.batch) {\n";
+    ss << "            return runBatch(opts);\n";
     ss << "        }\n";
+    ss << "        const std::string& input_file = opts.inputs[0];\n";
     ss << "        \n";
     ss << "        if (opts.verbose) {\n";
-    ss << "            std::cout << \"✓ Parse successful\\n\";\n";
-    ss << "        }\n";
-    ss << "        \n";
-    ss << "        if (opts.show_ast) {\n";
-    ss << "            std::cout << \"AST:\\n\" << result->toString() << \"\\n\";\n";
+    ss << "            std::cout << \"Parsing file: \" << input_file << \"\\n\";\n";
     ss << "        }\n";
     ss << "        \n";
+    if (options_.streaming) {
+        ss << "        // Read in chunks: memory stays bounded by the largest item\n";
+        ss << "        std::ifstream in(input_file, std::ios::binary);\n";
+        ss << "        if (!in) {\n";
+        ss << "            throw std::runtime_error(\"Cannot open file: \" + input_file);\n";
+        ss << "        }\n";
+        ss << "        " << parser_type << " parser;\n";
+        ss << "        size_t items = 0;\n";
+        if (buildsTree()) {
+            ss << "        parser.onItem([&](NodePtr item) {\n";
+            ss << "            ++items;\n";
+            ss << "            if (opts.show_ast) {\n";
+            ss << "                std::cout << item->toString() << \"\\n\";\n";
+            ss << "            }\n";
+            ss << "        });\n";
+        } else {
+            ss << "        parser.onItem([&](NodePtr) { ++items; });\n";
+        }
+        ss << "        std::string chunk(1 << 16, '\\0');\n";
+        ss << "        bool ok = true;\n";
+        ss << "        while (ok && in) {\n";
+        ss << "            in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));\n";
+        ss << "            ok = parser.feed(std::string_view(chunk.data(), static_cast<size_t>(in.gcount())));\n";
+        ss << "        }\n";
+        if (options_.profile) {
+            ss << "        ok = ok && parser.finish();\n";
+            ss << "        if (opts.profile_report) {\n";
+            ss << "            parser.printProfile(std::cerr);\n";
+            ss << "        }\n";
+            ss << "        if (!ok) {\n";
+        } else {
+            ss << "        if (!ok || !parser.finish()) {\n";
+        }
+        ss << "            std::cerr << \"Parse error: \" << parser.getError() << \"\\n\";\n";
+        ss << "            return 1;\n";
+        ss << "        }\n";
+        ss << "        \n";
+        ss << "        if (opts.verbose) {\n";
+        ss << "            std::cout << \"Input size: \" << parser.streamOffset() << \" bytes\\n\";\n";
+        ss << "            std::cout << \"✓ Parse successful (\" << items << \" items)\\n\";\n";
+        ss << "        }\n";
+        ss << "        \n";
+    } else {
+        ss << "        InputFile file(input_file);\n";
+        ss << "        std::string_view input = file.view();\n";
+        ss << "        \n";
+        ss << "        if (opts.verbose) {\n";
+        ss << "            std::cout << \"Input size: \" << input.size() << \" bytes\\n\";\n";
+        ss << "        }\n";
+        ss << "        \n";
+        ss << "        " << parser_type << " parser(input);\n";
+        if (!parallel_item_.empty()) {
+            ss << "        auto result = parser.parseParallel();\n";
+        } else {
+            ss << "        auto result = parser.parse();\n";
+        }
+        if (options_.profile) {
+            // Профиль печатается и для неудачного разбора: он объясняет, где был перебор
+            ss << "        if (opts.profile_report) {\n";
+            ss << "            parser.printProfile(std::cerr);\n";
+            ss << "        }\n";
+        }
+        ss << "        \n";
+        ss << "        if (!result) {\n";
+        ss << "            std::cerr << \"Parse error: \" << parser.getError() << \"\\n\";\n";
+        ss << "            return 1;\n";
+        ss << "        }\n";
+        ss << "        \n";
+        ss << "        if (opts.verbose) {\n";
+        ss << "            std::cout << \"✓ Parse successful\\n\";\n";
+        ss << "        }\n";
+        ss << "        \n";
+        if (options_.event_callbacks) {
+            // Дерево не строится: -a печатает правила разбора через обработчик событий
+            ss << "        if (opts.show_ast) {\n";
+            ss << "            struct OutlinePrinter {\n";
+            ss << "                size_t depth = 0;\n";
+            ss << "                void onEnter(RuleKind rule) { std::cout << std::string(2 * depth++, ' ') << ruleName(rule) << \"\\n\"; }\n";
+            ss << "                void onExit(RuleKind, std::string_view) { --depth; }\n";
+            ss << "            };\n";
+            ss << "            " << options_.parser_name << "<OutlinePrinter> printer(input);\n";
+            ss << "            printer.parse();\n";
+            ss << "        }\n";
+            ss << "        \n";
+        } else if (buildsTree()) {
+            ss << "        if (opts.show_ast) {\n";
+            ss << "            std::cout << \"AST:\\n\" << result->toString() << \"\\n\";\n";
+            ss << "        }\n";
+            ss << "        \n";
+        }
+    }
     ss << "        return 0;\n";
     ss << "        \n";
     ss << "    } catch (const std::exception& e) {\n";
@@ -649,6 +5102,236 @@ std::string CppCodeGenerator::generateMainCpp(const Grammar& /* grammar */) {
     return ss.str();
 }
 
+std::string CppCodeGenerator::generateBatchDriver() const {
+    std::ostringstream ss;
+    std::string parser_type = options_.parser_name + (options_.event_callbacks ? "<>" : "");
+    
+    ss << "// Expand the inputs of a batch: directories recursively, list files line by line\n";
+    ss << "std::vector<std::string> collectInputs(const CommandLineOptions& opts) {\n";
+    ss << "    std::vector<std::string> paths;\n";
+    ss << "    auto add = [&paths](const std::string& path) {\n";
+    ss << "        std::error_code ec;\n";
+    ss << "        if (!std::filesystem::is_directory(path, ec)) {\n";
+    ss << "            paths.push_back(path);\n";
+    ss << "            return;\n";
+    ss << "        }\n";
+    ss << "        std::vector<std::string> found;\n";
+    ss << "        std::filesystem::recursive_directory_iterator it(path, ec), end;\n";
+    ss << "        for (; !ec && it != end; it.increment(ec)) {\n";
+    ss << "            if (it->is_regular_file(ec)) {\n";
+    ss << "                found.push_back(it->path().string());\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "        std::sort(found.begin(), found.end());\n";
+    ss << "        paths.insert(paths.end(), found.begin(), found.end());\n";
+    ss << "    };\n";
+    ss << "    for (const auto& input : opts.inputs) {\n";
+    ss << "        add(input);\n";
+    ss << "    }\n";
+    ss << "    if (!opts.list_file.empty()) {\n";
+    ss << "        std::ifstream list;\n";
+    ss << "        std::istream* in = &std::cin;\n";
+    ss << "        if (opts.list_file != \"-\") {\n";
+    ss << "            list.open(opts.list_file);\n";
+    ss << "            if (!list) {\n";
+    ss << "                throw std::runtime_error(\"Cannot open file list: \" + opts.list_file);\n";
+    ss << "            }\n";
+    ss << "            in = &list;\n";
+    ss << "        }\n";
+    ss << "        std::string line;\n";
+    ss << "        while (std::getline(*in, line)) {\n";
+    ss << "            if (!line.empty() && line.back() == '\\r') {\n";
+    ss << "                line.pop_back();\n";
+    ss << "            }\n";
+    ss << "            if (!line.empty()) {\n";
+    ss << "                add(line);\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "    return paths;\n";
+    ss << "}\n\n";
+    
+    // Очередь с кражей работы: владелец берёт с начала своего блока файлов,
+    // освободившиеся потоки - с конца чужих
+    ss << "// File indices of one worker: the owner takes from the front, idle workers steal from the back\n";
+    ss << "class WorkQueue {\n";
+    ss << "public:\n";
+    ss << "    void push(size_t index) {\n";
+    ss << "        std::lock_guard<std::mutex> lock(mutex_);\n";
+    ss << "        items_.push_back(index);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    bool pop(size_t& index) {\n";
+    ss << "        std::lock_guard<std::mutex> lock(mutex_);\n";
+    ss << "        if (items_.empty()) return false;\n";
+    ss << "        index = items_.front();\n";
+    ss << "        items_.pop_front();\n";
+    ss << "        return true;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    bool steal(size_t& index) {\n";
+    ss << "        std::lock_guard<std::mutex> lock(mutex_);\n";
+    ss << "        if (items_.empty()) return false;\n";
+    ss << "        index = items_.back();\n";
+    ss << "        items_.pop_back();\n";
+    ss << "        return true;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "private:\n";
+    ss << "    std::mutex mutex_;\n";
+    ss << "    std::deque<size_t> items_;\n";
+    ss << "};\n\n";
+    
+    ss << "struct WorkerStats {\n";
+    ss << "    size_t files = 0;\n";
+    ss << "    size_t failed = 0;\n";
+    ss << "    size_t bytes = 0;\n";
+    ss << "    std::vector<double> latencies; // Seconds per file\n";
+    ss << "};\n\n";
+    
+    // Парсер переиспользуется между файлами одного потока через reset()
+    ss << "// Parse one file with the worker's parser; on failure fills error\n";
+    ss << "bool parseFile(" << parser_type << "& parser, const std::string& path, size_t& bytes, std::string& error) {\n";
+    if (options_.streaming) {
+        ss << "    std::ifstream in(path, std::ios::binary);\n";
+        ss << "    if (!in) {\n";
+        ss << "        throw std::runtime_error(\"Cannot open file: \" + path);\n";
+        ss << "    }\n";
+        ss << "    parser.reset(std::string_view());\n";
+        ss << "    thread_local std::string chunk(1 << 16, '\\0');\n";
+        ss << "    bool ok = true;\n";
+        ss << "    while (ok && in) {\n";
+        ss << "        in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));\n";
+        ss << "        ok = parser.feed(std::string_view(chunk.data(), static_cast<size_t>(in.gcount())));\n";
+        ss << "    }\n";
+        ss << "    ok = ok && parser.finish();\n";
+        ss << "    bytes = parser.streamOffset();\n";
+    } else {
+        ss << "    InputFile file(path);\n";
+        ss << "    bytes = file.view().size();\n";
+        ss << "    parser.reset(file.view());\n";
+        ss << "    bool ok = parser.parse() != nullptr;\n";
+        ss << "    parser.reset(std::string_view()); // The file is unmapped on return\n";
+    }
+    ss << "    if (!ok) {\n";
+    ss << "        error = \"Parse error: \" + parser.getError();\n";
+    ss << "    }\n";
+    ss << "    return ok;\n";
+    ss << "}\n\n";
+    
+    ss << "// Parse many files on a thread pool and print a throughput summary\n";
+    ss << "int runBatch(const CommandLineOptions& opts) {\n";
+    ss << "    const std::vector<std::string> paths = collectInputs(opts);\n";
+    ss << "    size_t jobs = opts.jobs != 0 ? opts.jobs : std::max(1u, std::thread::hardware_concurrency());\n";
+    ss << "    jobs = std::max<size_t>(1, std::min(jobs, paths.size()));\n";
+    ss << "\n";
+    ss << "    // Contiguous blocks keep each worker on neighbouring files\n";
+    ss << "    std::vector<WorkQueue> queues(jobs);\n";
+    ss << "    for (size_t w = 0; w < jobs; ++w) {\n";
+    ss << "        for (size_t i = paths.size() * w / jobs; i < paths.size() * (w + 1) / jobs; ++i) {\n";
+    ss << "            queues[w].push(i);\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "    std::vector<WorkerStats> stats(jobs);\n";
+    ss << "    std::mutex output_mutex;\n";
+    if (options_.profile) {
+        ss << "    std::vector<RuleProfile> profile; // Sum over the workers' parsers\n";
+    }
+    ss << "\n";
+    ss << "    auto work = [&](size_t w) {\n";
+    if (options_.streaming) {
+        ss << "        " << parser_type << " parser;\n";
+    } else {
+        ss << "        " << parser_type << " parser{std::string_view()};\n";
+    }
+    ss << "        WorkerStats& mine = stats[w];\n";
+    ss << "        size_t index = 0;\n";
+    ss << "        for (;;) {\n";
+    ss << "            // Queues only shrink, so a full round without work ends the worker\n";
+    ss << "            bool found = queues[w].pop(index);\n";
+    ss << "            for (size_t k = 1; !found && k < jobs; ++k) {\n";
+    ss << "                found = queues[(w + k) % jobs].steal(index);\n";
+    ss << "            }\n";
+    ss << "            if (!found) break;\n";
+    ss << "\n";
+    ss << "            auto started = std::chrono::steady_clock::now();\n";
+    ss << "            size_t bytes = 0;\n";
+    ss << "            std::string error;\n";
+    ss << "            bool ok = false;\n";
+    ss << "            try {\n";
+    ss << "                ok = parseFile(parser, paths[index], bytes, error);\n";
+    ss << "            } catch (const std::exception& e) {\n";
+    ss << "                error = e.what();\n";
+    ss << "            }\n";
+    ss << "            mine.latencies.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());\n";
+    ss << "            ++mine.files;\n";
+    ss << "            mine.bytes += bytes;\n";
+    ss << "            if (!ok) {\n";
+    ss << "                ++mine.failed;\n";
+    ss << "                std::lock_guard<std::mutex> lock(output_mutex);\n";
+    ss << "                std::cerr << paths[index] << \": \" << error << \"\\n\";\n";
+    ss << "            } else if (opts.verbose) {\n";
+    ss << "                std::lock_guard<std::mutex> lock(output_mutex);\n";
+    ss << "                std::cout << \"✓ \" << paths[index] << \"\\n\";\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    if (options_.profile) {
+        ss << "        std::lock_guard<std::mutex> lock(output_mutex);\n";
+        ss << "        std::vector<RuleProfile> mine_profile = parser.profile();\n";
+        ss << "        if (profile.empty()) {\n";
+        ss << "            profile = mine_profile;\n";
+        ss << "        } else {\n";
+        ss << "            for (size_t i = 0; i < profile.size(); ++i) {\n";
+        ss << "                profile[i] += mine_profile[i];\n";
+        ss << "            }\n";
+        ss << "        }\n";
+    }
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    auto started = std::chrono::steady_clock::now();\n";
+    ss << "    std::vector<std::thread> threads;\n";
+    ss << "    for (size_t w = 1; w < jobs; ++w) {\n";
+    ss << "        threads.emplace_back(work, w);\n";
+    ss << "    }\n";
+    ss << "    work(0);\n";
+    ss << "    for (auto& thread : threads) {\n";
+    ss << "        thread.join();\n";
+    ss << "    }\n";
+    ss << "    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();\n";
+    ss << "\n";
+    ss << "    WorkerStats total;\n";
+    ss << "    for (const auto& s : stats) {\n";
+    ss << "        total.files += s.files;\n";
+    ss << "        total.failed += s.failed;\n";
+    ss << "        total.bytes += s.bytes;\n";
+    ss << "        total.latencies.insert(total.latencies.end(), s.latencies.begin(), s.latencies.end());\n";
+    ss << "    }\n";
+    ss << "    auto percentile = [&total](double q) {\n";
+    ss << "        auto& values = total.latencies;\n";
+    ss << "        if (values.empty()) return 0.0;\n";
+    ss << "        auto nth = values.begin() + static_cast<std::ptrdiff_t>(q * static_cast<double>(values.size() - 1) + 0.5);\n";
+    ss << "        std::nth_element(values.begin(), nth, values.end());\n";
+    ss << "        return *nth;\n";
+    ss << "    };\n";
+    ss << "    double rate = elapsed > 0 ? 1.0 / elapsed : 0.0;\n";
+    ss << "    std::cout << std::fixed << std::setprecision(2);\n";
+    ss << "    std::cout << \"Parsed \" << total.files << \" files (\" << total.failed << \" failed) in \" << elapsed\n";
+    ss << "              << \" s with \" << jobs << \" threads\\n\";\n";
+    ss << "    std::cout << \"Throughput: \" << static_cast<double>(total.files) * rate << \" files/s, \"\n";
+    ss << "              << static_cast<double>(total.bytes) / 1e6 * rate << \" MB/s\\n\";\n";
+    ss << "    std::cout << std::setprecision(3) << \"Latency per file: p50 \" << percentile(0.50) * 1e3\n";
+    ss << "              << \" ms, p99 \" << percentile(0.99) * 1e3 << \" ms\\n\";\n";
+    if (options_.profile) {
+        ss << "    if (opts.profile_report) {\n";
+        ss << "        printProfileReport(std::cerr, profile);\n";
+        ss << "    }\n";
+    }
+    ss << "    return total.failed == 0 ? 0 : 1;\n";
+    ss << "}\n\n";
+    
+    return ss.str();
+}
+
 // Extended BNF методы
 
 std::string CppCodeGenerator::visitContextAction(const ContextAction* node, const std::string& on_failure_action) {
@@ -658,15 +5341,22 @@ std::string CppCodeGenerator::visitContextAction(const ContextAction* node, cons
     switch (node->actionType) {
         case ContextAction::ActionType::STORE:
             if (node->arguments.size() >= 2) {
-                ss << "        context_storage_[\"" << node->arguments[0] << "\"] = " 
-                   << node->arguments[1] << ";\n";
+                std::string key = contextText(node->arguments[0]);
+                std::string value = contextText(node->arguments[1]);
+                if (options_.streaming) {
+                    // Окно потока удаляется после элемента: тексты копируются
+                    key = "context_.keep(" + key + ")";
+                    value = "context_.keep(" + value + ")";
+                }
+                ss << "        context_.store(CONTEXT_" << makeIdentifier(node->arguments[0]) << ", " << key << ", "
+                   << value << ");\n";
             }
             break;
         case ContextAction::ActionType::LOOKUP:
             if (node->arguments.size() >= 1) {
-                ss << "        if (context_storage_.find(\"" << node->arguments[0] 
-                   << "\") == context_storage_.end()) {\n";
-                ss << "            " << on_failure_action << "; // Context lookup failed\n";
+                ss << "        if (!context_.find(CONTEXT_" << makeIdentifier(node->arguments[0]) << ", "
+                   << contextText(node->arguments[0]) << ")) {\n";
+                ss << "            " << on_failure_action << " // Context lookup failed\n";
                 ss << "        }\n";
             }
             break;
@@ -682,60 +5372,23 @@ std::string CppCodeGenerator::visitContextAction(const ContextAction* node, cons
     return ss.str();
 }
 
-std::string CppCodeGenerator::generateParameterizedFunction(const ProductionRule& rule) {
-    std::ostringstream ss;
-    std::string func_name = "parse_" + makeIdentifier(rule.leftSide);
-    
-    // Генерируем сигнатуру функции с параметрами
-    ss << "    std::shared_ptr<ASTNode> " << func_name << "(";
-    
-    if (!rule.parameters.empty()) {
-        ss << generateParameterDeclarations(rule.parameters);
+std::string CppCodeGenerator::visitCut(const Cut* node) {
+    // Сам ^ всегда успешен: его действие - в выборе действия при неудаче
+    // следующих элементов (visitSequence) и в освобождении memo-таблиц
+    std::string code = "        // Cut " + node->toString() + "\n";
+    if (!memoized_rules_.empty() && !options_.incremental) {
+        code += "        releaseMemo(pos_);\n";
     }
-    
-    ss << ") {\n";
-    ss << "        if (++recursion_depth_ > max_recursion_depth_) {\n";
-    ss << "            --recursion_depth_;\n";
-    ss << "            return nullptr; // Max recursion depth exceeded\n";
-    ss << "        }\n\n";
-    
-    ss << "        size_t saved_pos = pos_;\n";
-    ss << "        size_t saved_line = line_;\n";
-    ss << "        size_t saved_column = column_;\n";
-    ss << "        auto node = std::make_shared<ASTNode>(\"" << rule.leftSide << "\");\n\n";
-    
-    // Генерируем тело функции
-    std::string on_failure_action = 
-        "pos_ = saved_pos; line_ = saved_line; column_ = saved_column; --recursion_depth_; return nullptr;";
-    ss << visitNode(rule.rightSide.get(), on_failure_action);
-    
-    ss << "\n        --recursion_depth_;\n";
-    ss << "        return node;\n";
-    ss << "    }\n\n";
-    
-    return ss.str();
+    return code;
 }
 
-std::string CppCodeGenerator::generateParameterTypes(const std::vector<RuleParameter>& params) {
-    std::ostringstream ss;
-    
-    for (const auto& param : params) {
-        switch (param.type) {
-            case ParameterType::ENUM:
-                ss << generateEnumDeclaration(param) << "\n";
-                break;
-            case ParameterType::INTEGER:
-            case ParameterType::STRING:
-            case ParameterType::BOOLEAN:
-                // Встроенные типы не требуют объявления
-                break;
-        }
-    }
-    
-    return ss.str();
+// Текст последнего разбора правила name в текущем правиле; пустой, если
+// правило его не вызывает (тогда слот хранит один ключ - пустую строку)
+std::string CppCodeGenerator::contextText(const std::string& name) const {
+    return context_spans_.count(name) ? "ctx_" + makeIdentifier(name) : "std::string_view()";
 }
 
-std::string CppCodeGenerator::generateParameterDeclarations(const std::vector<RuleParameter>& params) {
+std::string CppCodeGenerator::generateParameterDeclarations(const std::vector<RuleParameter>& params) const {
     std::ostringstream ss;
     
     for (size_t i = 0; i < params.size(); ++i) {
@@ -760,7 +5413,13 @@ std::string CppCodeGenerator::generateParameterDeclarations(const std::vector<Ru
     return ss.str();
 }
 
-std::string CppCodeGenerator::generateParameterPassing(const std::vector<std::string>& paramValues) {
+// Целые параметры правила, которое вызывает сам парсер, начинаются с 0
+std::vector<std::string> CppCodeGenerator::entryArguments(const std::string& rule_name) const {
+    const ProductionRule* rule = grammar_->findRule(rule_name);
+    return std::vector<std::string>(rule ? rule->parameters.size() : 0, "0");
+}
+
+std::string CppCodeGenerator::generateParameterPassing(const std::vector<std::string>& paramValues) const {
     std::ostringstream ss;
     
     for (size_t i = 0; i < paramValues.size(); ++i) {
@@ -771,21 +5430,115 @@ std::string CppCodeGenerator::generateParameterPassing(const std::vector<std::st
     return ss.str();
 }
 
-std::string CppCodeGenerator::generateEnumDeclaration(const RuleParameter& param) {
+std::string CppCodeGenerator::generateContextStorage() {
+    return "    // Tables of {store}/{lookup}; checkpoints rewind them with the position\n"
+           "    ContextStore context_{" + std::to_string(context_slots_.size()) + "};\n";
+}
+
+std::string CppCodeGenerator::generateContextStoreClass() const {
     std::ostringstream ss;
-    
-    ss << "enum class " << param.name << "Enum {\n";
-    for (size_t i = 0; i < param.enumValues.size(); ++i) {
-        if (i > 0) ss << ",\n";
-        ss << "    " << param.enumValues[i];
+    ss << "// Tables of {store}/{lookup} actions, one per slot. Keys and values are\n";
+    ss << "// views of the input. Every store is logged: rewind() to a mark taken at a\n";
+    ss << "// checkpoint undoes the stores of a failed alternative, optional or\n";
+    ss << "// repetition, each in O(1).\n";
+    ss << "class ContextStore {\n";
+    ss << "public:\n";
+    ss << "    explicit ContextStore(size_t slots) : tables_(slots) {}\n";
+    ss << "\n";
+    ss << "    size_t mark() const { return log_.size(); }\n";
+    ss << "\n";
+    ss << "    void rewind(size_t mark) {\n";
+    ss << "        while (log_.size() > mark) {\n";
+    ss << "            const Undo& undo = log_.back();\n";
+    ss << "            if (undo.existed) {\n";
+    ss << "                tables_[undo.slot][undo.key] = undo.previous;\n";
+    ss << "            } else {\n";
+    ss << "                tables_[undo.slot].erase(undo.key);\n";
+    ss << "            }\n";
+    ss << "            log_.pop_back();\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    void store(size_t slot, std::string_view key, std::string_view value) {\n";
+    ss << "        auto [it, inserted] = tables_[slot].try_emplace(key, value);\n";
+    ss << "        log_.push_back(Undo{slot, key, inserted ? std::string_view() : it->second, !inserted});\n";
+    ss << "        it->second = value;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    const std::string_view* find(size_t slot, std::string_view key) const {\n";
+    ss << "        auto it = tables_[slot].find(key);\n";
+    ss << "        return it == tables_[slot].end() ? nullptr : &it->second;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // No checkpoint is open any more: the undo log can go\n";
+    ss << "    void commit() { log_.clear(); }\n";
+    ss << "\n";
+    ss << "    void clear() {\n";
+    ss << "        for (auto& table : tables_) table.clear();\n";
+    ss << "        log_.clear();\n";
+    if (options_.streaming) {
+        ss << "        kept_.clear();\n";
     }
-    ss << "\n};\n";
-    
+    ss << "    }\n";
+    if (options_.streaming) {
+        ss << "\n";
+        ss << "    // Streaming drops parsed input, so stored texts are copied here\n";
+        ss << "    std::string_view keep(std::string_view text) { return kept_.emplace_back(text); }\n";
+    }
+    ss << "\n";
+    ss << "private:\n";
+    ss << "    struct Undo {\n";
+    ss << "        size_t slot;\n";
+    ss << "        std::string_view key;\n";
+    ss << "        std::string_view previous;\n";
+    ss << "        bool existed;\n";
+    ss << "    };\n";
+    ss << "    std::vector<std::unordered_map<std::string_view, std::string_view>> tables_;\n";
+    ss << "    std::vector<Undo> log_;\n";
+    if (options_.streaming) {
+        ss << "    std::deque<std::string> kept_;\n";
+    }
+    ss << "};\n";
+    ss << "\n";
     return ss.str();
 }
 
-std::string CppCodeGenerator::generateContextStorage() {
-    return "    std::unordered_map<std::string, std::string> context_storage_;\n";
+// Слоты - первые аргументы {store} и {lookup}: номера известны при генерации,
+// и действие обращается к таблице по индексу, а не по строке
+void CppCodeGenerator::collectContextSlots(const Grammar& grammar) {
+    context_slots_.clear();
+    context_slot_.clear();
+    context_spans_.clear();
+    for (const auto& rule : grammar.rules) {
+        std::vector<std::string> names;
+        collectContextArguments(rule->rightSide.get(), names, true);
+        for (const auto& name : names) {
+            if (context_slot_.emplace(name, context_slots_.size()).second) {
+                context_slots_.push_back(name);
+            }
+        }
+    }
+}
+
+// Локальные ctx_<имя> для аргументов действий правила, которые оно вызывает
+std::string CppCodeGenerator::generateContextSpans(const ProductionRule& rule) {
+    context_spans_.clear();
+    if (context_slots_.empty()) {
+        return "";
+    }
+    std::vector<std::string> referenced;
+    collectReferences(rule.rightSide.get(), referenced);
+    std::vector<std::string> arguments;
+    collectContextArguments(rule.rightSide.get(), arguments, false);
+    
+    std::ostringstream ss;
+    for (const auto& name : arguments) {
+        if (std::find(referenced.begin(), referenced.end(), name) != referenced.end() &&
+            context_spans_.insert(name).second) {
+            ss << "        std::string_view ctx_" << makeIdentifier(name) << "; // Last text matched by " << name << "\n";
+        }
+    }
+    return ss.str();
 }
 
 std::string CppCodeGenerator::generateContextActions(const ContextAction* action) {
@@ -817,35 +5570,35 @@ bool CppCodeGenerator::hasContextActions(const Grammar& grammar) const {
 
 // Вспомогательный метод для поиска контекстных действий в узлах
 bool CppCodeGenerator::hasContextActionsInNode(const ASTNode* node) const {
-    if (dynamic_cast<const ContextAction*>(node)) {
+    if (node_cast<ContextAction>(node)) {
         return true;
     }
     
-    if (const auto* seq = dynamic_cast<const Sequence*>(node)) {
+    if (const auto* seq = node_cast<Sequence>(node)) {
         for (const auto& elem : seq->elements) {
             if (hasContextActionsInNode(elem.get())) return true;
         }
     }
     
-    if (const auto* alt = dynamic_cast<const Alternative*>(node)) {
+    if (const auto* alt = node_cast<Alternative>(node)) {
         for (const auto& choice : alt->choices) {
             if (hasContextActionsInNode(choice.get())) return true;
         }
     }
     
-    if (const auto* grp = dynamic_cast<const Group*>(node)) {
+    if (const auto* grp = node_cast<Group>(node)) {
         return hasContextActionsInNode(grp->content.get());
     }
     
-    if (const auto* opt = dynamic_cast<const Optional*>(node)) {
+    if (const auto* opt = node_cast<Optional>(node)) {
         return hasContextActionsInNode(opt->content.get());
     }
     
-    if (const auto* zom = dynamic_cast<const ZeroOrMore*>(node)) {
+    if (const auto* zom = node_cast<ZeroOrMore>(node)) {
         return hasContextActionsInNode(zom->content.get());
     }
     
-    if (const auto* oom = dynamic_cast<const OneOrMore*>(node)) {
+    if (const auto* oom = node_cast<OneOrMore>(node)) {
         return hasContextActionsInNode(oom->content.get());
     }
     
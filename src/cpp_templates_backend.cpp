@@ -0,0 +1,762 @@
+#include "cpp_templates_backend.hpp"
+#include "grammar_analysis.hpp"
+#include <sstream>
+#include <stdexcept>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+// Комбинаторы, общие для всех парсеров cpp-templates: заголовки нескольких
+// грамматик в одной единице трансляции включают их один раз
+const char* kCombinators = R"CPP(#ifndef BNF_COMBINATORS_V1
+#define BNF_COMBINATORS_V1
+// Parsing combinators shared by cpp-templates parsers. Each combinator is a
+// type with a static match(); on failure it leaves the state as it found it,
+// so callers never save state on its behalf
+namespace bnf_combinators {
+
+// Parse tree node. Nodes are stored in preorder: the first child of nodes[i]
+// is nodes[i + 1], and next is the index just past the node's subtree
+struct Node {
+    uint32_t rule;  // Rule number, see the parser's Rule enumeration
+    size_t begin;   // Matched text as byte offsets into the input
+    size_t end;
+    size_t next;
+};
+
+struct State {
+    std::string_view input;
+    size_t pos = 0;
+    size_t farthest = 0;  // Farthest offset at which a character match failed
+    size_t depth = 0;
+    size_t max_depth = 1000;
+    bool depth_exceeded = false;
+    std::vector<Node> nodes;
+
+    void fail() {
+        if (pos > farthest) farthest = pos;
+    }
+};
+
+// String literal as a template argument
+template<size_t N>
+struct Text {
+    char bytes[N] = {};
+    constexpr Text(const char (&text)[N]) {
+        for (size_t i = 0; i < N; ++i) bytes[i] = text[i];
+    }
+    static constexpr size_t size = N - 1;
+};
+
+template<Text T>
+struct Lit {
+    static bool match(State& s) {
+        if (s.input.size() - s.pos >= T.size && std::memcmp(s.input.data() + s.pos, T.bytes, T.size) == 0) {
+            s.pos += T.size;
+            return true;
+        }
+        s.fail();
+        return false;
+    }
+};
+
+// Length of the UTF-8 character at pos and its code point; 0 if the input
+// ends inside it. Invalid lead bytes are one-byte characters
+inline size_t decodeUtf8(std::string_view input, size_t pos, uint32_t& cp) {
+    if (pos >= input.size()) return 0;
+    const unsigned char first = static_cast<unsigned char>(input[pos]);
+    cp = first;
+    if (first < 0x80) return 1;
+    size_t len = 1;
+    if ((first & 0xE0) == 0xC0) len = 2;
+    else if ((first & 0xF0) == 0xE0) len = 3;
+    else if ((first & 0xF8) == 0xF0) len = 4;
+    if (pos + len > input.size()) return 0;
+    auto next = [&](size_t i) { return static_cast<uint32_t>(static_cast<unsigned char>(input[pos + i]) & 0x3F); };
+    if (len == 2) cp = ((first & 0x1Fu) << 6) | next(1);
+    else if (len == 3) cp = ((first & 0x0Fu) << 12) | (next(1) << 6) | next(2);
+    else if (len == 4) cp = ((first & 0x07u) << 18) | (next(1) << 12) | (next(2) << 6) | next(3);
+    return len;
+}
+
+// Code point range Lo..Hi; an ASCII range compares a single byte
+template<uint32_t Lo, uint32_t Hi>
+struct Range {
+    static bool match(State& s) {
+        if constexpr (Hi < 0x80) {
+            if (s.pos < s.input.size() && static_cast<unsigned char>(s.input[s.pos]) - Lo <= Hi - Lo) {
+                ++s.pos;
+                return true;
+            }
+        } else {
+            uint32_t cp = 0;
+            const size_t len = decodeUtf8(s.input, s.pos, cp);
+            if (len > 0 && cp - Lo <= Hi - Lo) {
+                s.pos += len;
+                return true;
+            }
+        }
+        s.fail();
+        return false;
+    }
+};
+
+// ASCII character class as a 128-bit map: bit c of Low, or bit c - 64 of High
+template<uint64_t Low, uint64_t High>
+struct Set {
+    static constexpr bool contains(unsigned char c) {
+        return c < 64 ? ((Low >> c) & 1) != 0 : c < 128 && ((High >> (c - 64)) & 1) != 0;
+    }
+    static bool match(State& s) {
+        if (s.pos < s.input.size() && contains(static_cast<unsigned char>(s.input[s.pos]))) {
+            ++s.pos;
+            return true;
+        }
+        s.fail();
+        return false;
+    }
+};
+
+template<class... P>
+struct Seq {
+    static bool match(State& s) {
+        const size_t pos = s.pos;
+        const size_t nodes = s.nodes.size();
+        if ((P::match(s) && ...)) return true;
+        s.pos = pos;
+        s.nodes.resize(nodes);
+        return false;
+    }
+};
+
+// A single element needs no saved state
+template<class P>
+struct Seq<P> : P {};
+
+// Ordered choice: the first alternative that matches
+template<class... P>
+struct Choice {
+    static bool match(State& s) {
+        return (P::match(s) || ...);
+    }
+};
+
+template<class P>
+struct Opt {
+    static bool match(State& s) {
+        P::match(s);
+        return true;
+    }
+};
+
+// Greedy repetition; an empty match ends it
+template<class P>
+struct Star {
+    static bool match(State& s) {
+        for (;;) {
+            const size_t before = s.pos;
+            if (!P::match(s) || s.pos == before) return true;
+        }
+    }
+};
+
+template<class P>
+struct Plus {
+    static bool match(State& s) {
+        const size_t before = s.pos;
+        if (!P::match(s)) return false;
+        return s.pos == before || Star<P>::match(s);
+    }
+};
+
+// Whitespace Ws skipped before token P; restored if P does not match
+template<class Ws, class P>
+struct Tok {
+    static bool match(State& s) {
+        const size_t pos = s.pos;
+        Ws::match(s);
+        if (P::match(s)) return true;
+        s.pos = pos;
+        return false;
+    }
+};
+
+// Whitespace rule R repeated while it consumes input. Its failures are not
+// syntax errors and do not move the farthest failure
+template<class R>
+struct Skip {
+    static bool match(State& s) {
+        const size_t farthest = s.farthest;
+        while (s.pos < s.input.size()) {
+            const size_t before = s.pos;
+            if (!R::Body::match(s) || s.pos == before) break;
+        }
+        s.farthest = farthest;
+        return true;
+    }
+};
+
+// Whitespace of grammars without a whitespace rule
+struct Spaces {
+    static bool match(State& s) {
+        while (s.pos < s.input.size() && std::isspace(static_cast<unsigned char>(s.input[s.pos]))) ++s.pos;
+        return true;
+    }
+};
+
+// Reference to rule R that adds a node for it to the tree
+template<class R>
+struct Call {
+    static bool match(State& s) {
+        if (s.depth >= s.max_depth) {
+            s.depth_exceeded = true;
+            return false;
+        }
+        ++s.depth;
+        const size_t index = s.nodes.size();
+        s.nodes.push_back(Node{R::id, s.pos, s.pos, 0});
+        const bool matched = R::Body::match(s);
+        --s.depth;
+        if (!matched) {
+            s.nodes.resize(index);
+            return false;
+        }
+        s.nodes[index].end = s.pos;
+        s.nodes[index].next = s.nodes.size();
+        return true;
+    }
+};
+
+// Reference to rule R without a node: inside tokens and in recognizers
+template<class R>
+struct Inline {
+    static bool match(State& s) {
+        if (s.depth >= s.max_depth) {
+            s.depth_exceeded = true;
+            return false;
+        }
+        ++s.depth;
+        const bool matched = R::Body::match(s);
+        --s.depth;
+        return matched;
+    }
+};
+
+} // namespace bnf_combinators
+#endif // BNF_COMBINATORS_V1
+)CPP";
+
+std::string hex64(uint64_t value) {
+    std::ostringstream out;
+    out << "0x" << std::hex << value << "ull";
+    return out.str();
+}
+
+// Текст правила для однострочного комментария: управляющие символы экранируются
+std::string commentText(const std::string& text) {
+    std::string result;
+    for (unsigned char c : text) {
+        if (c == '\\' || c < 0x20) {
+            std::ostringstream escaped;
+            escaped << "\\x" << std::hex << static_cast<unsigned>(c);
+            result += c == '\\' ? std::string("\\\\") : escaped.str();
+        } else {
+            result += static_cast<char>(c);
+        }
+    }
+    return result;
+}
+
+std::string join(const std::vector<std::string>& items) {
+    std::string result;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) result += ", ";
+        result += items[i];
+    }
+    return result;
+}
+
+} // namespace
+
+GeneratedCode CppTemplatesCodeGenerator::generate(const Grammar& grammar, const GeneratorOptions& options) {
+    GeneratedCode result;
+    options_ = options;
+    grammar_ = &grammar;
+    in_lexical_rule_ = false;
+
+    try {
+        if (grammar.isContextSensitive()) {
+            result.success = false;
+            result.error_message = "The cpp-templates backend does not support parameterized rules "
+                                   "or context actions; use the cpp backend";
+            return result;
+        }
+        if (!options_.whitespace_rule.empty() && !grammar.findRule(options_.whitespace_rule)) {
+            throw std::runtime_error("Whitespace rule not found: " + options_.whitespace_rule);
+        }
+        trivia_rule_ = findWhitespaceRule(grammar, options_.whitespace_rule);
+        lexical_rules_ = findLexicalRules(grammar, trivia_rule_, options_.token_rules);
+
+        for (const auto& option : ignoredOptions()) {
+            result.warnings.push_back("Option " + option + " is not supported by the cpp-templates backend; ignored");
+        }
+
+        std::ostringstream code;
+        code << "// Generated by BNF Parser Generator\n";
+        code << "// Parser: " << options_.parser_name << "\n";
+        code << "// Language: C++20, header-only parsing combinators\n";
+        code << "\n";
+        code << "#pragma once\n";
+        code << "\n";
+        code << "#include <cctype>\n";
+        code << "#include <cstdint>\n";
+        code << "#include <cstring>\n";
+        code << "#include <string>\n";
+        code << "#include <string_view>\n";
+        code << "#include <utility>\n";
+        code << "#include <vector>\n";
+        code << "\n";
+        code << kCombinators;
+        code << "\n";
+        if (!options_.namespace_name.empty()) {
+            code << "namespace " << options_.namespace_name << " {\n\n";
+        }
+        code << generateRules(grammar);
+        code << generateParserClass(grammar);
+        if (!options_.namespace_name.empty()) {
+            code << "} // namespace " << options_.namespace_name << "\n";
+        }
+
+        result.parser_code = code.str();
+        result.parser_filename = camelToSnake(options_.parser_name) + ".hpp";
+        result.success = true;
+        result.messages.push_back("Generated C++ combinator parser successfully");
+        result.messages.push_back("Total rules: " + std::to_string(grammar.rules.size()));
+        result.messages.push_back("Start symbol: " + grammar.startSymbol);
+        if (options_.recognizer) {
+            result.messages.push_back("Recognizer: no parse tree is built");
+        }
+        if (!trivia_rule_.empty()) {
+            result.messages.push_back("Whitespace rule: " + trivia_rule_ + " (" +
+                                      std::to_string(lexical_rules_.size()) + " token rules)");
+        }
+
+        if (options_.generate_executable) {
+            result.main_code = generateMain();
+            result.main_filename = camelToSnake(options_.parser_name) + "_main.cpp";
+            result.messages.push_back("Generated standalone executable main.cpp");
+        }
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.error_message = std::string("Generation failed: ") + e.what();
+    }
+
+    return result;
+}
+
+std::vector<std::string> CppTemplatesCodeGenerator::ignoredOptions() const {
+    std::vector<std::string> ignored;
+    if (options_.memoize || !options_.memoize_rules.empty()) ignored.push_back("memoize");
+    if (options_.arena_allocation) ignored.push_back("arena");
+    if (options_.dfa_lexer) ignored.push_back("dfa-lexer");
+    if (options_.streaming) ignored.push_back("streaming");
+    if (options_.incremental) ignored.push_back("incremental");
+    if (options_.parallel) ignored.push_back("parallel");
+    if (options_.event_callbacks) ignored.push_back("event-callbacks");
+    if (options_.profile || options_.profile_timing) ignored.push_back("profile");
+    if (options_.explicit_stack) ignored.push_back("explicit-stack");
+    if (options_.split_units > 0) ignored.push_back("split");
+    if (options_.diagnostics) ignored.push_back("diagnostics");
+    return ignored;
+}
+
+std::string CppTemplatesCodeGenerator::ruleType(const std::string& rule_name) const {
+    return "r_" + makeIdentifier(rule_name);
+}
+
+std::string CppTemplatesCodeGenerator::ruleEnumerator(const std::string& rule_name) const {
+    return "RULE_" + makeIdentifier(rule_name);
+}
+
+// Правила: объявления структур, затем определения - тела ссылаются друг на друга
+
+std::string CppTemplatesCodeGenerator::generateRules(const Grammar& grammar) {
+    // Повторное определение правила не используется, как и в findRule()
+    std::vector<const ProductionRule*> rules;
+    for (const auto& rule : grammar.rules) {
+        if (grammar.findRule(rule->leftSide) == rule.get()) {
+            rules.push_back(rule.get());
+        }
+    }
+
+    std::ostringstream ss;
+    ss << "namespace " << camelToSnake(options_.parser_name) << "_rules {\n";
+    ss << "using namespace bnf_combinators;\n";
+    ss << "\n";
+    for (const auto* rule : rules) {
+        ss << "struct " << ruleType(rule->leftSide) << ";\n";
+    }
+    ss << "\n";
+    if (trivia_rule_.empty()) {
+        ss << "// Whitespace between tokens: std::isspace before each terminal\n";
+        ss << "using Ws = Spaces;\n";
+    } else {
+        ss << "// Whitespace between tokens: rule " << trivia_rule_ << "\n";
+        ss << "using Ws = Skip<" << ruleType(trivia_rule_) << ">;\n";
+    }
+    ss << "\n";
+    for (size_t i = 0; i < rules.size(); ++i) {
+        ss << "// " << commentText(rules[i]->toString()) << "\n";
+        ss << "struct " << ruleType(rules[i]->leftSide) << " {\n";
+        ss << "    static constexpr uint32_t id = " << i << ";\n";
+        ss << "    using Body = " << generateRuleFunction(*rules[i]) << ";\n";
+        ss << "};\n";
+        ss << "\n";
+    }
+    ss << "} // namespace " << camelToSnake(options_.parser_name) << "_rules\n";
+    ss << "\n";
+    return ss.str();
+}
+
+std::string CppTemplatesCodeGenerator::generateRuleFunction(const ProductionRule& rule) {
+    in_lexical_rule_ = lexical_rules_.count(rule.leftSide) > 0;
+    std::string body = visitNode(rule.rightSide.get());
+    in_lexical_rule_ = false;
+    return body;
+}
+
+std::string CppTemplatesCodeGenerator::visitNode(const ASTNode* node) {
+    switch (node->kind()) {
+        case NodeKind::TERMINAL:
+            return visitTerminal(static_cast<const Terminal*>(node));
+        case NodeKind::NON_TERMINAL:
+            return visitNonTerminal(static_cast<const NonTerminal*>(node));
+        case NodeKind::CHAR_RANGE:
+            return visitCharRange(static_cast<const CharRange*>(node));
+        case NodeKind::ALTERNATIVE:
+            return visitAlternative(static_cast<const Alternative*>(node));
+        case NodeKind::SEQUENCE:
+            return visitSequence(static_cast<const Sequence*>(node));
+        case NodeKind::GROUP:
+            return visitGroup(static_cast<const Group*>(node));
+        case NodeKind::OPTIONAL:
+            return visitOptional(static_cast<const Optional*>(node));
+        case NodeKind::ZERO_OR_MORE:
+            return visitZeroOrMore(static_cast<const ZeroOrMore*>(node));
+        case NodeKind::ONE_OR_MORE:
+            return visitOneOrMore(static_cast<const OneOrMore*>(node));
+        case NodeKind::CONTEXT_ACTION:
+            break;
+        case NodeKind::CUT:
+            throw std::runtime_error("The cut operator is not supported by the cpp-templates backend");
+    }
+    throw std::runtime_error("Context actions are not supported by the cpp-templates backend");
+}
+
+std::string CppTemplatesCodeGenerator::beforeToken(const std::string& type, bool terminal) const {
+    // Как в CppCodeGenerator: в синтаксических правилах пробелы пропускаются
+    // перед терминалами, диапазонами и токенами, без правила пробелов - только
+    // перед терминалами
+    if (in_lexical_rule_ || (trivia_rule_.empty() && !terminal)) {
+        return type;
+    }
+    return "Tok<Ws, " + type + ">";
+}
+
+std::string CppTemplatesCodeGenerator::visitTerminal(const Terminal* node) {
+    return beforeToken("Lit<\"" + escapeString(node->value) + "\">", true);
+}
+
+std::string CppTemplatesCodeGenerator::visitNonTerminal(const NonTerminal* node) {
+    std::string type = ruleType(node->name);
+    std::string reference = (buildsTree() && !in_lexical_rule_ ? "Call<" : "Inline<") + type + ">";
+    if (!lexical_rules_.count(node->name) || node->name == trivia_rule_) {
+        return reference;
+    }
+    return beforeToken(reference, false);
+}
+
+std::string CppTemplatesCodeGenerator::visitCharRange(const CharRange* node) {
+    std::ostringstream ss;
+    ss << "Range<0x" << std::hex << node->start << ", 0x" << node->end << ">";
+    return beforeToken(ss.str(), false);
+}
+
+bool CppTemplatesCodeGenerator::collectByteSet(const ASTNode* node, uint64_t bits[2], bool& has_terminal) const {
+    auto add = [bits](uint32_t c) { bits[c / 64] |= uint64_t{1} << (c % 64); };
+    if (const auto* group = node_cast<Group>(node)) {
+        return collectByteSet(group->content.get(), bits, has_terminal);
+    }
+    if (const auto* terminal = node_cast<Terminal>(node)) {
+        if (terminal->value.size() != 1 || static_cast<unsigned char>(terminal->value[0]) >= 0x80) {
+            return false;
+        }
+        add(static_cast<unsigned char>(terminal->value[0]));
+        has_terminal = true;
+        return true;
+    }
+    if (const auto* range = node_cast<CharRange>(node)) {
+        if (range->end >= 0x80 || range->start > range->end) {
+            return false;
+        }
+        for (uint32_t c = range->start; c <= range->end; ++c) {
+            add(c);
+        }
+        return true;
+    }
+    if (const auto* alt = node_cast<Alternative>(node)) {
+        for (const auto& choice : alt->choices) {
+            if (!collectByteSet(choice.get(), bits, has_terminal)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+std::string CppTemplatesCodeGenerator::visitAlternative(const Alternative* node) {
+    // Выбор из ASCII-символов - битовая маска: порядок выбора не важен, каждая
+    // альтернатива разбирает ровно один байт. Без правила пробелов терминалы
+    // пропускают пробелы, а диапазоны нет - такой выбор остаётся перебором
+    uint64_t bits[2] = {0, 0};
+    bool has_terminal = false;
+    if (node->choices.size() > 1 && collectByteSet(node, bits, has_terminal) &&
+        !(trivia_rule_.empty() && has_terminal && !in_lexical_rule_)) {
+        return beforeToken("Set<" + hex64(bits[0]) + ", " + hex64(bits[1]) + ">", false);
+    }
+
+    if (node->choices.size() == 1) {
+        return visitNode(node->choices[0].get());
+    }
+    std::vector<std::string> choices;
+    for (const auto& choice : node->choices) {
+        choices.push_back(visitNode(choice.get()));
+    }
+    return "Choice<" + join(choices) + ">";
+}
+
+std::string CppTemplatesCodeGenerator::visitSequence(const Sequence* node) {
+    if (node->elements.size() == 1) {
+        return visitNode(node->elements[0].get());
+    }
+    std::vector<std::string> elements;
+    for (const auto& element : node->elements) {
+        elements.push_back(visitNode(element.get()));
+    }
+    return "Seq<" + join(elements) + ">";
+}
+
+std::string CppTemplatesCodeGenerator::visitGroup(const Group* node) {
+    return visitNode(node->content.get());
+}
+
+std::string CppTemplatesCodeGenerator::visitOptional(const Optional* node) {
+    return "Opt<" + visitNode(node->content.get()) + ">";
+}
+
+std::string CppTemplatesCodeGenerator::visitZeroOrMore(const ZeroOrMore* node) {
+    return "Star<" + visitNode(node->content.get()) + ">";
+}
+
+std::string CppTemplatesCodeGenerator::visitOneOrMore(const OneOrMore* node) {
+    return "Plus<" + visitNode(node->content.get()) + ">";
+}
+
+// Класс парсера: разбор стартового правила и доступ к дереву
+
+std::string CppTemplatesCodeGenerator::generateParserClass(const Grammar& grammar) const {
+    const std::string rules_ns = camelToSnake(options_.parser_name) + "_rules";
+    const std::string& name = options_.parser_name;
+    std::vector<std::string> rule_names;
+    for (const auto& rule : grammar.rules) {
+        if (grammar.findRule(rule->leftSide) == rule.get()) {
+            rule_names.push_back(rule->leftSide);
+        }
+    }
+    std::string start = rules_ns + "::" + ruleType(grammar.startSymbol);
+    std::string reference = std::string(buildsTree() ? "Call<" : "Inline<") + start + ">";
+
+    std::ostringstream ss;
+    ss << "class " << name << " {\n";
+    ss << "public:\n";
+    ss << "    using Node = bnf_combinators::Node;\n";
+    ss << "\n";
+    ss << "    // Rule numbers stored in Node::rule\n";
+    ss << "    enum Rule : uint32_t {\n";
+    for (size_t i = 0; i < rule_names.size(); ++i) {
+        ss << "        " << ruleEnumerator(rule_names[i]) << " = " << i << ",\n";
+    }
+    ss << "    };\n";
+    ss << "\n";
+    ss << "    explicit " << name << "(std::string_view input) {\n";
+    ss << "        state_.max_depth = " << options_.max_recursion_depth << ";\n";
+    ss << "        reset(input);\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Parse another input; the node buffer is kept for reuse\n";
+    ss << "    void reset(std::string_view input) {\n";
+    ss << "        state_.input = input;\n";
+    ss << "        state_.pos = 0;\n";
+    ss << "        state_.nodes.clear();\n";
+    ss << "        error_.clear();\n";
+    ss << "        error_offset_ = 0;\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    void setMaxDepth(size_t depth) { state_.max_depth = depth; }\n";
+    ss << "\n";
+    if (buildsTree()) {
+        ss << "    // Parse the whole input. Returns the root node (nodes()[0]), or nullptr on a\n";
+        ss << "    // syntax error (see getError()); valid until the next parse() or reset()\n";
+        ss << "    const Node* parse() {\n";
+    } else {
+        ss << "    // Recognize the whole input; false on a syntax error (see getError())\n";
+        ss << "    bool parse() {\n";
+    }
+    const std::string failure = buildsTree() ? "nullptr" : "false";
+    ss << "        state_.pos = 0;\n";
+    ss << "        state_.farthest = 0;\n";
+    ss << "        state_.depth = 0;\n";
+    ss << "        state_.depth_exceeded = false;\n";
+    ss << "        state_.nodes.clear();\n";
+    ss << "        error_.clear();\n";
+    ss << "        if (!bnf_combinators::" << reference << "::match(state_)) {\n";
+    ss << "            error_offset_ = state_.farthest;\n";
+    ss << "            error_ = state_.depth_exceeded ? std::string(\"Maximum recursion depth exceeded\")\n";
+    ss << "                                           : \"Parse failed at position \" + std::to_string(error_offset_);\n";
+    ss << "            return " << failure << ";\n";
+    ss << "        }\n";
+    ss << "        // Check if we consumed all input\n";
+    ss << "        " << rules_ns << "::Ws::match(state_);\n";
+    ss << "        if (state_.pos < state_.input.size()) {\n";
+    ss << "            error_offset_ = state_.pos;\n";
+    ss << "            error_ = \"Unexpected input at position \" + std::to_string(state_.pos);\n";
+    ss << "            return " << failure << ";\n";
+    ss << "        }\n";
+    ss << "        return " << (buildsTree() ? "&state_.nodes[0]" : "true") << ";\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    const std::string& getError() const { return error_; }\n";
+    ss << "    size_t errorOffset() const { return error_offset_; }\n";
+    ss << "\n";
+    ss << "    static const char* ruleName(uint32_t rule) {\n";
+    ss << "        static constexpr const char* names[] = {";
+    for (size_t i = 0; i < rule_names.size(); ++i) {
+        ss << (i > 0 ? ", " : "") << "\"" << escapeString(rule_names[i]) << "\"";
+    }
+    ss << "};\n";
+    ss << "        return rule < " << rule_names.size() << " ? names[rule] : \"?\";\n";
+    ss << "    }\n";
+    ss << "\n";
+    ss << "    // Line and column (from 1) of a byte offset\n";
+    ss << "    std::pair<size_t, size_t> lineColumn(size_t offset) const {\n";
+    ss << "        size_t line = 1;\n";
+    ss << "        size_t line_start = 0;\n";
+    ss << "        for (size_t i = 0; i < offset && i < state_.input.size(); ++i) {\n";
+    ss << "            if (state_.input[i] == '\\n') {\n";
+    ss << "                ++line;\n";
+    ss << "                line_start = i + 1;\n";
+    ss << "            }\n";
+    ss << "        }\n";
+    ss << "        return {line, offset - line_start + 1};\n";
+    ss << "    }\n";
+    if (buildsTree()) {
+        ss << "\n";
+        ss << "    // Nodes of the last parse in preorder; nodes()[0] is the root\n";
+        ss << "    const std::vector<Node>& nodes() const { return state_.nodes; }\n";
+        ss << "\n";
+        ss << "    std::string_view text(const Node& node) const {\n";
+        ss << "        return state_.input.substr(node.begin, node.end - node.begin);\n";
+        ss << "    }\n";
+        ss << "\n";
+        ss << "    // Calls f(child) for each child of a node of nodes(), in order\n";
+        ss << "    template<class F>\n";
+        ss << "    void forEachChild(const Node& node, F&& f) const {\n";
+        ss << "        const size_t index = static_cast<size_t>(&node - state_.nodes.data());\n";
+        ss << "        for (size_t i = index + 1; i < node.next; i = state_.nodes[i].next) {\n";
+        ss << "            f(state_.nodes[i]);\n";
+        ss << "        }\n";
+        ss << "    }\n";
+        ss << "\n";
+        ss << "    // Indented tree; leaves show their text\n";
+        ss << "    std::string toString(const Node& node, size_t indent = 0) const {\n";
+        ss << "        std::string out(indent * 2, ' ');\n";
+        ss << "        out += ruleName(node.rule);\n";
+        ss << "        const size_t index = static_cast<size_t>(&node - state_.nodes.data());\n";
+        ss << "        if (node.next == index + 1) {\n";
+        ss << "            out += \": \\\"\";\n";
+        ss << "            out += text(node);\n";
+        ss << "            out += \"\\\"\";\n";
+        ss << "        }\n";
+        ss << "        out += \"\\n\";\n";
+        ss << "        forEachChild(node, [&](const Node& child) { out += toString(child, indent + 1); });\n";
+        ss << "        return out;\n";
+        ss << "    }\n";
+    }
+    ss << "\n";
+    ss << "private:\n";
+    ss << "    bnf_combinators::State state_;\n";
+    ss << "    std::string error_;\n";
+    ss << "    size_t error_offset_ = 0;\n";
+    ss << "};\n";
+    ss << "\n";
+    return ss.str();
+}
+
+std::string CppTemplatesCodeGenerator::generateMain() const {
+    std::ostringstream ss;
+    ss << "// Generated main.cpp for " << options_.parser_name << "\n";
+    ss << "\n";
+    ss << "#include <fstream>\n";
+    ss << "#include <iostream>\n";
+    ss << "#include <iterator>\n";
+    ss << "#include <string>\n";
+    ss << "\n";
+    ss << "#include \"" << camelToSnake(options_.parser_name) << ".hpp\"\n";
+    ss << "\n";
+    if (!options_.namespace_name.empty()) {
+        ss << "using namespace " << options_.namespace_name << ";\n";
+        ss << "\n";
+    }
+    ss << "int main(int argc, char* argv[]) {\n";
+    ss << "    bool show_tree = false;\n";
+    ss << "    std::string path;\n";
+    ss << "    for (int i = 1; i < argc; ++i) {\n";
+    ss << "        std::string arg = argv[i];\n";
+    ss << "        if (arg == \"-a\" || arg == \"--ast\") {\n";
+    ss << "            show_tree = true;\n";
+    ss << "        } else {\n";
+    ss << "            path = arg;\n";
+    ss << "        }\n";
+    ss << "    }\n";
+    ss << "    if (path.empty()) {\n";
+    ss << "        std::cerr << \"Usage: \" << argv[0] << \" [-a|--ast] <input_file>\\n\";\n";
+    ss << "        return 1;\n";
+    ss << "    }\n";
+    ss << "    std::ifstream file(path, std::ios::binary);\n";
+    ss << "    if (!file) {\n";
+    ss << "        std::cerr << \"Error: Cannot open file: \" << path << \"\\n\";\n";
+    ss << "        return 1;\n";
+    ss << "    }\n";
+    ss << "    const std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());\n";
+    ss << "\n";
+    ss << "    " << options_.parser_name << " parser(input);\n";
+    ss << "    auto result = parser.parse();\n";
+    ss << "    if (!result) {\n";
+    ss << "        std::cerr << \"Parse error: \" << parser.getError() << \"\\n\";\n";
+    ss << "        return 1;\n";
+    ss << "    }\n";
+    if (buildsTree()) {
+        ss << "    if (show_tree) {\n";
+        ss << "        std::cout << \"AST:\\n\" << parser.toString(*result);\n";
+        ss << "    }\n";
+    } else {
+        ss << "    (void)show_tree;\n";
+    }
+    ss << "    return 0;\n";
+    ss << "}\n";
+    return ss.str();
+}
+
+} // namespace bnf_parser_generator
@@ -0,0 +1,203 @@
+#include "generation_cache.hpp"
+#include "version.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+const char kEntryHeader[] = "bnf-parser-gen cache 1\n";
+
+// Поле ключа с длиной значения: значения с переводами строк не склеиваются
+void addField(std::string& key, const char* name, const std::string& value) {
+    key += name;
+    key += ':' + std::to_string(value.size()) + ':' + value + '\n';
+}
+
+void addField(std::string& key, const char* name, bool value) {
+    addField(key, name, std::string(value ? "1" : "0"));
+}
+
+void addField(std::string& key, const char* name, size_t value) {
+    addField(key, name, std::to_string(value));
+}
+
+void addField(std::string& key, const char* name, const std::vector<std::string>& values) {
+    std::string joined;
+    for (const auto& value : values) {
+        joined += std::to_string(value.size()) + ':' + value;
+    }
+    addField(key, name, joined);
+}
+
+// Все поля GeneratorOptions: новое поле настроек должно попасть и сюда
+std::string describeOptions(const GeneratorOptions& options) {
+    std::string key;
+    addField(key, "target_language", options.target_language);
+    addField(key, "parser_name", options.parser_name);
+    addField(key, "namespace_name", options.namespace_name);
+    addField(key, "debug_mode", options.debug_mode);
+    addField(key, "generate_ast_printer", options.generate_ast_printer);
+    addField(key, "generate_ast_visitor", options.generate_ast_visitor);
+    addField(key, "indent_style", options.indent_style);
+    addField(key, "max_recursion_depth", options.max_recursion_depth);
+    addField(key, "generate_error_handling", options.generate_error_handling);
+    addField(key, "track_positions", options.track_positions);
+    addField(key, "generate_executable", options.generate_executable);
+    addField(key, "default_input_file", options.default_input_file);
+    addField(key, "memoize", options.memoize);
+    addField(key, "memoize_rules", options.memoize_rules);
+    addField(key, "no_memoize_rules", options.no_memoize_rules);
+    addField(key, "arena_allocation", options.arena_allocation);
+    addField(key, "first_set_dispatch", options.first_set_dispatch);
+    addField(key, "lazy_positions", options.lazy_positions);
+    addField(key, "char_class_scanners", options.char_class_scanners);
+    addField(key, "literal_tries", options.literal_tries);
+    addField(key, "whitespace_rule", options.whitespace_rule);
+    addField(key, "token_rules", options.token_rules);
+    addField(key, "dfa_lexer", options.dfa_lexer);
+    addField(key, "streaming", options.streaming);
+    addField(key, "stream_item", options.stream_item);
+    addField(key, "incremental", options.incremental);
+    addField(key, "parallel", options.parallel);
+    addField(key, "recognizer", options.recognizer);
+    addField(key, "event_callbacks", options.event_callbacks);
+    addField(key, "profile", options.profile);
+    addField(key, "profile_timing", options.profile_timing);
+    addField(key, "explicit_stack", options.explicit_stack);
+    addField(key, "split_units", options.split_units);
+    addField(key, "diagnostics", options.diagnostics);
+    return key;
+}
+
+// FNV-1a, 64 бита: только имя файла записи, сам ключ сверяется целиком
+uint64_t hashKey(const std::string& key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void writeBlock(std::ostream& out, const std::string& text) {
+    out << text.size() << '\n' << text;
+}
+
+bool readBlock(std::istream& in, std::string& text) {
+    size_t size = 0;
+    if (!(in >> size) || in.get() != '\n') return false;
+    text.resize(size);
+    return static_cast<bool>(in.read(text.data(), static_cast<std::streamsize>(size)));
+}
+
+void writeList(std::ostream& out, const std::vector<std::string>& items) {
+    out << items.size() << '\n';
+    for (const auto& item : items) writeBlock(out, item);
+}
+
+bool readList(std::istream& in, std::vector<std::string>& items) {
+    size_t count = 0;
+    if (!(in >> count) || in.get() != '\n') return false;
+    items.assign(count, std::string());
+    for (auto& item : items) {
+        if (!readBlock(in, item)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+GenerationCache::GenerationCache(std::string directory) : directory_(std::move(directory)) {}
+
+std::string GenerationCache::makeKey(const std::string& grammar_text, const GeneratorOptions& options,
+                                     const std::string& extra) {
+    std::string key;
+    addField(key, "version", std::string(version::FULL_VERSION));
+    addField(key, "build_date", std::string(version::BUILD_DATE));
+    key += describeOptions(options);
+    addField(key, "extra", extra);
+    addField(key, "grammar", grammar_text);
+    return key;
+}
+
+std::string GenerationCache::entryPath(const std::string& key) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hashKey(key) << ".gen";
+    return (std::filesystem::path(directory_) / name.str()).string();
+}
+
+std::optional<GeneratedCode> GenerationCache::load(const std::string& key) const try {
+    std::ifstream in(entryPath(key), std::ios::binary);
+    if (!in) return std::nullopt;
+
+    std::string header(sizeof(kEntryHeader) - 1, '\0');
+    std::string stored_key;
+    if (!in.read(header.data(), static_cast<std::streamsize>(header.size())) || header != kEntryHeader ||
+        !readBlock(in, stored_key) || stored_key != key) {
+        return std::nullopt;
+    }
+
+    GeneratedCode code;
+    std::vector<std::string> additional;
+    if (!readBlock(in, code.parser_filename) || !readBlock(in, code.parser_code) ||
+        !readBlock(in, code.main_filename) || !readBlock(in, code.main_code) ||
+        !readList(in, additional) || additional.size() % 2 != 0 ||
+        !readList(in, code.messages) || !readList(in, code.warnings)) {
+        return std::nullopt;
+    }
+    for (size_t i = 0; i < additional.size(); i += 2) {
+        code.additional_files.emplace_back(std::move(additional[i]), std::move(additional[i + 1]));
+    }
+    return code;
+} catch (const std::exception&) {
+    // Повреждённая длина блока в записи - та же ошибка, что и отсутствие записи
+    return std::nullopt;
+}
+
+bool GenerationCache::store(const std::string& key, const GeneratedCode& code) const {
+    namespace fs = std::filesystem;
+    if (!code.success) return false;
+
+    std::error_code ec;
+    fs::create_directories(directory_, ec);
+    if (ec) return false;
+
+    const std::string path = entryPath(key);
+    std::random_device random;
+    const std::string temp_path = path + ".tmp" + std::to_string(random());
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        out << kEntryHeader;
+        writeBlock(out, key);
+        writeBlock(out, code.parser_filename);
+        writeBlock(out, code.parser_code);
+        writeBlock(out, code.main_filename);
+        writeBlock(out, code.main_code);
+        std::vector<std::string> additional;
+        for (const auto& [filename, content] : code.additional_files) {
+            additional.push_back(filename);
+            additional.push_back(content);
+        }
+        writeList(out, additional);
+        writeList(out, code.messages);
+        writeList(out, code.warnings);
+        if (!out.flush()) {
+            out.close();
+            fs::remove(temp_path, ec);
+            return false;
+        }
+    }
+    fs::rename(temp_path, path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace bnf_parser_generator
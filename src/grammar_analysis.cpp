@@ -0,0 +1,474 @@
+#include "grammar_analysis.hpp"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+// Первый байт UTF-8 кодировки кодовой точки
+size_t leadByte(uint32_t cp) {
+    if (cp < 0x80) return cp;
+    if (cp < 0x800) return 0xC0 | (cp >> 6);
+    if (cp < 0x10000) return 0xE0 | (cp >> 12);
+    return 0xF0 | (cp >> 18);
+}
+
+// Байты, с которых может начинаться символ из диапазона [start, end]
+LookaheadSet charRangeFirst(uint32_t start, uint32_t end) {
+    LookaheadSet set;
+    if (start > end) return set;
+    // Ведущий байт монотонен по кодовой точке
+    for (size_t b = leadByte(start); b <= leadByte(end) && b < 256; ++b) {
+        set.set(b);
+    }
+    // Сгенерированный парсер читает байты 0x80-0xBF и 0xF8-0xFF как
+    // однобайтовые символы со значением самого байта
+    for (size_t b = 0x80; b < 256; ++b) {
+        bool raw = b < 0xC0 || b >= 0xF8;
+        if (raw && b >= start && b <= end) {
+            set.set(b);
+        }
+    }
+    return set;
+}
+
+std::string describeByte(size_t b) {
+    std::ostringstream ss;
+    if (b == '\'') {
+        ss << "'\\''";
+    } else if (b == '\\') {
+        ss << "'\\\\'";
+    } else if (b == '\n') {
+        ss << "'\\n'";
+    } else if (b == '\t') {
+        ss << "'\\t'";
+    } else if (b == '\r') {
+        ss << "'\\r'";
+    } else if (b >= 0x20 && b < 0x7F) {
+        ss << "'" << static_cast<char>(b) << "'";
+    } else {
+        ss << "0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << b;
+    }
+    return ss.str();
+}
+
+} // namespace
+
+GrammarAnalysis GrammarAnalysis::analyze(const Grammar& grammar) {
+    return analyze(grammar, Options{});
+}
+
+GrammarAnalysis GrammarAnalysis::analyze(const Grammar& grammar, const Options& options) {
+    return analyze(std::make_shared<const GrammarIR>(GrammarIR::lower(grammar)), options);
+}
+
+GrammarAnalysis GrammarAnalysis::analyze(std::shared_ptr<const GrammarIR> ir, const Options& options) {
+    GrammarAnalysis analysis;
+    analysis.options_ = options;
+    analysis.ir_ = std::move(ir);
+    const GrammarIR& g = *analysis.ir_;
+
+    // Повторное определение правила не создаёт новой записи
+    analysis.rules_.resize(g.ruleNameCount());
+    for (size_t name = 0; name < g.ruleNameCount(); ++name) {
+        analysis.rules_[name].name = g.symbols().name(static_cast<SymbolId>(name));
+    }
+    analysis.node_info_.resize(g.nodeCount());
+
+    // Определения каждого имени и правила, ссылающиеся на имя
+    std::vector<std::vector<RuleId>> definitions(g.ruleNameCount());
+    std::vector<std::vector<RuleId>> users(g.ruleNameCount());
+    for (RuleId rule = 0; rule < g.rules().size(); ++rule) {
+        definitions[g.rule(rule).name].push_back(rule);
+        for (NodeId node = g.rule(rule).body; node < g.bodyEnd(rule); ++node) {
+            const IRNode& n = g.node(node);
+            if (n.kind == NodeKind::NON_TERMINAL && n.rule != NO_ID) {
+                std::vector<RuleId>& list = users[n.symbol];
+                if (list.empty() || list.back() != rule) list.push_back(rule);
+            }
+        }
+    }
+
+    // nullable и FIRST: оба множества только растут, поэтому достаточно
+    // пересчитывать правила, ссылающиеся на изменившееся
+    std::vector<RuleId> queue;
+    std::vector<bool> queued(g.rules().size(), true);
+    for (RuleId rule = static_cast<RuleId>(g.rules().size()); rule-- > 0;) {
+        queue.push_back(rule);
+    }
+    while (!queue.empty()) {
+        RuleId rule = queue.back();
+        queue.pop_back();
+        queued[rule] = false;
+        if (!analysis.computeRule(rule)) continue;
+        for (RuleId user : users[g.rule(rule).name]) {
+            if (!queued[user]) {
+                queued[user] = true;
+                queue.push_back(user);
+            }
+        }
+    }
+    // Узлы правил, не пересчитанных после последнего изменения, уже актуальны:
+    // изменение поставило бы правило в очередь
+
+    // FOLLOW: после стартового символа идёт конец входа. Правило обходится
+    // заново, когда растёт его FOLLOW
+    if (g.startRule() != NO_ID) {
+        analysis.rules_[g.rule(g.startRule()).name].follow.set(END_OF_INPUT);
+    }
+    std::fill(queued.begin(), queued.end(), true);
+    for (RuleId rule = static_cast<RuleId>(g.rules().size()); rule-- > 0;) {
+        queue.push_back(rule);
+    }
+    std::vector<size_t> grown;
+    while (!queue.empty()) {
+        RuleId rule = queue.back();
+        queue.pop_back();
+        queued[rule] = false;
+        LookaheadSet follow = analysis.rules_[g.rule(rule).name].follow;
+        grown.clear();
+        analysis.computeFollow(g.rule(rule).body, follow, grown);
+        for (size_t name : grown) {
+            for (RuleId definition : definitions[name]) {
+                if (!queued[definition]) {
+                    queued[definition] = true;
+                    queue.push_back(definition);
+                }
+            }
+        }
+    }
+
+    // LL(1): каждое решение парсера определяется одним байтом предпросмотра
+    for (RuleId rule = 0; rule < g.rules().size(); ++rule) {
+        RuleAnalysis& info = analysis.rules_[g.rule(rule).name];
+        analysis.checkLL1(g.rule(rule).body, info.follow, info);
+    }
+    for (RuleAnalysis& info : analysis.rules_) {
+        // Одинаковые конфликты в разных местах правила сообщаем один раз
+        std::vector<std::string> unique;
+        for (const auto& conflict : info.conflicts) {
+            if (std::find(unique.begin(), unique.end(), conflict) == unique.end()) {
+                unique.push_back(conflict);
+            }
+        }
+        info.conflicts = std::move(unique);
+        info.isLL1 = info.conflicts.empty();
+    }
+
+    return analysis;
+}
+
+const RuleAnalysis* GrammarAnalysis::findRule(const std::string& name) const {
+    RuleId rule = ir_ ? ir_->findRule(name) : NO_ID;
+    return rule != NO_ID ? &rules_[ir_->rule(rule).name] : nullptr;
+}
+
+bool GrammarAnalysis::isNullable(const ASTNode* node) const {
+    NodeId id = ir_ ? ir_->find(node) : NO_ID;
+    return id != NO_ID ? node_info_[id].nullable : true;
+}
+
+LookaheadSet GrammarAnalysis::first(const ASTNode* node) const {
+    NodeId id = ir_ ? ir_->find(node) : NO_ID;
+    return id != NO_ID ? node_info_[id].first : LookaheadSet().set();
+}
+
+std::vector<std::string> GrammarAnalysis::ll1Rules() const {
+    std::vector<std::string> result;
+    for (const auto& rule : rules_) {
+        if (rule.isLL1) result.push_back(rule.name);
+    }
+    return result;
+}
+
+std::vector<std::string> GrammarAnalysis::nonLL1Rules() const {
+    std::vector<std::string> result;
+    for (const auto& rule : rules_) {
+        if (!rule.isLL1) result.push_back(rule.name);
+    }
+    return result;
+}
+
+std::string GrammarAnalysis::describe(const LookaheadSet& set) {
+    std::ostringstream ss;
+    ss << "{";
+    bool first_item = true;
+    for (size_t b = 0; b < 256; ++b) {
+        if (!set.test(b)) continue;
+        // Сворачиваем подряд идущие байты в диапазон
+        size_t end = b;
+        while (end + 1 < 256 && set.test(end + 1)) ++end;
+        if (!first_item) ss << ", ";
+        first_item = false;
+        ss << describeByte(b);
+        if (end > b) ss << "-" << describeByte(end);
+        b = end;
+    }
+    if (set.test(END_OF_INPUT)) {
+        if (!first_item) ss << ", ";
+        ss << "EOF";
+    }
+    ss << "}";
+    return ss.str();
+}
+
+bool GrammarAnalysis::computeRule(RuleId rule) {
+    const GrammarIR& g = *ir_;
+    // Дети имеют большие id, чем родитель: обход с конца видит их готовыми
+    for (NodeId node = g.bodyEnd(rule); node-- > g.rule(rule).body;) {
+        node_info_[node] = computeNode(node);
+    }
+    RuleAnalysis& info = rules_[g.rule(rule).name];
+    const NodeInfo& computed = node_info_[g.rule(rule).body];
+    LookaheadSet first = info.first | computed.first;
+    bool nullable = info.nullable || computed.nullable;
+    if (first == info.first && nullable == info.nullable) {
+        return false;
+    }
+    info.first = first;
+    info.nullable = nullable;
+    return true;
+}
+
+GrammarAnalysis::NodeInfo GrammarAnalysis::computeNode(NodeId id) const {
+    const GrammarIR& g = *ir_;
+    const IRNode& node = g.node(id);
+    NodeInfo info;
+    switch (node.kind) {
+        case NodeKind::TERMINAL: {
+            const std::string& value = g.literals().name(node.symbol);
+            if (value.empty()) {
+                info.nullable = true;
+            } else {
+                info.first.set(static_cast<unsigned char>(value[0]));
+                info.first |= options_.skippedBeforeTokens;
+            }
+            break;
+        }
+        case NodeKind::CHAR_RANGE:
+            info.first = charRangeFirst(node.range_start, node.range_end);
+            if (info.first.any()) {
+                info.first |= options_.skippedBeforeTokens;
+            }
+            break;
+        case NodeKind::NON_TERMINAL:
+            if (node.rule != NO_ID) {
+                info.nullable = rules_[node.symbol].nullable;
+                info.first = rules_[node.symbol].first;
+            }
+            break;
+        case NodeKind::ALTERNATIVE:
+            for (const NodeId* c = g.childrenBegin(id); c != g.childrenEnd(id); ++c) {
+                info.first |= node_info_[*c].first;
+                info.nullable = info.nullable || node_info_[*c].nullable;
+            }
+            break;
+        case NodeKind::SEQUENCE:
+            info.nullable = true;
+            for (const NodeId* e = g.childrenBegin(id); e != g.childrenEnd(id); ++e) {
+                info.first |= node_info_[*e].first;
+                if (!node_info_[*e].nullable) {
+                    info.nullable = false;
+                    break;
+                }
+            }
+            break;
+        case NodeKind::GROUP:
+        case NodeKind::ONE_OR_MORE:
+            info = node_info_[g.child(id)];
+            break;
+        case NodeKind::OPTIONAL:
+        case NodeKind::ZERO_OR_MORE:
+            info = node_info_[g.child(id)];
+            info.nullable = true;
+            break;
+        case NodeKind::CONTEXT_ACTION:
+        case NodeKind::CUT:
+            // Контекстные действия и отсечение не потребляют вход
+            info.nullable = true;
+            break;
+    }
+    return info;
+}
+
+void GrammarAnalysis::computeFollow(NodeId id, const LookaheadSet& follow, std::vector<size_t>& grown) {
+    const GrammarIR& g = *ir_;
+    const IRNode& node = g.node(id);
+    switch (node.kind) {
+        case NodeKind::NON_TERMINAL:
+            if (node.rule != NO_ID) {
+                LookaheadSet& target = rules_[node.symbol].follow;
+                LookaheadSet merged = target | follow;
+                if (merged != target) {
+                    target = merged;
+                    grown.push_back(node.symbol);
+                }
+            }
+            break;
+        case NodeKind::ALTERNATIVE:
+            for (const NodeId* c = g.childrenBegin(id); c != g.childrenEnd(id); ++c) {
+                computeFollow(*c, follow, grown);
+            }
+            break;
+        case NodeKind::SEQUENCE: {
+            // Идём с конца: за элементом следует FIRST хвоста (и FOLLOW, если хвост может быть пуст)
+            LookaheadSet trailing = follow;
+            for (const NodeId* e = g.childrenEnd(id); e-- != g.childrenBegin(id);) {
+                computeFollow(*e, trailing, grown);
+                trailing = isNullable(*e) ? (first(*e) | trailing) : first(*e);
+            }
+            break;
+        }
+        case NodeKind::GROUP:
+        case NodeKind::OPTIONAL:
+            computeFollow(g.child(id), follow, grown);
+            break;
+        case NodeKind::ZERO_OR_MORE:
+        case NodeKind::ONE_OR_MORE:
+            computeFollow(g.child(id), follow | first(g.child(id)), grown);
+            break;
+        default:
+            break;
+    }
+}
+
+void GrammarAnalysis::checkLL1(NodeId id, const LookaheadSet& follow, RuleAnalysis& rule) const {
+    const GrammarIR& g = *ir_;
+    // Решение "входить ли в повторение/опцию" конфликтует с тем, что идёт после
+    auto checkRepetition = [&](NodeId content, const char* kind) {
+        if (isNullable(content)) {
+            rule.conflicts.push_back(std::string(kind) + " body can match empty input");
+        }
+        LookaheadSet overlap = first(content) & follow;
+        if (overlap.any()) {
+            rule.conflicts.push_back(std::string(kind) + " body and what follows both start with " +
+                                     describe(overlap));
+        }
+    };
+
+    switch (g.node(id).kind) {
+        case NodeKind::ALTERNATIVE: {
+            std::vector<LookaheadSet> predict;
+            for (const NodeId* c = g.childrenBegin(id); c != g.childrenEnd(id); ++c) {
+                LookaheadSet p = first(*c);
+                if (isNullable(*c)) p |= follow;
+                predict.push_back(p);
+            }
+            for (size_t i = 0; i < predict.size(); ++i) {
+                for (size_t j = i + 1; j < predict.size(); ++j) {
+                    LookaheadSet overlap = predict[i] & predict[j];
+                    if (overlap.any()) {
+                        rule.conflicts.push_back("alternatives " + std::to_string(i + 1) + " and " +
+                                                 std::to_string(j + 1) + " both start with " + describe(overlap));
+                    }
+                }
+                checkLL1(g.child(id, i), follow, rule);
+            }
+            break;
+        }
+        case NodeKind::SEQUENCE: {
+            size_t count = g.node(id).child_count;
+            LookaheadSet trailing = follow;
+            std::vector<LookaheadSet> follows(count);
+            for (size_t i = count; i-- > 0;) {
+                NodeId element = g.child(id, i);
+                follows[i] = trailing;
+                trailing = isNullable(element) ? (first(element) | trailing) : first(element);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                checkLL1(g.child(id, i), follows[i], rule);
+            }
+            break;
+        }
+        case NodeKind::GROUP:
+            checkLL1(g.child(id), follow, rule);
+            break;
+        case NodeKind::OPTIONAL:
+            checkRepetition(g.child(id), "optional");
+            checkLL1(g.child(id), follow, rule);
+            break;
+        case NodeKind::ZERO_OR_MORE:
+        case NodeKind::ONE_OR_MORE:
+            checkRepetition(g.child(id), "repetition");
+            checkLL1(g.child(id), follow | first(g.child(id)), rule);
+            break;
+        default:
+            break;
+    }
+}
+
+// Правила-токены
+
+namespace {
+
+// Имя правила-токена по соглашению: есть буквы, все в верхнем регистре (NUMBER, LEFT_BRACE)
+bool isUpperCaseName(const std::string& name) {
+    bool has_letter = false;
+    for (char c : name) {
+        if (c >= 'a' && c <= 'z') return false;
+        if (c >= 'A' && c <= 'Z') has_letter = true;
+    }
+    return has_letter;
+}
+
+void collectReferences(const ASTNode* node, std::vector<std::string>& names) {
+    if (const auto* nt = node_cast<NonTerminal>(node)) {
+        names.push_back(nt->name);
+    }
+    forEachChild(node, [&](const ASTNode* child) { collectReferences(child, names); });
+}
+
+} // namespace
+
+std::string findWhitespaceRule(const Grammar& grammar, const std::string& requested) {
+    if (!requested.empty()) {
+        return requested;
+    }
+    for (const char* candidate : {"WHITESPACE", "TRIVIA"}) {
+        if (grammar.findRule(candidate)) {
+            return candidate;
+        }
+    }
+    return "";
+}
+
+std::unordered_set<std::string> findLexicalRules(const Grammar& grammar, const std::string& whitespace_rule,
+                                                 const std::vector<std::string>& token_rules) {
+    std::unordered_set<std::string> lexical;
+    if (whitespace_rule.empty()) {
+        return lexical;
+    }
+    
+    // Синтаксические правила достижимы из стартового, не проходя через токены;
+    // все остальные разбираются как токены, без пропуска пробелов внутри
+    auto isToken = [&](const std::string& rule_name) {
+        return rule_name == whitespace_rule || isUpperCaseName(rule_name) ||
+               std::find(token_rules.begin(), token_rules.end(), rule_name) != token_rules.end();
+    };
+    std::unordered_set<std::string> syntactic;
+    std::vector<std::string> pending = {grammar.startSymbol};
+    while (!pending.empty()) {
+        std::string current = pending.back();
+        pending.pop_back();
+        if (!syntactic.insert(current).second) continue;
+        const ProductionRule* rule = grammar.findRule(current);
+        if (!rule) continue;
+        std::vector<std::string> refs;
+        collectReferences(rule->rightSide.get(), refs);
+        for (const auto& ref : refs) {
+            if (!isToken(ref) && !syntactic.count(ref)) {
+                pending.push_back(ref);
+            }
+        }
+    }
+    for (const auto& rule : grammar.rules) {
+        if (!syntactic.count(rule->leftSide)) {
+            lexical.insert(rule->leftSide);
+        }
+    }
+    return lexical;
+}
+
+} // namespace bnf_parser_generator
@@ -0,0 +1,263 @@
+#include "bnf_parser.hpp"
+#include <stdexcept>
+#include <unordered_map>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+// Формат: сигнатура, таблица строк, стартовый символ, правила. Числа - varint
+// (по 7 бит, старший бит - продолжение), строки - индексы в таблице строк.
+// Узел - байт NodeKind и данные вида; дети следуют за родителем
+const char kMagic[] = {'\0', 'B', 'N', 'F', 'G', '\1'};
+constexpr size_t kMagicSize = sizeof(kMagic);
+
+// Ограничение вложенности узлов при чтении: повреждённые данные не должны
+// исчерпать стек
+constexpr size_t kMaxDepth = 4096;
+
+class BinaryWriter {
+public:
+    std::string finish(const Grammar& grammar) {
+        // Таблица строк собирается первым проходом, чтобы идти перед правилами
+        intern(grammar.startSymbol);
+        for (const auto& rule : grammar.rules) {
+            writeRule(*rule);
+        }
+        std::string out(kMagic, kMagicSize);
+        writeVarint(out, strings_.size());
+        for (const auto& text : strings_) {
+            writeVarint(out, text.size());
+            out += text;
+        }
+        writeVarint(out, intern(grammar.startSymbol));
+        writeVarint(out, grammar.rules.size());
+        return out + body_;
+    }
+
+private:
+    std::vector<std::string> strings_;
+    std::unordered_map<std::string, size_t> string_index_;
+    std::string body_;
+
+    static void writeVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    size_t intern(const std::string& text) {
+        auto [it, inserted] = string_index_.emplace(text, strings_.size());
+        if (inserted) strings_.push_back(text);
+        return it->second;
+    }
+
+    void writeString(const std::string& text) { writeVarint(body_, intern(text)); }
+
+    void writeStrings(const std::vector<std::string>& texts) {
+        writeVarint(body_, texts.size());
+        for (const auto& text : texts) writeString(text);
+    }
+
+    void writeRule(const ProductionRule& rule) {
+        writeString(rule.leftSide);
+        writeVarint(body_, rule.parameters.size());
+        for (const auto& param : rule.parameters) {
+            writeString(param.name);
+            body_ += static_cast<char>(param.type);
+            writeStrings(param.enumValues);
+            writeString(param.defaultValue);
+        }
+        writeNode(rule.rightSide.get());
+    }
+
+    void writeNode(const ASTNode* node) {
+        body_ += static_cast<char>(node->kind());
+        switch (node->kind()) {
+            case NodeKind::TERMINAL:
+                writeString(static_cast<const Terminal*>(node)->value);
+                return;
+            case NodeKind::NON_TERMINAL: {
+                const auto* nt = static_cast<const NonTerminal*>(node);
+                writeString(nt->name);
+                writeStrings(nt->parameterValues);
+                return;
+            }
+            case NodeKind::CHAR_RANGE: {
+                const auto* range = static_cast<const CharRange*>(node);
+                writeVarint(body_, range->start);
+                writeVarint(body_, range->end);
+                return;
+            }
+            case NodeKind::ALTERNATIVE:
+                writeVarint(body_, static_cast<const Alternative*>(node)->choices.size());
+                break;
+            case NodeKind::SEQUENCE:
+                writeVarint(body_, static_cast<const Sequence*>(node)->elements.size());
+                break;
+            case NodeKind::CONTEXT_ACTION: {
+                const auto* action = static_cast<const ContextAction*>(node);
+                body_ += static_cast<char>(action->actionType);
+                writeStrings(action->arguments);
+                return;
+            }
+            default:
+                break;
+        }
+        forEachChild(node, [this](const ASTNode* child) { writeNode(child); });
+    }
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(const std::string& data) : data_(data), pos_(kMagicSize) {}
+
+    std::unique_ptr<Grammar> read() {
+        const uint64_t string_count = readCount();
+        strings_.reserve(string_count);
+        for (uint64_t i = 0; i < string_count; ++i) {
+            const uint64_t size = readCount();
+            strings_.push_back(data_.substr(pos_, size));
+            pos_ += size;
+        }
+
+        auto grammar = std::make_unique<Grammar>();
+        grammar->startSymbol = readString();
+        const uint64_t rule_count = readCount();
+        grammar->rules.reserve(rule_count);
+        for (uint64_t i = 0; i < rule_count; ++i) {
+            std::string name = readString();
+            std::vector<RuleParameter> parameters;
+            const uint64_t param_count = readCount();
+            for (uint64_t j = 0; j < param_count; ++j) {
+                std::string param_name = readString();
+                const uint8_t type = readByte();
+                if (type > static_cast<uint8_t>(ParameterType::BOOLEAN)) fail("unknown parameter type");
+                RuleParameter param(param_name, static_cast<ParameterType>(type));
+                param.enumValues = readStrings();
+                param.defaultValue = readString();
+                parameters.push_back(std::move(param));
+            }
+            grammar->addRule(std::make_unique<ProductionRule>(name, parameters, readNode(0)));
+        }
+        if (pos_ != data_.size()) fail("trailing data");
+        return grammar;
+    }
+
+private:
+    const std::string& data_;
+    size_t pos_;
+    std::vector<std::string> strings_;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("Invalid binary grammar at byte " + std::to_string(pos_) + ": " + message);
+    }
+
+    uint8_t readByte() {
+        if (pos_ >= data_.size()) fail("unexpected end of data");
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint64_t readVarint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = readByte();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return value;
+        }
+        fail("malformed number");
+    }
+
+    // Число элементов: каждый занимает хотя бы байт, больше оставшихся данных не бывает
+    uint64_t readCount() {
+        const uint64_t count = readVarint();
+        if (count > data_.size() - pos_) fail("count exceeds data size");
+        return count;
+    }
+
+    std::string readString() {
+        const uint64_t index = readVarint();
+        if (index >= strings_.size()) fail("string index out of range");
+        return strings_[index];
+    }
+
+    std::vector<std::string> readStrings() {
+        std::vector<std::string> texts(readCount());
+        for (auto& text : texts) text = readString();
+        return texts;
+    }
+
+    std::unique_ptr<ASTNode> readNode(size_t depth) {
+        if (depth > kMaxDepth) fail("nesting too deep");
+        const uint8_t kind = readByte();
+        switch (static_cast<NodeKind>(kind)) {
+            case NodeKind::TERMINAL:
+                return std::make_unique<Terminal>(readString());
+            case NodeKind::NON_TERMINAL: {
+                std::string name = readString();
+                return std::make_unique<NonTerminal>(name, readStrings());
+            }
+            case NodeKind::CHAR_RANGE: {
+                const uint64_t start = readVarint();
+                const uint64_t end = readVarint();
+                if (start > 0x10FFFF || end > 0x10FFFF) fail("code point out of range");
+                return std::make_unique<CharRange>(static_cast<uint32_t>(start), static_cast<uint32_t>(end));
+            }
+            case NodeKind::ALTERNATIVE: {
+                auto alternative = std::make_unique<Alternative>();
+                const uint64_t count = readCount();
+                for (uint64_t i = 0; i < count; ++i) alternative->addChoice(readNode(depth + 1));
+                return alternative;
+            }
+            case NodeKind::SEQUENCE: {
+                auto sequence = std::make_unique<Sequence>();
+                const uint64_t count = readCount();
+                for (uint64_t i = 0; i < count; ++i) sequence->addElement(readNode(depth + 1));
+                return sequence;
+            }
+            case NodeKind::GROUP:
+                return std::make_unique<Group>(readNode(depth + 1));
+            case NodeKind::OPTIONAL:
+                return std::make_unique<Optional>(readNode(depth + 1));
+            case NodeKind::ZERO_OR_MORE:
+                return std::make_unique<ZeroOrMore>(readNode(depth + 1));
+            case NodeKind::ONE_OR_MORE:
+                return std::make_unique<OneOrMore>(readNode(depth + 1));
+            case NodeKind::CONTEXT_ACTION: {
+                const uint8_t type = readByte();
+                if (type > static_cast<uint8_t>(ContextAction::ActionType::CHECK)) fail("unknown context action");
+                auto action_type = static_cast<ContextAction::ActionType>(type);
+                auto arguments = readStrings();
+                // toString() обращается к аргументам по индексу
+                if (arguments.size() < (action_type == ContextAction::ActionType::STORE ? 2u : 1u)) {
+                    fail("missing context action arguments");
+                }
+                return std::make_unique<ContextAction>(action_type, arguments);
+            }
+            case NodeKind::CUT:
+                return std::make_unique<Cut>();
+        }
+        fail("unknown node kind " + std::to_string(kind));
+    }
+};
+
+} // namespace
+
+std::string BNFGrammarFactory::toBinary(const Grammar& grammar) {
+    return BinaryWriter().finish(grammar);
+}
+
+bool BNFGrammarFactory::isBinary(const std::string& data) {
+    return data.size() >= kMagicSize && data.compare(0, kMagicSize, kMagic, kMagicSize) == 0;
+}
+
+std::unique_ptr<Grammar> BNFGrammarFactory::fromBinary(const std::string& data) {
+    if (!isBinary(data)) {
+        throw std::runtime_error("Invalid binary grammar: missing signature");
+    }
+    return BinaryReader(data).read();
+}
+
+} // namespace bnf_parser_generator
@@ -0,0 +1,171 @@
+#include "grammar_ir.hpp"
+#include <algorithm>
+
+namespace bnf_parser_generator {
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    auto it = index_.find(name);
+    if (it != index_.end()) {
+        return it->second;
+    }
+    SymbolId id = static_cast<SymbolId>(names_.size());
+    names_.emplace_back(name);
+    index_.emplace(names_.back(), id);
+    return id;
+}
+
+SymbolId SymbolTable::find(std::string_view name) const {
+    auto it = index_.find(name);
+    return it != index_.end() ? it->second : NO_ID;
+}
+
+GrammarIR GrammarIR::lower(const Grammar& grammar) {
+    GrammarIR ir;
+
+    // Имена правил интернируются первыми: имя с id за пределами definitions_
+    // встречается только в ссылках и правила не имеет
+    ir.rules_.reserve(grammar.rules.size());
+    for (const auto& rule : grammar.rules) {
+        SymbolId name = ir.symbols_.intern(rule->leftSide);
+        if (name == ir.definitions_.size()) {
+            ir.definitions_.push_back(static_cast<RuleId>(ir.rules_.size()));
+        }
+        ir.rules_.push_back(IRRule{name, NO_ID, rule.get()});
+    }
+    ir.rule_names_ = ir.definitions_.size();
+    
+    // Размеры известны заранее: массивы и индекс узлов не перестраиваются
+    size_t node_count = 0;
+    std::vector<const ASTNode*> pending;
+    for (const auto& rule : grammar.rules) {
+        pending.push_back(rule->rightSide.get());
+        while (!pending.empty()) {
+            const ASTNode* node = pending.back();
+            pending.pop_back();
+            ++node_count;
+            forEachChild(node, [&](const ASTNode* child) { pending.push_back(child); });
+        }
+    }
+    ir.nodes_.reserve(node_count);
+    ir.sources_.reserve(node_count);
+    ir.children_.reserve(node_count);
+    ir.node_index_.reserve(node_count);
+    for (size_t i = 0; i < grammar.rules.size(); ++i) {
+        ir.rules_[i].body = ir.lowerNode(grammar.rules[i]->rightSide.get());
+    }
+    ir.definitions_.resize(ir.symbols_.size(), NO_ID);
+    ir.start_rule_ = ir.findRule(grammar.startSymbol);
+    return ir;
+}
+
+RuleId GrammarIR::findRule(std::string_view name) const {
+    SymbolId symbol = symbols_.find(name);
+    return symbol != NO_ID ? definitions_[symbol] : NO_ID;
+}
+
+NodeId GrammarIR::find(const ASTNode* node) const {
+    auto it = node_index_.find(node);
+    return it != node_index_.end() ? it->second : NO_ID;
+}
+
+std::vector<uint32_t> GrammarIR::ruleComponents() const {
+    // Рёбра: имя правила -> имена правил, на которые ссылаются его определения
+    std::vector<std::vector<SymbolId>> edges(rule_names_);
+    for (RuleId rule = 0; rule < rules_.size(); ++rule) {
+        for (NodeId node = rules_[rule].body; node < bodyEnd(rule); ++node) {
+            if (nodes_[node].kind == NodeKind::NON_TERMINAL && nodes_[node].rule != NO_ID) {
+                edges[rules_[rule].name].push_back(nodes_[node].symbol);
+            }
+        }
+    }
+
+    // Алгоритм Тарьяна на явном стеке: длинная цепочка правил не переполнит стек
+    std::vector<uint32_t> component(rule_names_, NO_ID);
+    std::vector<uint32_t> index(rule_names_, NO_ID);
+    std::vector<uint32_t> low(rule_names_, 0);
+    std::vector<SymbolId> open;                       // Вершины без компоненты
+    std::vector<std::pair<SymbolId, size_t>> calls;   // Вершина и следующее ребро
+    uint32_t next_index = 0;
+    uint32_t next_component = 0;
+    auto visit = [&](SymbolId name) {
+        index[name] = low[name] = next_index++;
+        open.push_back(name);
+        calls.emplace_back(name, 0);
+    };
+    for (SymbolId root = 0; root < rule_names_; ++root) {
+        if (index[root] != NO_ID) continue;
+        visit(root);
+        while (!calls.empty()) {
+            SymbolId name = calls.back().first;
+            size_t& edge = calls.back().second;
+            if (edge < edges[name].size()) {
+                SymbolId target = edges[name][edge++];
+                if (index[target] == NO_ID) {
+                    visit(target);
+                } else if (component[target] == NO_ID) {
+                    low[name] = std::min(low[name], index[target]);
+                }
+                continue;
+            }
+            calls.pop_back();
+            if (low[name] == index[name]) {
+                SymbolId member;
+                do {
+                    member = open.back();
+                    open.pop_back();
+                    component[member] = next_component;
+                } while (member != name);
+                ++next_component;
+            }
+            if (!calls.empty()) {
+                SymbolId caller = calls.back().first;
+                low[caller] = std::min(low[caller], low[name]);
+            }
+        }
+    }
+    return component;
+}
+
+NodeId GrammarIR::lowerNode(const ASTNode* node) {
+    NodeId id = static_cast<NodeId>(nodes_.size());
+    nodes_.push_back(IRNode{node->kind()});
+    sources_.push_back(node);
+    node_index_.emplace(node, id);
+
+    switch (node->kind()) {
+        case NodeKind::TERMINAL:
+            nodes_[id].symbol = literals_.intern(static_cast<const Terminal*>(node)->value);
+            break;
+        case NodeKind::NON_TERMINAL: {
+            SymbolId name = symbols_.intern(static_cast<const NonTerminal*>(node)->name);
+            nodes_[id].symbol = name;
+            nodes_[id].rule = name < definitions_.size() ? definitions_[name] : NO_ID;
+            break;
+        }
+        case NodeKind::CHAR_RANGE: {
+            const auto* range = static_cast<const CharRange*>(node);
+            nodes_[id].range_start = range->start;
+            nodes_[id].range_end = range->end;
+            break;
+        }
+        default:
+            break;
+    }
+
+    // Отрезок детей в children_ занимается до обхода поддеревьев, которые
+    // добавляют свои отрезки после него
+    uint32_t count = 0;
+    forEachChild(node, [&](const ASTNode*) { ++count; });
+    const uint32_t begin = static_cast<uint32_t>(children_.size());
+    nodes_[id].child_begin = begin;
+    nodes_[id].child_count = count;
+    children_.resize(begin + count);
+    uint32_t index = 0;
+    forEachChild(node, [&](const ASTNode* child) {
+        NodeId lowered = lowerNode(child);
+        children_[begin + index++] = lowered;
+    });
+    return id;
+}
+
+} // namespace bnf_parser_generator
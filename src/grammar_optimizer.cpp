@@ -0,0 +1,1051 @@
+#include "grammar_optimizer.hpp"
+#include "grammar_analysis.hpp"
+#include "grammar_ir.hpp"
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+std::unique_ptr<ASTNode> clone(const ASTNode* node) {
+    switch (node->kind()) {
+        case NodeKind::TERMINAL:
+            return std::make_unique<Terminal>(static_cast<const Terminal*>(node)->value);
+        case NodeKind::NON_TERMINAL: {
+            const auto* nt = static_cast<const NonTerminal*>(node);
+            return std::make_unique<NonTerminal>(nt->name, nt->parameterValues);
+        }
+        case NodeKind::CHAR_RANGE: {
+            const auto* range = static_cast<const CharRange*>(node);
+            return std::make_unique<CharRange>(range->start, range->end);
+        }
+        case NodeKind::ALTERNATIVE: {
+            auto alt = std::make_unique<Alternative>();
+            for (const auto& choice : static_cast<const Alternative*>(node)->choices) {
+                alt->addChoice(clone(choice.get()));
+            }
+            return alt;
+        }
+        case NodeKind::SEQUENCE: {
+            auto seq = std::make_unique<Sequence>();
+            for (const auto& element : static_cast<const Sequence*>(node)->elements) {
+                seq->addElement(clone(element.get()));
+            }
+            return seq;
+        }
+        case NodeKind::GROUP:
+            return std::make_unique<Group>(clone(static_cast<const Group*>(node)->content.get()));
+        case NodeKind::OPTIONAL:
+            return std::make_unique<Optional>(clone(static_cast<const Optional*>(node)->content.get()));
+        case NodeKind::ZERO_OR_MORE:
+            return std::make_unique<ZeroOrMore>(clone(static_cast<const ZeroOrMore*>(node)->content.get()));
+        case NodeKind::ONE_OR_MORE:
+            return std::make_unique<OneOrMore>(clone(static_cast<const OneOrMore*>(node)->content.get()));
+        case NodeKind::CONTEXT_ACTION: {
+            const auto* action = static_cast<const ContextAction*>(node);
+            return std::make_unique<ContextAction>(action->actionType, action->arguments);
+        }
+        case NodeKind::CUT:
+            return std::make_unique<Cut>();
+    }
+    return nullptr;
+}
+
+// Как forEachChild, но с изменяемой ссылкой на владеющий указатель ребёнка
+template<typename F>
+void forEachSlot(ASTNode* node, F&& f) {
+    switch (node->kind()) {
+        case NodeKind::ALTERNATIVE:
+            for (auto& choice : static_cast<Alternative*>(node)->choices) f(choice);
+            break;
+        case NodeKind::SEQUENCE:
+            for (auto& element : static_cast<Sequence*>(node)->elements) f(element);
+            break;
+        case NodeKind::GROUP:
+            f(static_cast<Group*>(node)->content);
+            break;
+        case NodeKind::OPTIONAL:
+            f(static_cast<Optional*>(node)->content);
+            break;
+        case NodeKind::ZERO_OR_MORE:
+            f(static_cast<ZeroOrMore*>(node)->content);
+            break;
+        case NodeKind::ONE_OR_MORE:
+            f(static_cast<OneOrMore*>(node)->content);
+            break;
+        default:
+            break;
+    }
+}
+
+std::unique_ptr<ASTNode>& contentSlot(ASTNode* node) {
+    switch (node->kind()) {
+        case NodeKind::OPTIONAL:
+            return static_cast<Optional*>(node)->content;
+        case NodeKind::ZERO_OR_MORE:
+            return static_cast<ZeroOrMore*>(node)->content;
+        case NodeKind::ONE_OR_MORE:
+            return static_cast<OneOrMore*>(node)->content;
+        default:
+            return static_cast<Group*>(node)->content;
+    }
+}
+
+// Контекстные действия меняют состояние парсера: такие выражения не
+// раскрываются и не выносятся за скобки
+bool hasContextAction(const ASTNode* node) {
+    if (node->is<ContextAction>()) {
+        return true;
+    }
+    bool found = false;
+    forEachChild(node, [&](const ASTNode* child) { found = found || hasContextAction(child); });
+    return found;
+}
+
+// Отсечение действует до ближайшей альтернативы, [ ] или { } правила:
+// выражения с ним не раскрываются, не выносятся за скобки и не
+// сливаются с вложенными выборами и повторениями - это сдвинуло бы границу
+bool hasCut(const ASTNode* node) {
+    if (node->is<Cut>()) {
+        return true;
+    }
+    bool found = false;
+    forEachChild(node, [&](const ASTNode* child) { found = found || hasCut(child); });
+    return found;
+}
+
+// Правила - аргументы {store} и {lookup}: действие берёт текст их вызова,
+// поэтому вызов не раскрывается
+void addContextArguments(const ASTNode* node, std::unordered_set<std::string>& names) {
+    if (const auto* action = node->as<ContextAction>()) {
+        if (action->actionType != ContextAction::ActionType::CHECK) {
+            names.insert(action->arguments.begin(), action->arguments.end());
+        }
+        return;
+    }
+    forEachChild(node, [&](const ASTNode* child) { addContextArguments(child, names); });
+}
+
+size_t nodeCount(const ASTNode* node) {
+    size_t count = 1;
+    forEachChild(node, [&](const ASTNode* child) { count += nodeCount(child); });
+    return count;
+}
+
+bool sameNode(const ASTNode* a, const ASTNode* b) {
+    if (a->kind() != b->kind()) {
+        return false;
+    }
+    switch (a->kind()) {
+        case NodeKind::TERMINAL:
+            return static_cast<const Terminal*>(a)->value == static_cast<const Terminal*>(b)->value;
+        case NodeKind::NON_TERMINAL: {
+            const auto* x = static_cast<const NonTerminal*>(a);
+            const auto* y = static_cast<const NonTerminal*>(b);
+            return x->name == y->name && x->parameterValues == y->parameterValues;
+        }
+        case NodeKind::CHAR_RANGE: {
+            const auto* x = static_cast<const CharRange*>(a);
+            const auto* y = static_cast<const CharRange*>(b);
+            return x->start == y->start && x->end == y->end;
+        }
+        case NodeKind::CONTEXT_ACTION:
+        case NodeKind::CUT:
+            return false;
+        default:
+            break;
+    }
+    std::vector<const ASTNode*> left;
+    std::vector<const ASTNode*> right;
+    forEachChild(a, [&](const ASTNode* child) { left.push_back(child); });
+    forEachChild(b, [&](const ASTNode* child) { right.push_back(child); });
+    if (left.size() != right.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < left.size(); ++i) {
+        if (!sameNode(left[i], right[i])) return false;
+    }
+    return true;
+}
+
+// Группа влияет только на запись toString(): она нужна альтернативе внутри
+// последовательности и составному выражению под постфиксным +
+bool needsGroup(const ASTNode* node, NodeKind parent) {
+    bool composite = node->is<Alternative>() || node->is<Sequence>();
+    return (parent == NodeKind::SEQUENCE && node->is<Alternative>()) ||
+           (parent == NodeKind::ONE_OR_MORE && composite);
+}
+
+std::unique_ptr<ASTNode> wrap(std::unique_ptr<ASTNode> node, NodeKind parent) {
+    if (needsGroup(node.get(), parent)) {
+        return std::make_unique<Group>(std::move(node));
+    }
+    return node;
+}
+
+// Элементы выбора как последовательности: A B -> [A, B], A -> [A]
+const ASTNode* element(const ASTNode* choice, size_t index) {
+    if (const auto* seq = choice->as<Sequence>()) {
+        return index < seq->elements.size() ? seq->elements[index].get() : nullptr;
+    }
+    return index == 0 ? choice : nullptr;
+}
+
+std::vector<std::unique_ptr<ASTNode>> takeElements(std::unique_ptr<ASTNode> choice) {
+    if (auto* seq = choice->as<Sequence>()) {
+        return std::move(seq->elements);
+    }
+    std::vector<std::unique_ptr<ASTNode>> elements;
+    elements.push_back(std::move(choice));
+    return elements;
+}
+
+// Символ, который сопоставляется ровно одной кодовой точке: ASCII-терминал
+// из одного байта или непустой диапазон. Многобайтовые терминалы не
+// сливаются: диапазон читает байты неверного UTF-8 иначе, чем matchString
+bool charInterval(const ASTNode* node, uint32_t& start, uint32_t& end) {
+    if (const auto* t = node->as<Terminal>()) {
+        if (t->value.size() != 1 || static_cast<unsigned char>(t->value[0]) >= 0x80) {
+            return false;
+        }
+        start = end = static_cast<unsigned char>(t->value[0]);
+        return true;
+    }
+    if (const auto* range = node->as<CharRange>()) {
+        start = range->start;
+        end = range->end;
+        return start <= end;
+    }
+    return false;
+}
+
+class Optimizer {
+public:
+    Optimizer(Grammar& grammar, const OptimizerOptions& options, OptimizationReport& report)
+        : grammar_(grammar), options_(options), report_(report),
+          flattened_(grammar.rules.size(), 0) {
+        whitespace_rule_ = findWhitespaceRule(grammar, options.whitespace_rule);
+        lexical_ = findLexicalRules(grammar, whitespace_rule_, options.token_rules);
+        keep_ = std::unordered_set<std::string>(options.keep_rules.begin(), options.keep_rules.end());
+        keep_.insert(grammar.startSymbol);
+        if (!whitespace_rule_.empty()) {
+            keep_.insert(whitespace_rule_);
+        }
+        for (const auto& rule : grammar.rules) {
+            addContextArguments(rule->rightSide.get(), keep_);
+        }
+    }
+
+    void flattenRules() {
+        for (size_t i = 0; i < grammar_.rules.size(); ++i) {
+            size_t count = flatten(grammar_.rules[i]->rightSide, NodeKind::GROUP);
+            flattened_[i] += count;
+            report_.flattened += count;
+        }
+    }
+
+    void reportFlattened() {
+        for (size_t i = 0; i < grammar_.rules.size(); ++i) {
+            if (flattened_[i] > 0) {
+                report_.changes.push_back("flatten: " + std::to_string(flattened_[i]) + " nodes in " +
+                                          grammar_.rules[i]->leftSide);
+            }
+        }
+    }
+
+    void inlineRules();
+    void foldCharClasses();
+    void leftFactor();
+    void removeUnreachable();
+
+private:
+    Grammar& grammar_;
+    const OptimizerOptions& options_;
+    OptimizationReport& report_;
+    std::string whitespace_rule_;
+    std::unordered_set<std::string> lexical_;
+    std::unordered_set<std::string> keep_;
+    std::vector<size_t> flattened_;  // По индексу правила: число убранных узлов
+
+    size_t flatten(std::unique_ptr<ASTNode>& slot, NodeKind parent);
+    void inlineInto(std::unique_ptr<ASTNode>& slot, NodeKind parent, const std::string& caller,
+                    const std::unordered_map<std::string, const ProductionRule*>& inlinable,
+                    std::map<std::string, size_t>& counts);
+    size_t fold(std::unique_ptr<ASTNode>& slot, NodeKind parent);
+    size_t factor(std::unique_ptr<ASTNode>& slot, NodeKind parent);
+    size_t factorChoices(std::vector<std::unique_ptr<ASTNode>>& choices);
+};
+
+// Число убранных узлов: групп, вложенных последовательностей и альтернатив,
+// последовательностей и альтернатив из одного элемента, вложенных повторений
+size_t Optimizer::flatten(std::unique_ptr<ASTNode>& slot, NodeKind parent) {
+    size_t count = 0;
+    ASTNode* node = slot.get();
+    forEachSlot(node, [&](std::unique_ptr<ASTNode>& child) { count += flatten(child, node->kind()); });
+
+    // Заменяет узел ребёнком и упрощает его уже в новом окружении
+    auto replace = [&](std::unique_ptr<ASTNode> child) {
+        slot = wrap(std::move(child), parent);
+        return count + 1 + flatten(slot, parent);
+    };
+
+    switch (node->kind()) {
+        case NodeKind::GROUP: {
+            auto& content = static_cast<Group*>(node)->content;
+            if (!needsGroup(content.get(), parent)) {
+                return replace(std::move(content));
+            }
+            break;
+        }
+        case NodeKind::SEQUENCE:
+        case NodeKind::ALTERNATIVE: {
+            // Последовательность и упорядоченный выбор ассоциативны
+            auto& items = node->is<Sequence>() ? static_cast<Sequence*>(node)->elements
+                                               : static_cast<Alternative*>(node)->choices;
+            std::vector<std::unique_ptr<ASTNode>> flat;
+            for (auto& item : items) {
+                if (item->kind() != node->kind() || (node->is<Alternative>() && hasCut(item.get()))) {
+                    flat.push_back(std::move(item));
+                    continue;
+                }
+                auto nested = takeElements(std::move(item));
+                if (auto* alt = nested.front()->as<Alternative>(); alt && nested.size() == 1) {
+                    nested = std::move(alt->choices);
+                }
+                for (auto& inner : nested) {
+                    flat.push_back(std::move(inner));
+                }
+                ++count;
+            }
+            items = std::move(flat);
+            if (items.size() == 1) {
+                return replace(std::move(items.front()));
+            }
+            break;
+        }
+        case NodeKind::OPTIONAL: {
+            // [A?] = [A], [A*] = A*, [A+] = A*
+            auto& content = static_cast<Optional*>(node)->content;
+            if (hasCut(content.get())) {
+                break;
+            }
+            if (auto* inner = content->as<Optional>()) {
+                content = std::move(inner->content);
+                ++count;
+            } else if (content->is<ZeroOrMore>()) {
+                return replace(std::move(content));
+            } else if (auto* more = content->as<OneOrMore>()) {
+                return replace(std::make_unique<ZeroOrMore>(std::move(more->content)));
+            }
+            break;
+        }
+        case NodeKind::ZERO_OR_MORE:
+        case NodeKind::ONE_OR_MORE: {
+            // Повторение останавливается на пустом совпадении: (A?)* = (A?)+ = A*
+            auto& content = contentSlot(node);
+            if (auto* inner = content->as<Optional>(); inner && !hasCut(inner)) {
+                return replace(std::make_unique<ZeroOrMore>(std::move(inner->content)));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return count;
+}
+
+void Optimizer::inlineRules() {
+    // Рекурсивные правила не раскрываются: компонента сильной связности из
+    // нескольких правил или ссылка правила на себя
+    GrammarIR ir = GrammarIR::lower(grammar_);
+    std::vector<uint32_t> component = ir.ruleComponents();
+    std::vector<size_t> component_size(component.size(), 0);
+    for (uint32_t c : component) {
+        ++component_size[c];
+    }
+    std::vector<bool> recursive(component.size(), false);
+    std::vector<size_t> definitions(component.size(), 0);
+    for (RuleId rule = 0; rule < ir.rules().size(); ++rule) {
+        SymbolId name = ir.rule(rule).name;
+        ++definitions[name];
+        for (NodeId node = ir.rule(rule).body; node < ir.bodyEnd(rule); ++node) {
+            if (ir.node(node).kind == NodeKind::NON_TERMINAL && ir.node(node).symbol == name) {
+                recursive[name] = true;
+            }
+        }
+    }
+
+    std::unordered_map<std::string, const ProductionRule*> inlinable;
+    for (const auto& rule : grammar_.rules) {
+        SymbolId name = ir.symbols().find(rule->leftSide);
+        if (recursive[name] || component_size[component[name]] > 1 || definitions[name] > 1 ||
+            rule->hasParameters() || keep_.count(rule->leftSide) ||
+            hasContextAction(rule->rightSide.get()) || hasCut(rule->rightSide.get()) ||
+            nodeCount(rule->rightSide.get()) > options_.inline_max_nodes) {
+            continue;
+        }
+        inlinable.emplace(rule->leftSide, rule.get());
+    }
+
+    // Вызываемые правила раскрываются раньше вызывающих (компоненты в обратном
+    // топологическом порядке), поэтому каждое тело раскрывается один раз, а
+    // ограничение размера проверяется по уже раскрытому телу
+    std::vector<size_t> order(grammar_.rules.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return component[ir.rule(a).name] < component[ir.rule(b).name];
+    });
+    for (size_t index : order) {
+        ProductionRule& rule = *grammar_.rules[index];
+        std::map<std::string, size_t> counts;
+        inlineInto(rule.rightSide, NodeKind::GROUP, rule.leftSide, inlinable, counts);
+        for (const auto& [callee, count] : counts) {
+            report_.inlined += count;
+            std::string line = "inline: " + callee + " into " + rule.leftSide;
+            if (count > 1) {
+                line += " (" + std::to_string(count) + " references)";
+            }
+            report_.changes.push_back(line);
+        }
+        // Тело правила изменилось: размер проверяется заново
+        auto it = inlinable.find(rule.leftSide);
+        if (it != inlinable.end() && it->second == &rule &&
+            nodeCount(rule.rightSide.get()) > options_.inline_max_nodes) {
+            inlinable.erase(it);
+        }
+    }
+}
+
+void Optimizer::inlineInto(std::unique_ptr<ASTNode>& slot, NodeKind parent, const std::string& caller,
+                           const std::unordered_map<std::string, const ProductionRule*>& inlinable,
+                           std::map<std::string, size_t>& counts) {
+    if (const auto* nt = slot->as<NonTerminal>()) {
+        auto it = inlinable.find(nt->name);
+        // Узел ссылки виден в дереве, из токена - тоже; токен из
+        // синтаксического правила не раскрывается и в распознавателе: внутри
+        // него не пропускаются пробелы
+        bool lexical = lexical_.count(caller) > 0;
+        bool visible = lexical ? options_.preserve_token_nodes : options_.preserve_tree;
+        if (it == inlinable.end() || nt->hasParameters() || nt->name == caller ||
+            lexical != (lexical_.count(nt->name) > 0) || visible) {
+            return;
+        }
+        ++counts[nt->name];
+        slot = wrap(clone(it->second->rightSide.get()), parent);
+        return;
+    }
+    ASTNode* node = slot.get();
+    forEachSlot(node, [&](std::unique_ptr<ASTNode>& child) {
+        inlineInto(child, node->kind(), caller, inlinable, counts);
+    });
+}
+
+void Optimizer::foldCharClasses() {
+    // В синтаксических правилах терминал и диапазон различаются: перед
+    // терминалом без правила пробелов пропускается std::isspace, а лексер на
+    // ДКА делает каждый из них своим видом токена
+    for (const auto& rule : grammar_.rules) {
+        if (!lexical_.count(rule->leftSide)) {
+            continue;
+        }
+        size_t count = fold(rule->rightSide, NodeKind::GROUP);
+        if (count > 0) {
+            report_.folded += count;
+            report_.changes.push_back("fold: " + std::to_string(count) + " character alternatives in " +
+                                      rule->leftSide);
+        }
+    }
+}
+
+// Каждый символ сопоставляется одной кодовой точке, поэтому порядок внутри
+// серии соседних символов не важен: серия заменяется объединением диапазонов
+size_t Optimizer::fold(std::unique_ptr<ASTNode>& slot, NodeKind parent) {
+    size_t count = 0;
+    ASTNode* node = slot.get();
+    forEachSlot(node, [&](std::unique_ptr<ASTNode>& child) { count += fold(child, node->kind()); });
+    auto* alt = node->as<Alternative>();
+    if (!alt) {
+        return count;
+    }
+
+    std::vector<std::unique_ptr<ASTNode>> out;
+    auto& choices = alt->choices;
+    for (size_t i = 0; i < choices.size();) {
+        std::vector<std::pair<uint32_t, uint32_t>> intervals;
+        size_t j = i;
+        uint32_t start = 0;
+        uint32_t end = 0;
+        while (j < choices.size() && charInterval(choices[j].get(), start, end)) {
+            intervals.emplace_back(start, end);
+            ++j;
+        }
+        std::sort(intervals.begin(), intervals.end());
+        std::vector<std::pair<uint32_t, uint32_t>> merged;
+        for (const auto& interval : intervals) {
+            if (!merged.empty() && interval.first <= merged.back().second + 1) {
+                merged.back().second = std::max(merged.back().second, interval.second);
+            } else {
+                merged.push_back(interval);
+            }
+        }
+        if (merged.size() >= intervals.size()) {
+            // Нечего сливать: символы (или одна не-символьная альтернатива) остаются
+            size_t stop = std::max(j, i + 1);
+            for (; i < stop; ++i) {
+                out.push_back(std::move(choices[i]));
+            }
+            continue;
+        }
+        count += intervals.size() - merged.size();
+        for (const auto& [first, last] : merged) {
+            if (first == last && first < 0x80) {
+                out.push_back(std::make_unique<Terminal>(std::string(1, static_cast<char>(first))));
+            } else {
+                out.push_back(std::make_unique<CharRange>(first, last));
+            }
+        }
+        i = j;
+    }
+    choices = std::move(out);
+    if (choices.size() == 1) {
+        slot = wrap(std::move(choices.front()), parent);
+    }
+    return count;
+}
+
+void Optimizer::leftFactor() {
+    for (const auto& rule : grammar_.rules) {
+        size_t count = factor(rule->rightSide, NodeKind::GROUP);
+        if (count > 0) {
+            report_.factored += count;
+            report_.changes.push_back("left-factor: " + std::to_string(count) + " alternatives in " +
+                                      rule->leftSide);
+        }
+    }
+}
+
+size_t Optimizer::factor(std::unique_ptr<ASTNode>& slot, NodeKind parent) {
+    size_t count = 0;
+    ASTNode* node = slot.get();
+    forEachSlot(node, [&](std::unique_ptr<ASTNode>& child) { count += factor(child, node->kind()); });
+    if (auto* alt = node->as<Alternative>()) {
+        count += factorChoices(alt->choices);
+        if (alt->choices.size() == 1) {
+            slot = wrap(std::move(alt->choices.front()), parent);
+        }
+    }
+    return count;
+}
+
+// PEG-выражение на данной позиции либо не сопоставляется, либо сопоставляется
+// единственным образом, поэтому A B | A C = A (B | C). Выносится только
+// префикс соседних альтернатив: перестановка выборов изменила бы разбор.
+// Пустой остаток успешен всегда, и выборы после него недостижимы:
+// A | A B = A, A B | A = A B?
+size_t Optimizer::factorChoices(std::vector<std::unique_ptr<ASTNode>>& choices) {
+    size_t count = 0;
+    std::vector<std::unique_ptr<ASTNode>> out;
+    for (size_t i = 0; i < choices.size();) {
+        const ASTNode* head = element(choices[i].get(), 0);
+        size_t j = i + 1;
+        if (head && !hasContextAction(head) && !hasCut(choices[i].get())) {
+            while (j < choices.size()) {
+                const ASTNode* other = element(choices[j].get(), 0);
+                if (!other || !sameNode(other, head) || hasCut(choices[j].get())) break;
+                ++j;
+            }
+        }
+        if (j - i < 2) {
+            out.push_back(std::move(choices[i]));
+            ++i;
+            continue;
+        }
+
+        // Самый длинный общий префикс всей серии
+        size_t prefix = 1;
+        for (;; ++prefix) {
+            const ASTNode* next = element(choices[i].get(), prefix);
+            bool shared = next && !hasContextAction(next);
+            for (size_t k = i + 1; shared && k < j; ++k) {
+                const ASTNode* other = element(choices[k].get(), prefix);
+                shared = other && sameNode(other, next);
+            }
+            if (!shared) break;
+        }
+
+        std::vector<std::vector<std::unique_ptr<ASTNode>>> parts;
+        for (size_t k = i; k < j; ++k) {
+            parts.push_back(takeElements(std::move(choices[k])));
+        }
+        auto seq = std::make_unique<Sequence>();
+        for (size_t e = 0; e < prefix; ++e) {
+            seq->addElement(std::move(parts.front()[e]));
+        }
+        auto tail = std::make_unique<Alternative>();
+        bool optional = false;
+        for (auto& part : parts) {
+            if (part.size() == prefix) {
+                optional = true;
+                break;
+            }
+            auto rest = std::make_unique<Sequence>();
+            for (size_t e = prefix; e < part.size(); ++e) {
+                rest->addElement(std::move(part[e]));
+            }
+            if (rest->elements.size() == 1) {
+                tail->addChoice(std::move(rest->elements.front()));
+            } else {
+                tail->addChoice(std::move(rest));
+            }
+        }
+        if (!tail->choices.empty()) {
+            // Остатки могут иметь свой, более длинный общий префикс
+            count += factorChoices(tail->choices);
+            std::unique_ptr<ASTNode> rest;
+            if (tail->choices.size() == 1) {
+                rest = std::move(tail->choices.front());
+            } else {
+                rest = std::move(tail);
+            }
+            if (optional) {
+                rest = std::make_unique<Optional>(std::move(rest));
+            }
+            for (auto& e : takeElements(std::move(rest))) {
+                seq->addElement(wrap(std::move(e), NodeKind::SEQUENCE));
+            }
+        }
+        count += j - i - 1;
+        if (seq->elements.size() == 1) {
+            out.push_back(std::move(seq->elements.front()));
+        } else {
+            out.push_back(std::move(seq));
+        }
+        i = j;
+    }
+    choices = std::move(out);
+    return count;
+}
+
+void Optimizer::removeUnreachable() {
+    if (grammar_.startSymbol.empty()) {
+        return;
+    }
+    std::unordered_set<std::string> reachable;
+    std::vector<std::string> pending(keep_.begin(), keep_.end());
+    while (!pending.empty()) {
+        std::string name = pending.back();
+        pending.pop_back();
+        if (!reachable.insert(name).second) continue;
+        // Все определения правила с этим именем
+        for (const auto& rule : grammar_.rules) {
+            if (rule->leftSide != name) continue;
+            std::vector<const ASTNode*> stack = {rule->rightSide.get()};
+            while (!stack.empty()) {
+                const ASTNode* node = stack.back();
+                stack.pop_back();
+                if (const auto* nt = node->as<NonTerminal>()) {
+                    if (!reachable.count(nt->name)) pending.push_back(nt->name);
+                }
+                forEachChild(node, [&](const ASTNode* child) { stack.push_back(child); });
+            }
+        }
+    }
+    grammar_.removeRulesIf([&](const ProductionRule& rule) {
+        if (reachable.count(rule.leftSide)) {
+            return false;
+        }
+        ++report_.removed;
+        report_.changes.push_back("remove: unreachable rule " + rule.leftSide);
+        return true;
+    });
+}
+
+// Специализация правил с параметрами. Значение аргумента известно при
+// генерации, если это имя (значение enum, true/false, любой идентификатор) или
+// параметр вызывающего, связанный с таким именем; параметр INTEGER и всё, что
+// ему передано (целое число, параметр INTEGER вызывающего, n-1, n+1), -
+// значение времени выполнения
+class Specializer {
+public:
+    explicit Specializer(const Grammar& grammar) : grammar_(grammar) {
+        for (const auto& rule : grammar.rules) {
+            for (const auto& param : rule->parameters) {
+                if (param.type == ParameterType::ENUM) {
+                    constants_.insert(param.enumValues.begin(), param.enumValues.end());
+                }
+            }
+            if (rule->hasParameters()) {
+                definitions_[rule->leftSide].push_back(rule.get());
+            }
+            collectConstants(rule->rightSide.get(), *rule);
+        }
+        constants_.insert("true");
+        constants_.insert("false");
+    }
+
+    std::unique_ptr<Grammar> run() {
+        result_ = std::make_unique<Grammar>();
+        for (const auto& rule : grammar_.rules) {
+            if (!rule->hasParameters()) {
+                result_->addRule(std::make_unique<ProductionRule>(rule->leftSide, substitute(rule->rightSide.get(), {})));
+            }
+        }
+        result_->startSymbol = grammar_.startSymbol;
+        if (definitions_.count(grammar_.startSymbol)) {
+            result_->startSymbol = call(grammar_.startSymbol, nullptr).first;
+        }
+        // Тело специализации может запросить новые: очередь до исчерпания
+        for (size_t i = 0; i < pending_.size(); ++i) {
+            Specialization spec = pending_[i];  // build() дополняет pending_
+            build(spec);
+        }
+        return std::move(result_);
+    }
+
+private:
+    // Аргумент вызова: имя, известное при генерации, или выражение C++
+    struct Argument {
+        std::string value;
+        bool runtime = false;
+    };
+    using Bindings = std::unordered_map<std::string, Argument>;
+
+    struct Specialization {
+        std::string rule;
+        std::string name;
+        std::vector<Argument> arguments;
+    };
+
+    const Grammar& grammar_;
+    std::unique_ptr<Grammar> result_;
+    std::unordered_set<std::string> constants_;
+    std::unordered_map<std::string, std::vector<const ProductionRule*>> definitions_;
+    std::unordered_map<std::string, std::string> names_;  // Ключ специализации -> имя правила
+    std::vector<Specialization> pending_;
+
+    // Аргумент вызова, который не параметр правила, - константа
+    void collectConstants(const ASTNode* node, const ProductionRule& rule) {
+        if (const auto* nt = node->as<NonTerminal>()) {
+            for (const auto& value : nt->parameterValues) {
+                if (!rule.findParameter(value)) constants_.insert(value);
+            }
+        }
+        forEachChild(node, [&](const ASTNode* child) { collectConstants(child, rule); });
+    }
+
+    // Параметр без типа с именем константы - образец: noun[sing] ::= ...
+    bool isPattern(const RuleParameter& param) const {
+        return param.type == ParameterType::STRING && constants_.count(param.name) > 0;
+    }
+
+    bool accepts(const RuleParameter& param, const std::string& value) const {
+        if (isPattern(param)) return param.name == value;
+        if (param.type == ParameterType::ENUM) {
+            return std::find(param.enumValues.begin(), param.enumValues.end(), value) != param.enumValues.end();
+        }
+        if (param.type == ParameterType::BOOLEAN) return value == "true" || value == "false";
+        return true;
+    }
+
+    std::vector<const ProductionRule*> withArity(const std::string& rule, size_t arity) const {
+        std::vector<const ProductionRule*> result;
+        for (const ProductionRule* definition : definitions_.at(rule)) {
+            if (definition->parameters.size() == arity) result.push_back(definition);
+        }
+        if (result.empty()) {
+            throw std::runtime_error("No definition of " + rule + " takes " + std::to_string(arity) + " parameters");
+        }
+        return result;
+    }
+
+    static bool isInteger(const std::vector<const ProductionRule*>& definitions, size_t i) {
+        return std::any_of(definitions.begin(), definitions.end(), [&](const ProductionRule* definition) {
+            return definition->parameters[i].type == ParameterType::INTEGER;
+        });
+    }
+
+    static bool isIntegerLiteral(const std::string& text) {
+        return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+    // Имя параметра INTEGER в специализации: первое не-число среди
+    // определений (spaces[0] и spaces[n:int] - n)
+    static std::string integerName(const std::vector<const ProductionRule*>& definitions, size_t i) {
+        for (const ProductionRule* definition : definitions) {
+            if (!isIntegerLiteral(definition->parameters[i].name)) return definition->parameters[i].name;
+        }
+        return "arg" + std::to_string(i);
+    }
+
+    // n-1, indent+1: параметр времени выполнения вызывающего со сдвигом
+    static std::optional<Argument> offsetArgument(const std::string& value, const Bindings& bindings) {
+        size_t op = value.find_last_of("+-");
+        if (op == std::string::npos || op == 0 || !isIntegerLiteral(value.substr(op + 1))) {
+            return std::nullopt;
+        }
+        auto it = bindings.find(value.substr(0, op));
+        if (it == bindings.end() || !it->second.runtime) {
+            return std::nullopt;
+        }
+        return Argument{it->second.value + value.substr(op), true};
+    }
+
+    // Имя правила-специализации и аргументы времени выполнения для вызова;
+    // arguments == nullptr - вызов без аргументов: любое значение параметров
+    std::pair<std::string, std::vector<std::string>> call(const std::string& rule, const std::vector<Argument>* arguments) {
+        if (!arguments) {
+            return callAny(rule);
+        }
+        std::vector<Argument> args = *arguments;
+        const auto definitions = withArity(rule, args.size());
+        std::string key = rule + "[";
+        bool all_integer = true;
+        std::vector<std::string> runtime;
+        for (size_t i = 0; i < args.size(); ++i) {
+            // Целые не специализируются: их область значений не ограничена
+            if (isInteger(definitions, i)) {
+                if (isIntegerLiteral(args[i].value)) {
+                    args[i].runtime = true;
+                } else if (!args[i].runtime) {
+                    throw std::runtime_error("Integer parameter " + integerName(definitions, i) + " of " + rule +
+                                             " gets " + args[i].value +
+                                             ", which is neither a number nor an integer parameter of the caller");
+                }
+            } else if (!args[i].runtime) {
+                all_integer = false;
+            }
+            if (args[i].runtime) {
+                for (const ProductionRule* definition : definitions) {
+                    const RuleParameter& param = definition->parameters[i];
+                    if (isPattern(param) || param.type == ParameterType::ENUM || param.type == ParameterType::BOOLEAN) {
+                        throw std::runtime_error("Parameter " + param.name + " of " + rule +
+                                                 " needs a value known at generation time");
+                    }
+                }
+                runtime.push_back(args[i].value);
+            }
+            key += (i > 0 ? "," : "") + (args[i].runtime ? std::string("*") : args[i].value);
+        }
+        key += "]";
+        // Правило только с параметрами времени выполнения остаётся одной функцией с прежним именем
+        std::string name = all_integer && definitions.size() == definitions_.at(rule).size() ? rule : key;
+        if (names_.emplace(key, name).second) {
+            pending_.push_back(Specialization{rule, name, args});
+        }
+        return {names_[key], runtime};
+    }
+
+    // Вызов без аргументов: выбор по всем значениям, которые принимают
+    // определения, по порядку; целые параметры начинаются с 0
+    std::pair<std::string, std::vector<std::string>> callAny(const std::string& rule) {
+        const auto& all = definitions_.at(rule);
+        const auto definitions = withArity(rule, all.front()->parameters.size());
+        std::vector<std::vector<Argument>> domains(definitions.front()->parameters.size());
+        bool all_integer = true;
+        for (size_t i = 0; i < domains.size(); ++i) {
+            if (isInteger(definitions, i)) {
+                domains[i].push_back(Argument{"0", true});
+                continue;
+            }
+            all_integer = false;
+            std::vector<std::string> values;
+            for (const ProductionRule* definition : definitions) {
+                const RuleParameter& param = definition->parameters[i];
+                if (isPattern(param)) {
+                    values.push_back(param.name);
+                } else if (param.type == ParameterType::ENUM) {
+                    values.insert(values.end(), param.enumValues.begin(), param.enumValues.end());
+                } else if (param.type == ParameterType::BOOLEAN) {
+                    values.insert(values.end(), {"true", "false"});
+                }
+            }
+            for (const auto& value : values) {
+                bool seen = std::any_of(domains[i].begin(), domains[i].end(),
+                                        [&](const Argument& arg) { return arg.value == value; });
+                if (!seen) domains[i].push_back(Argument{value, false});
+            }
+            if (domains[i].empty()) {
+                throw std::runtime_error("Rule " + rule + " is used without parameters, but the values of " +
+                                         definitions.front()->parameters[i].name + " are not known");
+            }
+        }
+        if (all_integer) {
+            std::vector<Argument> args;
+            for (auto& domain : domains) args.push_back(domain.front());
+            return call(rule, &args);
+        }
+        if (names_.emplace(rule, rule).second) {
+            // Правило rule - выбор из специализаций по всем комбинациям значений
+            auto choice = std::make_unique<Alternative>();
+            std::vector<size_t> index(domains.size(), 0);
+            while (true) {
+                std::vector<Argument> args;
+                for (size_t i = 0; i < domains.size(); ++i) args.push_back(domains[i][index[i]]);
+                auto [name, runtime] = call(rule, &args);
+                choice->addChoice(std::make_unique<NonTerminal>(name, runtime));
+                size_t i = domains.size();
+                while (i > 0 && ++index[i - 1] == domains[i - 1].size()) {
+                    index[--i] = 0;
+                }
+                if (i == 0) break;
+            }
+            std::unique_ptr<ASTNode> body = std::move(choice);
+            if (static_cast<Alternative*>(body.get())->choices.size() == 1) {
+                body = std::move(static_cast<Alternative*>(body.get())->choices.front());
+            }
+            result_->addRule(std::make_unique<ProductionRule>(rule, std::move(body)));
+        }
+        return {rule, {}};
+    }
+
+    // Правило специализации: подходящие определения по порядку, параметры
+    // заменены значениями; остаются только параметры времени выполнения.
+    // Определение с числом вместо параметра INTEGER (spaces[0]) начинается
+    // проверкой {check(n == 0)}
+    void build(const Specialization& spec) {
+        const auto definitions = withArity(spec.rule, spec.arguments.size());
+        std::vector<RuleParameter> parameters;
+        for (size_t i = 0; i < spec.arguments.size(); ++i) {
+            if (spec.arguments[i].runtime) {
+                parameters.emplace_back(integerName(definitions, i), ParameterType::INTEGER);
+            }
+        }
+        auto choice = std::make_unique<Alternative>();
+        for (const ProductionRule* definition : definitions) {
+            Bindings bindings;
+            std::vector<std::string> guards;
+            bool matches = true;
+            for (size_t i = 0, runtime = 0; i < spec.arguments.size() && matches; ++i) {
+                const RuleParameter& param = definition->parameters[i];
+                if (spec.arguments[i].runtime) {
+                    const std::string& name = parameters[runtime++].name;
+                    if (isIntegerLiteral(param.name)) {
+                        guards.push_back(name + " == " + param.name);
+                    } else {
+                        bindings[param.name] = Argument{name, true};
+                    }
+                } else if (!accepts(param, spec.arguments[i].value)) {
+                    matches = false;
+                } else if (!isPattern(param)) {
+                    bindings[param.name] = spec.arguments[i];
+                }
+            }
+            if (!matches) {
+                continue;
+            }
+            auto body = substitute(definition->rightSide.get(), bindings);
+            if (!guards.empty()) {
+                auto guarded = std::make_unique<Sequence>();
+                for (const auto& guard : guards) {
+                    guarded->addElement(std::make_unique<ContextAction>(ContextAction::ActionType::CHECK,
+                                                                        std::vector<std::string>{guard}));
+                }
+                guarded->addElement(std::move(body));
+                body = std::move(guarded);
+            }
+            choice->addChoice(std::move(body));
+        }
+        if (choice->choices.empty()) {
+            throw std::runtime_error("No definition of " + spec.rule + " matches " + spec.name);
+        }
+        std::unique_ptr<ASTNode> body = std::move(choice);
+        if (static_cast<Alternative*>(body.get())->choices.size() == 1) {
+            body = std::move(static_cast<Alternative*>(body.get())->choices.front());
+        }
+        result_->addRule(std::make_unique<ProductionRule>(spec.name, parameters, std::move(body)));
+    }
+
+    std::unique_ptr<ASTNode> substitute(const ASTNode* node, const Bindings& bindings) {
+        auto result = clone(node);
+        rewrite(result, bindings);
+        return result;
+    }
+
+    void rewrite(std::unique_ptr<ASTNode>& slot, const Bindings& bindings) {
+        const auto* nt = slot->as<NonTerminal>();
+        if (!nt) {
+            forEachSlot(slot.get(), [&](std::unique_ptr<ASTNode>& child) { rewrite(child, bindings); });
+            return;
+        }
+        if (!definitions_.count(nt->name)) return;
+        std::vector<Argument> args;
+        for (const auto& value : nt->parameterValues) {
+            auto it = bindings.find(value);
+            if (it != bindings.end()) {
+                args.push_back(it->second);
+            } else if (auto offset = offsetArgument(value, bindings)) {
+                args.push_back(*offset);
+            } else {
+                args.push_back(Argument{value, false});
+            }
+        }
+        auto [name, runtime] = call(nt->name, nt->hasParameters() ? &args : nullptr);
+        slot = std::make_unique<NonTerminal>(name, runtime);
+    }
+};
+
+} // namespace
+
+OptimizerOptions OptimizerOptions::forGenerator(const GeneratorOptions& options) {
+    OptimizerOptions result;
+    result.whitespace_rule = options.whitespace_rule;
+    result.token_rules = options.token_rules;
+    // Без AST узлы правил не видны, но события, потоковые элементы, параллельный
+    // разбор item* и переиспользование поддеревьев опираются на сами правила
+    result.preserve_tree = !options.recognizer || options.streaming || options.parallel || options.incremental;
+    // Внутри токенов узлы строит только дерево без лексера на ДКА
+    result.preserve_token_nodes = !options.recognizer && !options.event_callbacks && !options.dfa_lexer;
+    if (!options.stream_item.empty()) {
+        result.keep_rules.push_back(options.stream_item);
+    }
+    result.keep_rules.insert(result.keep_rules.end(), options.memoize_rules.begin(), options.memoize_rules.end());
+    return result;
+}
+
+OptimizationReport GrammarOptimizer::optimize(Grammar& grammar) {
+    return optimize(grammar, OptimizerOptions{});
+}
+
+OptimizationReport GrammarOptimizer::optimize(Grammar& grammar, const OptimizerOptions& options) {
+    OptimizationReport report;
+    Optimizer optimizer(grammar, options, report);
+
+    // Упрощение структуры открывает остальным проходам вложенные выборы, в том
+    // числе раскрытые тела правил; последнее - убирает группы после выноса префиксов
+    if (options.flatten) {
+        optimizer.flattenRules();
+    }
+    if (options.inline_rules) {
+        optimizer.inlineRules();
+        if (options.flatten) {
+            optimizer.flattenRules();
+        }
+    }
+    if (options.fold_char_classes) {
+        optimizer.foldCharClasses();
+    }
+    if (options.left_factor) {
+        optimizer.leftFactor();
+    }
+    if (options.flatten) {
+        optimizer.flattenRules();
+        optimizer.reportFlattened();
+    }
+    if (options.remove_unreachable) {
+        optimizer.removeUnreachable();
+    }
+    return report;
+}
+
+std::unique_ptr<Grammar> GrammarOptimizer::specialize(const Grammar& grammar) {
+    return Specializer(grammar).run();
+}
+
+} // namespace bnf_parser_generator
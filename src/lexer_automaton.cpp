@@ -0,0 +1,591 @@
+#include "lexer_automaton.hpp"
+#include "grammar_analysis.hpp"
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace bnf_parser_generator {
+
+namespace {
+
+using ByteSet = std::bitset<256>;
+
+// Ведущий байт символа, как его читает visitCharRange: число байтов продолжения
+// и вклад ведущего байта в кодовую точку. Байты продолжения не проверяются,
+// 0x80-0xBF и 0xF8-0xFF читаются как однобайтовые символы со значением байта
+struct LeadByte {
+    size_t continuation;
+    uint32_t base;
+};
+
+LeadByte decodeLead(unsigned b) {
+    if ((b & 0xE0) == 0xC0) return {1, (b & 0x1Fu) << 6};
+    if ((b & 0xF0) == 0xE0) return {2, (b & 0x0Fu) << 12};
+    if ((b & 0xF8) == 0xF0) return {3, (b & 0x07u) << 18};
+    return {0, b};
+}
+
+// Первый байт UTF-8 кодировки кодовой точки
+unsigned leadByte(uint32_t cp) {
+    if (cp < 0x80) return cp;
+    if (cp < 0x800) return 0xC0 | (cp >> 6);
+    if (cp < 0x10000) return 0xE0 | (cp >> 12);
+    return 0xF0 | (cp >> 18);
+}
+
+// Ведущий байт допустим для диапазона [lo, hi]: выбор по FIRST-множествам и
+// сканеры классов пропускают многобайтовые символы только с ведущими байтами
+// между кодировками lo и hi, так что избыточные кодировки ('\xC0\xB0')
+// диапазону ASCII не принадлежат
+bool leadInRange(unsigned b, uint32_t lo, uint32_t hi) {
+    return decodeLead(b).continuation == 0 || (b >= leadByte(lo) && b <= leadByte(hi));
+}
+
+// Последняя кодовая точка блока, который задаётся началом и числом байтов продолжения
+uint32_t blockEnd(uint32_t base, size_t continuation) {
+    return base + (uint32_t{1} << (6 * continuation)) - 1;
+}
+
+// Байты продолжения с младшими шестью битами digit
+ByteSet continuationBytes(unsigned digit) {
+    ByteSet bytes;
+    for (unsigned high = 0; high < 4; ++high) {
+        bytes.set(digit | (high << 6));
+    }
+    return bytes;
+}
+
+ByteSet rangeFirst(uint32_t lo, uint32_t hi) {
+    ByteSet first;
+    for (unsigned b = 0; b < 256; ++b) {
+        LeadByte lead = decodeLead(b);
+        if (leadInRange(b, lo, hi) && lead.base <= hi && lo <= blockEnd(lead.base, lead.continuation)) {
+            first.set(b);
+        }
+    }
+    return first;
+}
+
+std::string describeBytes(const ByteSet& bytes) {
+    LookaheadSet set;
+    for (size_t b = 0; b < 256; ++b) {
+        if (bytes.test(b)) set.set(b);
+    }
+    return GrammarAnalysis::describe(set);
+}
+
+/**
+ * Проверка, что токен - регулярное выражение, разбор PEG которого
+ * совпадает с самым длинным совпадением: каждый выбор и каждое повторение
+ * определяются следующим байтом
+ */
+class PatternChecker {
+public:
+    explicit PatternChecker(const Grammar& grammar) : grammar_(grammar) {}
+
+    struct Info {
+        ByteSet first;
+        bool nullable = false;
+        bool single = false;  // Ровно один символ: длина задаётся ведущим байтом
+    };
+
+    Info info(const ASTNode* node) {
+        auto cached = cache_.find(node);
+        if (cached != cache_.end()) {
+            return cached->second;
+        }
+        Info result;
+        if (const auto* t = node_cast<Terminal>(node)) {
+            result.nullable = t->value.empty();
+            if (!t->value.empty()) {
+                unsigned lead = static_cast<unsigned char>(t->value[0]);
+                result.first.set(lead);
+                result.single = t->value.size() == 1 + decodeLead(lead).continuation;
+            }
+        } else if (const auto* range = node_cast<CharRange>(node)) {
+            if (range->start <= range->end) result.first = rangeFirst(range->start, range->end);
+            result.single = true;
+        } else if (const auto* alt = node_cast<Alternative>(node)) {
+            result.single = true;
+            for (const auto& choice : alt->choices) {
+                Info part = info(choice.get());
+                result.first |= part.first;
+                result.nullable = result.nullable || part.nullable;
+                result.single = result.single && part.single;
+            }
+        } else if (const auto* seq = node_cast<Sequence>(node)) {
+            result.nullable = true;
+            for (const auto& element : seq->elements) {
+                Info part = info(element.get());
+                result.first |= part.first;
+                if (!part.nullable) {
+                    result.nullable = false;
+                    break;
+                }
+            }
+        } else if (const auto* group = node_cast<Group>(node)) {
+            result = info(group->content.get());
+        } else if (const auto* opt = node_cast<Optional>(node)) {
+            result.first = info(opt->content.get()).first;
+            result.nullable = true;
+        } else if (const auto* zeroMore = node_cast<ZeroOrMore>(node)) {
+            result.first = info(zeroMore->content.get()).first;
+            result.nullable = true;
+        } else if (const auto* oneMore = node_cast<OneOrMore>(node)) {
+            result = info(oneMore->content.get());
+        } else if (const auto* nt = node_cast<NonTerminal>(node)) {
+            result = info(expand(nt));
+            expanding_.pop_back();
+        } else {
+            throw std::runtime_error(token_ + " is not a regular expression");
+        }
+        cache_[node] = result;
+        return result;
+    }
+
+    void checkToken(const std::string& name, const ASTNode* pattern) {
+        token_ = "token " + name;
+        if (info(pattern).nullable) {
+            throw std::runtime_error(token_ + " matches the empty string");
+        }
+        check(pattern, ByteSet{});
+    }
+
+private:
+    const Grammar& grammar_;
+    std::string token_;
+    std::vector<std::string> expanding_;
+    std::unordered_map<const ASTNode*, Info> cache_;
+
+    // Правая часть правила по ссылке; вызывающий снимает имя со стека раскрытия
+    const ASTNode* expand(const NonTerminal* nt) {
+        const ProductionRule* rule = grammar_.findRule(nt->name);
+        if (!rule) {
+            throw std::runtime_error(token_ + " refers to undefined rule " + nt->name);
+        }
+        if (rule->hasParameters() || nt->hasParameters()) {
+            throw std::runtime_error(token_ + " uses parameterized rule " + nt->name);
+        }
+        if (std::find(expanding_.begin(), expanding_.end(), nt->name) != expanding_.end()) {
+            throw std::runtime_error(token_ + " is recursive through rule " + nt->name);
+        }
+        expanding_.push_back(nt->name);
+        return rule->rightSide.get();
+    }
+
+    // follow - байты, которые могут идти после node внутри токена
+    void check(const ASTNode* node, const ByteSet& follow) {
+        if (node_cast<Terminal>(node) || node_cast<CharRange>(node)) {
+            return;
+        }
+        if (const auto* nt = node_cast<NonTerminal>(node)) {
+            check(expand(nt), follow);
+            expanding_.pop_back();
+        } else if (const auto* group = node_cast<Group>(node)) {
+            check(group->content.get(), follow);
+        } else if (const auto* seq = node_cast<Sequence>(node)) {
+            ByteSet next = follow;
+            for (size_t i = seq->elements.size(); i-- > 0;) {
+                const ASTNode* element = seq->elements[i].get();
+                check(element, next);
+                Info part = info(element);
+                next = part.nullable ? (part.first | next) : part.first;
+            }
+        } else if (const auto* alt = node_cast<Alternative>(node)) {
+            // Выбор между одиночными символами - объединение множеств: любой вариант
+            // съедает столько байтов, сколько задаёт ведущий байт (в том числе для
+            // избыточных кодировок, которые visitCharRange принимает)
+            ByteSet seen;
+            ByteSet seen_multi;
+            for (size_t i = 0; i < alt->choices.size(); ++i) {
+                Info part = info(alt->choices[i].get());
+                ByteSet overlap = (part.single ? seen_multi : seen) & part.first;
+                if (overlap.any()) {
+                    throw std::runtime_error(token_ + ": choices overlap on " + describeBytes(overlap));
+                }
+                if (!part.single) {
+                    seen_multi |= part.first;
+                }
+                if (part.nullable && i + 1 < alt->choices.size()) {
+                    throw std::runtime_error(token_ + ": a choice matching the empty string is not the last one");
+                }
+                seen |= part.first;
+                check(alt->choices[i].get(), follow);
+            }
+            if (info(alt).nullable && (seen & follow).any()) {
+                throw std::runtime_error(token_ + ": optional choice overlaps what follows on " +
+                                         describeBytes(seen & follow));
+            }
+        } else if (const auto* opt = node_cast<Optional>(node)) {
+            ByteSet first = info(opt->content.get()).first;
+            if ((first & follow).any()) {
+                throw std::runtime_error(token_ + ": optional part overlaps what follows on " +
+                                         describeBytes(first & follow));
+            }
+            check(opt->content.get(), follow);
+        } else {
+            const ASTNode* content = nullptr;
+            if (const auto* zeroMore = node_cast<ZeroOrMore>(node)) {
+                content = zeroMore->content.get();
+            } else if (const auto* oneMore = node_cast<OneOrMore>(node)) {
+                content = oneMore->content.get();
+            } else {
+                throw std::runtime_error(token_ + " is not a regular expression");
+            }
+            Info part = info(content);
+            if (part.nullable) {
+                throw std::runtime_error(token_ + ": repeated part matches the empty string");
+            }
+            if ((part.first & follow).any()) {
+                throw std::runtime_error(token_ + ": repetition overlaps what follows on " +
+                                         describeBytes(part.first & follow));
+            }
+            check(content, follow | part.first);
+        }
+    }
+};
+
+/**
+ * НКА Томпсона по байтам входа. Состояние 0 - начальное
+ */
+class NfaBuilder {
+public:
+    struct State {
+        std::vector<int> epsilon;
+        std::vector<std::pair<ByteSet, int>> edges;
+        int token = LexerAutomaton::NO_TOKEN;
+    };
+    std::vector<State> states;
+
+    explicit NfaBuilder(const Grammar& grammar) : grammar_(grammar) { newState(); }
+
+    int newState() {
+        states.emplace_back();
+        return static_cast<int>(states.size()) - 1;
+    }
+
+    // Добавляет переходы для node из состояния from; возвращает конечное состояние
+    int build(const ASTNode* node, int from) {
+        if (const auto* t = node_cast<Terminal>(node)) {
+            for (unsigned char c : t->value) {
+                int next = newState();
+                ByteSet byte;
+                byte.set(c);
+                edge(from, byte, next);
+                from = next;
+            }
+            return from;
+        }
+        if (const auto* range = node_cast<CharRange>(node)) {
+            return buildRange(range->start, range->end, from);
+        }
+        if (const auto* alt = node_cast<Alternative>(node)) {
+            int to = newState();
+            for (const auto& choice : alt->choices) {
+                int start = newState();
+                epsilon(from, start);
+                epsilon(build(choice.get(), start), to);
+            }
+            return to;
+        }
+        if (const auto* seq = node_cast<Sequence>(node)) {
+            for (const auto& element : seq->elements) {
+                from = build(element.get(), from);
+            }
+            return from;
+        }
+        if (const auto* group = node_cast<Group>(node)) {
+            return build(group->content.get(), from);
+        }
+        if (const auto* opt = node_cast<Optional>(node)) {
+            int start = newState();
+            int to = newState();
+            epsilon(from, start);
+            epsilon(start, to);
+            epsilon(build(opt->content.get(), start), to);
+            return to;
+        }
+        if (const auto* zeroMore = node_cast<ZeroOrMore>(node)) {
+            int loop = newState();
+            int to = newState();
+            epsilon(from, loop);
+            epsilon(loop, to);
+            epsilon(build(zeroMore->content.get(), loop), loop);
+            return to;
+        }
+        if (const auto* oneMore = node_cast<OneOrMore>(node)) {
+            int loop = newState();
+            int to = newState();
+            epsilon(from, loop);
+            int end = build(oneMore->content.get(), loop);
+            epsilon(end, loop);
+            epsilon(end, to);
+            return to;
+        }
+        if (const auto* nt = node_cast<NonTerminal>(node)) {
+            // Регулярность (в том числе отсутствие рекурсии) уже проверена
+            return build(grammar_.findRule(nt->name)->rightSide.get(), from);
+        }
+        throw std::runtime_error("unsupported element in a token");
+    }
+
+private:
+    const Grammar& grammar_;
+    std::map<std::pair<size_t, int>, int> any_bytes_;
+
+    void epsilon(int from, int to) { states[from].epsilon.push_back(to); }
+    void edge(int from, const ByteSet& bytes, int to) { states[from].edges.emplace_back(bytes, to); }
+
+    // Состояние, из которого любые count байтов ведут в to
+    int anyBytes(size_t count, int to) {
+        if (count == 0) return to;
+        auto key = std::make_pair(count, to);
+        auto it = any_bytes_.find(key);
+        if (it != any_bytes_.end()) return it->second;
+        int next = anyBytes(count - 1, to);
+        int state = newState();
+        edge(state, ByteSet{}.set(), next);
+        any_bytes_[key] = state;
+        return state;
+    }
+
+    int buildRange(uint32_t lo, uint32_t hi, int from) {
+        int to = newState();
+        if (lo > hi) return to;
+        ByteSet single;
+        ByteSet full[4];
+        for (unsigned b = 0; b < 256; ++b) {
+            LeadByte lead = decodeLead(b);
+            uint32_t end = blockEnd(lead.base, lead.continuation);
+            if (lead.base > hi || end < lo || !leadInRange(b, lo, hi)) continue;
+            if (lead.continuation == 0) {
+                single.set(b);
+            } else if (lo <= lead.base && end <= hi) {
+                full[lead.continuation].set(b);
+            } else {
+                int state = newState();
+                edge(from, ByteSet{}.set(b), state);
+                addCodepoints(state, lead.base, lead.continuation, lo, hi, to);
+            }
+        }
+        if (single.any()) edge(from, single, to);
+        for (size_t count = 1; count < 4; ++count) {
+            if (full[count].any()) edge(from, full[count], anyBytes(count, to));
+        }
+        return to;
+    }
+
+    // Байты продолжения для кодовых точек [lo, hi] внутри блока base с count байтами
+    void addCodepoints(int from, uint32_t base, size_t count, uint32_t lo, uint32_t hi, int to) {
+        uint32_t span = uint32_t{1} << (6 * (count - 1));
+        ByteSet full;
+        for (unsigned digit = 0; digit < 64; ++digit) {
+            uint32_t sub_lo = base + digit * span;
+            uint32_t sub_hi = sub_lo + span - 1;
+            if (sub_hi < lo || sub_lo > hi) continue;
+            if (lo <= sub_lo && sub_hi <= hi) {
+                full |= continuationBytes(digit);
+            } else {
+                int state = newState();
+                edge(from, continuationBytes(digit), state);
+                addCodepoints(state, sub_lo, count - 1, lo, hi, to);
+            }
+        }
+        if (full.any()) edge(from, full, anyBytes(count - 1, to));
+    }
+};
+
+} // namespace
+
+LexerAutomaton LexerAutomaton::build(const Grammar& grammar, const std::vector<LexerToken>& tokens) {
+    if (tokens.empty()) {
+        throw std::runtime_error("no tokens");
+    }
+
+    // Каждый токен детерминирован, и токены различимы по первому байту
+    PatternChecker checker(grammar);
+    std::vector<ByteSet> firsts;
+    for (const auto& token : tokens) {
+        checker.checkToken(token.name, token.pattern);
+        ByteSet first = checker.info(token.pattern).first;
+        for (size_t i = 0; i < firsts.size(); ++i) {
+            if ((firsts[i] & first).any()) {
+                throw std::runtime_error("tokens " + tokens[i].name + " and " + token.name +
+                                         " both start with " + describeBytes(firsts[i] & first));
+            }
+        }
+        firsts.push_back(first);
+    }
+
+    NfaBuilder nfa(grammar);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        int start = nfa.newState();
+        nfa.states[0].epsilon.push_back(start);
+        int end = nfa.build(tokens[i].pattern, start);
+        nfa.states[end].token = static_cast<int>(i);
+    }
+
+    // Классы байтов: байты, неразличимые всеми переходами НКА
+    std::array<int, 256> nfa_class{};
+    int nfa_classes = 1;
+    for (const auto& state : nfa.states) {
+        for (const auto& edge : state.edges) {
+            std::map<std::pair<int, bool>, int> remap;
+            for (size_t b = 0; b < 256; ++b) {
+                auto key = std::make_pair(nfa_class[b], edge.first.test(b));
+                auto it = remap.emplace(key, static_cast<int>(remap.size())).first;
+                nfa_class[b] = it->second;
+            }
+            nfa_classes = static_cast<int>(remap.size());
+        }
+    }
+    std::vector<unsigned> representative(nfa_classes);
+    for (size_t b = 256; b-- > 0;) {
+        representative[nfa_class[b]] = static_cast<unsigned>(b);
+    }
+
+    // Построение подмножеств: 0 - пустое (тупиковое) состояние, 1 - начальное
+    auto closure = [&nfa](std::vector<int> set) {
+        std::vector<int> stack = set;
+        std::vector<bool> in(nfa.states.size(), false);
+        for (int s : set) in[s] = true;
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            for (int next : nfa.states[s].epsilon) {
+                if (!in[next]) {
+                    in[next] = true;
+                    set.push_back(next);
+                    stack.push_back(next);
+                }
+            }
+        }
+        std::sort(set.begin(), set.end());
+        return set;
+    };
+    std::map<std::vector<int>, uint32_t> dfa_ids;
+    std::vector<std::vector<int>> dfa_sets;
+    auto intern = [&](const std::vector<int>& set) {
+        auto it = dfa_ids.find(set);
+        if (it != dfa_ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(dfa_sets.size());
+        dfa_ids.emplace(set, id);
+        dfa_sets.push_back(set);
+        return id;
+    };
+    intern({});
+    intern(closure({0}));
+    std::vector<uint32_t> dfa_next;
+    std::vector<int> dfa_accept;
+    for (size_t id = 0; id < dfa_sets.size(); ++id) {
+        std::vector<int> set = dfa_sets[id];
+        int accept = NO_TOKEN;
+        for (int s : set) {
+            int token = nfa.states[s].token;
+            if (token != NO_TOKEN && (accept == NO_TOKEN || token < accept)) accept = token;
+        }
+        dfa_accept.push_back(accept);
+        for (int c = 0; c < nfa_classes; ++c) {
+            std::vector<int> target;
+            for (int s : set) {
+                for (const auto& edge : nfa.states[s].edges) {
+                    if (edge.first.test(representative[c])) target.push_back(edge.second);
+                }
+            }
+            std::sort(target.begin(), target.end());
+            target.erase(std::unique(target.begin(), target.end()), target.end());
+            uint32_t next = intern(target.empty() ? target : closure(target));
+            dfa_next.push_back(next);
+        }
+        if (dfa_sets.size() > 65535) {
+            throw std::runtime_error("lexer automaton exceeds 65535 states");
+        }
+    }
+
+    // Минимизация Мура: разбиение по принимаемому токену, уточнение по переходам
+    const size_t n = dfa_sets.size();
+    std::vector<uint32_t> block(n);
+    size_t block_count = 0;
+    {
+        std::map<int, uint32_t> by_accept;
+        for (size_t s = 0; s < n; ++s) {
+            block[s] = by_accept.emplace(dfa_accept[s], static_cast<uint32_t>(by_accept.size())).first->second;
+        }
+        block_count = by_accept.size();
+    }
+    while (true) {
+        std::map<std::vector<uint32_t>, uint32_t> signatures;
+        std::vector<uint32_t> refined(n);
+        for (size_t s = 0; s < n; ++s) {
+            std::vector<uint32_t> signature = {block[s]};
+            for (int c = 0; c < nfa_classes; ++c) {
+                signature.push_back(block[dfa_next[s * nfa_classes + c]]);
+            }
+            refined[s] = signatures.emplace(signature, static_cast<uint32_t>(signatures.size())).first->second;
+        }
+        block = refined;
+        if (signatures.size() == block_count) break;
+        block_count = signatures.size();
+    }
+
+    // Нумерация: блок тупикового состояния - 0, начального - 1, далее по порядку
+    std::vector<uint32_t> number(block_count, UINT32_MAX);
+    uint32_t next_number = 0;
+    number[block[0]] = next_number++;
+    number[block[1]] = next_number++;
+    for (size_t s = 0; s < n; ++s) {
+        if (number[block[s]] == UINT32_MAX) number[block[s]] = next_number++;
+    }
+    std::vector<uint32_t> min_next(block_count * nfa_classes);
+    std::vector<int> min_accept(block_count);
+    for (size_t s = 0; s < n; ++s) {
+        uint32_t state = number[block[s]];
+        min_accept[state] = dfa_accept[s];
+        for (int c = 0; c < nfa_classes; ++c) {
+            min_next[state * nfa_classes + c] = number[block[dfa_next[s * nfa_classes + c]]];
+        }
+    }
+
+    // Классы байтов после минимизации: совпадающие столбцы таблицы сливаются
+    LexerAutomaton automaton;
+    std::map<std::vector<uint32_t>, uint8_t> columns;
+    std::vector<int> column_of(nfa_classes);
+    for (int c = 0; c < nfa_classes; ++c) {
+        std::vector<uint32_t> column;
+        for (size_t state = 0; state < block_count; ++state) {
+            column.push_back(min_next[state * nfa_classes + c]);
+        }
+        column_of[c] = columns.emplace(column, static_cast<uint8_t>(columns.size())).first->second;
+    }
+    automaton.class_count_ = columns.size();
+    automaton.transitions_.assign(block_count * automaton.class_count_, DEAD_STATE);
+    for (size_t state = 0; state < block_count; ++state) {
+        for (int c = 0; c < nfa_classes; ++c) {
+            automaton.transitions_[state * automaton.class_count_ + column_of[c]] = min_next[state * nfa_classes + c];
+        }
+    }
+    for (size_t b = 0; b < 256; ++b) {
+        automaton.byte_classes_[b] = static_cast<uint8_t>(column_of[nfa_class[b]]);
+    }
+    automaton.accepts_ = min_accept;
+    return automaton;
+}
+
+int LexerAutomaton::match(std::string_view input, size_t pos, size_t& length) const {
+    int token = NO_TOKEN;
+    length = 0;
+    uint32_t state = START_STATE;
+    for (size_t p = pos; p < input.size(); ++p) {
+        state = next(state, byte_classes_[static_cast<unsigned char>(input[p])]);
+        if (state == DEAD_STATE) break;
+        if (accepts_[state] != NO_TOKEN) {
+            token = accepts_[state];
+            length = p + 1 - pos;
+        }
+    }
+    return token;
+}
+
+} // namespace bnf_parser_generator
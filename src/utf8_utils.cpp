@@ -1,5 +1,15 @@
 #include "utf8_utils.hpp"
+#include <cstring>
 #include <stdexcept>
+// Табличная проверка использует SSSE3. На x86 с GCC и Clang она собирается
+// всегда и выбирается во время работы, если процессор её поддерживает
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#include <tmmintrin.h>
+#define UTF8_LOOKUP_VALIDATION 1
+#define UTF8_SSSE3 __attribute__((target("ssse3")))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace bnf_parser_generator {
 namespace utf8 {
@@ -38,22 +48,268 @@ bool isValidSequence(const std::string& input, size_t pos, size_t length) {
 }
 
 std::string extractChar(const std::string& input, size_t pos, size_t& charLength) {
-    if (pos >= input.length()) {
-        charLength = 0;
-        return "";
+    const DecodedChar ch = decode(input, pos);
+    charLength = ch.length;
+    return ch.length == 0 ? std::string() : input.substr(pos, ch.length);
+}
+
+DecodedChar decodeMultibyte(std::string_view input, size_t pos) {
+    if (pos >= input.size()) {
+        return {0, 0};
     }
-    
-    unsigned char firstByte = static_cast<unsigned char>(input[pos]);
-    charLength = utf8::charLength(firstByte);
-    
-    // Проверяем валидность последовательности
-    if (!isValidSequence(input, pos, charLength)) {
-        // Если невалидная последовательность, берем только 1 байт
-        charLength = 1;
-        return std::string(1, input[pos]);
+    const auto* s = reinterpret_cast<const unsigned char*>(input.data()) + pos;
+    const size_t available = input.size() - pos;
+    const unsigned char first = s[0];
+    // Байт продолжения или 11111xxx не начинают символ
+    if ((first & 0xC0) == 0x80 || first >= 0xF8) {
+        return {first, 1};
     }
-    
-    return input.substr(pos, charLength);
+    const size_t len = charLength(first);
+    if (len > available) {
+        return {first, 1};
+    }
+    uint32_t codepoint = first & (0x7Fu >> len);
+    for (size_t i = 1; i < len; ++i) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return {first, 1};
+        }
+        codepoint = (codepoint << 6) | (s[i] & 0x3Fu);
+    }
+    return {codepoint, len};
+}
+
+namespace {
+
+// Длина корректного символа в начале s или 0 (таблица 3-7 стандарта Unicode)
+size_t validCharLength(const unsigned char* s, size_t available) {
+    const unsigned char c = s[0];
+    if (c < 0x80) return 1;
+    auto cont = [&](size_t i) { return i < available && (s[i] & 0xC0) == 0x80; };
+    if (c >= 0xC2 && c <= 0xDF) {
+        return cont(1) ? 2 : 0;
+    }
+    if (c >= 0xE0 && c <= 0xEF) {
+        if (!cont(1) || !cont(2)) return 0;
+        if (c == 0xE0 && s[1] < 0xA0) return 0;  // Избыточно длинная форма
+        if (c == 0xED && s[1] > 0x9F) return 0;  // Суррогат
+        return 3;
+    }
+    if (c >= 0xF0 && c <= 0xF4) {
+        if (!cont(1) || !cont(2) || !cont(3)) return 0;
+        if (c == 0xF0 && s[1] < 0x90) return 0;  // Избыточно длинная форма
+        if (c == 0xF4 && s[1] > 0x8F) return 0;  // Выше U+10FFFF
+        return 4;
+    }
+    return 0;
+}
+
+// Байты продолжения (10xxxxxx) в строке
+size_t countContinuationBytes(std::string_view input) {
+    const auto* s = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t size = input.size();
+    size_t count = 0;
+    size_t p = 0;
+#if defined(__SSE2__)
+    // Знаковое сравнение: байты продолжения - от -128 до -65
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(0xC0));
+    while (p + 16 <= size) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + p));
+        count += static_cast<size_t>(__builtin_popcount(
+            static_cast<unsigned>(_mm_movemask_epi8(_mm_cmplt_epi8(chunk, limit)))));
+        p += 16;
+    }
+#endif
+    // По 8 байт: старший бит байта установлен, следующий за ним - нет
+    while (p + 8 <= size) {
+        uint64_t word;
+        std::memcpy(&word, s + p, sizeof(word));
+        count += static_cast<size_t>(__builtin_popcountll(word & ~(word << 1) & 0x8080808080808080ull));
+        p += 8;
+    }
+    for (; p < size; ++p) {
+        if ((s[p] & 0xC0) == 0x80) ++count;
+    }
+    return count;
+}
+
+#if defined(UTF8_LOOKUP_VALIDATION)
+// Проверка блоков по 16 байт (Keiser, Lemire. Validating UTF-8 in less than
+// one instruction per byte). Ошибка пары соседних байтов - пересечение битов
+// трёх таблиц: по старшей и младшей половине первого байта и по старшей
+// половине второго. Третий и четвёртый байты символа проверяются по байтам
+// за два и три шага до них
+constexpr uint8_t TOO_SHORT = 1 << 0;   // 11______ 0_______ или 11______ 11______
+constexpr uint8_t TOO_LONG = 1 << 1;    // 0_______ 10______
+constexpr uint8_t OVERLONG_3 = 1 << 2;  // 11100000 100_____
+constexpr uint8_t TOO_LARGE = 1 << 3;   // 11110100 1001____ и старше
+constexpr uint8_t SURROGATE = 1 << 4;   // 11101101 101_____
+constexpr uint8_t OVERLONG_2 = 1 << 5;  // 1100000_ 10______
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;  // 11110101 1000____ и старше
+constexpr uint8_t OVERLONG_4 = 1 << 6;  // 11110000 1000____
+constexpr uint8_t TWO_CONTS = 1 << 7;   // 10______ 10______
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+UTF8_SSSE3 inline __m128i table(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4, uint8_t b5, uint8_t b6, uint8_t b7,
+                     uint8_t b8, uint8_t b9, uint8_t b10, uint8_t b11, uint8_t b12, uint8_t b13, uint8_t b14,
+                     uint8_t b15) {
+    return _mm_setr_epi8(static_cast<char>(b0), static_cast<char>(b1), static_cast<char>(b2), static_cast<char>(b3),
+                         static_cast<char>(b4), static_cast<char>(b5), static_cast<char>(b6), static_cast<char>(b7),
+                         static_cast<char>(b8), static_cast<char>(b9), static_cast<char>(b10), static_cast<char>(b11),
+                         static_cast<char>(b12), static_cast<char>(b13), static_cast<char>(b14),
+                         static_cast<char>(b15));
+}
+
+UTF8_SSSE3 inline __m128i highNibbles(__m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+// Ненулевые байты результата - ошибки в блоке input (prev - предыдущий блок)
+UTF8_SSSE3 inline __m128i blockErrors(__m128i input, __m128i prev) {
+    const __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    const __m128i byte_1_high = _mm_shuffle_epi8(
+        table(TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+              TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+              TOO_SHORT | OVERLONG_2,
+              TOO_SHORT,
+              TOO_SHORT | OVERLONG_3 | SURROGATE,
+              TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4),
+        highNibbles(prev1));
+    const __m128i byte_1_low = _mm_shuffle_epi8(
+        table(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+              CARRY | OVERLONG_2,
+              CARRY,
+              CARRY,
+              CARRY | TOO_LARGE,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+              CARRY | TOO_LARGE | TOO_LARGE_1000,
+              CARRY | TOO_LARGE | TOO_LARGE_1000),
+        _mm_and_si128(prev1, _mm_set1_epi8(0x0F)));
+    const __m128i byte_2_high = _mm_shuffle_epi8(
+        table(TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+              TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+              TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+              TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+              TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+              TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT),
+        highNibbles(input));
+    const __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // Байт за два шага после 1110xxxx и за три после 11110xxx должен быть
+    // продолжением: такие пары дают TWO_CONTS, бит которого и сверяется
+    const __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+    const __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+    const __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    const __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    const __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must_continue, special);
+}
+
+UTF8_SSSE3 inline bool anyNonZero(__m128i v) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+}
+
+// Ненулевые байты - символ, начатый в последних байтах блока, не закончен
+UTF8_SSSE3 inline __m128i incompleteTail(__m128i input) {
+    const __m128i max = table(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                              0xF0 - 1, 0xE0 - 1, 0xC0 - 1);
+    return _mm_subs_epu8(input, max);
+}
+
+// Блоки по 16 байт; ASCII-блок проверяется только на обрыв символа в предыдущем
+UTF8_SSSE3 bool isValidLookup(std::string_view input) {
+    const auto* s = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t size = input.size();
+    __m128i error = _mm_setzero_si128();
+    __m128i prev = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    unsigned char tail[16] = {};
+    for (size_t p = 0;; p += 16) {
+        __m128i block;
+        if (p + 16 <= size) {
+            block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + p));
+        } else {
+            // Хвост дополняется нулями: оборванный в нём символ - ошибка TOO_SHORT
+            std::memcpy(tail, s + p, size - p);
+            block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+        }
+        if (_mm_movemask_epi8(block) == 0) {
+            error = _mm_or_si128(error, prev_incomplete);
+        } else {
+            error = _mm_or_si128(error, blockErrors(block, prev));
+            prev_incomplete = incompleteTail(block);
+        }
+        prev = block;
+        if (p + 16 >= size) break;
+        // Ранний выход раз в 64 байта, а не ветвление на каждом блоке
+        if ((p & 48) == 48 && anyNonZero(error)) return false;
+    }
+    return !anyNonZero(_mm_or_si128(error, prev_incomplete));
+}
+#endif
+
+} // namespace
+
+size_t asciiPrefix(std::string_view input) {
+    const auto* s = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t size = input.size();
+    size_t p = 0;
+#if defined(__SSE2__)
+    while (p + 16 <= size) {
+        const unsigned high = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + p))));
+        if (high != 0) {
+            return p + static_cast<size_t>(__builtin_ctz(high));
+        }
+        p += 16;
+    }
+#endif
+    while (p + 8 <= size) {
+        uint64_t word;
+        std::memcpy(&word, s + p, sizeof(word));
+        const uint64_t high = word & 0x8080808080808080ull;
+        if (high != 0) {
+            // Младший адрес - младший байт только на little-endian
+            if constexpr (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+                return p + static_cast<size_t>(__builtin_ctzll(high) >> 3);
+            }
+            break;
+        }
+        p += 8;
+    }
+    while (p < size && s[p] < 0x80) ++p;
+    return p;
+}
+
+bool isValid(std::string_view input) {
+#if defined(UTF8_LOOKUP_VALIDATION)
+#if defined(__SSSE3__)
+    return isValidLookup(input);
+#else
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    if (ssse3) {
+        return isValidLookup(input);
+    }
+#endif
+#endif
+    const auto* s = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t size = input.size();
+    size_t p = 0;
+    while (p < size) {
+        p += asciiPrefix(input.substr(p));
+        if (p == size) break;
+        const size_t len = validCharLength(s + p, size - p);
+        if (len == 0) return false;
+        p += len;
+    }
+    return true;
 }
 
 bool isWhitespace(const std::string& utf8Char) {
@@ -68,18 +324,14 @@ bool isWhitespace(const std::string& utf8Char) {
     return false;
 }
 
-size_t length(const std::string& str) {
+size_t length(std::string_view str) {
+    if (isValid(str)) {
+        return str.size() - countContinuationBytes(str);
+    }
     size_t count = 0;
-    size_t pos = 0;
-    
-    while (pos < str.length()) {
-        size_t charLen;
-        extractChar(str, pos, charLen);
-        if (charLen == 0) break;
-        pos += charLen;
-        count++;
+    for (size_t pos = 0; pos < str.size(); pos += decode(str, pos).length) {
+        ++count;
     }
-    
     return count;
 }
 
@@ -170,6 +422,10 @@ std::string Utf8Iterator::current() const {
     return extractChar(str_, pos_, charLen);
 }
 
+uint32_t Utf8Iterator::codepoint() const {
+    return decode(str_, pos_).codepoint;
+}
+
 size_t Utf8Iterator::position() const {
     return pos_;
 }
@@ -181,9 +437,7 @@ size_t Utf8Iterator::charIndex() const {
 void Utf8Iterator::next() {
     if (atEnd()) return;
     
-    size_t charLen;
-    extractChar(str_, pos_, charLen);
-    pos_ += charLen;
+    pos_ += decode(str_, pos_).length;
     charIdx_++;
 }
 
@@ -1,4 +1,6 @@
 #include "bnf_parser.hpp"
+#include "lexer_automaton.hpp"
+#include "grammar_optimizer.hpp"
 #include <iostream>
 #include <cassert>
 
@@ -118,6 +120,271 @@ int main() {
             std::cout << "✓ Non-terminals and terminals extraction" << std::endl;
         }
         
+        // Тест 9: nullable, FIRST, FOLLOW и LL(1)
+        {
+            std::string bnf = R"(
+                start ::= item { ',' item };
+                item ::= 'a'..'z' | '0'..'9' [ '%' ];
+                list ::= 'x' | 'x' 'y';
+            )";
+            
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto analysis = BNFParser::analyzeGrammar(*grammar);
+            
+            const auto* item = analysis.findRule("item");
+            assert(item != nullptr);
+            assert(!item->nullable);
+            assert(item->first.test('a') && item->first.test('z') && item->first.test('5'));
+            assert(!item->first.test('%'));
+            assert(item->follow.test(',') && item->follow.test(END_OF_INPUT));
+            assert(item->isLL1);
+            
+            // Обе альтернативы начинаются с 'x'
+            const auto* list = analysis.findRule("list");
+            assert(list != nullptr && !list->isLL1 && !list->conflicts.empty());
+            
+            auto non_ll1 = analysis.nonLL1Rules();
+            assert(non_ll1.size() == 1 && non_ll1[0] == "list");
+            assert(GrammarAnalysis::describe(item->first) == "{'0'-'9', 'a'-'z'}");
+            
+            // Диапазон кодовых точек даёт ведущие байты UTF-8
+            auto utf8 = BNFGrammarFactory::fromString("start ::= '\\u0400'..'\\u04FF';");
+            auto utf8_analysis = GrammarAnalysis::analyze(*utf8);
+            const auto* cyr = utf8_analysis.findRule("start");
+            assert(cyr->first.test(0xD0) && cyr->first.test(0xD3) && cyr->first.count() == 4);
+            (void)item; (void)list; (void)cyr;
+            std::cout << "✓ Nullable/FIRST/FOLLOW analysis" << std::endl;
+        }
+        
+        // Тест 10: ДКА лексера по правилам-токенам
+        {
+            std::string bnf = R"(
+                WS ::= (' ' | '\n')+;
+                NUMBER ::= '-'? digit+ ('.' digit+)?;
+                digit ::= '0'..'9';
+                NAME ::= ('a'..'z' | '\u0400'..'\u04FF')+;
+                ARROW ::= '->';
+                NESTED ::= '(' NESTED? ')';
+            )";
+            
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto token = [&grammar](const std::string& name) {
+                return LexerToken{name, grammar->findRule(name)->rightSide.get()};
+            };
+            auto lexer = LexerAutomaton::build(*grammar, {token("WS"), token("NUMBER"), token("NAME")});
+            assert(lexer.next(LexerAutomaton::DEAD_STATE, lexer.byteClasses()['1']) == LexerAutomaton::DEAD_STATE);
+            
+            size_t length = 0;
+            assert(lexer.match("-12.5x", 0, length) == 1 && length == 5);
+            // Самое длинное совпадение: "12." - не число, токен заканчивается перед '.'
+            assert(lexer.match("12.", 0, length) == 1 && length == 2);
+            assert(lexer.match("ab\xD0\xB6" "c 1", 0, length) == 2 && length == 5);
+            assert(lexer.match(" \n x", 0, length) == 0 && length == 3);
+            assert(lexer.match("+", 0, length) == LexerAutomaton::NO_TOKEN);
+            // Избыточная кодировка 'a' не принадлежит диапазону 'a'..'z'
+            assert(lexer.match("\xC1\xA1", 0, length) == LexerAutomaton::NO_TOKEN);
+            
+            auto rejects = [&](const std::vector<LexerToken>& tokens, const std::string& reason) {
+                try {
+                    LexerAutomaton::build(*grammar, tokens);
+                } catch (const std::runtime_error& e) {
+                    return std::string(e.what()).find(reason) != std::string::npos;
+                }
+                return false;
+            };
+            // '-' начинает и NUMBER, и ARROW; NESTED нерегулярен
+            assert(rejects({token("NUMBER"), token("ARROW")}, "both start with {'-'}"));
+            assert(rejects({token("NESTED")}, "recursive through rule NESTED"));
+            (void)length; (void)rejects;
+            std::cout << "✓ Token DFA construction" << std::endl;
+        }
+
+        // Тест 11: Компактное представление грамматики
+        {
+            std::string bnf = R"(
+                start ::= item { ',' item } | missing;
+                item ::= 'a'..'z' | 'x';
+                start ::= 'end';
+            )";
+
+            // Без фабрики: она отвергла бы неопределённый missing
+            BNFLexer bnf_lexer(bnf);
+            BNFParser parser(bnf_lexer.tokenize());
+            auto grammar = parser.parseGrammar();
+            assert(grammar != nullptr);
+            auto ir = GrammarIR::lower(*grammar);
+            assert(ir.rules().size() == 3 && ir.ruleNameCount() == 2);
+            // Повторное определение - отдельное правило, поиск находит первое
+            assert(ir.findRule("start") == 0 && ir.findRule("item") == 1);
+            assert(ir.findRule("missing") == NO_ID && ir.findRule("nothing") == NO_ID);
+            assert(ir.ruleName(2) == "start" && ir.startRule() == 0);
+
+            // Узлы правила - непрерывный отрезок в прямом порядке обхода
+            NodeId body = ir.rule(1).body;
+            assert(ir.node(body).kind == NodeKind::ALTERNATIVE && ir.node(body).child_count == 2);
+            NodeId range = ir.child(body, 0);
+            assert(ir.node(range).kind == NodeKind::CHAR_RANGE);
+            assert(ir.node(range).range_start == 'a' && ir.node(range).range_end == 'z');
+            assert(ir.literals().name(ir.node(ir.child(body, 1)).symbol) == "x");
+            assert(ir.bodyEnd(1) == ir.rule(2).body && ir.bodyEnd(2) == ir.nodeCount());
+
+            // Ссылка разрешена при построении; узел связан с деревом
+            const auto* alt = node_cast<Alternative>(grammar->rules[0]->rightSide.get());
+            assert(alt != nullptr && alt->kind() == NodeKind::ALTERNATIVE);
+            NodeId missing = ir.find(alt->choices[1].get());
+            assert(ir.node(missing).kind == NodeKind::NON_TERMINAL && ir.node(missing).rule == NO_ID);
+            assert(ir.source(missing) == alt->choices[1].get());
+            assert(node_cast<Sequence>(alt) == nullptr);
+
+            auto validation = BNFParser::validateGrammar(ir);
+            assert(!validation.isValid && validation.errors.size() == 1);
+            assert(validation.errors[0].find("missing") != std::string::npos);
+            (void)body; (void)range; (void)missing;
+            std::cout << "✓ Grammar IR lowering" << std::endl;
+        }
+
+        // Тест 12: Оптимизация грамматики
+        {
+            std::string bnf = R"(
+                stmt ::= 'if' expr 'then' stmt | 'if' expr | string | (NUMBER);
+                expr ::= NUMBER | string;
+                string ::= STRING;
+                STRING ::= '"' char* '"';
+                char ::= hex_digit | 'g'..'z' | ' ';
+                hex_digit ::= '0'..'9' | 'a'..'f' | 'A'..'F';
+                NUMBER ::= digit+;
+                digit ::= '0'..'9';
+                unused ::= 'u';
+                WHITESPACE ::= ' ';
+            )";
+
+            // В дереве видны узлы всех правил, и внутри токенов: ничего не раскрывается
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto report = GrammarOptimizer::optimize(*grammar);
+            assert(report.inlined == 0 && report.factored == 1 && report.removed == 1);
+            assert(grammar->findRule("stmt")->rightSide->toString() ==
+                   "\"if\" <expr> [\"then\" <stmt>] | <string> | <NUMBER>");
+            assert(grammar->findRule("STRING")->rightSide->toString() == "\"\"\" {<char>} \"\"\"");
+            assert(grammar->findRule("digit") != nullptr && grammar->findRule("unused") == nullptr);
+
+            // Без узлов внутри токенов раскрываются правила, вызванные из токенов
+            auto tokens = BNFGrammarFactory::fromString(bnf);
+            OptimizerOptions leaves;
+            leaves.preserve_token_nodes = false;
+            report = GrammarOptimizer::optimize(*tokens, leaves);
+            assert(report.inlined == 3 && report.factored == 1 && report.folded == 2);
+            assert(report.removed == 4 && report.changes.size() > report.removed);
+            assert(tokens->findRule("STRING")->rightSide->toString() ==
+                   "\"\"\" {\" \" | '0'..'9' | 'A'..'F' | 'a'..'z'} \"\"\"");
+            assert(tokens->findRule("NUMBER")->rightSide->toString() == "'0'..'9'+");
+            assert(tokens->findRule("string") != nullptr && tokens->findRule("WHITESPACE") != nullptr);
+            assert(tokens->findRule("digit") == nullptr && tokens->findRule("unused") == nullptr);
+            assert(BNFParser::validateGrammar(*tokens).isValid);
+
+            // В распознавателе раскрываются и синтаксические правила
+            auto recognized = BNFGrammarFactory::fromString(bnf);
+            OptimizerOptions options;
+            options.preserve_tree = false;
+            options.preserve_token_nodes = false;
+            GrammarOptimizer::optimize(*recognized, options);
+            assert(recognized->findRule("stmt")->rightSide->toString() ==
+                   "\"if\" (<NUMBER> | <STRING>) [\"then\" <stmt>] | <STRING> | <NUMBER>");
+            assert(recognized->findRule("expr") == nullptr && recognized->findRule("string") == nullptr);
+
+            // Выключенные проходы не меняют грамматику
+            auto untouched = BNFGrammarFactory::fromString(bnf);
+            std::string before = untouched->toString();
+            OptimizerOptions none;
+            none.inline_rules = none.left_factor = none.fold_char_classes = false;
+            none.flatten = none.remove_unreachable = false;
+            assert(GrammarOptimizer::optimize(*untouched, none).total() == 0);
+            assert(untouched->toString() == before);
+            (void)report;
+            std::cout << "✓ Grammar optimization" << std::endl;
+        }
+
+        // Тест 13: Двоичная форма грамматики
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= ' '+;
+                start ::= greeting[sing] (',' NAME)*;
+                greeting[N:enum{sing,plur}] ::= 'hello' | 'привет' | '\u00e9'..'\u00ff';
+                NAME ::= ('a'..'z')+;
+            )";
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto* start = node_cast<Sequence>(grammar->rules[1]->rightSide.get());
+            assert(start != nullptr);
+            start->addElement(std::make_unique<ContextAction>(ContextAction::ActionType::STORE,
+                                                              std::vector<std::string>{"last", "NAME"}));
+            std::string binary = BNFGrammarFactory::toBinary(*grammar);
+            assert(BNFGrammarFactory::isBinary(binary) && !BNFGrammarFactory::isBinary(bnf));
+
+            auto loaded = BNFGrammarFactory::fromBinary(binary);
+            assert(loaded->toString() == grammar->toString());
+            assert(loaded->startSymbol == grammar->startSymbol);
+            assert(loaded->findRule("greeting")->parameters[0].enumValues.size() == 2);
+            assert(loaded->isContextSensitive());
+            assert(BNFGrammarFactory::toBinary(*loaded) == binary);
+
+            // Обрезанные и испорченные данные - исключение, а не падение
+            for (size_t size = 0; size < binary.size(); ++size) {
+                bool thrown = false;
+                try {
+                    BNFGrammarFactory::fromBinary(binary.substr(0, size));
+                } catch (const std::runtime_error&) {
+                    thrown = true;
+                }
+                assert(thrown);
+            }
+            std::string corrupted = binary;
+            corrupted[corrupted.size() / 2] = '\x7f';
+            try {
+                BNFGrammarFactory::fromBinary(corrupted);
+            } catch (const std::runtime_error&) {
+            }
+            std::cout << "✓ Binary grammar format" << std::endl;
+        }
+
+        // Тест 14: Токены - срезы текста, чтение по требованию
+        {
+            std::string bnf = "# c\nrule ::= <item name> { item } '\\u00e9\\n' | 'a'..'z';\nitem ::= \"x\";";
+            BNFLexer lexer(bnf);
+            BNFToken comment = lexer.next();
+            assert(comment.type == TokenType::COMMENT && comment.value == " c");
+            assert(comment.value.data() == bnf.data() + 1);
+            assert(lexer.next().type == TokenType::NEWLINE);
+            BNFToken name = lexer.next();
+            assert(name.type == TokenType::IDENTIFIER && name.value == "rule" && name.line == 2 && name.column == 1);
+            assert(lexer.next().type == TokenType::DEFINE);
+            BNFToken bracketed = lexer.next();
+            assert(bracketed.value == "item name" && bracketed.column == 10);
+            lexer.next();
+            lexer.next();
+            lexer.next();
+            BNFToken literal = lexer.next();
+            assert(literal.type == TokenType::TERMINAL && literal.has_escapes);
+            assert(literal.value == "\\u00e9\\n" && BNFLexer::unescape(literal.value) == "\u00e9\n");
+            assert(lexer.tokenize().back().type == TokenType::EOF_TOKEN);
+
+            // Разбор прямо из текста; { имя } - повторение, а не контекстное действие
+            BNFParser parser(bnf);
+            auto grammar = parser.parseGrammar();
+            assert(grammar != nullptr && grammar->rules.size() == 2);
+            const auto* alt = node_cast<Alternative>(grammar->rules[0]->rightSide.get());
+            assert(alt != nullptr);
+            const auto* seq = node_cast<Sequence>(alt->choices[0].get());
+            assert(seq != nullptr && seq->elements.size() == 3);
+            assert(node_cast<NonTerminal>(seq->elements[0].get())->name == "item name");
+            assert(node_cast<ZeroOrMore>(seq->elements[1].get()) != nullptr);
+            assert(node_cast<Terminal>(seq->elements[2].get())->value == "\u00e9\n");
+            assert(node_cast<CharRange>(alt->choices[1].get())->end == 'z');
+
+            BNFParser broken("rule ::= 'a'\n  | ;");
+            assert(broken.parseGrammar() == nullptr);
+            assert(broken.getError() == "Parse error at line 1, column 13: Expected ';' after rule definition");
+            std::cout << "✓ Streaming BNF front-end" << std::endl;
+        }
+
         std::cout << "\n✅ Все тесты прошли успешно" << std::endl;
         return 0;
         
@@ -12,11 +12,11 @@ int main() {
         // Тест 1: Парсинг параметризованного правила
         {
             std::string extended_bnf = R"(
-                agreement[N:enum{sing,plur}] ::= noun[N] verb[N]
-                noun[sing] ::= "cat" | "dog"
-                noun[plur] ::= "cats" | "dogs"
-                verb[sing] ::= "runs" | "jumps"
-                verb[plur] ::= "run" | "jump"
+                agreement[N:enum{sing,plur}] ::= noun[N] verb[N];
+                noun[sing] ::= "cat" | "dog";
+                noun[plur] ::= "cats" | "dogs";
+                verb[sing] ::= "runs" | "jumps";
+                verb[plur] ::= "run" | "jump";
             )";
             
             auto grammar = BNFGrammarFactory::fromString(extended_bnf);
@@ -41,11 +41,11 @@ int main() {
         // Тест 2: Генерация C++ кода для параметризованных правил
         {
             std::string extended_bnf = R"(
-                agreement[N:enum{sing,plur}] ::= noun[N] verb[N]
-                noun[sing] ::= "cat"
-                noun[plur] ::= "cats"
-                verb[sing] ::= "runs"
-                verb[plur] ::= "run"
+                agreement[N:enum{sing,plur}] ::= noun[N] verb[N];
+                noun[sing] ::= "cat";
+                noun[plur] ::= "cats";
+                verb[sing] ::= "runs";
+                verb[plur] ::= "run";
             )";
             
             auto grammar = BNFGrammarFactory::fromString(extended_bnf);
@@ -58,15 +58,13 @@ int main() {
             assert(result.success);
             assert(!result.parser_code.empty());
             
-            // Проверяем наличие enum в сгенерированном коде
-            assert(result.parser_code.find("enum class NEnum") != std::string::npos);
-            assert(result.parser_code.find("sing") != std::string::npos);
-            assert(result.parser_code.find("plur") != std::string::npos);
-            
-            // Проверяем наличие параметризованных функций
-            assert(result.parser_code.find("parse_agreement(NEnum N)") != std::string::npos);
-            assert(result.parser_code.find("parse_noun(NEnum N)") != std::string::npos);
-            assert(result.parser_code.find("parse_verb(NEnum N)") != std::string::npos);
+            // Значения enum подставлены: по функции на значение, без параметров
+            assert(result.parser_code.find("NodePtr parse_agreement()") != std::string::npos);
+            assert(result.parser_code.find("NodePtr parse_agreement_sing_()") != std::string::npos);
+            assert(result.parser_code.find("NodePtr parse_agreement_plur_()") != std::string::npos);
+            assert(result.parser_code.find("NodePtr parse_noun_sing_()") != std::string::npos);
+            assert(result.parser_code.find("NodePtr parse_verb_plur_()") != std::string::npos);
+            assert(result.parser_code.find("NEnum") == std::string::npos);
             
             std::cout << "✓ Parameterized code generation" << std::endl;
         }
@@ -74,11 +72,11 @@ int main() {
         // Тест 3: Контекстные действия
         {
             std::string context_bnf = R"(
-                document ::= (anchor | reference)*
-                anchor ::= "&" name content {store(name, content)}
-                reference ::= "*" name {lookup(name)}
-                name ::= 'a'..'z'+
-                content ::= 'A'..'Z'+
+                document ::= (anchor | reference)*;
+                anchor ::= "&" name content {store(name, content)};
+                reference ::= "*" name {lookup(name)};
+                name ::= 'a'..'z'+;
+                content ::= 'A'..'Z'+;
             )";
             
             auto grammar = BNFGrammarFactory::fromString(context_bnf);
@@ -92,9 +90,9 @@ int main() {
         // Тест 4: Генерация кода с контекстными действиями
         {
             std::string context_bnf = R"(
-                document ::= anchor reference
-                anchor ::= "&name" "value" {store(name, value)}
-                reference ::= "*name" {lookup(name)}
+                document ::= anchor reference;
+                anchor ::= "&name" "value" {store(name, value)};
+                reference ::= "*name" {lookup(name)};
             )";
             
             auto grammar = BNFGrammarFactory::fromString(context_bnf);
@@ -107,12 +105,12 @@ int main() {
             assert(result.success);
             
             // Проверяем наличие контекстного хранилища
-            assert(result.parser_code.find("context_storage_") != std::string::npos);
+            assert(result.parser_code.find("class ContextStore") != std::string::npos);
             assert(result.parser_code.find("std::unordered_map") != std::string::npos);
             
             // Проверяем генерацию store и lookup действий
-            assert(result.parser_code.find("context_storage_[") != std::string::npos);
-            assert(result.parser_code.find("context_storage_.find") != std::string::npos);
+            assert(result.parser_code.find("context_.store(CONTEXT_name") != std::string::npos);
+            assert(result.parser_code.find("context_.find(CONTEXT_name") != std::string::npos);
             
             std::cout << "✓ Context actions code generation" << std::endl;
         }
@@ -120,12 +118,12 @@ int main() {
         // Тест 5: Indentation грамматика (Python-style)
         {
             std::string indent_bnf = R"(
-                block[indent:int] ::= line[indent] (newline line[indent])*
-                line[indent] ::= spaces[indent] statement
-                spaces[0] ::= ""
-                spaces[n:int] ::= "    " spaces[n-1]
-                statement ::= "print" "hello"
-                newline ::= "\n"
+                block[indent:int] ::= line[indent] (newline line[indent])* ;
+                line[indent] ::= spaces[indent] statement ;
+                spaces[0] ::= "" ;
+                spaces[n:int] ::= "    " spaces[n-1] ;
+                statement ::= "print" "hello" ;
+                newline ::= "\n" ;
             )";
             
             auto grammar = BNFGrammarFactory::fromString(indent_bnf);
@@ -138,13 +136,25 @@ int main() {
             assert(block_rule->hasParameters());
             assert(block_rule->parameters[0].type == ParameterType::INTEGER);
             
+            // spaces[0] и spaces[n:int] - одна функция: образец 0 проверяется
+            // при разборе, n-1 передаётся как выражение
+            auto generator = CodeGeneratorFactory::create("cpp");
+            GeneratorOptions options;
+            options.parser_name = "IndentParser";
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            assert(result.parser_code.find("parse_block(0)") != std::string::npos);
+            assert(result.parser_code.find("NodePtr parse_spaces(int n)") != std::string::npos);
+            assert(result.parser_code.find("if (!(n == 0))") != std::string::npos);
+            assert(result.parser_code.find("parse_spaces(n-1)") != std::string::npos);
+            
             std::cout << "✓ Indentation grammar parsing" << std::endl;
         }
         
         // Тест 6: Валидация Extended BNF грамматик
         {
             std::string invalid_bnf = R"(
-                rule[param] ::= other[undefined_param]
+                rule[param] ::= other[undefined_param] ;
             )";
             
             try {
@@ -162,13 +172,13 @@ int main() {
         // Тест 7: Смешанные параметризованные и обычные правила
         {
             std::string mixed_bnf = R"(
-                program ::= agreement statement
-                agreement[N:enum{sing,plur}] ::= noun[N] verb[N]
-                noun[sing] ::= "cat"
-                noun[plur] ::= "cats"
-                verb[sing] ::= "runs"
-                verb[plur] ::= "run"
-                statement ::= "end"
+                program ::= agreement statement ;
+                agreement[N:enum{sing,plur}] ::= noun[N] verb[N] ;
+                noun[sing] ::= "cat" ;
+                noun[plur] ::= "cats" ;
+                verb[sing] ::= "runs" ;
+                verb[plur] ::= "run" ;
+                statement ::= "end" ;
             )";
             
             auto grammar = BNFGrammarFactory::fromString(mixed_bnf);
@@ -177,7 +187,7 @@ int main() {
             
             // Проверяем наличие как параметризованных, так и обычных правил
             auto parameterized_rules = grammar->getParameterizedRules();
-            assert(parameterized_rules.size() == 3); // agreement, noun, verb
+            assert(parameterized_rules.size() == 5); // agreement и по два определения noun, verb
             
             auto* program_rule = grammar->findRule("program");
             assert(program_rule != nullptr);
@@ -186,10 +196,10 @@ int main() {
             std::cout << "✓ Mixed parameterized and regular rules" << std::endl;
         }
         
-        // Тест 8: Генерация enum типов
+        // Тест 8: Специализация по значениям enum
         {
             std::string enum_bnf = R"(
-                test[T:enum{type1,type2,type3}] ::= "value"
+                test[T:enum{type1,type2,type3}] ::= "value" ;
             )";
             
             auto grammar = BNFGrammarFactory::fromString(enum_bnf);
@@ -201,13 +211,12 @@ int main() {
             auto result = generator->generate(*grammar, options);
             assert(result.success);
             
-            // Проверяем правильную генерацию enum
-            assert(result.parser_code.find("enum class TEnum") != std::string::npos);
-            assert(result.parser_code.find("type1") != std::string::npos);
-            assert(result.parser_code.find("type2") != std::string::npos);
-            assert(result.parser_code.find("type3") != std::string::npos);
+            // Стартовое правило - выбор по всем значениям enum
+            assert(result.parser_code.find("NodePtr parse_test_type1_()") != std::string::npos);
+            assert(result.parser_code.find("NodePtr parse_test_type2_()") != std::string::npos);
+            assert(result.parser_code.find("NodePtr parse_test_type3_()") != std::string::npos);
             
-            std::cout << "✓ Enum type generation" << std::endl;
+            std::cout << "✓ Enum parameter specialization" << std::endl;
         }
         
         std::cout << "\n✅ Все Extended BNF тесты прошли успешно" << std::endl;
@@ -1,10 +1,94 @@
 #include "bnf_parser.hpp"
+#include "bytecode_vm.hpp"
 #include "code_generator.hpp"
+#include "corpus_generator.hpp"
+#include "generation_cache.hpp"
+#include "grammar_optimizer.hpp"
+#include "utf8_utils.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <cassert>
+#include <algorithm>
 
 using namespace bnf_parser_generator;
 
+namespace {
+
+std::string compiler() {
+    const char* cxx = std::getenv("CXX");
+    return cxx && *cxx ? cxx : "c++";
+}
+
+// Проверки поведения собирают сгенерированный парсер системным компилятором
+// ($CXX или c++); без компилятора они пропускаются
+bool haveCompiler() {
+    static const bool available = std::system((compiler() + " --version > /dev/null 2>&1").c_str()) == 0;
+    return available;
+}
+
+// Собирает парсер с драйвером (путь ко входу - argv[1]) и возвращает его
+// вывод; пустая строка - сборка не удалась
+std::string runGenerated(const std::string& name, const std::string& parser_code, const std::string& driver,
+                         const std::string& input) {
+    const auto directory = std::filesystem::temp_directory_path() / "bnf_generator_test";
+    std::filesystem::create_directories(directory);
+    const auto parser_path = directory / (name + "_parser.cpp");
+    const auto driver_path = directory / (name + "_driver.cpp");
+    const auto binary_path = directory / name;
+    const auto input_path = directory / (name + ".input");
+    const auto output_path = directory / (name + ".output");
+    std::ofstream(parser_path, std::ios::binary) << parser_code;
+    std::ofstream(driver_path, std::ios::binary) << "#include \"" << parser_path.string() << "\"\n" << driver;
+    std::ofstream(input_path, std::ios::binary) << input;
+
+    std::string compile = compiler() + " -std=c++20 -O1 -w -o " + binary_path.string() + " " +
+                          driver_path.string() + " > " + output_path.string() + " 2>&1";
+    if (std::system(compile.c_str()) != 0) {
+        std::ifstream log(output_path);
+        std::cerr << log.rdbuf();
+        return "";
+    }
+    std::string run = binary_path.string() + " " + input_path.string() + " > " + output_path.string() + " 2>&1";
+    [[maybe_unused]] int status = std::system(run.c_str());
+    std::ifstream in(output_path, std::ios::binary);
+    std::stringstream output;
+    output << in.rdbuf();
+    return output.str();
+}
+
+// Драйвер, печатающий дерево разбора: по узлу на строку, с отступом по глубине
+std::string treeDriver(const Grammar& grammar, const std::string& parser_name) {
+    std::ostringstream ss;
+    ss << "#include <fstream>\n#include <iostream>\n#include <sstream>\n\n";
+    ss << "void print(const ASTNode* node, size_t depth) {\n";
+    ss << "    std::cout << std::string(2 * depth, ' ') << node->toString() << \"\\n\";\n";
+    for (const auto& rule : grammar.rules) {
+        ss << "    if (auto* n = dynamic_cast<const " << rule->leftSide << "Node*>(node)) {\n";
+        ss << "        for (const auto& child : n->children) print(&*child, depth + 1);\n";
+        ss << "    }\n";
+    }
+    ss << "}\n\n";
+    ss << "int main(int, char* argv[]) {\n";
+    ss << "    std::ifstream file(argv[1], std::ios::binary);\n";
+    ss << "    std::stringstream content;\n";
+    ss << "    content << file.rdbuf();\n";
+    ss << "    const std::string input = content.str();\n";
+    ss << "    " << parser_name << " parser{std::string_view(input)};\n";
+    ss << "    auto result = parser.parse();\n";
+    ss << "    if (!result) {\n";
+    ss << "        std::cout << \"FAIL \" << parser.getError() << \"\\n\";\n";
+    ss << "        return 1;\n";
+    ss << "    }\n";
+    ss << "    print(&*result, 0);\n";
+    ss << "}\n";
+    return ss.str();
+}
+
+} // namespace
+
 int main() {
     std::cout << "=== Code Generator Tests ===" << std::endl;
     
@@ -176,6 +260,1485 @@ int main() {
             std::cout << "✓ Messages and warnings" << std::endl;
         }
         
+        // Тест 11: Packrat-мемоизация
+        {
+            std::string bnf = R"(
+                expr ::= term '+' expr | term;
+                term ::= factor | '(' expr ')';
+                factor ::= 'x';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            auto plain = generator->generate(*grammar, options);
+            assert(plain.success);
+            assert(plain.parser_code.find("MemoEntry") == std::string::npos);
+            assert(plain.parser_code.find("using NodePtr = std::unique_ptr<ASTNode>") != std::string::npos);
+
+            options.memoize = true;
+            options.no_memoize_rules = {"term"};
+            auto memo = generator->generate(*grammar, options);
+            assert(memo.success);
+            assert(memo.parser_code.find("using NodePtr = std::shared_ptr<ASTNode>") != std::string::npos);
+            assert(memo.parser_code.find("memo_expr_") != std::string::npos);
+            assert(memo.parser_code.find("parse_expr_uncached()") != std::string::npos);
+            // Исключено явно
+            assert(memo.parser_code.find("memo_term_") == std::string::npos);
+            // Листовое правило не мемоизируется по умолчанию
+            assert(memo.parser_code.find("memo_factor_") == std::string::npos);
+
+            // Явное включение работает и без глобального флага
+            GeneratorOptions opt_in;
+            opt_in.memoize_rules = {"factor"};
+            auto forced = generator->generate(*grammar, opt_in);
+            assert(forced.success);
+            assert(forced.parser_code.find("memo_factor_") != std::string::npos);
+            assert(forced.parser_code.find("memo_expr_") == std::string::npos);
+
+            // Упор в предел глубины зависит от глубины вызова: такой результат не
+            // запоминается, а запись годится только там, где правило не упрётся
+            if (haveCompiler()) {
+                std::string chain;
+                for (int i = 0; i < 39; ++i) {
+                    chain += "w" + std::to_string(i) + " ::= w" + std::to_string(i + 1) + ";\n";
+                }
+                chain.replace(chain.rfind("w39"), 3, "r");
+                auto run = [&](const std::string& start, const std::string& r, GeneratorOptions variant) {
+                    auto deep = BNFGrammarFactory::fromString(start + chain + r);
+                    variant.parser_name = "DepthParser";
+                    variant.max_recursion_depth = 40;
+                    std::string output = runGenerated("memo_depth", generator->generate(*deep, variant).parser_code,
+                                                      treeDriver(*deep, variant.parser_name), "x");
+                    assert(!output.empty());
+                    return output.rfind("FAIL", 0) != 0;
+                };
+                GeneratorOptions memoized;
+                memoized.memoize_rules = {"r"};
+                GeneratorOptions incremental = memoized;
+                incremental.incremental = true;
+                for (const std::string& r : {std::string("r ::= \"x\";"), std::string("r ::= \"x\" ^ (\"y\")?;")}) {
+                    // Неудача r на дне цепочки не мешает r во второй альтернативе
+                    const std::string shallow_after_deep = "start ::= w0 \"!\" | r;\n";
+                    assert(run(shallow_after_deep, r, GeneratorOptions{}));
+                    assert(run(shallow_after_deep, r, memoized));
+                    assert(run(shallow_after_deep, r, incremental));
+                    // Успех r у корня не переносится на дно цепочки
+                    const std::string deep_after_shallow = "start ::= r \"?\" | w0;\n";
+                    assert(!run(deep_after_shallow, r, GeneratorOptions{}));
+                    assert(!run(deep_after_shallow, r, memoized));
+                    assert(!run(deep_after_shallow, r, incremental));
+                }
+            }
+            std::cout << "✓ Packrat memoization generation" << std::endl;
+        }
+
+        // Тест 12: Zero-copy вход и mmap в main
+        {
+            std::string bnf = R"(
+                start ::= 'hello' 'world';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.parser_name = "ViewParser";
+            options.generate_executable = true;
+
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            assert(result.parser_code.find("std::string_view input_;") != std::string::npos);
+            assert(result.parser_code.find("explicit ViewParser(std::string_view input)") != std::string::npos);
+            assert(result.parser_code.find("ViewParser(const char* data, size_t size)") != std::string::npos);
+            assert(result.parser_code.find("std::memcmp") != std::string::npos);
+            assert(result.parser_code.find("substr") == std::string::npos);
+            assert(result.main_code.find("mmap(") != std::string::npos);
+            assert(result.main_code.find("class InputFile") != std::string::npos);
+            assert(result.main_code.find("struct stat st{};") != std::string::npos);
+            std::cout << "✓ Zero-copy input generation" << std::endl;
+        }
+
+        // Тест 13: Арена для AST и переиспользование парсера
+        {
+            std::string bnf = R"(
+                list ::= '[' [ item { ',' item } ] ']';
+                item ::= 'a'..'z'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            auto plain = generator->generate(*grammar, options);
+            assert(plain.success);
+            assert(plain.parser_code.find("class Arena") == std::string::npos);
+            assert(plain.parser_code.find("void reset(std::string_view input)") != std::string::npos);
+
+            options.arena_allocation = true;
+            auto arena = generator->generate(*grammar, options);
+            assert(arena.success);
+            assert(arena.parser_code.find("class Arena") != std::string::npos);
+            assert(arena.parser_code.find("using NodePtr = ASTNode*;") != std::string::npos);
+            assert(arena.parser_code.find("ArenaVector<NodePtr> children;") != std::string::npos);
+            assert(arena.parser_code.find("arena_.create<") != std::string::npos);
+            // Откат при backtracking - сброс метки арены
+            assert(arena.parser_code.find("arena_.rewind(") != std::string::npos);
+            assert(arena.parser_code.find("make_unique") == std::string::npos);
+
+            // С мемоизацией узлы из таблицы должны пережить откат
+            options.memoize = true;
+            auto memo = generator->generate(*grammar, options);
+            assert(memo.success);
+            assert(memo.parser_code.find("using NodePtr = ASTNode*;") != std::string::npos);
+            assert(memo.parser_code.find("arena_.rewind(") == std::string::npos);
+            std::cout << "✓ Arena allocation generation" << std::endl;
+        }
+
+        // Тест 14: Выбор альтернативы по FIRST-множествам
+        {
+            std::string bnf = R"(
+                value ::= '[' ']' | '0'..'9'+ | 'true';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            assert(result.parser_code.find("alt_dispatch_") != std::string::npos);
+            assert(result.parser_code.find("alt_viable_") != std::string::npos);
+
+            // Альтернатива с пустым разбором допустима на любом байте: если таковы
+            // все альтернативы, таблица ничего не отсекает и не генерируется
+            auto nullable = BNFGrammarFactory::fromString("value ::= ['a'] | ['b'];");
+            auto nullable_result = generator->generate(*nullable, options);
+            assert(nullable_result.success);
+            assert(nullable_result.parser_code.find("alt_dispatch_") == std::string::npos);
+
+            options.first_set_dispatch = false;
+            auto ordered = generator->generate(*grammar, options);
+            assert(ordered.success);
+            assert(ordered.parser_code.find("alt_dispatch_") == std::string::npos);
+            std::cout << "✓ FIRST-set alternative dispatch" << std::endl;
+        }
+
+        // Тест 15: Ленивое вычисление строки и столбца
+        {
+            std::string bnf = R"(
+                start ::= item item*;
+                item ::= 'a'..'z'+ ';';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            auto eager = generator->generate(*grammar, options);
+            assert(eager.success);
+            assert(eager.parser_code.find("size_t line_ = 1;") != std::string::npos);
+            assert(eager.parser_code.find("node->line = saved_line;") != std::string::npos);
+            assert(eager.parser_code.find("positionAt") == std::string::npos);
+
+            options.lazy_positions = true;
+            options.memoize = true;
+            auto lazy = generator->generate(*grammar, options);
+            assert(lazy.success);
+            // В горячем пути и точках возврата остаётся только смещение
+            assert(lazy.parser_code.find("++line_") == std::string::npos);
+            assert(lazy.parser_code.find("saved_line") == std::string::npos);
+            assert(lazy.parser_code.find("column_") == std::string::npos);
+            assert(lazy.parser_code.find("size_t offset = 0;") != std::string::npos);
+            assert(lazy.parser_code.find("node->offset = saved_pos;") != std::string::npos);
+            assert(lazy.parser_code.find("SourcePosition positionAt(size_t offset) const") != std::string::npos);
+            assert(lazy.parser_code.find("std::memchr") != std::string::npos);
+            std::cout << "✓ Lazy line/column generation" << std::endl;
+        }
+
+        // Тест 16: Пропуск пробелов по правилу грамматики
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= (' ' | '\t' | '\n' | '\r')+;
+                list ::= '[' NUMBER { ',' NUMBER } ']';
+                NUMBER ::= '-'? digit+;
+                digit ::= '0'..'9';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("static bool isSkippedByte(unsigned char c)") != std::string::npos);
+            assert(code.find("_mm_cmpeq_epi8") != std::string::npos);
+
+            // Внутри токена (и вспомогательного digit) пробелы не пропускаются
+            auto body = [&code](const std::string& function) {
+                size_t begin = code.find("NodePtr " + function + "() {");
+                size_t end = std::min(code.find("    // Parse rule:", begin),
+                                      code.find("    // Helper methods", begin));
+                return code.substr(begin, end - begin);
+            };
+            assert(body("parse_NUMBER").find("skipWhitespace()") == std::string::npos);
+            assert(body("parse_digit").find("skipWhitespace()") == std::string::npos);
+            assert(body("parse_list").find("skipWhitespace()") != std::string::npos);
+            size_t match = code.find("bool matchString(std::string_view str) {");
+            assert(code.find("skipWhitespace();", match) > code.find("return false;", match));
+
+            // Правило с комментариями не сводится к классу байтов: вызывается само правило
+            auto trivia = BNFGrammarFactory::fromString(R"(
+                TRIVIA ::= (' ' | COMMENT)+;
+                COMMENT ::= '#' 'a'..'z'* '\n';
+                start ::= 'x' 'y';
+            )");
+            auto trivia_result = generator->generate(*trivia, options);
+            assert(trivia_result.success);
+            assert(trivia_result.parser_code.find("repeat rule TRIVIA") != std::string::npos);
+
+            // Без правила пробелов - прежний std::isspace перед каждым терминалом
+            auto legacy = BNFGrammarFactory::fromString("start ::= 'x' 'y';");
+            auto legacy_result = generator->generate(*legacy, options);
+            assert(legacy_result.success);
+            assert(legacy_result.parser_code.find("Whitespace between tokens: std::isspace") != std::string::npos);
+
+            options.whitespace_rule = "MISSING";
+            assert(!generator->generate(*grammar, options).success);
+            std::cout << "✓ Grammar-driven whitespace skipping" << std::endl;
+        }
+
+        // Тест 17: Блочное сканирование повторений классов символов
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= (' ' | '\t' | '\n')+;
+                start ::= IDENT STRING words;
+                IDENT ::= letter (letter | '0'..'9')*;
+                letter ::= 'a'..'z' | '_';
+                STRING ::= '"' (' '..'!' | '#'..'[' | ']'..'\U0010FFFF' | '\\' '"')* '"';
+                words ::= 'a'..'z'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            auto body = [&code](const std::string& function) {
+                size_t begin = code.find("NodePtr " + function + "() {");
+                size_t end = std::min(code.find("    // Parse rule:", begin),
+                                      code.find("    // Helper methods", begin));
+                return code.substr(begin, end - begin);
+            };
+
+            // Ссылка на правило letter строит его узел в дереве: сканируются только
+            // цифры, letter разбирается вызовом между их отрезками
+            std::string ident = body("parse_IDENT");
+            assert(ident.find("advanceTo(scanClass") != std::string::npos);
+            assert(ident.find("parse_letter()") != std::string::npos);
+            // Класс и другая альтернатива (экранирование) с непересекающимися FIRST
+            assert(body("parse_STRING").find("advanceTo(scanClass") != std::string::npos);
+            // В синтаксическом правиле пробелы пропускаются перед каждым символом
+            assert(body("parse_words").find("scanClass") == std::string::npos);
+
+            assert(code.find("size_t scanClass0(size_t p) const") != std::string::npos);
+            assert(code.find("_mm256_movemask_epi8") != std::string::npos);
+            assert(code.find("_mm_movemask_epi8") != std::string::npos);
+            assert(code.find("vshrn_n_u16") != std::string::npos);
+            assert(code.find("#include <immintrin.h>") != std::string::npos);
+
+            // Без дерева ссылка на правило-класс внутри токена раскрывается
+            options.recognizer = true;
+            auto recognizer = generator->generate(*grammar, options);
+            assert(recognizer.success);
+            const std::string& recognized = recognizer.parser_code;
+            size_t ident_begin = recognized.find("NodePtr parse_IDENT() {");
+            std::string recognized_ident =
+                recognized.substr(ident_begin, recognized.find("    // Parse rule:", ident_begin) - ident_begin);
+            size_t first_letter = recognized_ident.find("parse_letter()");
+            assert(first_letter != std::string::npos);
+            assert(recognized_ident.find("parse_letter()", first_letter + 1) == std::string::npos);
+            assert(recognized_ident.find("advanceTo(scanClass") != std::string::npos);
+            options.recognizer = false;
+
+            options.char_class_scanners = false;
+            auto plain = generator->generate(*grammar, options);
+            assert(plain.success);
+            assert(plain.parser_code.find("scanClass") == std::string::npos);
+
+            // Сканеры не меняют дерево: узлы правил внутри токенов остаются
+            auto strings = BNFGrammarFactory::fromString(R"(
+                WHITESPACE ::= (' ' | '\n')+;
+                start ::= item+;
+                item ::= NUMBER | STRING | '[' item* ']';
+                STRING ::= '"' json_char* '"';
+                json_char ::= unescaped_char | escape_sequence;
+                unescaped_char ::= ' '..'!' | '#'..'[' | ']'..'\U0010FFFF';
+                escape_sequence ::= '\\' ('"' | '\\' | 'n');
+                NUMBER ::= '0' | non_zero_digit digit*;
+                non_zero_digit ::= '1'..'9';
+                digit ::= '0'..'9';
+            )");
+            if (haveCompiler()) {
+                const std::string input = "[120 \"a\\\"b\\n\" 0] \"\xD0\xB9\"";
+                GeneratorOptions scanned;
+                scanned.parser_name = "ScanParser";
+                const std::string driver = treeDriver(*strings, scanned.parser_name);
+                std::string tree = runGenerated("scan_tree", generator->generate(*strings, scanned).parser_code,
+                                                driver, input);
+                scanned.char_class_scanners = false;
+                std::string loop_tree = runGenerated(
+                    "loop_tree", generator->generate(*strings, scanned).parser_code, driver, input);
+                assert(tree.rfind("start\n", 0) == 0 && tree.find("      STRING\n") != std::string::npos);
+                assert(tree.find("      STRING\n        json_char\n          unescaped_char\n") != std::string::npos);
+                assert(tree.find("        digit\n") != std::string::npos);
+                assert(tree == loop_tree);
+            }
+            std::cout << "✓ Bulk character class scanners" << std::endl;
+        }
+
+        // Тест 18: Двухэтапный разбор с лексером на ДКА
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= (' ' | '\n')+;
+                start ::= '@' NAME '=' NUMBER ';';
+                NAME ::= 'a'..'z'+;
+                NUMBER ::= '0'..'9'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.dfa_lexer = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success && result.warnings.empty());
+            const std::string& code = result.parser_code;
+            assert(code.find("const std::vector<Token>& tokenize()") != std::string::npos);
+            assert(code.find("static constexpr uint8_t next_state[") != std::string::npos);
+            assert(code.find("TOKEN_NAME, // NAME") != std::string::npos);
+            assert(code.find("TOKEN_LITERAL_1, // \"=\"") != std::string::npos);
+            assert(code.find("matchToken(TOKEN_LITERAL_0)") != std::string::npos);
+            // Разбор идёт по токенам: посимвольного сравнения нет
+            assert(code.find("matchString(") == std::string::npos);
+            assert(code.find("node->value = input_.substr(token.offset, token.length);") != std::string::npos);
+
+            // 'let' и NAME начинаются с одной буквы: лексер невозможен, парсер посимвольный
+            auto ambiguous = BNFGrammarFactory::fromString(R"(
+                WHITESPACE ::= ' '+;
+                start ::= 'let' NAME;
+                NAME ::= 'a'..'z'+;
+            )");
+            auto fallback = generator->generate(*ambiguous, options);
+            assert(fallback.success && fallback.warnings.size() == 1);
+            assert(fallback.warnings[0].find("DFA lexer disabled") != std::string::npos);
+            assert(fallback.parser_code.find("tokenize()") == std::string::npos);
+            std::cout << "✓ DFA lexer stage" << std::endl;
+        }
+
+        // Тест 19: Потоковый разбор по элементам
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= ' '+;
+                log ::= entry*;
+                entry ::= NAME '=' NAME ';';
+                NAME ::= 'a'..'z'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.streaming = true;
+            options.stream_item = "entry";
+            options.lazy_positions = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("bool feed(std::string_view chunk)") != std::string::npos);
+            assert(code.find("bool finish()") != std::string::npos);
+            assert(code.find("void onItem(std::function<void(NodePtr)> callback)") != std::string::npos);
+            assert(code.find("auto item = parse_entry();") != std::string::npos);
+            assert(code.find("hit_end_ = true;") != std::string::npos);
+            // Смещения в узлах не переживают сдвига окна: позиции считаются сразу
+            assert(code.find("size_t offset = 0;") == std::string::npos);
+            assert(result.warnings.size() == 1 && result.warnings[0].find("Lazy positions") != std::string::npos);
+
+            options.stream_item = "missing";
+            auto missing = generator->generate(*grammar, options);
+            assert(!missing.success);
+            assert(missing.error_message.find("missing") != std::string::npos);
+
+            options.streaming = false;
+            auto plain = generator->generate(*grammar, options);
+            assert(plain.success && plain.parser_code.find("hit_end_") == std::string::npos);
+
+            // Большой элемент мелкими частями: незаконченный элемент разбирается
+            // заново, только когда окно выросло вдвое
+            auto lists = BNFGrammarFactory::fromString(R"(
+                WHITESPACE ::= ' '+;
+                log ::= list*;
+                list ::= '[' NAME* ']';
+                NAME ::= 'a'..'z'+;
+            )");
+            GeneratorOptions streaming;
+            streaming.parser_name = "ListParser";
+            streaming.streaming = true;
+            streaming.stream_item = "list";
+            streaming.profile = true;
+            auto chunked = generator->generate(*lists, streaming);
+            assert(chunked.success && chunked.parser_code.find("retry_size_ = ok && !last") != std::string::npos);
+            if (haveCompiler()) {
+                std::string input = "[";
+                for (size_t i = 0; i < 100000; ++i) input += "abc ";
+                input += "] [x] [";
+                std::string output = runGenerated("stream_chunks", chunked.parser_code, R"(
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+int main(int, char* argv[]) {
+    std::ifstream file(argv[1], std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    const std::string input = content.str();
+    ListParser parser;
+    size_t items = 0;
+    parser.onItem([&](NodePtr) { ++items; });
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < input.size(); pos += 100) {
+        ok = parser.feed(std::string_view(input).substr(pos, 100));
+    }
+    const bool finished = parser.finish();
+    std::cout << (ok ? "fed " : "failed ") << items << " " << finished << "\n";
+    for (const auto& rule : parser.profile()) {
+        if (std::string(rule.rule) == "list") std::cout << rule.calls << "\n";
+    }
+}
+)", input);
+                std::istringstream in(output);
+                std::string fed;
+                size_t items = 0, calls = 0;
+                bool finished = true;
+                in >> fed >> items >> finished >> calls;
+                // Последний элемент не закрыт: finish() сообщает ошибку
+                assert(fed == "fed" && items == 2 && !finished);
+                // Без порога - по попытке на каждую из 4000 частей
+                assert(calls < 60);
+            }
+            std::cout << "✓ Streaming item parser" << std::endl;
+        }
+
+        // Тест 20: Инкрементальный разбор после правки
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= ' '+;
+                list ::= '[' item (',' item)* ']';
+                item ::= NAME | list;
+                NAME ::= 'a'..'z'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.incremental = true;
+            options.arena_allocation = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("NodePtr reparse(size_t offset, size_t removed, std::string_view inserted)") != std::string::npos);
+            assert(code.find("std::vector<MemoColumn> memo_columns_;") != std::string::npos);
+            assert(code.find("noteExamined(") != std::string::npos);
+            // Узлы хранят смещения детей, а не абсолютные позиции
+            assert(code.find("ChildOffsets child_offsets;") != std::string::npos);
+            // Правка сдвигает текст и колонки только до прошлой правки, а разбор
+            // продолжается с узла вокруг неё
+            assert(code.find("void moveGap(size_t to)") != std::string::npos);
+            assert(code.find("void dropReaching(size_t limit, size_t bound)") != std::string::npos);
+            assert(code.find("NodePtr resume(const std::vector<PathStep>& path, size_t delta)") != std::string::npos);
+            assert(code.find("node->offset = saved_pos;") == std::string::npos);
+            assert(code.find("std::unordered_map<size_t, MemoEntry>") == std::string::npos);
+            assert(result.warnings.size() == 1 && result.warnings[0].find("Arena allocation") != std::string::npos);
+
+            if (haveCompiler()) {
+                // Случайные правки дают то же дерево, что разбор с нуля, а время
+                // правки внутри элемента не растёт с длиной списка
+                std::string output = runGenerated("incremental_edits", code, R"(
+#include <chrono>
+#include <iostream>
+#include <random>
+
+// The tree with absolute offsets, from the children's relative ones
+void dump(const ASTNode* node, size_t start, std::string& out) {
+    out += node->toString() + "@" + std::to_string(start) + "(";
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        dump(node->children[i].get(), start + node->child_offsets[i], out);
+    }
+    out += ')';
+}
+
+std::string dump(const NodePtr& root) {
+    std::string out;
+    if (root) dump(root.get(), 0, out);
+    return out;
+}
+
+int main() {
+    std::mt19937 random(7);
+    const char* pieces[] = {"x", "yz", " ", ", w", "[v]", ",", "]", "[", ""};
+    size_t mismatches = 0;
+    for (int round = 0; round < 50; ++round) {
+        std::string text = "[ab, [cd, e], f]";
+        GeneratedParser parser{std::string(text)};
+        parser.parse();
+        for (int edit = 0; edit < 40; ++edit) {
+            size_t offset = random() % (text.size() + 1);
+            size_t removed = std::min<size_t>(random() % 3, text.size() - offset);
+            std::string inserted = pieces[random() % 9];
+            text.replace(offset, removed, inserted);
+            NodePtr updated = parser.reparse(offset, removed, inserted);
+            GeneratedParser fresh{std::string(text)};
+            if (dump(updated) != dump(fresh.parse())) ++mismatches;
+        }
+    }
+    std::cout << mismatches << "\n";
+
+    std::string list = "[abc";
+    for (int i = 0; i < 200000; ++i) list += ", abc";
+    list += "]";
+    GeneratedParser parser{std::string(list)};
+    auto start = std::chrono::steady_clock::now();
+    parser.parse();
+    auto parsed = std::chrono::steady_clock::now();
+    // Inside a NAME in the middle: the item is parsed again, the list is not
+    size_t middle = list.find("abc", list.size() / 2) + 1;
+    parser.reparse(middle, 0, "x");
+    parser.reparse(middle, 1, "");
+    auto warm = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (int i = 0; i < 100; ++i) {
+        ok = ok && parser.reparse(middle, 0, "x") && parser.reparse(middle, 1, "");
+    }
+    auto edited = std::chrono::steady_clock::now();
+    std::cout << ok << " " << std::chrono::duration<double>(parsed - start).count() << " "
+              << std::chrono::duration<double>(edited - warm).count() / 200 << "\n";
+}
+)", "");
+                std::istringstream in(output);
+                size_t mismatches = 1;
+                bool ok = false;
+                double parse_time = 0, reparse_time = 1;
+                in >> mismatches >> ok >> parse_time >> reparse_time;
+                assert(mismatches == 0 && ok);
+                assert(reparse_time * 20 < parse_time);
+            }
+
+            options.streaming = true;
+            auto combined = generator->generate(*grammar, options);
+            assert(!combined.success);
+            std::cout << "✓ Incremental reparsing" << std::endl;
+        }
+
+        // Тест 21: Пакетный разбор многих файлов в сгенерированном main
+        {
+            std::string bnf = R"(
+                list ::= '[' ']';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.parser_name = "BatchParser";
+            options.generate_executable = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& main = result.main_code;
+            assert(main.find("int runBatch(const CommandLineOptions& opts)") != std::string::npos);
+            assert(main.find("class WorkQueue") != std::string::npos);
+            assert(main.find("bool steal(size_t& index)") != std::string::npos);
+            assert(main.find("recursive_directory_iterator") != std::string::npos);
+            // Один парсер на поток, переиспользуемый через reset()
+            assert(main.find("BatchParser parser{std::string_view()};") != std::string::npos);
+            assert(main.find("parser.reset(file.view());") != std::string::npos);
+            assert(main.find("files/s") != std::string::npos && main.find("p99") != std::string::npos);
+
+            options.streaming = true;
+            auto streaming = generator->generate(*grammar, options);
+            assert(streaming.success);
+            assert(streaming.main_code.find("ok = ok && parser.finish();") != std::string::npos);
+            std::cout << "✓ Batch driver in generated main" << std::endl;
+        }
+
+        // Тест 22: Параллельный разбор стартового правила вида item*
+        {
+            std::string bnf = R"(
+                log ::= entry*;
+                WHITESPACE ::= (' ' | '\n')+;
+                entry ::= NAME '=' NAME ';';
+                NAME ::= 'a'..'z'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.parallel = true;
+            options.generate_executable = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success && result.warnings.empty());
+            const std::string& code = result.parser_code;
+            assert(code.find("NodePtr parseParallel(unsigned threads = 0)") != std::string::npos);
+            assert(code.find("size_t findItemStart(size_t p) const") != std::string::npos);
+            assert(code.find("NodePtr item = parse_entry();") != std::string::npos);
+            // Ошибки сообщает последовательный разбор
+            assert(code.find("return parse();") != std::string::npos);
+            assert(result.main_code.find("parser.parseParallel()") != std::string::npos);
+
+            std::string nested = R"(
+                doc ::= '[' entry* ']';
+                entry ::= 'a'..'z'+ ';';
+            )";
+            auto other = generator->generate(*BNFGrammarFactory::fromString(nested), options);
+            assert(other.success && other.parser_code.find("parseParallel") == std::string::npos);
+            assert(other.warnings.size() == 1 && other.warnings[0].find("item* or item+") != std::string::npos);
+
+            options.streaming = true;
+            assert(!generator->generate(*grammar, options).success);
+            std::cout << "✓ Parallel parsing of top-level items" << std::endl;
+        }
+
+        // Тест 23: Распознаватель и событийный разбор без AST
+        {
+            std::string bnf = R"(
+                list ::= '[' item (',' item)* ']';
+                WHITESPACE ::= ' '+;
+                item ::= NAME | list;
+                NAME ::= 'a'..'z'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.recognizer = true;
+            options.generate_executable = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success && result.warnings.empty());
+            const std::string& code = result.parser_code;
+            assert(code.find("using NodePtr = Match;") != std::string::npos);
+            assert(code.find("class ItemNode") == std::string::npos);
+            assert(code.find("children.push_back") == std::string::npos);
+            assert(code.find("return NodePtr(true);") != std::string::npos);
+            assert(code.find("size_t errorOffset() const") != std::string::npos);
+            assert(result.main_code.find("toString()") == std::string::npos);
+
+            GeneratorOptions events;
+            events.event_callbacks = true;
+            events.memoize = true;
+            events.arena_allocation = true;
+            events.generate_executable = true;
+            auto sax = generator->generate(*grammar, events);
+            assert(sax.success && sax.warnings.size() == 2);
+            const std::string& sax_code = sax.parser_code;
+            assert(sax_code.find("template <typename Handler = NoEvents>") != std::string::npos);
+            assert(sax_code.find("RULE_item,") != std::string::npos);
+            assert(sax_code.find("requires(Handler& h, std::string_view span) { h.onToken(span); }") != std::string::npos);
+            // Откат журнала событий вместе с позицией при backtracking
+            assert(sax_code.find("size_t saved_event = enterRule(RULE_list);") != std::string::npos);
+            assert(sax_code.find("rollbackEvents(alt_events);") != std::string::npos);
+            // Токен - одно правило со спаном; внутри него событий нет
+            assert(sax_code.find("_event = enterRule(RULE_NAME);") != std::string::npos);
+            assert(sax_code.find("enterRule(RULE_WHITESPACE)") == std::string::npos);
+            assert(sax_code.find("recordToken(pos_ - 1);") != std::string::npos);
+            assert(sax_code.find("deliverEvents();") != std::string::npos);
+            assert(sax_code.find("memo_") == std::string::npos);
+            assert(sax.main_code.find("GeneratedParser<OutlinePrinter> printer(input);") != std::string::npos);
+
+            events.recognizer = true;
+            assert(!generator->generate(*grammar, events).success);
+            std::cout << "✓ Recognizer and event callback modes" << std::endl;
+        }
+
+        // Тест 24: Профилирование правил
+        {
+            std::string bnf = R"(
+                stmt ::= assign | call;
+                assign ::= NAME '=' NAME;
+                call ::= NAME '(' ')';
+                NAME ::= 'a'..'z'+;
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            // Без флага код парсера не содержит инструментирования
+            GeneratorOptions plain;
+            plain.generate_executable = true;
+            auto base = generator->generate(*grammar, plain);
+            assert(base.success);
+            assert(base.parser_code.find("RuleProfile") == std::string::npos);
+            assert(base.parser_code.find("_unprofiled") == std::string::npos);
+            assert(base.main_code.find("--profile-report") == std::string::npos);
+
+            GeneratorOptions options;
+            options.profile = true;
+            options.memoize_rules = {"NAME"};
+            options.generate_executable = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("struct RuleProfile {") != std::string::npos);
+            assert(code.find("RuleProfile profile_[4];") != std::string::npos);
+            // parse_X() считает вызовы, правило разбирается в parse_X_unprofiled()
+            assert(code.find("NodePtr parse_assign() {") != std::string::npos);
+            assert(code.find("NodePtr result = parse_assign_unprofiled();") != std::string::npos);
+            assert(code.find("profile_[1].failed_bytes += pos_ - saved_pos;") != std::string::npos);
+            assert(code.find("NodePtr parse_NAME_unprofiled() {") != std::string::npos);
+            assert(code.find("++profile_[3].memo_hits;") != std::string::npos);
+            assert(code.find("void printProfile(std::ostream& out) const") != std::string::npos);
+            assert(code.find("profileClock()") == std::string::npos);
+            assert(result.main_code.find("parser.printProfile(std::cerr);") != std::string::npos);
+            assert(result.main_code.find("printProfileReport(std::cerr, profile);") != std::string::npos);
+
+            options.profile_timing = true;
+            auto timed = generator->generate(*grammar, options).parser_code;
+            assert(timed.find("counters.exclusive_cycles += cycles - profile_child_cycles_;") != std::string::npos);
+            assert(timed.find("return __rdtsc();") != std::string::npos);
+            std::cout << "✓ Per-rule profiling" << std::endl;
+        }
+
+        // Тест 25: Разбор на явном стеке
+        {
+            std::string bnf = R"(
+                list ::= '[' item* ']';
+                item ::= list | 'x';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions plain;
+            auto base = generator->generate(*grammar, plain).parser_code;
+            assert(base.find("RuleTask") == std::string::npos);
+            assert(base.find("#include <coroutine>") == std::string::npos);
+
+            GeneratorOptions options;
+            options.explicit_stack = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("#include <coroutine>") != std::string::npos);
+            assert(code.find("class FrameStack {") != std::string::npos);
+            // Правила - корутины: вызов правила приостанавливает вызывающего
+            assert(code.find("RuleTask parse_list() {") != std::string::npos);
+            assert(code.find("= (co_await parse_item());") != std::string::npos);
+            assert(code.find("auto result = parse_list().run();") != std::string::npos);
+            assert(code.find("co_return node;") != std::string::npos);
+            // Глубина ограничена setMaxDepth(), а не max_recursion_depth
+            assert(code.find("if (++recursion_depth_ > max_depth_) {") != std::string::npos);
+            assert(code.find("void setMaxDepth(size_t depth)") != std::string::npos);
+            // Глубокое дерево освобождается без рекурсии деструкторов
+            assert(code.find("~listNode() override { freeChildren(children); }") != std::string::npos);
+
+            // Правила-токены лексера на ДКА остаются обычными функциями
+            std::string token_bnf = R"(
+                list ::= '[' item* ']';
+                item ::= list | NUMBER;
+                NUMBER ::= '0'..'9'+;
+                WHITESPACE ::= ' '+;
+            )";
+            auto token_grammar = BNFGrammarFactory::fromString(token_bnf);
+            options.dfa_lexer = true;
+            auto lexed = generator->generate(*token_grammar, options).parser_code;
+            assert(lexed.find("NodePtr parse_NUMBER() {") != std::string::npos);
+            assert(lexed.find("= parse_NUMBER();") != std::string::npos);
+            assert(lexed.find("RuleTask parse_item() {") != std::string::npos);
+            std::cout << "✓ Explicit stack parsing" << std::endl;
+        }
+
+        // Тест 26: Разбиение на единицы трансляции
+        {
+            std::string bnf = R"(
+                doc ::= list+;
+                list ::= '[' item* ']';
+                item ::= list | atom;
+                atom ::= 'x';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            options.parser_name = "DocParser";
+            options.split_units = 4;
+            options.generate_executable = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            assert(result.parser_filename == "doc_parser.hpp");
+            assert(result.additional_files.size() == 4);
+            const std::string& header = result.parser_code;
+            assert(header.find("#pragma once") != std::string::npos);
+            // В классе парсера остаются только объявления правил
+            assert(header.find("    NodePtr parse_list();") != std::string::npos);
+            assert(header.find("NodePtr parse_list() {") == std::string::npos);
+            assert(result.main_code.find("#include \"doc_parser.hpp\"") != std::string::npos);
+
+            // Взаимно рекурсивные list и item - в одном файле
+            auto unitOf = [&](const std::string& definition) {
+                for (size_t i = 0; i < result.additional_files.size(); ++i) {
+                    const auto& [filename, content] = result.additional_files[i];
+                    if (content.find(definition) != std::string::npos) {
+                        assert(filename == "doc_parser_rules_" + std::to_string(i) + ".cpp");
+                        assert(content.find("#include \"doc_parser.hpp\"") != std::string::npos);
+                        return i;
+                    }
+                }
+                assert(false && "rule definition not found");
+                return size_t(0);
+            };
+            assert(unitOf("NodePtr DocParser::parse_list() {") == unitOf("NodePtr DocParser::parse_item() {"));
+            unitOf("NodePtr DocParser::parse_doc() {");
+            unitOf("NodePtr DocParser::parse_atom() {");
+
+            // Правка одного правила (без изменения FIRST) меняет только его файл
+            std::string edited_bnf = bnf;
+            edited_bnf.replace(edited_bnf.find("'x'"), 3, "'x' 'y'");
+            auto edited = generator->generate(*BNFGrammarFactory::fromString(edited_bnf), options);
+            size_t changed = 0;
+            for (size_t i = 0; i < result.additional_files.size(); ++i) {
+                changed += edited.additional_files[i].second != result.additional_files[i].second;
+            }
+            assert(changed == 1);
+
+            // Шаблон событийного парсера не разбивается
+            options.event_callbacks = true;
+            auto events = generator->generate(*grammar, options);
+            assert(events.success);
+            assert(events.additional_files.empty());
+            assert(events.parser_filename == "doc_parser.cpp");
+            std::cout << "✓ Split translation units" << std::endl;
+        }
+
+        // Тест 27: Бор для альтернатив из литералов
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= ' '+;
+                start ::= (keyword | op)*;
+                keyword ::= 'in' | 'int' | 'interface' | 'if' | ('else');
+                op ::= '<' | '<=' | '=';
+                pair ::= 'a' | 'b';
+            )";
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+
+            GeneratorOptions options;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("int matchLiterals0() const {") != std::string::npos);
+            assert(code.find("int matchLiterals1() const {") != std::string::npos);
+            assert(code.find("int matchLiterals2() const {") == std::string::npos);
+            assert(code.find("literal_lengths_0[] = {2, 3, 9, 2, 4};") != std::string::npos);
+            // Первый по порядку литерал: после 'in' более длинные 'int' и 'interface' не проверяются
+            assert(code.find("\"terface\"") == std::string::npos);
+            assert(code.find("\"lse\", 3) == 0") != std::string::npos);
+            // Для пары литералов остаётся FIRST-диспетчеризация
+            assert(code.find("matchString(\"a\")") != std::string::npos);
+
+            // Потоковый разбор учитывает все проверенные литералы
+            options.streaming = true;
+            auto streaming = generator->generate(*grammar, options);
+            assert(streaming.success);
+            assert(streaming.parser_code.find("literal_reach_0[] = {0, 2, 3, 9, 9, 9};") != std::string::npos);
+
+            options.streaming = false;
+            options.literal_tries = false;
+            auto plain = generator->generate(*grammar, options);
+            assert(plain.success);
+            assert(plain.parser_code.find("matchLiterals") == std::string::npos);
+            std::cout << "✓ Literal alternative tries" << std::endl;
+        }
+
+        // Тест 28: Генератор на шаблонах комбинаторов
+        {
+            assert(CodeGeneratorFactory::isLanguageSupported("cpp-templates"));
+            auto generator = CodeGeneratorFactory::create("cpp-templates");
+            assert(generator != nullptr);
+            assert(generator->getFileExtension() == ".hpp");
+
+            std::string bnf = R"(
+                WHITESPACE ::= ' '+;
+                list ::= '[' item (',' item)* ']';
+                item ::= NAME | list;
+                NAME ::= ('a'..'z' | '_')+;
+            )";
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            GeneratorOptions options;
+            options.parser_name = "ListParser";
+            auto result = generator->generate(*grammar, options);
+            assert(result.success && result.warnings.empty());
+            assert(result.parser_filename == "list_parser.hpp");
+            const std::string& code = result.parser_code;
+            assert(code.find("struct r_list {") != std::string::npos);
+            assert(code.find("using Ws = Skip<r_WHITESPACE>;") != std::string::npos);
+            assert(code.find("Call<r_item>") != std::string::npos);
+            // Внутри токена ссылки не создают узлов, класс символов - одна маска
+            assert(code.find("Set<") != std::string::npos);
+            assert(code.find("const Node* parse()") != std::string::npos);
+
+            // Распознаватель не строит дерево, пропущенные настройки - предупреждения
+            options.recognizer = true;
+            options.memoize = true;
+            auto recognizer = generator->generate(*grammar, options);
+            assert(recognizer.success);
+            assert(recognizer.parser_code.find("bool parse()") != std::string::npos);
+            assert(recognizer.parser_code.find("Call<") == std::string::npos);
+            assert(recognizer.warnings.size() == 1 && recognizer.warnings[0].find("memoize") != std::string::npos);
+
+            auto context = BNFGrammarFactory::fromString(R"(
+                start ::= noun[sing];
+                noun[sing] ::= 'cat';
+                noun[plur] ::= 'cats';
+            )");
+            auto rejected = generator->generate(*context, GeneratorOptions{});
+            assert(!rejected.success);
+            std::cout << "✓ Template combinator backend" << std::endl;
+        }
+
+        // Тест 29: Кэш результатов генерации
+        {
+            const auto directory = std::filesystem::temp_directory_path() / "bnf_generation_cache_test";
+            std::filesystem::remove_all(directory);
+            GenerationCache cache(directory.string());
+
+            std::string bnf = "start ::= 'a' rest; rest ::= 'b'*;";
+            GeneratorOptions options;
+            options.generate_executable = true;
+            options.split_units = 2;
+            const std::string key = GenerationCache::makeKey(bnf, options);
+            assert(!cache.load(key).has_value());
+
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto generator = CodeGeneratorFactory::create("cpp");
+            auto result = generator->generate(*grammar, options);
+            assert(result.success && cache.store(key, result));
+
+            auto cached = cache.load(key);
+            assert(cached.has_value() && cached->success);
+            assert(cached->parser_code == result.parser_code && cached->parser_filename == result.parser_filename);
+            assert(cached->main_code == result.main_code && cached->main_filename == result.main_filename);
+            assert(cached->additional_files == result.additional_files);
+            assert(cached->messages == result.messages && cached->warnings == result.warnings);
+
+            // Любая настройка, текст грамматики или дополнительная часть - другой ключ
+            GeneratorOptions other = options;
+            other.memoize = true;
+            assert(GenerationCache::makeKey(bnf, other) != key);
+            assert(GenerationCache::makeKey(bnf + " ", options) != key);
+            assert(GenerationCache::makeKey(bnf, options, "no-optimize") != key);
+            assert(!cache.load(GenerationCache::makeKey(bnf, other)).has_value());
+
+            // Повреждённая запись - промах
+            std::ofstream(cache.entryPath(key), std::ios::binary) << "bnf-parser-gen cache 1\n99999999999\n";
+            assert(!cache.load(key).has_value());
+            std::filesystem::remove_all(directory);
+            std::cout << "✓ Generation cache" << std::endl;
+        }
+
+        // Тест 30: Интерпретатор байт-кода
+        {
+            auto grammar = BNFGrammarFactory::fromString(R"(
+                WHITESPACE ::= ' '+;
+                list ::= '[' item (',' item)* ']';
+                item ::= NAME | list;
+                NAME ::= ('a'..'z' | '_')+;
+            )");
+            BytecodeProgram program = BytecodeProgram::compile(*grammar);
+            BytecodeParser parser(program);
+            assert(parser.parse("[a, [b_c ,d]] "));
+            assert(parser.toString(*parser.root()) ==
+                   "list\n"
+                   "  item\n"
+                   "    NAME: \"a\"\n"
+                   "  item\n"
+                   "    list\n"
+                   "      item\n"
+                   "        NAME: \"b_c\"\n"
+                   "      item\n"
+                   "        NAME: \"d\"\n");
+            assert(!parser.parse("[a, [b c]]"));
+            assert(parser.getError() == "Parse failed at position 7" && parser.errorOffset() == 7);
+            assert(!parser.parse("[a] b"));
+            assert(parser.getError() == "Unexpected input at position 4");
+
+            // Загруженная программа разбирает так же, испорченная - исключение
+            const std::string bytes = program.serialize();
+            BytecodeProgram loaded = BytecodeProgram::deserialize(bytes);
+            assert(loaded.serialize() == bytes);
+            BytecodeParser loaded_parser(loaded);
+            assert(loaded_parser.parse("[a,[b]]") && loaded_parser.nodes().size() == 7);
+            bool threw = false;
+            try {
+                BytecodeProgram::deserialize(bytes.substr(0, bytes.size() - 3));
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            assert(threw);
+
+            // Пробелы с комментариями пропускаются правилом, без правила - std::isspace
+            auto commented = BNFGrammarFactory::fromString(R"(
+                TRIVIA ::= (' ' | '#' 'a'..'z'* '\n')+;
+                sum ::= NUMBER ('+' NUMBER)*;
+                NUMBER ::= '0'..'9'+;
+            )");
+            BytecodeProgram sum = BytecodeProgram::compile(*commented);
+            BytecodeParser sum_parser(sum);
+            assert(sum_parser.parse("1 #one\n+ 22 #x\n"));
+            assert(sum_parser.nodes().size() == 3 && sum_parser.text(sum_parser.nodes()[2]) == "22");
+            assert(!sum_parser.parse("1 # 2\n"));
+
+            GeneratorOptions recognizer;
+            recognizer.recognizer = true;
+            auto legacy = BNFGrammarFactory::fromString("pair ::= '(' 'x' ',' 'y' ')';");
+            BytecodeProgram pair = BytecodeProgram::compile(*legacy, recognizer);
+            BytecodeParser pair_parser(pair);
+            assert(pair_parser.parse(" ( x ,y ) \n") && pair_parser.root() == nullptr);
+
+            // Глубина вложенности ограничена max_recursion_depth
+            GeneratorOptions shallow;
+            shallow.max_recursion_depth = 5;
+            BytecodeProgram limited = BytecodeProgram::compile(*grammar, shallow);
+            BytecodeParser limited_parser(limited);
+            assert(limited_parser.parse("[[a]]"));
+            assert(!limited_parser.parse("[[[[a]]]]"));
+            assert(limited_parser.getError() == "Maximum recursion depth exceeded");
+            std::cout << "✓ Bytecode interpreter" << std::endl;
+        }
+
+        // Тест 31: Контекстные действия - слоты, тексты правил и откат при возврате
+        {
+            auto grammar = BNFGrammarFactory::fromString(R"(
+                WHITESPACE ::= ' '+;
+                document ::= item*;
+                item ::= '&' name content {store(name, content)} '!' | '&' name '?' | reference;
+                reference ::= '*' name {lookup(name)};
+                name ::= 'a'..'z'+;
+                content ::= 'A'..'Z'+;
+            )");
+            assert(grammar);  // Действие совпадает с пустой строкой: правила продуктивны
+            auto generator = CodeGeneratorFactory::create("cpp");
+            GeneratorOptions options;
+            options.parser_name = "AnchorParser";
+            options.incremental = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("class ContextStore") != std::string::npos);
+            assert(code.find("static constexpr size_t CONTEXT_name = 0;") != std::string::npos);
+            assert(code.find("context_.store(CONTEXT_name, ctx_name, ctx_content);") != std::string::npos);
+            assert(code.find("if (!context_.find(CONTEXT_name, ctx_name)) {") != std::string::npos);
+            // Неудачная альтернатива отменяет свои store
+            assert(code.find("context_.rewind(alt_context);") != std::string::npos);
+            assert(code.find("reparse(") == std::string::npos);
+            bool warned = false;
+            for (const auto& warning : result.warnings) {
+                warned = warned || warning.find("Incremental reparsing disabled") != std::string::npos;
+            }
+            assert(warned);
+
+            // Потоковый разбор копирует тексты: окно удаляется после элемента
+            options.incremental = false;
+            options.streaming = true;
+            auto streaming = generator->generate(*grammar, options);
+            assert(streaming.success);
+            assert(streaming.parser_code.find("context_.store(CONTEXT_name, context_.keep(ctx_name)") != std::string::npos);
+            assert(streaming.parser_code.find("context_.commit();") != std::string::npos);
+            std::cout << "✓ Context action storage" << std::endl;
+        }
+
+        // Тест 32: Специализация правил с параметрами
+        {
+            auto grammar = BNFGrammarFactory::fromString(R"G(
+                sentence ::= agreement[sing] | agreement[plur] | agreement;
+                agreement[N:enum{sing,plur}] ::= noun[N] verb[N] block[depth];
+                noun[sing] ::= "cat";
+                noun[plur] ::= "cats";
+                verb[sing] ::= "runs";
+                verb[N:enum{plur}] ::= "run";
+                block[depth:int] ::= "." | "(" block[depth] ")";
+            )G");
+            // int-параметр не от вызывающего - ошибка; исправленная грамматика
+            bool threw = false;
+            try {
+                GrammarOptimizer::specialize(*grammar);
+            } catch (const std::runtime_error& e) {
+                threw = std::string(e.what()).find("Integer parameter depth of block") != std::string::npos;
+            }
+            assert(threw);
+
+            grammar = BNFGrammarFactory::fromString(R"G(
+                sentence[depth:int] ::= agreement[sing, depth] | agreement[plur, depth] | agreement;
+                agreement[N:enum{sing,plur}, depth:int] ::= noun[N] verb[N] block[depth];
+                noun[sing] ::= "cat";
+                noun[plur] ::= "cats";
+                verb[sing] ::= "runs";
+                verb[N:enum{plur}] ::= "run";
+                block[depth:int] ::= "." | "(" block[depth] ")";
+            )G");
+            auto specialized = GrammarOptimizer::specialize(*grammar);
+            assert(specialized->startSymbol == "sentence");
+            assert(specialized->findRule("noun[sing]") && !specialized->findRule("noun[sing]")->hasParameters());
+            assert(specialized->findRule("verb[plur]"));
+            assert(specialized->findRule("agreement[sing,*]")->parameters.size() == 1);
+            // agreement без аргументов - выбор по значениям N, depth начинается с 0
+            assert(specialized->findRule("agreement")->rightSide->toString() == "<agreement[sing,*][0]> | <agreement[plur,*][0]>");
+
+            auto generator = CodeGeneratorFactory::create("cpp");
+            GeneratorOptions options;
+            options.memoize = true;
+            options.memoize_rules = {"noun[sing]", "noun[plur]"};
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("NodePtr parse_noun_sing_()") != std::string::npos);
+            assert(code.find("NodePtr parse_agreement_plur___(int depth)") != std::string::npos);
+            assert(code.find("auto result = parse_sentence(0);") != std::string::npos);
+            assert(code.find("std::shared_ptr<ASTNode> parse_") == std::string::npos);
+            // Мемоизируются специализации без параметров, каждая своей таблицей
+            assert(code.find("memo_noun_sing__;") != std::string::npos);
+            assert(code.find("memo_noun_plur__;") != std::string::npos);
+            assert(code.find("memo_block_") == std::string::npos);
+
+            auto unmatched = BNFGrammarFactory::fromString(R"(
+                start ::= agreement[many];
+                agreement[N:enum{sing,plur}] ::= noun[N];
+                noun[sing] ::= "cat";
+            )");
+            auto failed = generator->generate(*unmatched, options);
+            assert(!failed.success && failed.error_message == "No definition of agreement matches agreement[many]");
+            std::cout << "✓ Parameterized rule specialization" << std::endl;
+        }
+
+        // Тест 33: Диагностика дальней ошибки
+        {
+            auto grammar = BNFGrammarFactory::fromString(R"(
+                program ::= statement+;
+                statement ::= "let" IDENT "=" NUMBER ";" | "print" IDENT ";";
+                IDENT ::= ("a".."z")+;
+                NUMBER ::= ("0".."9")+;
+                WHITESPACE ::= (" " | "\n")+;
+            )");
+            auto generator = CodeGeneratorFactory::create("cpp");
+            GeneratorOptions options;
+            auto plain = generator->generate(*grammar, options);
+            assert(plain.success && plain.parser_code.find("farthest_") == std::string::npos);
+
+            options.diagnostics = true;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("#include <bitset>") != std::string::npos);
+            assert(code.find("std::bitset<6> expected_;") != std::string::npos);
+            assert(code.find("\"\\\"let\\\"\", \"IDENT\", \"\\\"=\\\"\", \"NUMBER\", \"\\\";\\\"\"") != std::string::npos);
+            // Неудача токена отмечается у вызова, внутри токена - нет
+            assert(code.find("if (pos_ >= farthest_) { expect(pos_, 1); }") != std::string::npos);
+            assert(code.find("error_message_ = expectedMessage();") != std::string::npos);
+            // Отсечённые FIRST-таблицей альтернативы отмечаются вместе, после пробелов
+            assert(code.find("const size_t failed_at = whitespaceEnd();") != std::string::npos);
+
+            options.streaming = true;
+            auto streaming = generator->generate(*grammar, options);
+            assert(streaming.success && streaming.parser_code.find("farthest_") == std::string::npos);
+            assert(!streaming.warnings.empty() && streaming.warnings.back().find("Diagnostics disabled") == 0);
+            std::cout << "✓ Farthest-failure diagnostics" << std::endl;
+        }
+
+        // Тест 34: Отсечение ^
+        {
+            std::string bnf = R"(
+                program ::= statement+;
+                statement ::= "let" ^ IDENT "=" IDENT ";" | "let" "!" | ["do" ^ IDENT] ";" | {"x" ^ IDENT} "end";
+                IDENT ::= ("a".."z")+;
+                WHITESPACE ::= " "+;
+            )";
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            const ASTNode* statement = grammar->findRule("statement")->rightSide.get();
+            assert(statement->toString().find("\"let\" ^ <IDENT>") != std::string::npos);
+            auto loaded = BNFGrammarFactory::fromBinary(BNFGrammarFactory::toBinary(*grammar));
+            assert(loaded->toString() == grammar->toString());
+
+            // Альтернативы с отсечением не выносятся за скобки
+            auto optimized = BNFGrammarFactory::fromString(bnf);
+            GrammarOptimizer::optimize(*optimized);
+            assert(optimized->findRule("statement")->rightSide->toString() == statement->toString());
+
+            bool threw = false;
+            try {
+                BNFGrammarFactory::fromString("a ::= \"x\" ^*;");
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            assert(threw);
+
+            auto generator = CodeGeneratorFactory::create("cpp");
+            GeneratorOptions options;
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            const std::string& code = result.parser_code;
+            assert(code.find("alt_cut_") != std::string::npos);
+            assert(code.find("bool opt_cut_") != std::string::npos && code.find("bool rep_cut_") != std::string::npos);
+            assert(code.find("releaseMemo") == std::string::npos);
+
+            options.memoize = true;
+            auto memoized = generator->generate(*grammar, options);
+            assert(memoized.success && memoized.parser_code.find("releaseMemo(pos_);") != std::string::npos);
+
+            threw = false;
+            try {
+                BytecodeProgram::compile(*grammar);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            assert(threw);
+            std::cout << "✓ Cut operator" << std::endl;
+        }
+
+        // Тест 35: Генератор корпуса по грамматике
+        {
+            auto grammar = BNFGrammarFactory::fromString(R"(
+                document ::= "[" [value {"," value}] "]";
+                value ::= object | array | STRING | NUMBER | "true" | "null";
+                object ::= "{" [member {"," member}] "}";
+                member ::= STRING ":" value;
+                array ::= "[" [value {"," value}] "]";
+                STRING ::= '"' {"a".."z" | " "} '"';
+                NUMBER ::= ["-"] ("0".."9")+;
+                WHITESPACE ::= (" " | "\n")+;
+            )");
+            CorpusOptions options;
+            options.target_bytes = 64 * 1024;
+            options.max_depth = 6;
+            options.validate = true;
+            std::ostringstream out;
+            CorpusStats stats = CorpusGenerator(*grammar, options).generate(out);
+            const std::string corpus = out.str();
+            assert(stats.bytes == corpus.size() && corpus.size() >= options.target_bytes);
+            assert(stats.items > 100 && stats.validated && stats.max_depth >= 6);
+            BytecodeProgram program = BytecodeProgram::compile(*grammar);
+            BytecodeParser parser(program);
+            assert(parser.parse(corpus));
+
+            // Один seed - один вывод
+            std::ostringstream again;
+            CorpusGenerator(*grammar, options).generate(again);
+            assert(again.str() == corpus);
+            options.seed = 2;
+            std::ostringstream other;
+            CorpusGenerator(*grammar, options).generate(other);
+            assert(other.str() != corpus);
+
+            auto text = BNFGrammarFactory::fromString(R"(
+                text ::= word+;
+                word ::= ("a".."я")+;
+                WHITESPACE ::= " "+;
+            )");
+            CorpusOptions unicode;
+            unicode.target_bytes = 4096;
+            unicode.unicode_ratio = 1.0;
+            std::ostringstream letters;
+            CorpusGenerator(*text, unicode).generate(letters);
+            assert(utf8::isValid(letters.str()) && utf8::asciiPrefix(letters.str()) < letters.str().size());
+
+            // Параметры специализируются: каждое предложение согласовано
+            auto agreement = BNFGrammarFactory::fromString(R"(
+                agreement[N:enum{sing,plur}] ::= noun[N] verb[N];
+                noun[sing] ::= "cat" | "dog";
+                noun[plur] ::= "cats" | "dogs";
+                verb[sing] ::= "runs";
+                verb[plur] ::= "run";
+            )");
+            CorpusOptions lines;
+            lines.target_bytes = 2048;
+            std::ostringstream sentences;
+            CorpusGenerator(*agreement, lines).generate(sentences);
+            std::istringstream in(sentences.str());
+            std::string line;
+            size_t count = 0;
+            while (std::getline(in, line)) {
+                assert(line == "cat runs" || line == "dog runs" || line == "cats run" || line == "dogs run");
+                ++count;
+            }
+            assert(count > 100);
+
+            // {lookup} ссылается только на сохранённые {store} ключи
+            auto anchors = BNFGrammarFactory::fromString(R"(
+                document ::= element*;
+                element ::= anchor | reference | NAME;
+                anchor ::= "&" name "=" NAME {store(name)};
+                reference ::= "*" name {lookup(name)};
+                name ::= NAME;
+                NAME ::= ("a".."c")+;
+                WHITESPACE ::= " "+;
+            )");
+            std::ostringstream refs;
+            CorpusGenerator(*anchors, lines).generate(refs);
+            std::istringstream tokens(refs.str());
+            std::string token;
+            std::vector<std::string> stored;
+            size_t references = 0;
+            while (tokens >> token) {
+                if (token == "&") {
+                    tokens >> token;
+                    stored.push_back(token);
+                } else if (token == "*") {
+                    tokens >> token;
+                    assert(std::find(stored.begin(), stored.end(), token) != stored.end());
+                    ++references;
+                }
+            }
+            assert(!stored.empty() && references > 0);
+
+            CorpusOptions weighted;
+            weighted.weights["value"] = {1.0, 1.0};
+            bool threw = false;
+            try {
+                CorpusGenerator corpus_generator(*grammar, weighted);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            assert(threw);
+            weighted.weights["value"] = {0.0, 1.0, 0.0, 0.0, 0.0, 0.0};
+            weighted.target_bytes = 1024;
+            std::ostringstream arrays;
+            CorpusGenerator(*grammar, weighted).generate(arrays);
+            assert(arrays.str().find_first_of("{\"0123456789tn") == std::string::npos);
+            std::cout << "✓ Corpus generator" << std::endl;
+        }
+
+        // Тест 36: Оптимизатор не меняет дерево разбора
+        {
+            std::string bnf = R"(
+                WHITESPACE ::= (' ' | '\n')+;
+                document ::= value+;
+                value ::= NUMBER | STRING | '[' value* ']';
+                STRING ::= '"' json_char* '"';
+                json_char ::= unescaped_char | escape_sequence;
+                unescaped_char ::= ' '..'!' | '#'..'[' | ']'..'~';
+                escape_sequence ::= '\\' ('"' | 'n' | 'u' hex_digit hex_digit);
+                NUMBER ::= '-'? ('0' | non_zero_digit digit*);
+                digit ::= '0'..'9';
+                non_zero_digit ::= '1'..'9';
+                hex_digit ::= digit | 'a'..'f';
+            )";
+            auto grammar = BNFGrammarFactory::fromString(bnf);
+            auto optimized = BNFGrammarFactory::fromString(bnf);
+            GeneratorOptions options;
+            options.parser_name = "TreeParser";
+            auto report = GrammarOptimizer::optimize(*optimized, OptimizerOptions::forGenerator(options));
+            // Узлы правил внутри токенов видны в дереве: они не раскрываются
+            assert(report.inlined == 0 && optimized->findRule("digit") && optimized->findRule("json_char"));
+            // Распознавателю дерево не нужно
+            GeneratorOptions recognizer = options;
+            recognizer.recognizer = true;
+            auto recognized = BNFGrammarFactory::fromString(bnf);
+            assert(GrammarOptimizer::optimize(*recognized, OptimizerOptions::forGenerator(recognizer)).inlined > 0);
+            assert(!recognized->findRule("digit"));
+
+            if (haveCompiler()) {
+                auto generator = CodeGeneratorFactory::create("cpp");
+                const std::string input = "[-120 \"a\\u0f\\n\" [0]] 7";
+                std::string tree = runGenerated("unoptimized_tree", generator->generate(*grammar, options).parser_code,
+                                                treeDriver(*grammar, options.parser_name), input);
+                std::string optimized_tree =
+                    runGenerated("optimized_tree", generator->generate(*optimized, options).parser_code,
+                                 treeDriver(*optimized, options.parser_name), input);
+                assert(tree.rfind("document\n", 0) == 0);
+                assert(tree.find("      NUMBER\n        non_zero_digit\n        digit\n        digit\n") != std::string::npos);
+                assert(tree.find("          escape_sequence\n            hex_digit\n              digit\n") !=
+                       std::string::npos);
+                assert(tree == optimized_tree);
+            }
+            std::cout << "✓ Optimizer preserves the parse tree" << std::endl;
+        }
+
+        // Тест 37: Отступы через целые параметры - spaces[0], spaces[n-1], block[indent+1]
+        {
+            auto grammar = BNFGrammarFactory::fromFile("grammars/indentation.bnf");
+            auto generator = CodeGeneratorFactory::create("cpp");
+            GeneratorOptions options;
+            options.parser_name = "IndentationParser";
+            auto result = generator->generate(*grammar, options);
+            assert(result.success);
+            assert(result.parser_code.find("NodePtr parse_spaces(int n)") != std::string::npos);
+            assert(result.parser_code.find("parse_block(indent+1)") != std::string::npos);
+
+            // Параметры интерпретатор байт-кода не принимает: validate - ошибка, а не пропуск
+            CorpusOptions validated;
+            validated.validate = true;
+            bool rejected = false;
+            try {
+                CorpusGenerator(*grammar, validated);
+            } catch (const std::runtime_error& e) {
+                rejected = std::string(e.what()).find("Cannot validate") != std::string::npos;
+            }
+            assert(rejected);
+
+            if (haveCompiler()) {
+                std::ifstream example("examples/test_indentation.py", std::ios::binary);
+                std::stringstream content;
+                content << example.rdbuf();
+                const std::string input = content.str();
+                const std::string driver = treeDriver(*grammar, options.parser_name);
+                std::string tree = runGenerated("indentation", result.parser_code, driver, input);
+                assert(tree.rfind("program\n", 0) == 0 && tree.find("else") != std::string::npos);
+                // print("big") на уровне if - вложенный блок пуст
+                std::string misindented = input;
+                misindented.replace(misindented.find("        print(\"big\")"), 8, "    ");
+                assert(runGenerated("misindented", result.parser_code, driver, misindented).rfind("FAIL", 0) == 0);
+
+                // Корпус по этой грамматике разбирается её же парсером: правило
+                // TRIVIA - только комментарий, и разделитель не должен его порождать
+                std::string corpora;
+                for (uint64_t seed = 1; seed <= 5; ++seed) {
+                    CorpusOptions corpus_options;
+                    corpus_options.seed = seed;
+                    corpus_options.target_bytes = 4 * 1024;
+                    std::ostringstream out;
+                    CorpusGenerator(*grammar, corpus_options).generate(out);
+                    assert(out.str().find('#') == std::string::npos);
+                    corpora += out.str();
+                    corpora += '\0';
+                }
+                const std::string corpus_driver = R"DRIVER(
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+int main(int, char* argv[]) {
+    std::ifstream file(argv[1], std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    std::istringstream corpora(content.str());
+    std::string corpus;
+    while (std::getline(corpora, corpus, '\0')) {
+        IndentationParser parser{std::string_view(corpus)};
+        std::cout << (parser.parse() ? "OK" : "FAIL " + parser.getError()) << "\n";
+    }
+}
+)DRIVER";
+                std::string verdicts = runGenerated("indentation_corpus", result.parser_code, corpus_driver, corpora);
+                assert(verdicts == "OK\nOK\nOK\nOK\nOK\n");
+            }
+            std::cout << "✓ Integer parameters track indentation" << std::endl;
+        }
+
         std::cout << "\n✅ Все тесты генератора прошли успешно" << std::endl;
         return 0;
         
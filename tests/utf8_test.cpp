@@ -1,6 +1,7 @@
 #include "utf8_utils.hpp"
 #include <iostream>
 #include <cassert>
+#include <vector>
 
 int main() {
     std::cout << "=== UTF-8 Utils Tests ===" << std::endl;
@@ -73,7 +74,56 @@ int main() {
         assert(len == 0);
         assert(empty.empty());
         std::cout << "✓ Edge cases" << std::endl;
-        
+
+        // Тест 11: Декодирование в кодовые точки без выделения памяти
+        DecodedChar ch = decode(russian, 0);
+        assert(ch.codepoint == 0x41F && ch.length == 2);  // 'П'
+        ch = decode("€", 0);
+        assert(ch.codepoint == 0x20AC && ch.length == 3);
+        ch = decode("\xF0\x9F\x98\x80", 0);
+        assert(ch.codepoint == 0x1F600 && ch.length == 4);
+        ch = decode("\xD0", 0);  // Оборванная последовательность - один байт
+        assert(ch.codepoint == 0xD0 && ch.length == 1);
+        ch = decode("\x80", 0);
+        assert(ch.codepoint == 0x80 && ch.length == 1);
+        ch = decode("ab", 2);
+        assert(ch.length == 0);
+        assert(isWhitespace(decode("\t", 0).codepoint));
+        assert(!isWhitespace(decode("П", 0).codepoint));
+        std::vector<uint32_t> codepoints;
+        for (Utf8Iterator it(mixed); !it.atEnd(); it.next()) {
+            codepoints.push_back(it.codepoint());
+        }
+        assert(codepoints.size() == 9 && codepoints[0] == 'H' && codepoints[6] == 0x41C);
+        std::cout << "✓ Codepoint decoding" << std::endl;
+
+        // Тест 12: Строгая проверка UTF-8 и блочные length/asciiPrefix
+        assert(isValid(""));
+        assert(isValid("Hello Мир € \xF0\x9F\x98\x80"));
+        assert(!isValid("\xC0\xAF"));          // Избыточно длинная '/'
+        assert(!isValid("\xE0\x80\xAF"));
+        assert(!isValid("\xED\xA0\x80"));      // Суррогат U+D800
+        assert(!isValid("\xF4\x90\x80\x80"));  // U+110000
+        assert(!isValid("\x80"));
+        assert(!isValid("abc\xE2\x82"));       // Обрыв в конце
+        std::string text;
+        for (int i = 0; i < 50; ++i) {
+            text += "ASCII run of some length, ";
+            text += "Привет, 世界! \xF0\x9F\x98\x80 ";
+        }
+        assert(isValid(text));
+        assert(length(text) == 50 * (26 + 14));
+        // Ошибка на границе блоков и после длинного ASCII-отрезка
+        for (size_t cut = 1; cut < 40; ++cut) {
+            std::string broken = std::string(cut, 'a') + "\xE2\x82" + std::string(40, 'b');
+            assert(!isValid(broken));
+            assert(length(broken) == cut + 2 + 40);  // Невалидные байты - по символу
+        }
+        assert(asciiPrefix(text) == 26);
+        assert(asciiPrefix(std::string(100, 'x')) == 100);
+        assert(asciiPrefix(std::string(37, 'x') + "П") == 37);
+        std::cout << "✓ Validation and block counting" << std::endl;
+
         std::cout << "\nВсе тесты прошли успешно" << std::endl;
         return 0;
         